@@ -0,0 +1,300 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BakeLedgeGraphCommandlet.h"
+#include "LedgeGraphAsset.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Level.h"
+#include "Engine/World.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "HAL/FileManager.h"
+#include "Misc/PackageName.h"
+#include "PhysicsEngine/AggregateGeom.h"
+#include "PhysicsEngine/BodySetup.h"
+#include "UObject/Package.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogLedgeBake, Log, All);
+
+namespace LedgeBake
+{
+	struct FBakeBox
+	{
+		FTransform Transform;
+		FVector HalfExtent;
+		FBox Bounds;
+		FVector Corners[8];
+	};
+
+	//Corner index bits: 1 = +X, 2 = +Y, 4 = +Z. Each face lists its corners going around the quad
+	static const int32 FaceCorners[6][4] =
+	{
+		{ 0, 2, 6, 4 }, { 1, 3, 7, 5 },
+		{ 0, 1, 5, 4 }, { 2, 3, 7, 6 },
+		{ 0, 1, 3, 2 }, { 4, 5, 7, 6 },
+	};
+
+	//How far past an edge we look for geometry that would make it not a ledge
+	static const float ProbeOffset = 10.f;
+
+	static const float GraphCellSize = 200.f;
+
+	static bool IsInsideAnyBox(const TArray<FBakeBox>& Boxes, int32 IgnoreBox, const FVector& Point)
+	{
+		for(int32 BoxIndex = 0; BoxIndex < Boxes.Num(); BoxIndex++)
+		{
+			const FBakeBox& Box = Boxes[BoxIndex];
+			if(BoxIndex == IgnoreBox || !Box.Bounds.IsInsideOrOn(Point))
+			{
+				continue;
+			}
+			const FVector Local = Box.Transform.InverseTransformPosition(Point);
+			if(FMath::Abs(Local.X) <= Box.HalfExtent.X && FMath::Abs(Local.Y) <= Box.HalfExtent.Y && FMath::Abs(Local.Z) <= Box.HalfExtent.Z)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+UBakeLedgeGraphCommandlet::UBakeLedgeGraphCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UBakeLedgeGraphCommandlet::Main(const FString& Params)
+{
+#if WITH_EDITOR
+	FString Maps;
+	if(!FParse::Value(*Params, TEXT("Map="), Maps, false))
+	{
+		UE_LOG(LogLedgeBake, Error, TEXT("Usage: -run=BakeLedgeGraph -Map=/Game/Maps/A+/Game/Maps/B [-Spacing=50] [-Link=75]"));
+		return 1;
+	}
+
+	float NodeSpacing = 50.f;
+	float LinkDistance = 75.f;
+	FParse::Value(*Params, TEXT("Spacing="), NodeSpacing);
+	FParse::Value(*Params, TEXT("Link="), LinkDistance);
+
+	TArray<FString> MapPackageNames;
+	Maps.ParseIntoArray(MapPackageNames, TEXT("+"));
+
+	int32 Failures = 0;
+	for(const FString& MapPackageName : MapPackageNames)
+	{
+		if(!BakeMap(MapPackageName, FMath::Max(NodeSpacing, 1.f), LinkDistance))
+		{
+			Failures++;
+		}
+		CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+	}
+	return Failures == 0 ? 0 : 1;
+#else
+	UE_LOG(LogLedgeBake, Error, TEXT("BakeLedgeGraph needs an editor build"));
+	return 1;
+#endif
+}
+
+bool UBakeLedgeGraphCommandlet::BakeMap(const FString& MapPackageName, float NodeSpacing, float LinkDistance)
+{
+#if WITH_EDITOR
+	using namespace LedgeBake;
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	UPackage* MapPackage = LoadPackage(nullptr, *MapPackageName, LOAD_None);
+	UWorld* World = MapPackage ? UWorld::FindWorldInPackage(MapPackage) : nullptr;
+	if(!World || !World->PersistentLevel)
+	{
+		UE_LOG(LogLedgeBake, Error, TEXT("Could not load map %s"), *MapPackageName);
+		return false;
+	}
+
+	//Same geometry the wall surface cache uses: simple box collision on static meshes the player collides with
+	TArray<FBakeBox> Boxes;
+	int32 SkippedComponents = 0;
+	for(AActor* Actor : World->PersistentLevel->Actors)
+	{
+		if(!Actor)
+		{
+			continue;
+		}
+
+		TInlineComponentArray<UStaticMeshComponent*> Meshes(Actor);
+		for(UStaticMeshComponent* Mesh : Meshes)
+		{
+			if(Mesh->Mobility != EComponentMobility::Static || !Mesh->IsCollisionEnabled() || Mesh->GetCollisionResponseToChannel(ECC_Pawn) != ECR_Block)
+			{
+				continue;
+			}
+
+			UBodySetup* BodySetup = Mesh->GetBodySetup();
+			if(!BodySetup || BodySetup->AggGeom.BoxElems.Num() == 0)
+			{
+				SkippedComponents++;
+				continue;
+			}
+
+			//Components are not registered in a commandlet, so their world transform has to be worked out here
+			Mesh->UpdateComponentToWorld();
+			for(const FKBoxElem& Elem : BodySetup->AggGeom.BoxElems)
+			{
+				FBakeBox& Box = Boxes.AddDefaulted_GetRef();
+				Box.Transform = Elem.GetTransform() * Mesh->GetComponentTransform();
+				Box.HalfExtent = FVector(Elem.X, Elem.Y, Elem.Z) * 0.5f;
+				Box.Bounds = FBox(ForceInit);
+				for(int32 Corner = 0; Corner < 8; Corner++)
+				{
+					const FVector Local((Corner & 1) ? Box.HalfExtent.X : -Box.HalfExtent.X, (Corner & 2) ? Box.HalfExtent.Y : -Box.HalfExtent.Y, (Corner & 4) ? Box.HalfExtent.Z : -Box.HalfExtent.Z);
+					Box.Corners[Corner] = Box.Transform.TransformPosition(Local);
+					Box.Bounds += Box.Corners[Corner];
+				}
+			}
+		}
+	}
+
+	const float WalkableFloorZ = GetDefault<UCharacterMovementComponent>()->GetWalkableFloorZ();
+	TArray<FLedgeNode> Nodes;
+	TArray<TArray<int32>> Adjacency;
+	TArray<int32> NodeEdge;
+	int32 NumEdgeLines = 0;
+
+	for(int32 BoxIndex = 0; BoxIndex < Boxes.Num(); BoxIndex++)
+	{
+		const FBakeBox& Box = Boxes[BoxIndex];
+		const FVector BoxCenter = Box.Transform.GetLocation();
+
+		//The face pointing most upward is the one you can stand on
+		int32 TopFace = INDEX_NONE;
+		FVector TopCenter;
+		float TopNormalZ = -1.f;
+		for(int32 Face = 0; Face < 6; Face++)
+		{
+			const FVector FaceCenter = (Box.Corners[FaceCorners[Face][0]] + Box.Corners[FaceCorners[Face][1]] + Box.Corners[FaceCorners[Face][2]] + Box.Corners[FaceCorners[Face][3]]) * 0.25f;
+			const float NormalZ = (FaceCenter - BoxCenter).GetSafeNormal().Z;
+			if(NormalZ > TopNormalZ)
+			{
+				TopNormalZ = NormalZ;
+				TopFace = Face;
+				TopCenter = FaceCenter;
+			}
+		}
+		if(TopFace == INDEX_NONE || TopNormalZ < WalkableFloorZ)
+		{
+			continue;
+		}
+
+		const float BottomZ = Box.Bounds.Min.Z;
+		for(int32 Edge = 0; Edge < 4; Edge++)
+		{
+			const FVector A = Box.Corners[FaceCorners[TopFace][Edge]];
+			const FVector B = Box.Corners[FaceCorners[TopFace][(Edge + 1) % 4]];
+			FVector Outward = (A + B) * 0.5f - TopCenter;
+			Outward.Z = 0.f;
+			Outward = Outward.GetSafeNormal();
+			if(Outward.IsNearlyZero())
+			{
+				continue;
+			}
+
+			const int32 EdgeId = NumEdgeLines++;
+			const int32 Segments = FMath::Max(1, FMath::CeilToInt(FVector::Dist(A, B) / NodeSpacing));
+			int32 PrevNode = INDEX_NONE;
+			for(int32 Step = 0; Step <= Segments; Step++)
+			{
+				const FVector Position = FMath::Lerp(A, B, float(Step) / Segments);
+
+				//Not a ledge if the floor carries on past the edge or something sits on top of it
+				if(IsInsideAnyBox(Boxes, BoxIndex, Position + Outward * ProbeOffset - FVector(0, 0, ProbeOffset))
+					|| IsInsideAnyBox(Boxes, BoxIndex, Position + FVector(0, 0, ProbeOffset)))
+				{
+					PrevNode = INDEX_NONE;
+					continue;
+				}
+
+				const int32 NodeIndex = Nodes.Num();
+				FLedgeNode& Node = Nodes.AddDefaulted_GetRef();
+				Node.Position = Position;
+				Node.Normal = Outward;
+				Node.Height = Position.Z - BottomZ;
+				Adjacency.AddDefaulted();
+				NodeEdge.Add(EdgeId);
+
+				if(PrevNode != INDEX_NONE)
+				{
+					Adjacency[PrevNode].Add(NodeIndex);
+					Adjacency[NodeIndex].Add(PrevNode);
+				}
+				PrevNode = NodeIndex;
+			}
+		}
+	}
+
+	//Link nodes from different edges that are close enough to move between, corners and small gaps
+	TMultiMap<FIntVector, int32> LinkGrid;
+	const float LinkCellSize = FMath::Max(LinkDistance, 1.f);
+	auto GetLinkCell = [LinkCellSize](const FVector& Position)
+	{
+		return FIntVector(FMath::FloorToInt(Position.X / LinkCellSize), FMath::FloorToInt(Position.Y / LinkCellSize), FMath::FloorToInt(Position.Z / LinkCellSize));
+	};
+	for(int32 NodeIndex = 0; NodeIndex < Nodes.Num(); NodeIndex++)
+	{
+		LinkGrid.Add(GetLinkCell(Nodes[NodeIndex].Position), NodeIndex);
+	}
+
+	TArray<int32> CellNodes;
+	for(int32 NodeIndex = 0; NodeIndex < Nodes.Num(); NodeIndex++)
+	{
+		const FIntVector Cell = GetLinkCell(Nodes[NodeIndex].Position);
+		for(int32 X = -1; X <= 1; X++)
+		{
+			for(int32 Y = -1; Y <= 1; Y++)
+			{
+				for(int32 Z = -1; Z <= 1; Z++)
+				{
+					CellNodes.Reset();
+					LinkGrid.MultiFind(Cell + FIntVector(X, Y, Z), CellNodes);
+					for(const int32 Other : CellNodes)
+					{
+						if(Other > NodeIndex && NodeEdge[Other] != NodeEdge[NodeIndex] && FVector::Dist(Nodes[Other].Position, Nodes[NodeIndex].Position) <= LinkDistance)
+						{
+							Adjacency[NodeIndex].AddUnique(Other);
+							Adjacency[Other].AddUnique(NodeIndex);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	const FString GraphPackageName = ULedgeGraphAsset::GetGraphPackageName(MapPackageName);
+	UPackage* GraphPackage = CreatePackage(nullptr, *GraphPackageName);
+	GraphPackage->FullyLoad();
+	ULedgeGraphAsset* Graph = NewObject<ULedgeGraphAsset>(GraphPackage, *FPackageName::GetShortName(GraphPackageName), RF_Public | RF_Standalone);
+	Graph->Build(Nodes, Adjacency, GraphCellSize);
+	GraphPackage->MarkPackageDirty();
+
+	const FString Filename = FPackageName::LongPackageNameToFilename(GraphPackageName, FPackageName::GetAssetPackageExtension());
+	if(!UPackage::SavePackage(GraphPackage, Graph, RF_Public | RF_Standalone, *Filename))
+	{
+		UE_LOG(LogLedgeBake, Error, TEXT("Failed to save %s"), *Filename);
+		return false;
+	}
+
+	int32 NumLinks = 0;
+	for(const TArray<int32>& Links : Adjacency)
+	{
+		NumLinks += Links.Num();
+	}
+
+	UE_LOG(LogLedgeBake, Display, TEXT("%s: %d boxes (%d components without box collision skipped), %d ledge nodes, %d links. Baked in %.2fs, %lld bytes on disk at %s"),
+		*MapPackageName, Boxes.Num(), SkippedComponents, Nodes.Num(), NumLinks / 2, FPlatformTime::Seconds() - StartTime, IFileManager::Get().FileSize(*Filename), *Filename);
+	return true;
+#else
+	return false;
+#endif
+}
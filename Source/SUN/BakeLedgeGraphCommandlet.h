@@ -0,0 +1,23 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "BakeLedgeGraphCommandlet.generated.h"
+
+//Scans the static box collision of each map and saves its ledges as a ULedgeGraphAsset next to the other graphs.
+//UE4Editor-Cmd SUN.uproject -run=BakeLedgeGraph -Map=/Game/Maps/A+/Game/Maps/B [-Spacing=50] [-Link=75]
+UCLASS()
+class UBakeLedgeGraphCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UBakeLedgeGraphCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	bool BakeMap(const FString& MapPackageName, float NodeSpacing, float LinkDistance);
+};
@@ -0,0 +1,203 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DamageSubsystem.h"
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "SUNDamageType.h"
+#include "HealthComponent.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Health slots"), STAT_SUN_HealthSlots, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Damage events"), STAT_SUN_DamageEvents, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Heal events"), STAT_SUN_HealEvents, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Deaths"), STAT_SUN_Deaths, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Damage resolve"), STAT_SUN_DamageResolve, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Damage broadcast"), STAT_SUN_DamageBroadcast, STATGROUP_SUN);
+
+UDamageSubsystem::UDamageSubsystem()
+{
+	//After hitscan (TG_PostUpdateWork) so this frame's shots are resolved this frame
+	TickGroup = TG_LastDemotable;
+}
+
+int32 UDamageSubsystem::AddHealth(float InMaxHealth, UHealthComponent* Component)
+{
+	int32 Slot;
+	if(FreeSlots.Num() > 0)
+	{
+		Slot = FreeSlots.Pop(false);
+		Health[Slot] = InMaxHealth;
+		MaxHealth[Slot] = InMaxHealth;
+		bAlive[Slot] = true;
+		bInUse[Slot] = true;
+		Components[Slot] = Component;
+	}
+	else
+	{
+		Slot = Health.Add(InMaxHealth);
+		MaxHealth.Add(InMaxHealth);
+		bAlive.Add(true);
+		bInUse.Add(true);
+		bChanged.Add(false);
+		Generations.Add(0);
+		Components.Add(Component);
+	}
+	INC_DWORD_STAT(STAT_SUN_HealthSlots);
+	return Slot;
+}
+
+//Anything still queued for the slot is ignored, even once AddHealth hands the slot to someone else
+void UDamageSubsystem::RemoveHealth(int32 Slot)
+{
+	if(!Components.IsValidIndex(Slot) || !bInUse[Slot])
+	{
+		return;
+	}
+
+	bAlive[Slot] = false;
+	bInUse[Slot] = false;
+	Generations[Slot]++;
+	Components[Slot] = nullptr;
+	FreeSlots.Add(Slot);
+	DEC_DWORD_STAT(STAT_SUN_HealthSlots);
+}
+
+void UDamageSubsystem::ResetHealth(int32 Slot)
+{
+	Health[Slot] = MaxHealth[Slot];
+	bAlive[Slot] = true;
+}
+
+void UDamageSubsystem::SetHealth(int32 Slot, float Value)
+{
+	Health[Slot] = FMath::Clamp(Value, 0.f, MaxHealth[Slot]);
+	if(UHealthComponent* Component = Components[Slot])
+	{
+		Component->SetCurrentHealth(Health[Slot]);
+	}
+}
+
+void UDamageSubsystem::QueueDamage(int32 Slot, float Amount, TSubclassOf<UDamageType> DamageType, AActor* Causer)
+{
+	Pending.Add({ Slot, Generations[Slot], Amount * GetDamageScale(DamageType), Causer });
+}
+
+void UDamageSubsystem::QueueHeal(int32 Slot, float Amount)
+{
+	Pending.Add({ Slot, Generations[Slot], -Amount, nullptr });
+}
+
+void UDamageSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_SUN_HealthSlots, Health.Num() - FreeSlots.Num());
+	Health.Empty();
+	MaxHealth.Empty();
+	bAlive.Empty();
+	bInUse.Empty();
+	bChanged.Empty();
+	Generations.Empty();
+	FreeSlots.Empty();
+	Components.Empty();
+	Pending.Empty();
+
+	Super::Deinitialize();
+}
+
+void UDamageSubsystem::Tick(float DeltaTime)
+{
+	if(Pending.Num() == 0)
+	{
+		return;
+	}
+
+	{
+		SUN_SCOPE_CYCLE_COUNTER(STAT_SUN_DamageResolve, DamageResolve);
+
+		int32 NumDamage = 0;
+		for(const FPendingChange& Change : Pending)
+		{
+			const int32 Slot = Change.Slot;
+			if(!bAlive[Slot] || Generations[Slot] != Change.Generation)
+			{
+				continue;
+			}
+
+			const float Old = Health[Slot];
+			const float New = FMath::Clamp(Old - Change.Amount, 0.f, MaxHealth[Slot]);
+			NumDamage += Change.Amount > 0.f;
+			if(New == Old)
+			{
+				continue;
+			}
+
+			Health[Slot] = New;
+			if(!bChanged[Slot])
+			{
+				bChanged[Slot] = true;
+				ChangedSlots.Add(Slot);
+			}
+			if(New > Old)
+			{
+				Heals.Add({ Slot, Components[Slot], New - Old });
+			}
+			else
+			{
+				Hits.Add({ Slot, Components[Slot], Old - New, Change.Causer });
+			}
+			if(New <= 0.f)
+			{
+				bAlive[Slot] = false;
+				Deaths.Add({ Slot, Components[Slot], Change.Causer });
+			}
+		}
+
+		//Components only mirror the value for Blueprints, UI and replication
+		for(const int32 Slot : ChangedSlots)
+		{
+			bChanged[Slot] = false;
+			if(UHealthComponent* Component = Components[Slot])
+			{
+				Component->SetCurrentHealth(Health[Slot]);
+			}
+		}
+
+		SUN_INC_COUNTER(STAT_SUN_DamageEvents, DamageEvents, NumDamage);
+		INC_DWORD_STAT_BY(STAT_SUN_HealEvents, Pending.Num() - NumDamage);
+		SUN_INC_COUNTER(STAT_SUN_Deaths, Deaths, Deaths.Num());
+		Pending.Reset();
+		ChangedSlots.Reset();
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_SUN_DamageBroadcast);
+	if(Hits.Num() > 0)
+	{
+		OnHits.Broadcast(Hits);
+		Hits.Reset();
+	}
+	if(Heals.Num() > 0)
+	{
+		OnHeals.Broadcast(Heals);
+		Heals.Reset();
+	}
+	if(Deaths.Num() > 0)
+	{
+		OnDeaths.Broadcast(Deaths);
+		for(const FDeathEvent& Death : Deaths)
+		{
+			if(IsValid(Death.Health))
+			{
+				Death.Health->Die();
+			}
+		}
+		Deaths.Reset();
+	}
+}
+
+float UDamageSubsystem::GetDamageScale(TSubclassOf<UDamageType> DamageType)
+{
+	if(DamageType && DamageType->IsChildOf(USUNDamageType::StaticClass()))
+	{
+		return DamageType->GetDefaultObject<USUNDamageType>()->DamageScale;
+	}
+	return 1.f;
+}
@@ -0,0 +1,101 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SUNWorldSubsystem.h"
+#include "DamageSubsystem.generated.h"
+
+class UDamageType;
+class UHealthComponent;
+
+struct FDeathEvent
+{
+	int32 Slot;
+	UHealthComponent* Health;
+	TWeakObjectPtr<AActor> Causer;
+};
+
+struct FHitEvent
+{
+	int32 Slot;
+	UHealthComponent* Health;
+	float Amount;
+	TWeakObjectPtr<AActor> Causer;
+};
+
+struct FHealEvent
+{
+	int32 Slot;
+	UHealthComponent* Health;
+	float Amount;
+};
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnHits, const TArray<FHitEvent>&);
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnDeaths, const TArray<FDeathEvent>&);
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnHeals, const TArray<FHealEvent>&);
+
+//Health for everything damageable in the world, kept in parallel arrays indexed by slot. Damage and healing are only
+//queued while the frame runs and resolved together once everything else has ticked: damage type scaling, clamping
+//and death detection in one pass, then the components are synced and hits, heals and deaths are broadcast in bulk.
+//Slots do not need a component, so crowds without actors can use the same pipeline
+UCLASS()
+class SUN_API UDamageSubsystem : public USUNWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	UDamageSubsystem();
+
+	int32 AddHealth(float MaxHealth, UHealthComponent* Component = nullptr);
+	void RemoveHealth(int32 Slot);
+
+	//Full health and alive again, takes effect immediately
+	void ResetHealth(int32 Slot);
+	//Moves health between slots when something changes form, takes effect immediately and does not kill
+	void SetHealth(int32 Slot, float Value);
+
+	void QueueDamage(int32 Slot, float Amount, TSubclassOf<UDamageType> DamageType, AActor* Causer);
+	void QueueHeal(int32 Slot, float Amount);
+
+	float GetHealth(int32 Slot) const { return Health[Slot]; }
+	float GetMaxHealth(int32 Slot) const { return MaxHealth[Slot]; }
+	bool IsAlive(int32 Slot) const { return bAlive[Slot]; }
+
+	FOnHits OnHits;
+	FOnDeaths OnDeaths;
+	FOnHeals OnHeals;
+
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+
+private:
+	struct FPendingChange
+	{
+		int32 Slot;
+		//Generation of the slot when queued, a slot freed and reused since then drops the change
+		uint32 Generation;
+		float Amount;
+		TWeakObjectPtr<AActor> Causer;
+	};
+
+	static float GetDamageScale(TSubclassOf<UDamageType> DamageType);
+
+	TArray<float> Health;
+	TArray<float> MaxHealth;
+	TBitArray<> bAlive;
+	TBitArray<> bInUse;
+	TBitArray<> bChanged;
+	TArray<uint32> Generations;
+	TArray<int32> FreeSlots;
+
+	UPROPERTY(Transient)
+	TArray<UHealthComponent*> Components;
+
+	//Damage is positive, healing negative
+	TArray<FPendingChange> Pending;
+	TArray<int32> ChangedSlots;
+	TArray<FHitEvent> Hits;
+	TArray<FDeathEvent> Deaths;
+	TArray<FHealEvent> Heals;
+};
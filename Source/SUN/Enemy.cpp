@@ -2,15 +2,50 @@
 
 
 #include "Enemy.h"
+#include "LagCompensationSubsystem.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/CollisionProfile.h"
+#include "Engine/StaticMesh.h"
 
 // Sets default values
 AEnemy::AEnemy()
 {
+	Body = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("Body"));
+	Body->SetMobility(EComponentMobility::Movable);
+	Body->SetCollisionProfileName(UCollisionProfile::Pawn_ProfileName);
+	//Hitscan traces the visibility channel, which the pawn profile ignores
+	Body->SetCollisionResponseToChannel(ECC_Visibility, ECR_Block);
+	Body->SetCanEverAffectNavigation(false);
+	RootComponent = Body;
+
  	Health = CreateDefaultSubobject<UHealthComponent>(TEXT("HealthComponent"));
-	 // Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+	//Nothing to do per frame, and there can be a lot of these
+	PrimaryActorTick.bCanEverTick = false;
 
-	
+	//Enemies stand where they were spawned, so after their first update they only need to replicate when their
+	//health changes or the pool moves them, both of which flush dormancy
+	bReplicates = true;
+	SetReplicatingMovement(true);
+	NetDormancy = DORM_DormantAll;
+	NetUpdateFrequency = 10.f;
+}
+
+//Looks like its horde instance unless the Blueprint brought its own visuals
+void AEnemy::PostInitializeComponents()
+{
+	Super::PostInitializeComponents();
+
+	if(Body->GetStaticMesh())
+	{
+		return;
+	}
+	TInlineComponentArray<UPrimitiveComponent*> Primitives(this);
+	if(Primitives.Num() > 1)
+	{
+		return;
+	}
+	Body->SetStaticMesh(HordeMesh ? HordeMesh : LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cylinder.Cylinder")));
+	Body->SetRelativeScale3D(HordeMeshScale);
 }
 
 // Called when the game starts or when spawned
@@ -20,11 +55,25 @@ void AEnemy::BeginPlay()
 	
 }
 
-// Called every frame
-void AEnemy::Tick(float DeltaTime)
+void AEnemy::Park()
 {
-	Super::Tick(DeltaTime);
-
+	bParked = true;
+	SetActorHiddenInGame(true);
+	SetActorEnableCollision(false);
+	SetActorTickEnabled(false);
+	GetWorld()->GetSubsystem<ULagCompensationSubsystem>()->Untrack(this);
+	FlushNetDormancy();
 }
 
-
+void AEnemy::Unpark(const FTransform& Transform)
+{
+	bParked = false;
+	SetActorTransform(Transform, false, nullptr, ETeleportType::ResetPhysics);
+	Health->ResetHealth();
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+	SetActorTickEnabled(true);
+	//Re-tracked after the teleport so the rewind history starts at the new location
+	GetWorld()->GetSubsystem<ULagCompensationSubsystem>()->Track(this);
+	FlushNetDormancy();
+}
@@ -16,18 +16,38 @@ public:
 	// Sets default values for this actor's properties
 	AEnemy();
 	
-	
+	virtual void PostInitializeComponents() override;
+
+	//Root, so the enemy can be placed, moved by the pool and replicated, and what shots and the katana hit. Shows the
+	//horde mesh when a Blueprint gives it no mesh and has no other primitives
+	UPROPERTY(VisibleAnywhere, Category = Body)
+	class UStaticMeshComponent* Body;
+
 	UPROPERTY(EditAnywhere, Category = Health)
 	class UHealthComponent* Health;
 
+	//Drawn for this class in UHordeSubsystem while it is not a real actor, a cylinder if not set
+	UPROPERTY(EditDefaultsOnly, Category = Horde)
+	class UStaticMesh* HordeMesh;
+
+	UPROPERTY(EditDefaultsOnly, Category = Horde)
+	FVector HordeMeshScale = FVector(1.f);
+
+	//Walking speed towards the nearest player while in the horde
+	UPROPERTY(EditDefaultsOnly, Category = Horde)
+	float HordeSpeed = 300.f;
+
+	//Taken out of play by UEnemyPool: hidden, no collision, no tick, not tracked for lag compensation
+	void Park();
+	//Back in play at Transform with full health
+	void Unpark(const FTransform& Transform);
+	bool IsParked() const { return bParked; }
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
-public:	
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
-
-	
+private:
+	bool bParked = false;
 
 };
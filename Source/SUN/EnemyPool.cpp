@@ -0,0 +1,138 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EnemyPool.h"
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "Enemy.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Enemy pool hits"), STAT_SUN_EnemyPoolHits, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Enemy pool misses"), STAT_SUN_EnemyPoolMisses, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Enemies destroyed"), STAT_SUN_EnemiesDestroyed, STATGROUP_SUN);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Enemies parked"), STAT_SUN_EnemiesParked, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Enemy spawn"), STAT_SUN_EnemySpawn, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Enemy release"), STAT_SUN_EnemyRelease, STATGROUP_SUN);
+
+static TAutoConsoleVariable<int32> CVarEnemyPool(
+	TEXT("sun.Enemy.Pool"),
+	1,
+	TEXT("0: dead enemies are destroyed and every spawn creates a new actor\n")
+	TEXT("1: dead enemies are parked in UEnemyPool and reused by later spawns"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarEnemyPoolCap(
+	TEXT("sun.Enemy.PoolCap"),
+	64,
+	TEXT("Parked enemies kept per class, enemies dying once their class is at the cap are destroyed"),
+	ECVF_Default);
+
+bool UEnemyPool::IsPoolingEnabled()
+{
+	return CVarEnemyPool.GetValueOnGameThread() != 0;
+}
+
+void UEnemyPool::Prewarm(TSubclassOf<AEnemy> Class, int32 Count)
+{
+	if(!Class || !IsPoolingEnabled())
+	{
+		return;
+	}
+
+	TArray<AEnemy*>& Free = Buckets.FindOrAdd(Class).Free;
+	Count = FMath::Min(Count, CVarEnemyPoolCap.GetValueOnGameThread());
+	while(Free.Num() < Count)
+	{
+		AEnemy* Enemy = SpawnActor(Class, FTransform::Identity);
+		if(!Enemy)
+		{
+			return;
+		}
+		Enemy->Park();
+		Free.Add(Enemy);
+		INC_DWORD_STAT(STAT_SUN_EnemiesParked);
+	}
+}
+
+AEnemy* UEnemyPool::Spawn(TSubclassOf<AEnemy> Class, const FTransform& Transform)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SUN_EnemySpawn);
+
+	if(!Class)
+	{
+		return nullptr;
+	}
+
+	//Parked enemies can be destroyed from outside (level unload, GC), those come back null or pending kill
+	AEnemy* Enemy = nullptr;
+	if(FEnemyPoolBucket* Bucket = Buckets.Find(Class))
+	{
+		while(!Enemy && Bucket->Free.Num() > 0)
+		{
+			Enemy = Bucket->Free.Pop(false);
+			DEC_DWORD_STAT(STAT_SUN_EnemiesParked);
+			if(!IsValid(Enemy))
+			{
+				Enemy = nullptr;
+			}
+		}
+	}
+
+	if(!Enemy)
+	{
+		INC_DWORD_STAT(STAT_SUN_EnemyPoolMisses);
+		return SpawnActor(Class, Transform);
+	}
+
+	INC_DWORD_STAT(STAT_SUN_EnemyPoolHits);
+	Enemy->Unpark(Transform);
+	return Enemy;
+}
+
+int32 UEnemyPool::GetNumParked(TSubclassOf<AEnemy> Class) const
+{
+	const FEnemyPoolBucket* Bucket = Buckets.Find(Class);
+	return Bucket ? Bucket->Free.Num() : 0;
+}
+
+void UEnemyPool::Release(AEnemy* Enemy)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SUN_EnemyRelease);
+
+	if(!Enemy || Enemy->IsPendingKillPending() || Enemy->IsParked())
+	{
+		return;
+	}
+
+	TArray<AEnemy*>* Free = IsPoolingEnabled() ? &Buckets.FindOrAdd(Enemy->GetClass()).Free : nullptr;
+	if(!Free || Free->Num() >= CVarEnemyPoolCap.GetValueOnGameThread())
+	{
+		SUN_INC_COUNTER(STAT_SUN_EnemiesDestroyed, Destroys, 1);
+		Enemy->Destroy();
+		return;
+	}
+
+	Enemy->Park();
+	Free->Add(Enemy);
+	INC_DWORD_STAT(STAT_SUN_EnemiesParked);
+}
+
+void UEnemyPool::Deinitialize()
+{
+	for(const TPair<UClass*, FEnemyPoolBucket>& Bucket : Buckets)
+	{
+		DEC_DWORD_STAT_BY(STAT_SUN_EnemiesParked, Bucket.Value.Free.Num());
+	}
+	Buckets.Empty();
+
+	Super::Deinitialize();
+}
+
+AEnemy* UEnemyPool::SpawnActor(UClass* Class, const FTransform& Transform)
+{
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+	SUN_INC_COUNTER(STAT_SUN_ActorSpawns, Spawns, 1);
+	return GetWorld()->SpawnActor<AEnemy>(Class, Transform, SpawnParams);
+}
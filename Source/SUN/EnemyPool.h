@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "EnemyPool.generated.h"
+
+class AEnemy;
+
+USTRUCT()
+struct FEnemyPoolBucket
+{
+	GENERATED_BODY()
+
+	UPROPERTY(Transient)
+	TArray<AEnemy*> Free;
+};
+
+//Dead enemies are parked here instead of being destroyed: hidden, no collision, no tick. Spawn hands out a parked
+//enemy of the requested class at full health and only spawns a new actor when the class has none left. A class
+//only keeps up to sun.Enemy.PoolCap parked enemies, anything dying past that is destroyed as before
+UCLASS()
+class SUN_API UEnemyPool : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	//False when sun.Enemy.Pool is 0, enemies are then destroyed on death and spawned fresh
+	static bool IsPoolingEnabled();
+
+	//Make sure at least Count enemies of Class are parked and ready
+	void Prewarm(TSubclassOf<AEnemy> Class, int32 Count);
+
+	AEnemy* Spawn(TSubclassOf<AEnemy> Class, const FTransform& Transform);
+
+	int32 GetNumParked(TSubclassOf<AEnemy> Class) const;
+
+	//Called when an enemy dies. Parks it, or destroys it if pooling is off or its class is at the cap
+	void Release(AEnemy* Enemy);
+
+	virtual void Deinitialize() override;
+
+private:
+	AEnemy* SpawnActor(UClass* Class, const FTransform& Transform);
+
+	UPROPERTY(Transient)
+	TMap<UClass*, FEnemyPoolBucket> Buckets;
+};
@@ -0,0 +1,175 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FireScheduler.h"
+#include "SUN.h"
+#include "Components/SceneComponent.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Fire scheduler shooters"), STAT_SUN_FireShooters, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Scheduled shots"), STAT_SUN_ScheduledShots, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Scheduled shots dropped"), STAT_SUN_ScheduledShotsDropped, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Fire scheduler"), STAT_SUN_FireScheduler, STATGROUP_SUN);
+
+static TAutoConsoleVariable<int32> CVarFireMaxShotsPerFrame(
+	TEXT("sun.Fire.MaxShotsPerFrame"),
+	8,
+	TEXT("Most shots one shooter can fire in a frame, anything past that after a hitch is dropped"),
+	ECVF_Default);
+
+UFireScheduler::UFireScheduler()
+{
+	//Movement and aim are final for the frame, the shots still make it into this frame's hitscan batch
+	TickGroup = TG_PostPhysics;
+}
+
+void UFireScheduler::Register(AActor* Shooter, USceneComponent* AimSource, float Interval, FOnScheduledShot OnShot)
+{
+	if(!Shooter || !AimSource || ShooterIndices.Contains(Shooter))
+	{
+		return;
+	}
+
+	ShooterIndices.Add(Shooter, Shooters.Num());
+	FShooter& Entry = Shooters.AddDefaulted_GetRef();
+	Entry.Actor = Shooter;
+	Entry.Key = Shooter;
+	Entry.AimSource = AimSource;
+	Entry.OnShot = OnShot;
+	Entry.Interval = FMath::Max(Interval, KINDA_SMALL_NUMBER);
+	Entry.NextShotTime = 0.f;
+	Entry.bFiring = false;
+	INC_DWORD_STAT(STAT_SUN_FireShooters);
+}
+
+//Only detaches the entry, it is compacted away on the next tick so this is safe from inside a shot callback
+void UFireScheduler::Unregister(AActor* Shooter)
+{
+	int32 Index;
+	if(ShooterIndices.RemoveAndCopyValue(Shooter, Index))
+	{
+		Shooters[Index].Actor = nullptr;
+		Shooters[Index].Key = nullptr;
+		Shooters[Index].bFiring = false;
+	}
+}
+
+void UFireScheduler::StartFiring(AActor* Shooter)
+{
+	const int32* Index = ShooterIndices.Find(Shooter);
+	if(!Index)
+	{
+		return;
+	}
+
+	FShooter& Entry = Shooters[*Index];
+	const USceneComponent* AimSource = Entry.AimSource.Get();
+	if(Entry.bFiring || !AimSource)
+	{
+		return;
+	}
+
+	Entry.bFiring = true;
+	Entry.NextShotTime = FMath::Max(Entry.NextShotTime, GetWorld()->GetTimeSeconds());
+	Entry.PreviousOrigin = AimSource->GetComponentLocation();
+	Entry.PreviousAim = AimSource->GetComponentQuat();
+}
+
+void UFireScheduler::StopFiring(AActor* Shooter)
+{
+	if(const int32* Index = ShooterIndices.Find(Shooter))
+	{
+		Shooters[*Index].bFiring = false;
+	}
+}
+
+void UFireScheduler::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_SUN_FireShooters, Shooters.Num());
+	Shooters.Empty();
+	ShooterIndices.Empty();
+
+	Super::Deinitialize();
+}
+
+void UFireScheduler::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SUN_FireScheduler);
+
+	const float Now = GetWorld()->GetTimeSeconds();
+	const float FrameStart = Now - DeltaTime;
+	const int32 MaxShotsPerFrame = FMath::Max(CVarFireMaxShotsPerFrame.GetValueOnGameThread(), 1);
+
+	for(int32 Index = Shooters.Num() - 1; Index >= 0; Index--)
+	{
+		if(!Shooters[Index].Actor.IsValid() || !Shooters[Index].AimSource.IsValid())
+		{
+			RemoveAt(Index);
+		}
+	}
+
+	int32 NumShots = 0;
+	for(int32 Index = 0; Index < Shooters.Num(); Index++)
+	{
+		FShooter& Entry = Shooters[Index];
+		if(!Entry.bFiring)
+		{
+			continue;
+		}
+
+		const USceneComponent* AimSource = Entry.AimSource.Get();
+		const FVector Origin = AimSource->GetComponentLocation();
+		const FQuat Aim = AimSource->GetComponentQuat();
+
+		int32 NumEntryShots = 0;
+		while(Entry.bFiring && Entry.NextShotTime <= Now)
+		{
+			if(NumEntryShots == MaxShotsPerFrame)
+			{
+				INC_DWORD_STAT_BY(STAT_SUN_ScheduledShotsDropped, FMath::FloorToInt((Now - Entry.NextShotTime) / Entry.Interval) + 1);
+				Entry.NextShotTime = Now + Entry.Interval;
+				break;
+			}
+
+			//Nothing can fall due before this frame began, even after a long hitch
+			const float ShotTime = FMath::Max(Entry.NextShotTime, FrameStart);
+			const float Alpha = DeltaTime > 0.f ? (ShotTime - FrameStart) / DeltaTime : 1.f;
+			const FVector ShotOrigin = FMath::Lerp(Entry.PreviousOrigin, Origin, Alpha);
+			const FVector ShotDirection = FQuat::Slerp(Entry.PreviousAim, Aim, Alpha).GetForwardVector();
+
+			Entry.NextShotTime = ShotTime + Entry.Interval;
+			NumEntryShots++;
+
+			//The callback may stop firing, unregister or add shooters, so Entry is looked up again afterwards
+			Entry.OnShot.ExecuteIfBound(ShotOrigin, ShotDirection, ShotTime);
+			if(!Shooters.IsValidIndex(Index) || &Entry != &Shooters[Index])
+			{
+				break;
+			}
+		}
+		NumShots += NumEntryShots;
+
+		if(Shooters.IsValidIndex(Index))
+		{
+			Shooters[Index].PreviousOrigin = Origin;
+			Shooters[Index].PreviousAim = Aim;
+		}
+	}
+
+	INC_DWORD_STAT_BY(STAT_SUN_ScheduledShots, NumShots);
+}
+
+void UFireScheduler::RemoveAt(int32 Index)
+{
+	if(Shooters[Index].Key)
+	{
+		ShooterIndices.Remove(Shooters[Index].Key);
+	}
+	Shooters.RemoveAtSwap(Index, 1, false);
+	if(Shooters.IsValidIndex(Index) && Shooters[Index].Key)
+	{
+		ShooterIndices.Add(Shooters[Index].Key, Index);
+	}
+	DEC_DWORD_STAT(STAT_SUN_FireShooters);
+}
@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SUNWorldSubsystem.h"
+#include "FireScheduler.generated.h"
+
+//Origin and direction of one scheduled shot and the world time it was due at, which can be earlier in the frame
+DECLARE_DELEGATE_ThreeParams(FOnScheduledShot, const FVector& /*Origin*/, const FVector& /*Direction*/, float /*ShotTime*/);
+
+//Automatic fire for every shooter in one pass per frame. Each firing shooter accumulates elapsed time and every shot
+//that fell due since the last frame is emitted, several per frame if the fire interval is shorter than the frame.
+//A shot due partway through the frame gets that exact time and an aim blended between last frame's and this frame's
+UCLASS()
+class SUN_API UFireScheduler : public USUNWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	UFireScheduler();
+
+	//Aim is read from AimSource's location and forward vector once per frame
+	void Register(AActor* Shooter, USceneComponent* AimSource, float Interval, FOnScheduledShot OnShot);
+	void Unregister(AActor* Shooter);
+
+	//First shot goes out this frame unless the previous burst's interval has not passed yet
+	void StartFiring(AActor* Shooter);
+	void StopFiring(AActor* Shooter);
+
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+
+private:
+	struct FShooter
+	{
+		TWeakObjectPtr<AActor> Actor;
+		const AActor* Key;
+		TWeakObjectPtr<USceneComponent> AimSource;
+		FOnScheduledShot OnShot;
+		float Interval;
+		float NextShotTime;
+		FVector PreviousOrigin;
+		FQuat PreviousAim;
+		bool bFiring;
+	};
+
+	void RemoveAt(int32 Index);
+
+	TArray<FShooter> Shooters;
+	TMap<const AActor*, int32> ShooterIndices;
+};
@@ -0,0 +1,215 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FrameWatchdog.h"
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "SUNCharacter.h"
+#include "ParkourComponent.h"
+#include "SUNCharacterMovementComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonWriter.h"
+#include "UObject/UObjectGlobals.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogFrameWatchdog, Log, All);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Watchdog hitches"), STAT_SUN_WatchdogHitches, STATGROUP_SUN);
+
+static TAutoConsoleVariable<int32> CVarWatchdog(
+	TEXT("sun.Watchdog"),
+	1,
+	TEXT("1 writes a record of every frame over sun.Watchdog.BudgetMs to Saved/Hitches"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarWatchdogBudgetMs(
+	TEXT("sun.Watchdog.BudgetMs"),
+	33.3f,
+	TEXT("Game thread milliseconds from the start of the world tick to the end of the frame before it is recorded as a hitch.\n")
+	TEXT("The wait for the max tick rate is not counted, a 30 Hz server idling through its frames records nothing"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarWatchdogMaxFileKB(
+	TEXT("sun.Watchdog.MaxFileKB"),
+	1024,
+	TEXT("Size of the hitch file before it is moved to Hitches.1.jsonl and a new one is started"),
+	ECVF_Default);
+
+//Scopes faster than this are left out of the record
+static const float MinRecordedMs = 0.01f;
+
+namespace FrameWatchdog
+{
+	static UFrameWatchdog* Writer = nullptr;
+
+	static FString GetPath()
+	{
+		return FPaths::ProjectSavedDir() / TEXT("Hitches") / TEXT("Hitches.jsonl");
+	}
+
+	static FString GetPreviousPath()
+	{
+		return FPaths::ProjectSavedDir() / TEXT("Hitches") / TEXT("Hitches.1.jsonl");
+	}
+}
+
+void UFrameWatchdog::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	UWorld* World = GetWorld();
+	if(!World || !World->IsGameWorld() || FrameWatchdog::Writer)
+	{
+		return;
+	}
+
+	FrameWatchdog::Writer = this;
+	FrameEndHandle = FSUNPerf::OnFrameEnd.AddUObject(this, &UFrameWatchdog::OnFrameEnd);
+	PreGarbageCollectHandle = FCoreUObjectDelegates::GetPreGarbageCollectDelegate().AddUObject(this, &UFrameWatchdog::OnPreGarbageCollect);
+	PostGarbageCollectHandle = FCoreUObjectDelegates::GetPostGarbageCollect().AddUObject(this, &UFrameWatchdog::OnPostGarbageCollect);
+}
+
+void UFrameWatchdog::Deinitialize()
+{
+	if(FrameWatchdog::Writer == this)
+	{
+		FrameWatchdog::Writer = nullptr;
+		FSUNPerf::OnFrameEnd.Remove(FrameEndHandle);
+		FCoreUObjectDelegates::GetPreGarbageCollectDelegate().Remove(PreGarbageCollectHandle);
+		FCoreUObjectDelegates::GetPostGarbageCollect().Remove(PostGarbageCollectHandle);
+	}
+	delete File;
+	File = nullptr;
+
+	Super::Deinitialize();
+}
+
+void UFrameWatchdog::OnPreGarbageCollect()
+{
+	GarbageCollectStartCycles = FPlatformTime::Cycles();
+}
+
+void UFrameWatchdog::OnPostGarbageCollect()
+{
+	GarbageCollectCycles += FPlatformTime::Cycles() - GarbageCollectStartCycles;
+	NumGarbageCollects++;
+}
+
+void UFrameWatchdog::OnFrameEnd()
+{
+	const float FrameMs = FSUNPerf::GetFrameMs();
+	const float BudgetMs = CVarWatchdogBudgetMs.GetValueOnGameThread();
+
+	//Loading a map is one long frame nobody plays through
+	if(CVarWatchdog.GetValueOnGameThread() != 0 && FrameMs > BudgetMs && GetWorld()->HasBegunPlay())
+	{
+		INC_DWORD_STAT(STAT_SUN_WatchdogHitches);
+		Write(MakeRecord(FrameMs, BudgetMs));
+
+		ESUNPerfScope Worst = ESUNPerfScope::CharacterTick;
+		for(int32 Scope = 1; Scope < (int32)ESUNPerfScope::Num; Scope++)
+		{
+			if(FSUNPerf::GetMs((ESUNPerfScope)Scope) > FSUNPerf::GetMs(Worst))
+			{
+				Worst = (ESUNPerfScope)Scope;
+			}
+		}
+		UE_LOG(LogFrameWatchdog, Warning, TEXT("Hitch: %.1f ms over a %.1f ms budget, %s %.1f ms, garbage collection %.1f ms"),
+			FrameMs, BudgetMs, FSUNPerf::GetName(Worst), FSUNPerf::GetMs(Worst), FPlatformTime::ToMilliseconds(GarbageCollectCycles));
+	}
+
+	GarbageCollectCycles = 0;
+	NumGarbageCollects = 0;
+}
+
+FString UFrameWatchdog::MakeRecord(float FrameMs, float BudgetMs) const
+{
+	FString Record;
+	TSharedRef<TJsonWriter<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>> Writer = TJsonWriterFactory<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>::Create(&Record);
+	Writer->WriteObjectStart();
+	Writer->WriteValue(TEXT("time"), FDateTime::UtcNow().ToIso8601());
+	Writer->WriteValue(TEXT("frame"), (int64)GFrameCounter);
+	Writer->WriteValue(TEXT("map"), GetWorld()->GetMapName());
+	Writer->WriteValue(TEXT("ms"), FrameMs);
+	Writer->WriteValue(TEXT("budget"), BudgetMs);
+
+	Writer->WriteObjectStart(TEXT("scopes"));
+	for(int32 Scope = 0; Scope < (int32)ESUNPerfScope::Num; Scope++)
+	{
+		const float Ms = FSUNPerf::GetMs((ESUNPerfScope)Scope);
+		if(Ms >= MinRecordedMs)
+		{
+			Writer->WriteValue(FSUNPerf::GetName((ESUNPerfScope)Scope), Ms);
+		}
+	}
+	Writer->WriteObjectEnd();
+
+	Writer->WriteObjectStart(TEXT("counts"));
+	for(int32 Counter = 0; Counter < (int32)ESUNPerfCounter::Num; Counter++)
+	{
+		if(const int32 Count = FSUNPerf::GetCount((ESUNPerfCounter)Counter))
+		{
+			Writer->WriteValue(FSUNPerf::GetName((ESUNPerfCounter)Counter), Count);
+		}
+	}
+	Writer->WriteObjectEnd();
+
+	Writer->WriteObjectStart(TEXT("gc"));
+	Writer->WriteValue(TEXT("count"), NumGarbageCollects);
+	Writer->WriteValue(TEXT("ms"), FPlatformTime::ToMilliseconds(GarbageCollectCycles));
+	Writer->WriteObjectEnd();
+
+	Writer->WriteArrayStart(TEXT("characters"));
+	for(FConstPlayerControllerIterator Iterator = GetWorld()->GetPlayerControllerIterator(); Iterator; ++Iterator)
+	{
+		const APlayerController* Player = Iterator->Get();
+		const ASUNCharacter* Character = Player ? Cast<ASUNCharacter>(Player->GetPawn()) : nullptr;
+		if(!Character)
+		{
+			continue;
+		}
+		const UCharacterMovementComponent* Movement = Character->GetCharacterMovement();
+		Writer->WriteObjectStart();
+		Writer->WriteValue(TEXT("name"), Character->GetName());
+		Writer->WriteValue(TEXT("movement"), Movement->GetMovementName());
+		Writer->WriteValue(TEXT("speed"), Movement->Velocity.Size());
+		Writer->WriteValue(TEXT("wallRunning"), Character->GetParkour()->IsWallRunning);
+		Writer->WriteValue(TEXT("weapon"), FString(Character->WeaponMode == GUN ? TEXT("Gun") : TEXT("Melee")));
+		Writer->WriteValue(TEXT("dashing"), Character->GetSUNMovement()->IsDashing());
+		Writer->WriteObjectEnd();
+	}
+	Writer->WriteArrayEnd();
+
+	Writer->WriteObjectEnd();
+	Writer->Close();
+	return Record;
+}
+
+void UFrameWatchdog::Write(const FString& Record)
+{
+	const FTCHARToUTF8 Line(*(Record + LINE_TERMINATOR));
+	const int64 MaxBytes = FMath::Max(CVarWatchdogMaxFileKB.GetValueOnGameThread(), 1) * 1024ll;
+
+	if(File && File->TotalSize() + Line.Length() > MaxBytes)
+	{
+		delete File;
+		File = nullptr;
+		IFileManager::Get().Move(*FrameWatchdog::GetPreviousPath(), *FrameWatchdog::GetPath(), true);
+	}
+	if(!File)
+	{
+		File = IFileManager::Get().CreateFileWriter(*FrameWatchdog::GetPath(), FILEWRITE_Append | FILEWRITE_AllowRead);
+		if(!File)
+		{
+			return;
+		}
+	}
+
+	File->Serialize((void*)Line.Get(), Line.Length());
+	//Flushed every time, the session may end in a crash right after
+	File->Flush();
+}
@@ -0,0 +1,40 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "FrameWatchdog.generated.h"
+
+//Writes a record of every frame whose game thread time goes over sun.Watchdog.BudgetMs to Saved/Hitches: the SUN
+//scope times and counts of that frame, garbage collection during it and what each player's character was doing.
+//One JSON object per line, rolled over to a second file at sun.Watchdog.MaxFileKB so the latest hitches of a long
+//session are kept in bounded space. Only one game world writes when several share the frame (PIE)
+UCLASS()
+class SUN_API UFrameWatchdog : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+private:
+	void OnFrameEnd();
+	void OnPreGarbageCollect();
+	void OnPostGarbageCollect();
+
+	FString MakeRecord(float FrameMs, float BudgetMs) const;
+	void Write(const FString& Record);
+
+	FDelegateHandle FrameEndHandle;
+	FDelegateHandle PreGarbageCollectHandle;
+	FDelegateHandle PostGarbageCollectHandle;
+
+	uint32 GarbageCollectStartCycles = 0;
+	uint32 GarbageCollectCycles = 0;
+	int32 NumGarbageCollects = 0;
+
+	//Opened on the first hitch, so sessions without any leave no file
+	FArchive* File = nullptr;
+};
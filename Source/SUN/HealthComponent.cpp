@@ -2,20 +2,31 @@
 
 
 #include "HealthComponent.h"
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "LagCompensationSubsystem.h"
+#include "DamageSubsystem.h"
+#include "StatusEffectSubsystem.h"
+#include "SignificanceSubsystem.h"
+#include "EnemyPool.h"
+#include "Enemy.h"
+#include "Net/UnrealNetwork.h"
+
+DECLARE_CYCLE_STAT(TEXT("Damage handling"), STAT_SUN_DamageHandling, STATGROUP_SUN);
 
 // Sets default values for this component's properties
 UHealthComponent::UHealthComponent()
 {
-	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
-	// off to improve performance if you don't need them.
-	PrimaryComponentTick.bCanEverTick = true;
+	//Nothing to tick, damage is resolved in batches by UDamageSubsystem
+	PrimaryComponentTick.bCanEverTick = false;
+	SetIsReplicatedByDefault(true);
 }
 
 UHealthComponent::UHealthComponent(float MHP)
 {
-	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
-	// off to improve performance if you don't need them.
-	PrimaryComponentTick.bCanEverTick = true;
+	//Nothing to tick, damage is resolved in batches by UDamageSubsystem
+	PrimaryComponentTick.bCanEverTick = false;
+	SetIsReplicatedByDefault(true);
 	MaxHealth = MHP;
 	CurrentHealth = MaxHealth;
 	// ...
@@ -27,42 +38,116 @@ void UHealthComponent::BeginPlay()
 {
 	Super::BeginPlay();
 	CurrentHealth = MaxHealth;
+	HealthSlot = GetWorld()->GetSubsystem<UDamageSubsystem>()->AddHealth(MaxHealth, this);
 	AActor* Owner = GetOwner();
 	if(Owner)
+	{
 		Owner->OnTakeAnyDamage.AddDynamic(this, &UHealthComponent::HandleDamage);
+		//Anything that can be damaged can be shot by someone seeing it in the past
+		GetWorld()->GetSubsystem<ULagCompensationSubsystem>()->Track(Owner);
+		//and is a gameplay actor whose ticks can be slowed down when nobody is around
+		GetWorld()->GetSubsystem<USignificanceSubsystem>()->Register(Owner);
+	}
 }
 
+void UHealthComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if(ULagCompensationSubsystem* LagCompensation = GetWorld()->GetSubsystem<ULagCompensationSubsystem>())
+	{
+		LagCompensation->Untrack(GetOwner());
+	}
+	if(USignificanceSubsystem* Significance = GetWorld()->GetSubsystem<USignificanceSubsystem>())
+	{
+		Significance->Unregister(GetOwner());
+	}
+	if(UStatusEffectSubsystem* StatusEffects = GetWorld()->GetSubsystem<UStatusEffectSubsystem>())
+	{
+		StatusEffects->RemoveEffects(HealthSlot);
+	}
+	if(UDamageSubsystem* Damage = GetWorld()->GetSubsystem<UDamageSubsystem>())
+	{
+		Damage->RemoveHealth(HealthSlot);
+	}
+	HealthSlot = INDEX_NONE;
+	Super::EndPlay(EndPlayReason);
+}
 
-// Called every frame
-void UHealthComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+void UHealthComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
 {
-	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);	
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+	DOREPLIFETIME(UHealthComponent, ReplicatedHealth);
+}
+
+void UHealthComponent::SetCurrentHealth(float Health)
+{
+	CurrentHealth = Health;
+	AActor* Owner = GetOwner();
+	if(!Owner || !Owner->HasAuthority())
+	{
+		return;
+	}
+
+	const uint8 Quantized = (uint8)FMath::CeilToInt(FMath::Clamp(Health / FMath::Max(MaxHealth, 1.f), 0.f, 1.f) * 255.f);
+	if(Quantized != ReplicatedHealth)
+	{
+		ReplicatedHealth = Quantized;
+		//Dormant enemies send this one change and go back to sleep
+		Owner->FlushNetDormancy();
+	}
+}
+
+void UHealthComponent::OnRep_ReplicatedHealth()
+{
+	CurrentHealth = ReplicatedHealth / 255.f * MaxHealth;
 }
 
 void UHealthComponent::HandleDamage(AActor* DamagedActor, float Damage, const class UDamageType* DamageType, class AController* InstigatedBy, AActor* DamageCauser)
 {
-	TakeDamage(Damage);
+	SUN_SCOPE_CYCLE_COUNTER(STAT_SUN_DamageHandling, DamageHandling);
+	GetWorld()->GetSubsystem<USignificanceSubsystem>()->NotifyActivity(GetOwner());
+	if(HealthSlot != INDEX_NONE)
+	{
+		GetWorld()->GetSubsystem<UDamageSubsystem>()->QueueDamage(HealthSlot, Damage, DamageType ? DamageType->GetClass() : nullptr, DamageCauser);
+	}
 }
 void UHealthComponent::TakeDamage(float Dmg)
 {
-	CurrentHealth -= Dmg;
-	if(CurrentHealth < 0)
+	if(HealthSlot != INDEX_NONE)
 	{
-		CurrentHealth = 0;
-		Die();
+		GetWorld()->GetSubsystem<UDamageSubsystem>()->QueueDamage(HealthSlot, Dmg, nullptr, nullptr);
 	}
 }
 
 void UHealthComponent::HealDamage(float Heal)
 {
-	CurrentHealth += Heal;
-	if(CurrentHealth > MaxHealth)
+	if(HealthSlot != INDEX_NONE)
+	{
+		GetWorld()->GetSubsystem<UDamageSubsystem>()->QueueHeal(HealthSlot, Heal);
+	}
+}
+
+void UHealthComponent::ApplyEffect(const FStatusEffectSpec& Spec, AActor* Causer)
+{
+	GetWorld()->GetSubsystem<UStatusEffectSubsystem>()->ApplyEffect(HealthSlot, Spec, Causer);
+}
+
+void UHealthComponent::ResetHealth()
+{
+	SetCurrentHealth(MaxHealth);
+	if(HealthSlot != INDEX_NONE)
 	{
-		CurrentHealth = MaxHealth;
+		GetWorld()->GetSubsystem<UDamageSubsystem>()->ResetHealth(HealthSlot);
 	}
 }
 
 void UHealthComponent::Die()
 {
+	//Enemies go back to the pool to be respawned instead of being destroyed and collected
+	if(AEnemy* Enemy = Cast<AEnemy>(GetOwner()))
+	{
+		GetWorld()->GetSubsystem<UEnemyPool>()->Release(Enemy);
+		return;
+	}
+	SUN_INC_COUNTER(STAT_SUN_ActorDestroys, Destroys, 1);
 	GetOwner()->Destroy();
 }
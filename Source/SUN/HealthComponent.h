@@ -20,6 +20,8 @@ public:
 protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 private:
 	UPROPERTY(EditAnywhere, Category = Health)
 	float MaxHealth = 100.f;
@@ -27,20 +29,34 @@ private:
 	UFUNCTION()
 	void HandleDamage(AActor* DamagedActor, float Damage, const class UDamageType* DamageType, class AController* InstigatedBy, AActor* DamageCauser);
 
-public:	
-	// Called every frame
-	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	//Slot in UDamageSubsystem holding the real value
+	int32 HealthSlot = INDEX_NONE;
+
+	//Fraction of MaxHealth in 255 steps, rounded up so only a dead owner replicates 0. Set at most once a frame
+	//from the resolved damage, so every hit of the frame goes out as one change
+	UPROPERTY(ReplicatedUsing = OnRep_ReplicatedHealth)
+	uint8 ReplicatedHealth = 255;
+
+	UFUNCTION()
+	void OnRep_ReplicatedHealth();
 
+public:	
+	//Mirror of the health in UDamageSubsystem, updated when the frame's damage is resolved. On clients it is
+	//rebuilt from ReplicatedHealth
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Health)
 	float CurrentHealth = 100.f;
 
-	
+	//Sets the mirror. On the server this also replicates the health if its quantized value changed
+	void SetCurrentHealth(float Health);
+
+	//Queued, applied with everything else at the end of the frame
 	void TakeDamage(float Dmg);
 	void HealDamage(float Heal);
+	//Damage or heal over time, stacking with what is already running per the spec
+	void ApplyEffect(const struct FStatusEffectSpec& Spec, AActor* Causer);
 	void Die();
-	void ResetHealth()
-	{
-		CurrentHealth = MaxHealth;
-	}
-		
+	void ResetHealth();
+
+	int32 GetHealthSlot() const { return HealthSlot; }
+	float GetMaxHealth() const { return MaxHealth; }
 };
@@ -0,0 +1,105 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HitscanSubsystem.h"
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "LagCompensationSubsystem.h"
+#include "Engine/World.h"
+#include "GameFramework/DamageType.h"
+#include "HAL/IConsoleManager.h"
+#include "Kismet/GameplayStatics.h"
+#include "Async/ParallelFor.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Hitscan shots"), STAT_SUN_HitscanShots, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Hitscan traces"), STAT_SUN_HitscanTraces, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Hitscan resolve"), STAT_SUN_HitscanResolve, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Hitscan apply damage"), STAT_SUN_HitscanApplyDamage, STATGROUP_SUN);
+
+static TAutoConsoleVariable<int32> CVarHitscanParallel(
+	TEXT("sun.Hitscan.Parallel"),
+	1,
+	TEXT("0: the frame's hitscan traces run one after another on the game thread\n")
+	TEXT("1: the frame's hitscan traces are spread over the task graph workers"),
+	ECVF_Default);
+
+UHitscanSubsystem::UHitscanSubsystem()
+{
+	//After timers (automatic fire) and all actor ticks, so every shot of the frame is in the batch
+	TickGroup = TG_PostUpdateWork;
+}
+
+void UHitscanSubsystem::SubmitShot(const FHitscanShot& Shot)
+{
+	PendingShots.Add(Shot);
+}
+
+void UHitscanSubsystem::Tick(float DeltaTime)
+{
+	if(PendingShots.Num() == 0)
+	{
+		return;
+	}
+
+	INC_DWORD_STAT_BY(STAT_SUN_HitscanShots, PendingShots.Num());
+
+	ResolveShots();
+	ApplyDamage();
+
+	PendingShots.Reset();
+	Results.Reset();
+}
+
+//Physics is done for the frame and nothing moves until the damage pass, so the scene can be queried from any thread
+void UHitscanSubsystem::ResolveShots()
+{
+	SUN_SCOPE_CYCLE_COUNTER(STAT_SUN_HitscanResolve, Hitscan);
+
+	UWorld* World = GetWorld();
+	Results.SetNum(PendingShots.Num());
+
+	ParallelFor(PendingShots.Num(), [this, World](int32 Index)
+	{
+		const FHitscanShot& Shot = PendingShots[Index];
+		World->LineTraceSingleByChannel(Results[Index], Shot.Start, Shot.End, Shot.Channel, Shot.Params);
+	}, CVarHitscanParallel.GetValueOnGameThread() == 0);
+
+	SUN_INC_COUNTER(STAT_SUN_HitscanTraces, Traces, PendingShots.Num());
+
+	//Shots from remote players are checked again against where the targets were when they fired
+	const ULagCompensationSubsystem* LagCompensation = World->GetSubsystem<ULagCompensationSubsystem>();
+	for(int32 Index = 0; Index < PendingShots.Num(); Index++)
+	{
+		const FHitscanShot& Shot = PendingShots[Index];
+		if(Shot.ShotTime >= 0.f && LagCompensation)
+		{
+			LagCompensation->ResolveShot(Shot.Start, Shot.End, Shot.Channel, Shot.Params, Shot.ShotTime, Results[Index]);
+		}
+	}
+}
+
+//Damage can kill and destroy actors, so it is kept on the game thread and applied in submission order
+void UHitscanSubsystem::ApplyDamage()
+{
+	SCOPE_CYCLE_COUNTER(STAT_SUN_HitscanApplyDamage);
+
+	for(int32 Index = 0; Index < PendingShots.Num(); Index++)
+	{
+		const FHitResult& Hit = Results[Index];
+		if(!Hit.bBlockingHit)
+		{
+			continue;
+		}
+
+		//An earlier shot in the batch may already have destroyed it
+		AActor* HitActor = Hit.GetActor();
+		if(!HitActor || HitActor->IsPendingKillPending())
+		{
+			continue;
+		}
+
+		const FHitscanShot& Shot = PendingShots[Index];
+		const FVector ShotDirection = (Shot.End - Shot.Start).GetSafeNormal();
+		UGameplayStatics::ApplyPointDamage(HitActor, Shot.Damage, ShotDirection, Hit, nullptr, Shot.Shooter.Get(), Shot.DamageType);
+	}
+}
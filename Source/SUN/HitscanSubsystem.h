@@ -0,0 +1,50 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CollisionQueryParams.h"
+#include "Engine/EngineTypes.h"
+#include "SUNWorldSubsystem.h"
+#include "HitscanSubsystem.generated.h"
+
+class UDamageType;
+
+//One hitscan shot waiting to be resolved
+struct FHitscanShot
+{
+	TWeakObjectPtr<AActor> Shooter;
+	FVector Start;
+	FVector End;
+	float Damage;
+	TSubclassOf<UDamageType> DamageType;
+	ECollisionChannel Channel;
+	FCollisionQueryParams Params;
+
+	//World time the shooter saw when firing, the targets are rewound to it. Negative traces the present
+	float ShotTime = -1.f;
+};
+
+//Collects every hitscan shot fired during a frame. Once all actors and timers have run, the traces for the whole
+//batch are resolved in parallel on worker threads and the damage is then applied on the game thread in the order
+//the shots were submitted, so damage events never fire in the middle of another actor's tick
+UCLASS()
+class SUN_API UHitscanSubsystem : public USUNWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	UHitscanSubsystem();
+
+	//Queue a shot for this frame's batch
+	void SubmitShot(const FHitscanShot& Shot);
+
+	virtual void Tick(float DeltaTime) override;
+
+private:
+	void ResolveShots();
+	void ApplyDamage();
+
+	TArray<FHitscanShot> PendingShots;
+	TArray<FHitResult> Results;
+};
@@ -0,0 +1,48 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HordeRenderer.h"
+#include "HordeSubsystem.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "Engine/CollisionProfile.h"
+#include "Engine/EngineTypes.h"
+
+AHordeRenderer::AHordeRenderer()
+{
+	PrimaryActorTick.bCanEverTick = false;
+
+	Instances = CreateDefaultSubobject<UHierarchicalInstancedStaticMeshComponent>(TEXT("Instances"));
+	Instances->SetMobility(EComponentMobility::Movable);
+	Instances->SetCollisionProfileName(UCollisionProfile::Pawn_ProfileName);
+	Instances->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
+	Instances->SetCastShadow(false);
+	//Animation phase, for materials that animate per instance
+	Instances->NumCustomDataFloats = 1;
+	RootComponent = Instances;
+}
+
+float AHordeRenderer::TakeDamage(float DamageAmount, FDamageEvent const& DamageEvent, AController* EventInstigator, AActor* DamageCauser)
+{
+	UHordeSubsystem* HordeSubsystem = Horde.Get();
+	if(!HordeSubsystem || DamageAmount <= 0.f)
+	{
+		return 0.f;
+	}
+
+	if(DamageEvent.IsOfType(FPointDamageEvent::ClassID))
+	{
+		const FPointDamageEvent& PointDamage = static_cast<const FPointDamageEvent&>(DamageEvent);
+		HordeSubsystem->DamageInstance(BatchIndex, PointDamage.HitInfo.Item, DamageAmount, DamageEvent.DamageTypeClass, DamageCauser);
+	}
+	else if(DamageEvent.IsOfType(FRadialDamageEvent::ClassID))
+	{
+		//Every instance inside the radius, scaled by falloff like UGameplayStatics::ApplyRadialDamage would per actor
+		const FRadialDamageEvent& RadialDamage = static_cast<const FRadialDamageEvent&>(DamageEvent);
+		for(const FHitResult& Hit : RadialDamage.ComponentHits)
+		{
+			const float Scale = RadialDamage.Params.GetDamageScale(FVector::Dist(RadialDamage.Origin, Hit.ImpactPoint));
+			HordeSubsystem->DamageInstance(BatchIndex, Hit.Item, DamageAmount * Scale, DamageEvent.DamageTypeClass, DamageCauser);
+		}
+	}
+	return DamageAmount;
+}
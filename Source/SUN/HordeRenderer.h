@@ -0,0 +1,29 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "HordeRenderer.generated.h"
+
+class UHierarchicalInstancedStaticMeshComponent;
+class UHordeSubsystem;
+
+//Draws one horde batch of UHordeSubsystem and stands in for its enemies when they are hit. Damage applied to this
+//actor goes to the enemy behind the instance that was hit, so hitscan, melee and radial damage need no special case
+UCLASS(NotPlaceable, Transient)
+class SUN_API AHordeRenderer : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	AHordeRenderer();
+
+	UPROPERTY(VisibleAnywhere, Category = Horde)
+	UHierarchicalInstancedStaticMeshComponent* Instances;
+
+	TWeakObjectPtr<UHordeSubsystem> Horde;
+	int32 BatchIndex = INDEX_NONE;
+
+	virtual float TakeDamage(float DamageAmount, struct FDamageEvent const& DamageEvent, AController* EventInstigator, AActor* DamageCauser) override;
+};
@@ -0,0 +1,495 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HordeSubsystem.h"
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "DamageSubsystem.h"
+#include "Enemy.h"
+#include "EnemyPool.h"
+#include "HordeRenderer.h"
+#include "Async/ParallelFor.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogHorde, Log, All);
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Horde enemies"), STAT_SUN_HordeEnemies, STATGROUP_SUN);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Horde enemies promoted"), STAT_SUN_HordePromoted, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Horde promotions"), STAT_SUN_HordePromotions, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Horde demotions"), STAT_SUN_HordeDemotions, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Horde tick"), STAT_SUN_HordeTick, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Horde simulate"), STAT_SUN_HordeSimulate, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Horde promote"), STAT_SUN_HordePromote, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Horde instances"), STAT_SUN_HordeInstances, STATGROUP_SUN);
+
+static TAutoConsoleVariable<float> CVarHordePromoteRadius(
+	TEXT("sun.Horde.PromoteRadius"),
+	1500.f,
+	TEXT("Horde enemies closer than this to a player become actors"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarHordeDemoteRadius(
+	TEXT("sun.Horde.DemoteRadius"),
+	2500.f,
+	TEXT("Promoted horde enemies further than this from every player go back to being instances"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarHordeDemoteDelay(
+	TEXT("sun.Horde.DemoteDelay"),
+	3.f,
+	TEXT("Seconds a horde enemy stays an actor after it was last damaged"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarHordeMaxPromoted(
+	TEXT("sun.Horde.MaxPromoted"),
+	64,
+	TEXT("Horde enemies that can be actors at once, the rest wait as instances"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarHordeCollision(
+	TEXT("sun.Horde.Collision"),
+	1,
+	TEXT("0: horde instances have no collision and can only be hit once promoted\n")
+	TEXT("1: horde instances can be traced and hit, each one has a query-only body that moves with it"),
+	ECVF_Default);
+
+static FAutoConsoleCommandWithWorldAndArgs HordeSpawnCommand(
+	TEXT("sun.Horde.Spawn"),
+	TEXT("sun.Horde.Spawn [Count] [Radius] [EnemyClassPath]: spawns Count (10000) horde enemies within Radius (5000) of the first player"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&UHordeSubsystem::SpawnCommand));
+
+//Enemies per ParallelFor task
+static const int32 HordeChunkSize = 512;
+
+//Instances of promoted and dead enemies are moved here. Not scaled to zero, they may have bodies
+static const FVector HiddenLocation(0.f, 0.f, -1000000.f);
+
+//Animation cycles per second at HordeSpeed
+static const float AnimRate = 1.5f;
+
+UHordeSubsystem::UHordeSubsystem()
+{
+	//Moved before physics, so promoted enemies spawn where the instances were drawn last frame
+	TickGroup = TG_PrePhysics;
+}
+
+void UHordeSubsystem::Spawn(TSubclassOf<AEnemy> Class, int32 Count, const FVector& Center, float Radius)
+{
+	if(!Class || Count <= 0)
+	{
+		return;
+	}
+
+	UDamageSubsystem* Damage = GetWorld()->GetSubsystem<UDamageSubsystem>();
+	if(!DeathsHandle.IsValid())
+	{
+		HitsHandle = Damage->OnHits.AddUObject(this, &UHordeSubsystem::OnHits);
+		DeathsHandle = Damage->OnDeaths.AddUObject(this, &UHordeSubsystem::OnDeaths);
+	}
+
+	int32 BatchIndex;
+	FHordeBatch& Batch = FindOrAddBatch(Class, BatchIndex);
+	FRandomStream Random(FPlatformTime::Cycles());
+	for(int32 Spawned = 0; Spawned < Count; Spawned++)
+	{
+		int32 Index;
+		if(Batch.FreeIndices.Num() > 0)
+		{
+			Index = Batch.FreeIndices.Pop(false);
+		}
+		else
+		{
+			Index = Batch.Num();
+			Batch.Positions.AddUninitialized();
+			Batch.Velocities.AddUninitialized();
+			Batch.AnimPhases.AddUninitialized();
+			Batch.PlayerDistancesSq.AddUninitialized();
+			Batch.LastDamageTimes.AddUninitialized();
+			Batch.HealthSlots.AddUninitialized();
+			Batch.States.AddUninitialized();
+			Batch.Actors.AddDefaulted();
+		}
+
+		//Uniform over the disc
+		const float Angle = Random.FRandRange(0.f, 2.f * PI);
+		const float Distance = Radius * FMath::Sqrt(Random.FRand());
+		Batch.Positions[Index] = Center + FVector(FMath::Cos(Angle), FMath::Sin(Angle), 0.f) * Distance;
+		Batch.Velocities[Index] = FVector::ZeroVector;
+		Batch.AnimPhases[Index] = Random.FRand();
+		Batch.PlayerDistancesSq[Index] = MAX_flt;
+		Batch.LastDamageTimes[Index] = -MAX_flt;
+		Batch.HealthSlots[Index] = Damage->AddHealth(Batch.MaxHealth);
+		Batch.States[Index] = EHordeState::Instanced;
+		SlotToEntity.Add(Batch.HealthSlots[Index], { BatchIndex, Index });
+	}
+
+	NumEnemies += Count;
+	INC_DWORD_STAT_BY(STAT_SUN_HordeEnemies, Count);
+}
+
+void UHordeSubsystem::DamageInstance(int32 BatchIndex, int32 Index, float Amount, TSubclassOf<UDamageType> DamageType, AActor* Causer)
+{
+	if(!Batches.IsValidIndex(BatchIndex) || !Batches[BatchIndex].States.IsValidIndex(Index))
+	{
+		return;
+	}
+
+	//Queued like any other damage, the hit also asks for the enemy to become an actor next frame
+	FHordeBatch& Batch = Batches[BatchIndex];
+	if(Batch.States[Index] == EHordeState::Instanced)
+	{
+		GetWorld()->GetSubsystem<UDamageSubsystem>()->QueueDamage(Batch.HealthSlots[Index], Amount, DamageType, Causer);
+		Batch.LastDamageTimes[Index] = GetWorld()->GetTimeSeconds();
+	}
+}
+
+void UHordeSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_SUN_HordeEnemies, NumEnemies);
+	DEC_DWORD_STAT_BY(STAT_SUN_HordePromoted, NumPromoted);
+	if(UDamageSubsystem* Damage = GetWorld()->GetSubsystem<UDamageSubsystem>())
+	{
+		Damage->OnHits.Remove(HitsHandle);
+		Damage->OnDeaths.Remove(DeathsHandle);
+	}
+	Batches.Empty();
+	BatchIndices.Empty();
+	SlotToEntity.Empty();
+	Renderers.Empty();
+	NumEnemies = 0;
+	NumPromoted = 0;
+
+	Super::Deinitialize();
+}
+
+void UHordeSubsystem::Tick(float DeltaTime)
+{
+	if(NumEnemies == 0)
+	{
+		return;
+	}
+
+	SUN_SCOPE_CYCLE_COUNTER(STAT_SUN_HordeTick, Horde);
+	PlayerLocations.Reset();
+	for(FConstPlayerControllerIterator Iterator = GetWorld()->GetPlayerControllerIterator(); Iterator; ++Iterator)
+	{
+		const APlayerController* Player = Iterator->Get();
+		if(Player && Player->GetPawn())
+		{
+			PlayerLocations.Add(Player->GetPawn()->GetActorLocation());
+		}
+	}
+
+	for(int32 BatchIndex = 0; BatchIndex < Batches.Num(); BatchIndex++)
+	{
+		Simulate(Batches[BatchIndex], DeltaTime);
+		UpdatePromotions(BatchIndex);
+		UpdateInstances(Batches[BatchIndex]);
+	}
+}
+
+FHordeBatch& UHordeSubsystem::FindOrAddBatch(TSubclassOf<AEnemy> Class, int32& OutBatchIndex)
+{
+	if(const int32* Index = BatchIndices.Find(Class))
+	{
+		OutBatchIndex = *Index;
+		return Batches[*Index];
+	}
+
+	OutBatchIndex = Batches.Num();
+	BatchIndices.Add(Class, OutBatchIndex);
+	FHordeBatch& Batch = Batches.AddDefaulted_GetRef();
+
+	const AEnemy* Defaults = Class->GetDefaultObject<AEnemy>();
+	Batch.Class = Class;
+	Batch.Speed = Defaults->HordeSpeed;
+	Batch.MaxHealth = Defaults->Health ? Defaults->Health->GetMaxHealth() : 100.f;
+	Batch.MeshScale = Defaults->HordeMeshScale;
+	UStaticMesh* Mesh = Defaults->HordeMesh;
+	if(!Mesh)
+	{
+		Mesh = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cylinder.Cylinder"));
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.ObjectFlags |= RF_Transient;
+	AHordeRenderer* Renderer = GetWorld()->SpawnActor<AHordeRenderer>(AHordeRenderer::StaticClass(), FTransform::Identity, SpawnParams);
+	if(Renderer)
+	{
+		Renderer->Horde = this;
+		Renderer->BatchIndex = OutBatchIndex;
+		Renderer->Instances->SetStaticMesh(Mesh);
+		if(CVarHordeCollision.GetValueOnGameThread() == 0)
+		{
+			Renderer->Instances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		}
+		Batch.Renderer = Renderer;
+		Renderers.Add(Renderer);
+	}
+	return Batch;
+}
+
+//Straight at the nearest player on the spawn plane. Promoted and dead enemies are skipped, the distance to the
+//nearest player is kept for the promotion pass
+void UHordeSubsystem::Simulate(FHordeBatch& Batch, float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SUN_HordeSimulate);
+
+	const int32 Num = Batch.Num();
+	const float Speed = Batch.Speed;
+	const float PhaseStep = DeltaTime * AnimRate;
+	ParallelFor(FMath::DivideAndRoundUp(Num, HordeChunkSize), [&](int32 Chunk)
+	{
+		const int32 Last = FMath::Min((Chunk + 1) * HordeChunkSize, Num);
+		for(int32 Index = Chunk * HordeChunkSize; Index < Last; Index++)
+		{
+			if(Batch.States[Index] != EHordeState::Instanced)
+			{
+				continue;
+			}
+
+			FVector& Position = Batch.Positions[Index];
+			float NearestSq = MAX_flt;
+			FVector Nearest = Position;
+			for(const FVector& Player : PlayerLocations)
+			{
+				const float DistanceSq = FVector::DistSquared2D(Position, Player);
+				if(DistanceSq < NearestSq)
+				{
+					NearestSq = DistanceSq;
+					Nearest = Player;
+				}
+			}
+
+			const FVector Velocity = (Nearest - Position).GetSafeNormal2D() * Speed;
+			Position += Velocity * DeltaTime;
+			Batch.Velocities[Index] = Velocity;
+			Batch.PlayerDistancesSq[Index] = NearestSq;
+			Batch.AnimPhases[Index] = FMath::Frac(Batch.AnimPhases[Index] + PhaseStep);
+		}
+	});
+}
+
+//Game thread, spawning and parking actors. Promoted enemies follow their actor from here
+void UHordeSubsystem::UpdatePromotions(int32 BatchIndex)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SUN_HordePromote);
+
+	FHordeBatch& Batch = Batches[BatchIndex];
+	const float Now = GetWorld()->GetTimeSeconds();
+	const float PromoteRadiusSq = FMath::Square(CVarHordePromoteRadius.GetValueOnGameThread());
+	const float DemoteRadiusSq = FMath::Square(CVarHordeDemoteRadius.GetValueOnGameThread());
+	const float DemoteDelay = CVarHordeDemoteDelay.GetValueOnGameThread();
+	const int32 MaxPromoted = CVarHordeMaxPromoted.GetValueOnGameThread();
+
+	for(int32 Index = 0; Index < Batch.Num(); Index++)
+	{
+		const bool bRecentlyDamaged = Now - Batch.LastDamageTimes[Index] < DemoteDelay;
+		if(Batch.States[Index] == EHordeState::Instanced)
+		{
+			if((bRecentlyDamaged || Batch.PlayerDistancesSq[Index] < PromoteRadiusSq) && NumPromoted < MaxPromoted)
+			{
+				Promote(BatchIndex, Index);
+			}
+			continue;
+		}
+		if(Batch.States[Index] != EHordeState::Promoted)
+		{
+			continue;
+		}
+
+		AEnemy* Actor = Batch.Actors[Index].Get();
+		if(!Actor || Actor->IsParked())
+		{
+			//Taken away from us without dying, treat it as gone
+			Kill(BatchIndex, Index);
+			continue;
+		}
+
+		Batch.Positions[Index] = Actor->GetActorLocation();
+		float NearestSq = MAX_flt;
+		for(const FVector& Player : PlayerLocations)
+		{
+			NearestSq = FMath::Min(NearestSq, FVector::DistSquared2D(Batch.Positions[Index], Player));
+		}
+		Batch.PlayerDistancesSq[Index] = NearestSq;
+		if(NearestSq > DemoteRadiusSq && !bRecentlyDamaged)
+		{
+			Demote(BatchIndex, Index);
+		}
+	}
+}
+
+void UHordeSubsystem::Promote(int32 BatchIndex, int32 Index)
+{
+	FHordeBatch& Batch = Batches[BatchIndex];
+	const FVector& Velocity = Batch.Velocities[Index];
+	const FRotator Rotation = Velocity.IsNearlyZero() ? FRotator::ZeroRotator : Velocity.Rotation();
+	AEnemy* Actor = GetWorld()->GetSubsystem<UEnemyPool>()->Spawn(Batch.Class, FTransform(Rotation, Batch.Positions[Index]));
+	if(!Actor || !Actor->Health || Actor->Health->GetHealthSlot() == INDEX_NONE)
+	{
+		return;
+	}
+
+	UDamageSubsystem* Damage = GetWorld()->GetSubsystem<UDamageSubsystem>();
+	const int32 ActorSlot = Actor->Health->GetHealthSlot();
+	Damage->SetHealth(ActorSlot, Damage->GetHealth(Batch.HealthSlots[Index]));
+	SlotToEntity.Add(ActorSlot, { BatchIndex, Index });
+	Batch.Actors[Index] = Actor;
+	Batch.States[Index] = EHordeState::Promoted;
+	NumPromoted++;
+	INC_DWORD_STAT(STAT_SUN_HordePromotions);
+	INC_DWORD_STAT(STAT_SUN_HordePromoted);
+}
+
+void UHordeSubsystem::Demote(int32 BatchIndex, int32 Index)
+{
+	FHordeBatch& Batch = Batches[BatchIndex];
+	AEnemy* Actor = Batch.Actors[Index].Get();
+	const int32 ActorSlot = Actor->Health->GetHealthSlot();
+
+	UDamageSubsystem* Damage = GetWorld()->GetSubsystem<UDamageSubsystem>();
+	Damage->SetHealth(Batch.HealthSlots[Index], Damage->GetHealth(ActorSlot));
+	SlotToEntity.Remove(ActorSlot);
+	GetWorld()->GetSubsystem<UEnemyPool>()->Release(Actor);
+	Batch.Actors[Index] = nullptr;
+	Batch.States[Index] = EHordeState::Instanced;
+	NumPromoted--;
+	INC_DWORD_STAT(STAT_SUN_HordeDemotions);
+	DEC_DWORD_STAT(STAT_SUN_HordePromoted);
+}
+
+//The actor of a promoted enemy that died goes back to the pool through UHealthComponent::Die
+void UHordeSubsystem::Kill(int32 BatchIndex, int32 Index)
+{
+	FHordeBatch& Batch = Batches[BatchIndex];
+	if(Batch.States[Index] == EHordeState::Promoted)
+	{
+		if(AEnemy* Actor = Batch.Actors[Index].Get())
+		{
+			SlotToEntity.Remove(Actor->Health->GetHealthSlot());
+		}
+		Batch.Actors[Index] = nullptr;
+		NumPromoted--;
+		DEC_DWORD_STAT(STAT_SUN_HordePromoted);
+	}
+
+	SlotToEntity.Remove(Batch.HealthSlots[Index]);
+	GetWorld()->GetSubsystem<UDamageSubsystem>()->RemoveHealth(Batch.HealthSlots[Index]);
+	Batch.HealthSlots[Index] = INDEX_NONE;
+	Batch.States[Index] = EHordeState::Dead;
+	Batch.FreeIndices.Add(Index);
+	NumEnemies--;
+	DEC_DWORD_STAT(STAT_SUN_HordeEnemies);
+}
+
+void UHordeSubsystem::UpdateInstances(FHordeBatch& Batch)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SUN_HordeInstances);
+
+	AHordeRenderer* Renderer = Batch.Renderer.Get();
+	if(!Renderer)
+	{
+		return;
+	}
+
+	UHierarchicalInstancedStaticMeshComponent* Instances = Renderer->Instances;
+	const int32 Num = Batch.Num();
+	while(Instances->GetInstanceCount() < Num)
+	{
+		Instances->AddInstance(FTransform(FQuat::Identity, HiddenLocation, Batch.MeshScale));
+	}
+
+	InstanceTransforms.SetNum(Num, false);
+	ParallelFor(FMath::DivideAndRoundUp(Num, HordeChunkSize), [&](int32 Chunk)
+	{
+		const int32 Last = FMath::Min((Chunk + 1) * HordeChunkSize, Num);
+		for(int32 Index = Chunk * HordeChunkSize; Index < Last; Index++)
+		{
+			if(Batch.States[Index] == EHordeState::Instanced)
+			{
+				const FVector& Velocity = Batch.Velocities[Index];
+				const FQuat Rotation = Velocity.IsNearlyZero() ? FQuat::Identity : Velocity.ToOrientationQuat();
+				InstanceTransforms[Index] = FTransform(Rotation, Batch.Positions[Index], Batch.MeshScale);
+			}
+			else
+			{
+				InstanceTransforms[Index] = FTransform(FQuat::Identity, HiddenLocation, Batch.MeshScale);
+			}
+		}
+	});
+
+	for(int32 Index = 0; Index < Num; Index++)
+	{
+		Instances->SetCustomDataValue(Index, 0, Batch.AnimPhases[Index], false);
+	}
+	Instances->BatchUpdateInstancesTransforms(0, InstanceTransforms, true, true, true);
+}
+
+//Deaths of instances and of promoted actors both come through here, before the actors' Die
+//Damage to promoted actors only shows up here. An enemy under fire stays an actor however far away its shooter is
+void UHordeSubsystem::OnHits(const TArray<FHitEvent>& Hits)
+{
+	const float Now = GetWorld()->GetTimeSeconds();
+	for(const FHitEvent& Hit : Hits)
+	{
+		if(const FEntity* Entity = SlotToEntity.Find(Hit.Slot))
+		{
+			Batches[Entity->Batch].LastDamageTimes[Entity->Index] = Now;
+		}
+	}
+}
+
+void UHordeSubsystem::OnDeaths(const TArray<FDeathEvent>& Deaths)
+{
+	for(const FDeathEvent& Death : Deaths)
+	{
+		if(const FEntity* Entity = SlotToEntity.Find(Death.Slot))
+		{
+			const FEntity Dead = *Entity;
+			FHordeBatch& Batch = Batches[Dead.Batch];
+			AEnemy* Actor = Batch.Actors[Dead.Index].Get();
+			//The instance slot ran out while promoted (effects still ticking on it), the actor has to go too
+			if(Actor && Death.Slot == Batch.HealthSlots[Dead.Index])
+			{
+				GetWorld()->GetSubsystem<UEnemyPool>()->Release(Actor);
+			}
+			Kill(Dead.Batch, Dead.Index);
+		}
+	}
+}
+
+void UHordeSubsystem::SpawnCommand(const TArray<FString>& Args, UWorld* World)
+{
+	UHordeSubsystem* Horde = World ? World->GetSubsystem<UHordeSubsystem>() : nullptr;
+	if(!Horde || !World->IsGameWorld())
+	{
+		UE_LOG(LogHorde, Warning, TEXT("sun.Horde.Spawn needs a running game world"));
+		return;
+	}
+
+	const int32 Count = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 10000;
+	const float Radius = Args.Num() > 1 ? FCString::Atof(*Args[1]) : 5000.f;
+	TSubclassOf<AEnemy> Class = AEnemy::StaticClass();
+	if(Args.Num() > 2)
+	{
+		if(UClass* Override = LoadClass<AEnemy>(nullptr, *Args[2]))
+		{
+			Class = Override;
+		}
+	}
+
+	FVector Center = FVector::ZeroVector;
+	APlayerController* Player = World->GetFirstPlayerController();
+	if(Player && Player->GetPawn())
+	{
+		Center = Player->GetPawn()->GetActorLocation();
+	}
+
+	Horde->Spawn(Class, Count, Center, Radius);
+	UE_LOG(LogHorde, Display, TEXT("Spawned %d %s, %d in the horde"), Count, *Class->GetName(), Horde->GetNumEnemies());
+}
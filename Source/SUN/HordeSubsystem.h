@@ -0,0 +1,106 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SUNWorldSubsystem.h"
+#include "HordeSubsystem.generated.h"
+
+class AEnemy;
+class AHordeRenderer;
+class UDamageType;
+struct FDeathEvent;
+struct FHitEvent;
+
+enum class EHordeState : uint8
+{
+	Instanced,
+	Promoted,
+	Dead
+};
+
+//Enemies of one class, stored as parallel arrays. Indices are stable and match the instance index in the renderer,
+//dead enemies leave a hole that the next spawn fills
+struct FHordeBatch
+{
+	TSubclassOf<AEnemy> Class;
+	float Speed;
+	float MaxHealth;
+	FVector MeshScale;
+	TWeakObjectPtr<AHordeRenderer> Renderer;
+
+	TArray<FVector> Positions;
+	TArray<FVector> Velocities;
+	TArray<float> AnimPhases;
+	TArray<float> PlayerDistancesSq;
+	TArray<float> LastDamageTimes;
+	TArray<int32> HealthSlots;
+	TArray<EHordeState> States;
+	TArray<TWeakObjectPtr<AEnemy>> Actors;
+	TArray<int32> FreeIndices;
+
+	int32 Num() const { return Positions.Num(); }
+};
+
+//Thousands of enemies without an actor each. Position, velocity, animation phase and health slot live in FHordeBatch,
+//they walk towards the nearest player in parallel chunks and each class is drawn with one hierarchical instanced mesh.
+//An enemy near a player or just damaged is promoted to a real AEnemy from UEnemyPool, and demoted back once it has
+//been far away and unhurt for a while. Health stays in UDamageSubsystem in both forms and is carried across
+UCLASS()
+class SUN_API UHordeSubsystem : public USUNWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	UHordeSubsystem();
+
+	//Count enemies of Class scattered within Radius of Center, all at Center's height
+	void Spawn(TSubclassOf<AEnemy> Class, int32 Count, const FVector& Center, float Radius);
+
+	//Damage to an enemy while it is an instance, from AHordeRenderer
+	void DamageInstance(int32 BatchIndex, int32 Index, float Amount, TSubclassOf<UDamageType> DamageType, AActor* Causer);
+
+	int32 GetNumEnemies() const { return NumEnemies; }
+	int32 GetNumPromoted() const { return NumPromoted; }
+
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+
+	//sun.Horde.Spawn [Count] [Radius] [EnemyClassPath] spawns a horde around the first player
+	static void SpawnCommand(const TArray<FString>& Args, UWorld* World);
+
+private:
+	struct FEntity
+	{
+		int32 Batch;
+		int32 Index;
+	};
+
+	FHordeBatch& FindOrAddBatch(TSubclassOf<AEnemy> Class, int32& OutBatchIndex);
+	void Simulate(FHordeBatch& Batch, float DeltaTime);
+	void UpdatePromotions(int32 BatchIndex);
+	void Promote(int32 BatchIndex, int32 Index);
+	void Demote(int32 BatchIndex, int32 Index);
+	void Kill(int32 BatchIndex, int32 Index);
+	void UpdateInstances(FHordeBatch& Batch);
+	void OnHits(const TArray<FHitEvent>& Hits);
+	void OnDeaths(const TArray<FDeathEvent>& Deaths);
+
+	TArray<FHordeBatch> Batches;
+	TMap<UClass*, int32> BatchIndices;
+
+	//Health slot of the instance, and of the actor while promoted, to the enemy it belongs to
+	TMap<int32, FEntity> SlotToEntity;
+
+	//Scratch reused every frame
+	TArray<FVector> PlayerLocations;
+	TArray<FTransform> InstanceTransforms;
+
+	UPROPERTY(Transient)
+	TArray<AHordeRenderer*> Renderers;
+
+	FDelegateHandle HitsHandle;
+	FDelegateHandle DeathsHandle;
+	int32 NumEnemies = 0;
+	int32 NumPromoted = 0;
+};
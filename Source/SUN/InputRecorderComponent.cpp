@@ -0,0 +1,509 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "InputRecorderComponent.h"
+#include "SUNCharacter.h"
+#include "SUNCharacterMovementComponent.h"
+#include "SUNPerf.h"
+#include "Engine/World.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+#include "Misc/Paths.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogInputRecorder, Log, All);
+
+static TAutoConsoleVariable<float> CVarInputDivergence(
+	TEXT("sun.Input.Divergence"),
+	5.f,
+	TEXT("How far a replay may end from where the recording did, in cm, before it counts as diverged"),
+	ECVF_Default);
+
+static void StartRecordingCommand(const TArray<FString>& Args, UWorld* World);
+static void StopRecordingCommand(const TArray<FString>& Args, UWorld* World);
+static void StartReplayCommand(const TArray<FString>& Args, UWorld* World);
+
+static FAutoConsoleCommandWithWorldAndArgs InputRecordCommand(
+	TEXT("sun.Input.Record"),
+	TEXT("sun.Input.Record [Name]: records the first player's input to Saved/InputRecordings/Name.suninput (Run)"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&StartRecordingCommand));
+
+static FAutoConsoleCommandWithWorldAndArgs InputStopCommand(
+	TEXT("sun.Input.Stop"),
+	TEXT("sun.Input.Stop: stops and saves the recording started with sun.Input.Record"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&StopRecordingCommand));
+
+static FAutoConsoleCommandWithWorldAndArgs InputReplayCommand(
+	TEXT("sun.Input.Replay"),
+	TEXT("sun.Input.Replay [Name] [exit]: plays a recording back into the first player's character and logs frame times and divergence. With exit the game quits when done, with exit code 1 if it diverged"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&StartReplayCommand));
+
+namespace InputRecording
+{
+	static const uint32 FileMagic = 0x494E5553;
+	static const int32 FileVersion = 1;
+	//An hour at 120 fps, anything bigger is a broken file
+	static const int32 MaxFrames = 432000;
+
+	enum EChanged : uint8
+	{
+		ChangedDeltaTime = 1 << 0,
+		ChangedForward = 1 << 1,
+		ChangedRight = 1 << 2,
+		ChangedPitch = 1 << 3,
+		ChangedYaw = 1 << 4
+	};
+
+	static UInputRecorderComponent* FindRecorder(UWorld* World)
+	{
+		APlayerController* Player = World ? World->GetFirstPlayerController() : nullptr;
+		APawn* Pawn = Player ? Player->GetPawn() : nullptr;
+		return Pawn ? Pawn->FindComponentByClass<UInputRecorderComponent>() : nullptr;
+	}
+
+	//Sorted ascending
+	static float Percentile(const TArray<float>& Sorted, float Fraction)
+	{
+		if(Sorted.Num() == 0)
+		{
+			return 0.f;
+		}
+		return Sorted[FMath::Clamp(FMath::CeilToInt(Fraction * Sorted.Num()) - 1, 0, Sorted.Num() - 1)];
+	}
+}
+
+static void StartRecordingCommand(const TArray<FString>& Args, UWorld* World)
+{
+	UInputRecorderComponent* Recorder = InputRecording::FindRecorder(World);
+	if(!Recorder)
+	{
+		UE_LOG(LogInputRecorder, Warning, TEXT("sun.Input.Record needs a player controlling a SUN character"));
+		return;
+	}
+	Recorder->StartRecording(Args.Num() > 0 ? Args[0] : TEXT("Run"));
+}
+
+static void StopRecordingCommand(const TArray<FString>& Args, UWorld* World)
+{
+	if(UInputRecorderComponent* Recorder = InputRecording::FindRecorder(World))
+	{
+		Recorder->StopRecording();
+	}
+}
+
+static void StartReplayCommand(const TArray<FString>& Args, UWorld* World)
+{
+	UInputRecorderComponent* Recorder = InputRecording::FindRecorder(World);
+	if(!Recorder)
+	{
+		UE_LOG(LogInputRecorder, Warning, TEXT("sun.Input.Replay needs a player controlling a SUN character"));
+		return;
+	}
+	const bool bExit = Args.Num() > 1 && Args[1] == TEXT("exit");
+	if(!Recorder->StartReplay(Args.Num() > 0 ? Args[0] : TEXT("Run"), bExit) && bExit)
+	{
+		FPlatformMisc::RequestExitWithStatus(false, 1);
+	}
+}
+
+void FSUNInputRecording::Serialize(FArchive& Ar)
+{
+	uint32 Magic = InputRecording::FileMagic;
+	int32 Version = InputRecording::FileVersion;
+	Ar << Magic << Version;
+	if(Ar.IsLoading() && (Magic != InputRecording::FileMagic || Version != InputRecording::FileVersion))
+	{
+		Ar.SetError();
+		return;
+	}
+
+	Ar << Map << StartLocation << StartRotation << StartControlRotation << StartVelocity << EndLocation;
+
+	int32 NumFrames = Frames.Num();
+	Ar << NumFrames;
+	if(Ar.IsLoading())
+	{
+		if(NumFrames < 0 || NumFrames > InputRecording::MaxFrames)
+		{
+			Ar.SetError();
+			return;
+		}
+		Frames.SetNum(NumFrames);
+	}
+
+	//Values that did not change are not stored, which is most of them most frames
+	FSUNInputFrame Previous;
+	for(FSUNInputFrame& Frame : Frames)
+	{
+		uint8 Changed = 0;
+		if(Ar.IsSaving())
+		{
+			Changed |= Frame.DeltaTime != Previous.DeltaTime ? InputRecording::ChangedDeltaTime : 0;
+			Changed |= Frame.Forward != Previous.Forward ? InputRecording::ChangedForward : 0;
+			Changed |= Frame.Right != Previous.Right ? InputRecording::ChangedRight : 0;
+			Changed |= Frame.ControlRotation.Pitch != Previous.ControlRotation.Pitch ? InputRecording::ChangedPitch : 0;
+			Changed |= Frame.ControlRotation.Yaw != Previous.ControlRotation.Yaw ? InputRecording::ChangedYaw : 0;
+		}
+		else
+		{
+			Frame = Previous;
+		}
+
+		uint8 Actions = (uint8)Frame.Actions;
+		Ar << Changed << Actions;
+		Frame.Actions = (ESUNInputAction)Actions;
+		if(Changed & InputRecording::ChangedDeltaTime)
+		{
+			Ar << Frame.DeltaTime;
+		}
+		if(Changed & InputRecording::ChangedForward)
+		{
+			Ar << Frame.Forward;
+		}
+		if(Changed & InputRecording::ChangedRight)
+		{
+			Ar << Frame.Right;
+		}
+		if(Changed & InputRecording::ChangedPitch)
+		{
+			Ar << Frame.ControlRotation.Pitch;
+		}
+		if(Changed & InputRecording::ChangedYaw)
+		{
+			Ar << Frame.ControlRotation.Yaw;
+		}
+		Previous = Frame;
+	}
+}
+
+bool FSUNInputRecording::Save(const FString& Path)
+{
+	TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*Path));
+	if(!Writer)
+	{
+		return false;
+	}
+	Serialize(*Writer);
+	return Writer->Close();
+}
+
+bool FSUNInputRecording::Load(const FString& Path)
+{
+	TUniquePtr<FArchive> Reader(IFileManager::Get().CreateFileReader(*Path));
+	if(!Reader)
+	{
+		return false;
+	}
+	Serialize(*Reader);
+	return Reader->Close();
+}
+
+FString FSUNInputRecording::GetPath(const FString& Name)
+{
+	return FPaths::ProjectSavedDir() / TEXT("InputRecordings") / Name + TEXT(".suninput");
+}
+
+// Sets default values for this component's properties
+UInputRecorderComponent::UInputRecorderComponent()
+{
+	//Only ticks while recording or replaying
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+	PrimaryComponentTick.TickGroup = TG_PrePhysics;
+}
+
+ASUNCharacter* UInputRecorderComponent::GetCharacter() const
+{
+	return Cast<ASUNCharacter>(GetOwner());
+}
+
+bool UInputRecorderComponent::SetUpTick()
+{
+	ASUNCharacter* Character = GetCharacter();
+	AController* Controller = Character ? Character->GetController() : nullptr;
+	if(!Controller)
+	{
+		return false;
+	}
+	PrimaryComponentTick.AddPrerequisite(Controller, Controller->PrimaryActorTick);
+	Character->GetCharacterMovement()->PrimaryComponentTick.AddPrerequisite(this, PrimaryComponentTick);
+	SetComponentTickEnabled(true);
+	return true;
+}
+
+void UInputRecorderComponent::StartRecording(const FString& Name)
+{
+	if(Mode != EMode::Idle || !SetUpTick())
+	{
+		UE_LOG(LogInputRecorder, Warning, TEXT("Can't record %s, already recording or replaying, or not controlled"), *Name);
+		return;
+	}
+
+	RecordingName = Name;
+	Recording = FSUNInputRecording();
+	Current = FSUNInputFrame();
+	Mode = EMode::StartRecording;
+	UE_LOG(LogInputRecorder, Display, TEXT("Recording %s"), *Name);
+}
+
+void UInputRecorderComponent::StopRecording()
+{
+	if(IsRecording())
+	{
+		Mode = EMode::StopRecording;
+	}
+}
+
+bool UInputRecorderComponent::StartReplay(const FString& Name, bool bInExitWhenDone)
+{
+	const FString Path = FSUNInputRecording::GetPath(Name);
+	if(Mode != EMode::Idle || !Recording.Load(Path) || Recording.Frames.Num() == 0 || !SetUpTick())
+	{
+		UE_LOG(LogInputRecorder, Warning, TEXT("Can't replay %s, busy, not controlled or no recording at %s"), *Name, *Path);
+		Mode = EMode::Idle;
+		return false;
+	}
+	if(Recording.Map != GetWorld()->GetMapName())
+	{
+		UE_LOG(LogInputRecorder, Warning, TEXT("%s was recorded in %s, not %s, it will diverge"), *Name, *Recording.Map, *GetWorld()->GetMapName());
+	}
+
+	//Live input would be added on top of the recorded one
+	ASUNCharacter* Character = GetCharacter();
+	if(APlayerController* Player = Cast<APlayerController>(Character->GetController()))
+	{
+		Character->DisableInput(Player);
+	}
+
+	//Every replayed frame takes exactly as long as it did when recorded, however long it really takes
+	bSavedUseFixedTimeStep = FApp::UseFixedTimeStep();
+	SavedFixedDeltaTime = FApp::GetFixedDeltaTime();
+	FApp::SetUseFixedTimeStep(true);
+	FApp::SetFixedDeltaTime(Recording.Frames[0].DeltaTime);
+
+	RecordingName = Name;
+	bExitWhenDone = bInExitWhenDone;
+	ReplayFrame = 0;
+	FrameMs.Reset(Recording.Frames.Num());
+	GameThreadMs.Reset(Recording.Frames.Num());
+	StartFrameCounter = GFrameCounter;
+	Mode = EMode::StartReplay;
+	UE_LOG(LogInputRecorder, Display, TEXT("Replaying %s, %d frames"), *Name, Recording.Frames.Num());
+	return true;
+}
+
+void UInputRecorderComponent::RecordForward(float Value)
+{
+	if(IsRecording())
+	{
+		Current.Forward = Value;
+	}
+}
+
+void UInputRecorderComponent::RecordRight(float Value)
+{
+	if(IsRecording())
+	{
+		Current.Right = Value;
+	}
+}
+
+void UInputRecorderComponent::RecordAction(ESUNInputAction Action)
+{
+	if(IsRecording())
+	{
+		Current.Actions |= Action;
+	}
+}
+
+void UInputRecorderComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if(IsRecording())
+	{
+		UE_LOG(LogInputRecorder, Warning, TEXT("Recording %s ended with the character, not saved"), *RecordingName);
+	}
+	if(IsReplaying())
+	{
+		RestoreTimeStep();
+	}
+	Mode = EMode::Idle;
+	Super::EndPlay(EndPlayReason);
+}
+
+// Called every frame while recording or replaying
+void UInputRecorderComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if(IsReplaying())
+	{
+		TickReplay();
+	}
+	else
+	{
+		TickRecording(DeltaTime);
+	}
+}
+
+//The controller has processed this frame's input, the character has not moved with it yet
+void UInputRecorderComponent::TickRecording(float DeltaTime)
+{
+	ASUNCharacter* Character = GetCharacter();
+	if(Mode == EMode::StartRecording)
+	{
+		Recording.Map = GetWorld()->GetMapName();
+		Recording.StartLocation = Character->GetActorLocation();
+		Recording.StartRotation = Character->GetActorRotation();
+		Recording.StartControlRotation = Character->GetControlRotation();
+		Recording.StartVelocity = Character->GetCharacterMovement()->Velocity;
+		Mode = EMode::Recording;
+	}
+	else if(Mode == EMode::StopRecording)
+	{
+		//Where the last recorded frame left it
+		Recording.EndLocation = Character->GetActorLocation();
+		const FString Path = FSUNInputRecording::GetPath(RecordingName);
+		if(Recording.Save(Path))
+		{
+			UE_LOG(LogInputRecorder, Display, TEXT("Saved %d frames to %s"), Recording.Frames.Num(), *Path);
+		}
+		else
+		{
+			UE_LOG(LogInputRecorder, Error, TEXT("Could not write %s"), *Path);
+		}
+		Recording = FSUNInputRecording();
+		Mode = EMode::Idle;
+		SetComponentTickEnabled(false);
+		return;
+	}
+
+	Current.DeltaTime = DeltaTime;
+	Current.ControlRotation = Character->GetControlRotation();
+	Recording.Frames.Add(Current);
+	Current.Actions = ESUNInputAction::None;
+}
+
+void UInputRecorderComponent::TickReplay()
+{
+	ASUNCharacter* Character = GetCharacter();
+	if(Mode == EMode::StartReplay)
+	{
+		//The frame the replay was started in was not on the recorded timestep yet
+		if(GFrameCounter == StartFrameCounter)
+		{
+			return;
+		}
+
+		Character->GetSUNMovement()->ResetAbilities();
+		if(Character->GetParkour()->IsWallRunning)
+		{
+			Character->GetParkour()->EndWallRun(FallOffWall);
+		}
+		Character->TeleportTo(Recording.StartLocation, Recording.StartRotation);
+		Character->GetCharacterMovement()->Velocity = Recording.StartVelocity;
+		Character->GetController()->SetControlRotation(Recording.StartControlRotation);
+		Mode = EMode::Replaying;
+	}
+	else
+	{
+		const double Now = FPlatformTime::Seconds();
+		FrameMs.Add((float)((Now - LastFrameTime) * 1000.0));
+		GameThreadMs.Add(FSUNPerf::GetFrameMs());
+	}
+	LastFrameTime = FPlatformTime::Seconds();
+
+	if(ReplayFrame == Recording.Frames.Num())
+	{
+		FinishReplay();
+		return;
+	}
+
+	ApplyFrame(Recording.Frames[ReplayFrame]);
+	ReplayFrame++;
+	if(ReplayFrame < Recording.Frames.Num())
+	{
+		FApp::SetFixedDeltaTime(Recording.Frames[ReplayFrame].DeltaTime);
+	}
+}
+
+//Same order as when recorded: action bindings, then axis bindings with the rotation of the frame before, then the
+//controller turns with this frame's look input
+void UInputRecorderComponent::ApplyFrame(const FSUNInputFrame& Frame)
+{
+	ASUNCharacter* Character = GetCharacter();
+	if(EnumHasAnyFlags(Frame.Actions, ESUNInputAction::EndAttack))
+	{
+		Character->EndAttack();
+	}
+	if(EnumHasAnyFlags(Frame.Actions, ESUNInputAction::SwitchWeaponMode))
+	{
+		Character->SwitchWeaponMode();
+	}
+	if(EnumHasAnyFlags(Frame.Actions, ESUNInputAction::StartAttack))
+	{
+		Character->StartAttack();
+	}
+	if(EnumHasAnyFlags(Frame.Actions, ESUNInputAction::DoubleJump))
+	{
+		Character->DoubleJump();
+	}
+	if(EnumHasAnyFlags(Frame.Actions, ESUNInputAction::Dash))
+	{
+		Character->Dash();
+	}
+	Character->MoveForward(Frame.Forward);
+	Character->MoveRight(Frame.Right);
+
+	Character->GetController()->SetControlRotation(Frame.ControlRotation);
+	Character->FaceRotation(Frame.ControlRotation, Frame.DeltaTime);
+}
+
+void UInputRecorderComponent::FinishReplay()
+{
+	ASUNCharacter* Character = GetCharacter();
+	RestoreTimeStep();
+	Mode = EMode::Idle;
+	SetComponentTickEnabled(false);
+	if(APlayerController* Player = Cast<APlayerController>(Character->GetController()))
+	{
+		Character->EnableInput(Player);
+	}
+
+	FrameMs.Sort();
+	GameThreadMs.Sort();
+	float TotalMs = 0.f;
+	for(const float Ms : FrameMs)
+	{
+		TotalMs += Ms;
+	}
+	UE_LOG(LogInputRecorder, Display, TEXT("Replayed %s: %d frames, frame avg %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms, game thread p50 %.2f ms, p99 %.2f ms"),
+		*RecordingName, Recording.Frames.Num(), TotalMs / FMath::Max(FrameMs.Num(), 1),
+		InputRecording::Percentile(FrameMs, 0.5f), InputRecording::Percentile(FrameMs, 0.99f), InputRecording::Percentile(FrameMs, 1.f),
+		InputRecording::Percentile(GameThreadMs, 0.5f), InputRecording::Percentile(GameThreadMs, 0.99f));
+
+	const float Divergence = FVector::Dist(Character->GetActorLocation(), Recording.EndLocation);
+	const bool bDiverged = Divergence > CVarInputDivergence.GetValueOnGameThread();
+	if(bDiverged)
+	{
+		UE_LOG(LogInputRecorder, Error, TEXT("Replay of %s diverged: ended %.1f cm from the recording, at %s instead of %s"),
+			*RecordingName, Divergence, *Character->GetActorLocation().ToString(), *Recording.EndLocation.ToString());
+	}
+	else
+	{
+		UE_LOG(LogInputRecorder, Display, TEXT("Replay of %s ended %.2f cm from the recording"), *RecordingName, Divergence);
+	}
+
+	Recording = FSUNInputRecording();
+	if(bExitWhenDone)
+	{
+		FPlatformMisc::RequestExitWithStatus(false, bDiverged ? 1 : 0);
+	}
+}
+
+void UInputRecorderComponent::RestoreTimeStep()
+{
+	FApp::SetUseFixedTimeStep(bSavedUseFixedTimeStep);
+	FApp::SetFixedDeltaTime(SavedFixedDeltaTime);
+}
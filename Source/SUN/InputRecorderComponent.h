@@ -0,0 +1,115 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "InputRecorderComponent.generated.h"
+
+class ASUNCharacter;
+
+enum class ESUNInputAction : uint8
+{
+	None = 0,
+	DoubleJump = 1 << 0,
+	Dash = 1 << 1,
+	StartAttack = 1 << 2,
+	EndAttack = 1 << 3,
+	SwitchWeaponMode = 1 << 4
+};
+ENUM_CLASS_FLAGS(ESUNInputAction)
+
+//Everything the player did in one frame. Axes are the last value the binding was called with, actions the ones
+//pressed that frame and ControlRotation where the view pointed once the frame's look input was applied
+struct FSUNInputFrame
+{
+	float DeltaTime = 0.f;
+	float Forward = 0.f;
+	float Right = 0.f;
+	FRotator ControlRotation = FRotator::ZeroRotator;
+	ESUNInputAction Actions = ESUNInputAction::None;
+};
+
+//A recorded run: where the character started, its input every frame and where it ended up. Saved as a small
+//binary file where each frame only stores the values that changed since the one before
+struct SUN_API FSUNInputRecording
+{
+	FString Map;
+	FVector StartLocation = FVector::ZeroVector;
+	FRotator StartRotation = FRotator::ZeroRotator;
+	FRotator StartControlRotation = FRotator::ZeroRotator;
+	FVector StartVelocity = FVector::ZeroVector;
+	FVector EndLocation = FVector::ZeroVector;
+	TArray<FSUNInputFrame> Frames;
+
+	void Serialize(FArchive& Ar);
+	bool Save(const FString& Path);
+	bool Load(const FString& Path);
+
+	//Saved/InputRecordings/Name.suninput
+	static FString GetPath(const FString& Name);
+};
+
+//Records the input of the owning ASUNCharacter to a file, or plays a recording back into it with the engine on a
+//fixed timestep set to the recorded frame times, so a real parkour run can be repeated headless as a benchmark.
+//Replays log their frame times and how far the character ended up from where the recording did
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class SUN_API UInputRecorderComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UInputRecorderComponent();
+
+	void StartRecording(const FString& Name);
+	//Saves once the last recorded frame has moved the character
+	void StopRecording();
+	//Exits the game with a non-zero code on divergence if bExitWhenDone
+	bool StartReplay(const FString& Name, bool bExitWhenDone);
+
+	bool IsRecording() const { return Mode == EMode::Recording || Mode == EMode::StartRecording; }
+	bool IsReplaying() const { return Mode == EMode::Replaying || Mode == EMode::StartReplay; }
+
+	//Called by the character's input handlers
+	void RecordForward(float Value);
+	void RecordRight(float Value);
+	void RecordAction(ESUNInputAction Action);
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+private:
+	enum class EMode : uint8
+	{
+		Idle,
+		StartRecording,
+		Recording,
+		StopRecording,
+		StartReplay,
+		Replaying
+	};
+
+	//After the controller has processed input, before the character moves
+	bool SetUpTick();
+	void TickRecording(float DeltaTime);
+	void TickReplay();
+	void ApplyFrame(const FSUNInputFrame& Frame);
+	void FinishReplay();
+	void RestoreTimeStep();
+
+	ASUNCharacter* GetCharacter() const;
+
+	EMode Mode = EMode::Idle;
+	FString RecordingName;
+	FSUNInputRecording Recording;
+	FSUNInputFrame Current;
+
+	int32 ReplayFrame = 0;
+	uint64 StartFrameCounter = 0;
+	double LastFrameTime = 0.0;
+	TArray<float> FrameMs;
+	TArray<float> GameThreadMs;
+	bool bExitWhenDone = false;
+	bool bSavedUseFixedTimeStep = false;
+	double SavedFixedDeltaTime = 0.0;
+};
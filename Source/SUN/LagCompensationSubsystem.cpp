@@ -0,0 +1,282 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LagCompensationSubsystem.h"
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "Components/PrimitiveComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerState.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Lag comp tracked actors"), STAT_SUN_LagCompTracked, STATGROUP_SUN);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Lag comp bytes per actor"), STAT_SUN_LagCompBytesPerActor, STATGROUP_SUN);
+DECLARE_MEMORY_STAT(TEXT("Lag comp history"), STAT_SUN_LagCompMemory, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Lag comp rewound candidates"), STAT_SUN_LagCompCandidates, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Lag comp world traces"), STAT_SUN_LagCompWorldTraces, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Lag comp record"), STAT_SUN_LagCompRecord, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Lag comp rewind and trace"), STAT_SUN_LagCompRewind, STATGROUP_SUN);
+
+static TAutoConsoleVariable<int32> CVarLagCompEnable(
+	TEXT("sun.LagComp.Enable"),
+	1,
+	TEXT("0: shots are traced against the present\n")
+	TEXT("1: servers record history and rewind shots from remote players\n")
+	TEXT("2: always record, for profiling in standalone"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLagCompHistoryFrames(
+	TEXT("sun.LagComp.HistoryFrames"),
+	64,
+	TEXT("Frames of collision history kept per tracked actor. Read when the world starts"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarLagCompMaxRewind(
+	TEXT("sun.LagComp.MaxRewind"),
+	0.25f,
+	TEXT("Longest a shot is rewound, in seconds, however high the shooter's ping"),
+	ECVF_Default);
+
+//Passes through tracked actors in their current pose before giving up on the present
+static const int32 MaxWorldPasses = 4;
+
+ULagCompensationSubsystem::ULagCompensationSubsystem()
+{
+	//Movement and physics have settled for the frame, hitscan resolves after this in TG_PostUpdateWork
+	TickGroup = TG_PostPhysics;
+}
+
+void ULagCompensationSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	HistoryFrames = FMath::Max(CVarLagCompHistoryFrames.GetValueOnGameThread(), 2);
+	FrameTimes.SetNumZeroed(HistoryFrames);
+	SET_DWORD_STAT(STAT_SUN_LagCompBytesPerActor, GetBytesPerTrackedActor());
+}
+
+void ULagCompensationSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_SUN_LagCompTracked, Slots.Num());
+	Slots.Empty();
+	Tracked.Empty();
+	FreeSlots.Empty();
+	Samples.Empty();
+	SET_MEMORY_STAT(STAT_SUN_LagCompMemory, 0);
+
+	Super::Deinitialize();
+}
+
+bool ULagCompensationSubsystem::IsRecording() const
+{
+	const int32 Mode = CVarLagCompEnable.GetValueOnGameThread();
+	const ENetMode NetMode = GetWorld()->GetNetMode();
+	return Mode == 2 || (Mode == 1 && (NetMode == NM_DedicatedServer || NetMode == NM_ListenServer));
+}
+
+int32 ULagCompensationSubsystem::GetBytesPerTrackedActor() const
+{
+	return HistoryFrames * sizeof(FLagSample) + sizeof(FTrackedActor);
+}
+
+void ULagCompensationSubsystem::Track(AActor* Actor)
+{
+	UPrimitiveComponent* Collision = Actor ? Cast<UPrimitiveComponent>(Actor->GetRootComponent()) : nullptr;
+	if(!Collision || Slots.Contains(Actor))
+	{
+		return;
+	}
+
+	int32 Slot;
+	if(FreeSlots.Num() > 0)
+	{
+		Slot = FreeSlots.Pop(false);
+	}
+	else
+	{
+		Slot = Tracked.AddDefaulted();
+		Samples.AddUninitialized(HistoryFrames);
+		SET_MEMORY_STAT(STAT_SUN_LagCompMemory, Samples.GetAllocatedSize() + Tracked.GetAllocatedSize() + FrameTimes.GetAllocatedSize());
+	}
+
+	Tracked[Slot].Collision = Collision;
+	Tracked[Slot].BoundsRadius = Collision->Bounds.SphereRadius;
+	Slots.Add(Actor, Slot);
+	INC_DWORD_STAT(STAT_SUN_LagCompTracked);
+
+	//No history yet, it has been standing where it is now for as long as anyone can ask
+	const FLagSample Current = { Collision->GetComponentQuat(), Collision->GetComponentLocation() };
+	for(int32 Frame = 0; Frame < HistoryFrames; Frame++)
+	{
+		Samples[Slot * HistoryFrames + Frame] = Current;
+	}
+}
+
+void ULagCompensationSubsystem::Untrack(AActor* Actor)
+{
+	int32 Slot;
+	if(Slots.RemoveAndCopyValue(Actor, Slot))
+	{
+		Tracked[Slot].Collision = nullptr;
+		FreeSlots.Add(Slot);
+		DEC_DWORD_STAT(STAT_SUN_LagCompTracked);
+	}
+}
+
+void ULagCompensationSubsystem::Tick(float DeltaTime)
+{
+	if(!IsRecording() || Slots.Num() == 0)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_SUN_LagCompRecord);
+
+	Head = (Head + 1) % HistoryFrames;
+	NumRecorded = FMath::Min(NumRecorded + 1, HistoryFrames);
+	FrameTimes[Head] = GetWorld()->GetTimeSeconds();
+
+	for(int32 Slot = 0; Slot < Tracked.Num(); Slot++)
+	{
+		if(const UPrimitiveComponent* Collision = Tracked[Slot].Collision.Get())
+		{
+			FLagSample& Sample = Samples[Slot * HistoryFrames + Head];
+			Sample.Rotation = Collision->GetComponentQuat();
+			Sample.Location = Collision->GetComponentLocation();
+		}
+	}
+}
+
+float ULagCompensationSubsystem::GetShotTime(const APawn* Shooter) const
+{
+	if(!Shooter || !Shooter->HasAuthority() || Shooter->IsLocallyControlled() || !IsRecording())
+	{
+		return -1.f;
+	}
+
+	const APlayerState* PlayerState = Shooter->GetPlayerState();
+	if(!PlayerState)
+	{
+		return -1.f;
+	}
+
+	//ExactPing is the round trip in milliseconds, the shot left the client half of that ago
+	const float Latency = FMath::Min(PlayerState->ExactPing * 0.0005f, CVarLagCompMaxRewind.GetValueOnGameThread());
+	return GetWorld()->GetTimeSeconds() - Latency;
+}
+
+//Newest frame at or before Time blended with the one after it. Older than the history clamps to the oldest frame
+bool ULagCompensationSubsystem::GetSample(int32 Slot, float Time, FTransform& OutTransform) const
+{
+	if(NumRecorded == 0)
+	{
+		return false;
+	}
+
+	const FLagSample* ActorSamples = &Samples[Slot * HistoryFrames];
+	int32 Newer = Head;
+	for(int32 Age = 0; Age < NumRecorded; Age++)
+	{
+		const int32 Frame = (Head - Age + HistoryFrames) % HistoryFrames;
+		if(FrameTimes[Frame] <= Time || Age == NumRecorded - 1)
+		{
+			const FLagSample& Before = ActorSamples[Frame];
+			if(Age == 0 || FrameTimes[Frame] >= Time)
+			{
+				OutTransform = FTransform(Before.Rotation, Before.Location);
+				return true;
+			}
+
+			const FLagSample& After = ActorSamples[Newer];
+			const float Alpha = (Time - FrameTimes[Frame]) / FMath::Max(FrameTimes[Newer] - FrameTimes[Frame], KINDA_SMALL_NUMBER);
+			OutTransform = FTransform(FQuat::Slerp(Before.Rotation, After.Rotation, Alpha), FMath::Lerp(Before.Location, After.Location, Alpha));
+			return true;
+		}
+		Newer = Frame;
+	}
+	return false;
+}
+
+void ULagCompensationSubsystem::ResolveShot(const FVector& Start, const FVector& End, ECollisionChannel Channel, const FCollisionQueryParams& Params, float ShotTime, FHitResult& InOutHit) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_SUN_LagCompRewind);
+
+	//What the shot hits in the present once tracked actors are out of the way
+	FHitResult Best = InOutHit;
+	if(Best.bBlockingHit && IsTracked(Best.GetActor()))
+	{
+		FCollisionQueryParams WorldParams = Params;
+		for(int32 Pass = 0; Pass < MaxWorldPasses && Best.bBlockingHit && IsTracked(Best.GetActor()); Pass++)
+		{
+			WorldParams.AddIgnoredActor(Best.GetActor());
+			SUN_INC_COUNTER(STAT_SUN_LagCompWorldTraces, Traces, 1);
+			GetWorld()->LineTraceSingleByChannel(Best, Start, End, Channel, WorldParams);
+		}
+		if(Best.bBlockingHit && IsTracked(Best.GetActor()))
+		{
+			Best.Init(Start, End);
+		}
+	}
+
+	//Only actors whose rewound bounds touch the ray are traced
+	int32 NumCandidates = 0;
+	FHitResult Hit;
+	for(int32 Slot = 0; Slot < Tracked.Num(); Slot++)
+	{
+		const UPrimitiveComponent* Collision = Tracked[Slot].Collision.Get();
+		if(!Collision || Params.GetIgnoredActors().Contains(Collision->GetOwner()->GetUniqueID()))
+		{
+			continue;
+		}
+
+		FTransform Then;
+		if(!GetSample(Slot, ShotTime, Then) || FMath::PointDistToSegment(Then.GetLocation(), Start, End) > Tracked[Slot].BoundsRadius)
+		{
+			continue;
+		}
+
+		NumCandidates++;
+		if(TraceRewound(Slot, Then, Start, End, Channel, Params, Hit) && (!Best.bBlockingHit || Hit.Distance < Best.Distance))
+		{
+			Best = Hit;
+		}
+	}
+
+	INC_DWORD_STAT_BY(STAT_SUN_LagCompCandidates, NumCandidates);
+	InOutHit = Best;
+}
+
+//The actor moved rigidly from Then to Now, so moving the ray by the same amount and tracing the current collision
+//gives the hit against the old pose without touching the actor. The hit is moved back to where it was Then.
+//LineTraceComponent ignores responses, so collision the present-time trace on Channel passes through is skipped here
+bool ULagCompensationSubsystem::TraceRewound(int32 Slot, const FTransform& Then, const FVector& Start, const FVector& End, ECollisionChannel Channel, const FCollisionQueryParams& Params, FHitResult& OutHit) const
+{
+	UPrimitiveComponent* Collision = Tracked[Slot].Collision.Get();
+	if(!Collision || Collision->GetCollisionResponseToChannel(Channel) != ECR_Block)
+	{
+		return false;
+	}
+
+	const FTransform Now(Collision->GetComponentQuat(), Collision->GetComponentLocation());
+	const FVector NowStart = Now.TransformPosition(Then.InverseTransformPosition(Start));
+	const FVector NowEnd = Now.TransformPosition(Then.InverseTransformPosition(End));
+	if(!Collision->LineTraceComponent(OutHit, NowStart, NowEnd, Params))
+	{
+		return false;
+	}
+
+	OutHit.bBlockingHit = true;
+	OutHit.TraceStart = Start;
+	OutHit.TraceEnd = End;
+	OutHit.Location = Then.TransformPosition(Now.InverseTransformPosition(OutHit.Location));
+	OutHit.ImpactPoint = Then.TransformPosition(Now.InverseTransformPosition(OutHit.ImpactPoint));
+	OutHit.Normal = Then.TransformVectorNoScale(Now.InverseTransformVectorNoScale(OutHit.Normal));
+	OutHit.ImpactNormal = Then.TransformVectorNoScale(Now.InverseTransformVectorNoScale(OutHit.ImpactNormal));
+	return true;
+}
+
+bool ULagCompensationSubsystem::IsTracked(const AActor* Actor) const
+{
+	return Actor && Slots.Contains(Actor);
+}
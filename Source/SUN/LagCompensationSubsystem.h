@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CollisionQueryParams.h"
+#include "Engine/EngineTypes.h"
+#include "SUNWorldSubsystem.h"
+#include "LagCompensationSubsystem.generated.h"
+
+class APawn;
+class UPrimitiveComponent;
+
+//Server side rewind for hitscan. Every frame the root collision transform of each tracked actor (everything with a
+//UHealthComponent) is written into a fixed ring of HistoryFrames samples, one contiguous block per actor, so recording
+//never allocates. A shot fired at time T is checked against the actors whose rewound bounds are near the ray: the ray is
+//moved into each candidate's current collision by the difference between its pose at T and now and traced there
+UCLASS()
+class SUN_API ULagCompensationSubsystem : public USUNWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	ULagCompensationSubsystem();
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+
+	void Track(AActor* Actor);
+	void Untrack(AActor* Actor);
+
+	//World time the shooter was seeing when it fired, or -1 when there is nothing to compensate (local or not a server)
+	float GetShotTime(const APawn* Shooter) const;
+
+	//Replaces InOutHit with what the shot hit at ShotTime. Current poses of tracked actors are traced through and the
+	//first of the remaining world hit and the rewound tracked actor hits wins
+	void ResolveShot(const FVector& Start, const FVector& End, ECollisionChannel Channel, const FCollisionQueryParams& Params, float ShotTime, FHitResult& InOutHit) const;
+
+	bool IsRecording() const;
+	int32 GetBytesPerTrackedActor() const;
+
+private:
+	struct FLagSample
+	{
+		FQuat Rotation;
+		FVector Location;
+	};
+
+	struct FTrackedActor
+	{
+		TWeakObjectPtr<UPrimitiveComponent> Collision;
+		float BoundsRadius;
+	};
+
+	bool GetSample(int32 Slot, float Time, FTransform& OutTransform) const;
+	bool TraceRewound(int32 Slot, const FTransform& Then, const FVector& Start, const FVector& End, ECollisionChannel Channel, const FCollisionQueryParams& Params, FHitResult& OutHit) const;
+	bool IsTracked(const AActor* Actor) const;
+
+	int32 HistoryFrames = 0;
+	int32 Head = INDEX_NONE;
+	int32 NumRecorded = 0;
+
+	//FrameTimes[Frame] is shared by all actors, Samples[Slot * HistoryFrames + Frame] is one actor's pose in that frame
+	TArray<float> FrameTimes;
+	TArray<FLagSample> Samples;
+	TArray<FTrackedActor> Tracked;
+	TArray<int32> FreeSlots;
+	TMap<const AActor*, int32> Slots;
+};
@@ -0,0 +1,105 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LedgeGraphAsset.h"
+#include "Algo/BinarySearch.h"
+#include "Misc/PackageName.h"
+
+//Mirrors the map's folders so maps with the same name don't share a graph, the graph of /Game/Maps/Arena is
+//Parkour/LedgeGraphs/Maps/Arena_Ledges. Maps from other mount points keep their root as the first folder
+FString ULedgeGraphAsset::GetGraphPackageName(const FString& MapPackageName)
+{
+	FString RelativePath = MapPackageName;
+	RelativePath.RemoveFromStart(TEXT("/"));
+	RelativePath.RemoveFromStart(TEXT("Game/"));
+	return FString::Printf(TEXT("/Game/Parkour/LedgeGraphs/%s_Ledges"), *RelativePath);
+}
+
+void ULedgeGraphAsset::Build(const TArray<FLedgeNode>& InNodes, const TArray<TArray<int32>>& InAdjacency, float InCellSize)
+{
+	check(InNodes.Num() == InAdjacency.Num());
+	CellSize = InCellSize;
+
+	TArray<TPair<int64, int32>> Order;
+	Order.Reserve(InNodes.Num());
+	for(int32 Index = 0; Index < InNodes.Num(); Index++)
+	{
+		Order.Emplace(MakeCellKey(GetCell(InNodes[Index].Position)), Index);
+	}
+	Order.Sort([](const TPair<int64, int32>& A, const TPair<int64, int32>& B) { return A.Key < B.Key || (A.Key == B.Key && A.Value < B.Value); });
+
+	TArray<int32> Remap;
+	Remap.SetNumUninitialized(InNodes.Num());
+	for(int32 Sorted = 0; Sorted < Order.Num(); Sorted++)
+	{
+		Remap[Order[Sorted].Value] = Sorted;
+	}
+
+	Nodes.Reset(InNodes.Num());
+	Edges.Reset();
+	CellKeys.Reset();
+	CellStarts.Reset();
+	for(int32 Sorted = 0; Sorted < Order.Num(); Sorted++)
+	{
+		const int32 Original = Order[Sorted].Value;
+		if(CellKeys.Num() == 0 || CellKeys.Last() != Order[Sorted].Key)
+		{
+			CellKeys.Add(Order[Sorted].Key);
+			CellStarts.Add(Sorted);
+		}
+
+		FLedgeNode& Node = Nodes.Add_GetRef(InNodes[Original]);
+		Node.FirstEdge = Edges.Num();
+		Node.NumEdges = InAdjacency[Original].Num();
+		for(const int32 Neighbour : InAdjacency[Original])
+		{
+			Edges.Add(Remap[Neighbour]);
+		}
+	}
+	CellStarts.Add(Nodes.Num());
+}
+
+int32 ULedgeGraphAsset::FindNearestNode(const FVector& Location, float MaxDistance, TFunctionRef<bool(const FLedgeNode&)> Filter) const
+{
+	const FIntVector CellMin = GetCell(Location - FVector(MaxDistance));
+	const FIntVector CellMax = GetCell(Location + FVector(MaxDistance));
+
+	float BestDistSq = MaxDistance * MaxDistance;
+	int32 Best = INDEX_NONE;
+	for(int32 X = CellMin.X; X <= CellMax.X; X++)
+	{
+		for(int32 Y = CellMin.Y; Y <= CellMax.Y; Y++)
+		{
+			for(int32 Z = CellMin.Z; Z <= CellMax.Z; Z++)
+			{
+				const int32 Cell = Algo::BinarySearch(CellKeys, MakeCellKey(FIntVector(X, Y, Z)));
+				if(Cell == INDEX_NONE)
+				{
+					continue;
+				}
+				for(int32 Index = CellStarts[Cell]; Index < CellStarts[Cell + 1]; Index++)
+				{
+					const float DistSq = FVector::DistSquared(Nodes[Index].Position, Location);
+					if(DistSq <= BestDistSq && Filter(Nodes[Index]))
+					{
+						BestDistSq = DistSq;
+						Best = Index;
+					}
+				}
+			}
+		}
+	}
+	return Best;
+}
+
+FIntVector ULedgeGraphAsset::GetCell(const FVector& Location) const
+{
+	return FIntVector(FMath::FloorToInt(Location.X / CellSize), FMath::FloorToInt(Location.Y / CellSize), FMath::FloorToInt(Location.Z / CellSize));
+}
+
+//21 bits per axis is plenty for any level at the cell sizes used here
+int64 ULedgeGraphAsset::MakeCellKey(const FIntVector& Cell)
+{
+	const int64 Mask = (1 << 21) - 1;
+	return ((int64(Cell.X) & Mask) << 42) | ((int64(Cell.Y) & Mask) << 21) | (int64(Cell.Z) & Mask);
+}
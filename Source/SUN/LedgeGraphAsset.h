@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "LedgeGraphAsset.generated.h"
+
+USTRUCT()
+struct FLedgeNode
+{
+	GENERATED_BODY()
+
+	//Point on the top edge
+	UPROPERTY()
+	FVector Position;
+
+	//Horizontal, pointing away from the wall below the ledge
+	UPROPERTY()
+	FVector Normal;
+
+	//Height of the wall face below the ledge
+	UPROPERTY()
+	float Height;
+
+	//Range in ULedgeGraphAsset::Edges
+	UPROPERTY()
+	int32 FirstEdge;
+
+	UPROPERTY()
+	int32 NumEdges;
+};
+
+//Ledges and edges of one level, baked offline by UBakeLedgeGraphCommandlet. Nodes are sorted by grid cell so
+//a query only looks at the few cells around it
+UCLASS()
+class SUN_API ULedgeGraphAsset : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	//Long package name of the graph baked for a map package, under /Game/Parkour/LedgeGraphs which is always cooked
+	static FString GetGraphPackageName(const FString& MapPackageName);
+
+	//Packs nodes and adjacency lists, sorting them into the spatial index
+	void Build(const TArray<FLedgeNode>& InNodes, const TArray<TArray<int32>>& InAdjacency, float InCellSize);
+
+	//Closest node within MaxDistance that passes Filter, INDEX_NONE if there is none
+	int32 FindNearestNode(const FVector& Location, float MaxDistance, TFunctionRef<bool(const FLedgeNode&)> Filter) const;
+
+	const FLedgeNode& GetNode(int32 Index) const { return Nodes[Index]; }
+	int32 GetNumNodes() const { return Nodes.Num(); }
+	TArrayView<const int32> GetNeighbours(int32 Index) const { return TArrayView<const int32>(Edges.GetData() + Nodes[Index].FirstEdge, Nodes[Index].NumEdges); }
+
+private:
+	FIntVector GetCell(const FVector& Location) const;
+	static int64 MakeCellKey(const FIntVector& Cell);
+
+	UPROPERTY(VisibleAnywhere, Category = LedgeGraph)
+	float CellSize = 200.f;
+
+	UPROPERTY()
+	TArray<FLedgeNode> Nodes;
+
+	UPROPERTY()
+	TArray<int32> Edges;
+
+	//Sorted, CellStarts has one extra entry so cell i covers Nodes[CellStarts[i], CellStarts[i + 1])
+	UPROPERTY()
+	TArray<int64> CellKeys;
+
+	UPROPERTY()
+	TArray<int32> CellStarts;
+};
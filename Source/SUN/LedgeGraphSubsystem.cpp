@@ -0,0 +1,127 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LedgeGraphSubsystem.h"
+#include "LedgeGraphAsset.h"
+#include "Engine/Level.h"
+#include "Misc/PackageName.h"
+#include "UObject/UObjectHash.h"
+
+void ULedgeGraphSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	ActorsInitializedHandle = FWorldDelegates::OnWorldInitializedActors.AddUObject(this, &ULedgeGraphSubsystem::OnWorldInitializedActors);
+	LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &ULedgeGraphSubsystem::OnLevelAdded);
+	LevelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &ULedgeGraphSubsystem::OnLevelRemoved);
+}
+
+void ULedgeGraphSubsystem::Deinitialize()
+{
+	FWorldDelegates::OnWorldInitializedActors.Remove(ActorsInitializedHandle);
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedHandle);
+	Graphs.Empty();
+
+	Super::Deinitialize();
+}
+
+bool ULedgeGraphSubsystem::FindLedge(const FVector& Location, float MaxDistance, TFunctionRef<bool(const FVector& Position, const FVector& Normal)> Filter, FLedgeHit& OutHit) const
+{
+	float BestDistSq = MAX_flt;
+	for(const TPair<ULevel*, ULedgeGraphAsset*>& Entry : Graphs)
+	{
+		const ULedgeGraphAsset* Graph = Entry.Value;
+		const int32 Node = Graph->FindNearestNode(Location, MaxDistance, [&Filter](const FLedgeNode& Candidate) { return Filter(Candidate.Position, Candidate.Normal); });
+		if(Node == INDEX_NONE)
+		{
+			continue;
+		}
+
+		const FLedgeNode& Ledge = Graph->GetNode(Node);
+		const float DistSq = FVector::DistSquared(Ledge.Position, Location);
+		if(DistSq < BestDistSq)
+		{
+			BestDistSq = DistSq;
+			OutHit.Position = Ledge.Position;
+			OutHit.Normal = Ledge.Normal;
+			OutHit.Height = Ledge.Height;
+			OutHit.Node = Node;
+			OutHit.Graph = Graph;
+		}
+	}
+	return BestDistSq < MAX_flt;
+}
+
+//Graphs are optional, levels nobody has baked just have no ledges
+void ULedgeGraphSubsystem::RequestGraph(ULevel* Level)
+{
+	if(!Level || Graphs.Contains(Level))
+	{
+		return;
+	}
+
+	const FString MapPackageName = UWorld::RemovePIEPrefix(Level->GetOutermost()->GetName());
+	const FString GraphPackageName = ULedgeGraphAsset::GetGraphPackageName(MapPackageName);
+	if(!FPackageName::DoesPackageExist(GraphPackageName))
+	{
+		return;
+	}
+
+	LoadPackageAsync(GraphPackageName, FLoadPackageAsyncDelegate::CreateUObject(this, &ULedgeGraphSubsystem::OnGraphLoaded, TWeakObjectPtr<ULevel>(Level)));
+}
+
+void ULedgeGraphSubsystem::OnGraphLoaded(const FName& PackageName, UPackage* Package, EAsyncLoadingResult::Type Result, TWeakObjectPtr<ULevel> Level)
+{
+	//The level may have streamed out again while the graph was loading
+	if(Result != EAsyncLoadingResult::Succeeded || !Package || !Level.IsValid() || !Level->bIsVisible)
+	{
+		return;
+	}
+
+	ULedgeGraphAsset* Graph = nullptr;
+	ForEachObjectWithOuter(Package, [&Graph](UObject* Object)
+	{
+		if(!Graph)
+		{
+			Graph = Cast<ULedgeGraphAsset>(Object);
+		}
+	}, false);
+
+	if(Graph)
+	{
+		Graphs.Add(Level.Get(), Graph);
+	}
+}
+
+void ULedgeGraphSubsystem::OnWorldInitializedActors(const UWorld::FActorsInitializedParams& Params)
+{
+	if(Params.World == GetWorld() && Params.World->IsGameWorld())
+	{
+		RequestGraph(Params.World->PersistentLevel);
+	}
+}
+
+void ULedgeGraphSubsystem::OnLevelAdded(ULevel* Level, UWorld* World)
+{
+	if(World == GetWorld() && World->IsGameWorld())
+	{
+		RequestGraph(Level);
+	}
+}
+
+void ULedgeGraphSubsystem::OnLevelRemoved(ULevel* Level, UWorld* World)
+{
+	if(World != GetWorld())
+	{
+		return;
+	}
+	if(Level)
+	{
+		Graphs.Remove(Level);
+	}
+	else
+	{
+		Graphs.Empty();
+	}
+}
@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/World.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "UObject/Package.h"
+#include "LedgeGraphSubsystem.generated.h"
+
+class ULedgeGraphAsset;
+class ULevel;
+
+struct FLedgeHit
+{
+	FVector Position;
+	FVector Normal;
+	float Height;
+	int32 Node;
+	const ULedgeGraphAsset* Graph;
+};
+
+//Streams the baked ledge graph of every level in and out alongside the level, and answers ledge queries from them
+UCLASS()
+class SUN_API ULedgeGraphSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//Closest ledge within MaxDistance of Location that passes Filter
+	bool FindLedge(const FVector& Location, float MaxDistance, TFunctionRef<bool(const FVector& Position, const FVector& Normal)> Filter, FLedgeHit& OutHit) const;
+
+private:
+	void RequestGraph(ULevel* Level);
+	void OnGraphLoaded(const FName& PackageName, UPackage* Package, EAsyncLoadingResult::Type Result, TWeakObjectPtr<ULevel> Level);
+	void OnWorldInitializedActors(const UWorld::FActorsInitializedParams& Params);
+	void OnLevelAdded(ULevel* Level, UWorld* World);
+	void OnLevelRemoved(ULevel* Level, UWorld* World);
+
+	UPROPERTY(Transient)
+	TMap<ULevel*, ULedgeGraphAsset*> Graphs;
+
+	FDelegateHandle ActorsInitializedHandle;
+	FDelegateHandle LevelAddedHandle;
+	FDelegateHandle LevelRemovedHandle;
+};
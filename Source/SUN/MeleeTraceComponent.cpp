@@ -0,0 +1,189 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MeleeTraceComponent.h"
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "Components/SkinnedMeshComponent.h"
+#include "SUNDebugDraw.h"
+#include "SignificanceSubsystem.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "Kismet/GameplayStatics.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Melee sweeps"), STAT_SUN_MeleeSweeps, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Melee trace"), STAT_SUN_MeleeTrace, STATGROUP_SUN);
+
+// Sets default values for this component's properties
+UMeleeTraceComponent::UMeleeTraceComponent()
+{
+	//Only ticks during a swing, after animation and physics so the sockets are where they will be drawn
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+	PrimaryComponentTick.TickGroup = TG_PostPhysics;
+	QueryParams = FCollisionQueryParams(SCENE_QUERY_STAT(MeleeTrace), false);
+}
+
+void UMeleeTraceComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	EndSwing();
+	Super::EndPlay(EndPlayReason);
+}
+
+void UMeleeTraceComponent::SetBlade(USceneComponent* InBlade)
+{
+	Blade = InBlade;
+	QueryParams.ClearIgnoredActors();
+	QueryParams.AddIgnoredActor(GetOwner());
+}
+
+void UMeleeTraceComponent::BeginSwing(float Duration)
+{
+	if(!Blade)
+	{
+		return;
+	}
+
+	HitActors.Reset();
+	SwingTimeLeft = Duration;
+	if(bSwinging)
+	{
+		return;
+	}
+
+	bSwinging = true;
+	GetWorld()->GetSubsystem<USignificanceSubsystem>()->NotifyActivity(GetOwner());
+	AnimatedParent = Cast<USkinnedMeshComponent>(Blade->GetAttachParent());
+	if(AnimatedParent)
+	{
+		SavedAnimTickOption = AnimatedParent->VisibilityBasedAnimTickOption;
+		AnimatedParent->VisibilityBasedAnimTickOption = EVisibilityBasedAnimTickOption::AlwaysTickPoseAndRefreshBones;
+	}
+	PreviousSample = SampleBlade();
+	SetComponentTickEnabled(true);
+}
+
+void UMeleeTraceComponent::EndSwing()
+{
+	if(!bSwinging)
+	{
+		return;
+	}
+
+	bSwinging = false;
+	if(AnimatedParent)
+	{
+		AnimatedParent->VisibilityBasedAnimTickOption = SavedAnimTickOption;
+		AnimatedParent = nullptr;
+	}
+	HitActors.Reset();
+	SetComponentTickEnabled(false);
+}
+
+// Called every frame while swinging
+void UMeleeTraceComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	const FBladeSample Sample = SampleBlade();
+	SweepBetween(PreviousSample, Sample);
+	PreviousSample = Sample;
+
+	SwingTimeLeft -= DeltaTime;
+	if(SwingTimeLeft <= 0.f)
+	{
+		EndSwing();
+	}
+}
+
+UMeleeTraceComponent::FBladeSample UMeleeTraceComponent::SampleBlade() const
+{
+	const FVector Base = Blade->DoesSocketExist(BladeBaseSocket) ? Blade->GetSocketLocation(BladeBaseSocket) : Blade->GetComponentLocation();
+	const FVector Tip = Blade->DoesSocketExist(BladeTipSocket) ? Blade->GetSocketLocation(BladeTipSocket) : Base + Blade->GetForwardVector() * BladeLength;
+
+	FBladeSample Sample;
+	Sample.Owner = GetOwner()->GetActorTransform();
+	Sample.LocalBase = Sample.Owner.InverseTransformPosition(Base);
+	Sample.LocalTip = Sample.Owner.InverseTransformPosition(Tip);
+	return Sample;
+}
+
+//More sweeps the further the tip travelled, capped at MaxSweepsPerFrame
+void UMeleeTraceComponent::SweepBetween(const FBladeSample& From, const FBladeSample& To)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SUN_MeleeTrace);
+
+	const float TipTravel = FVector::Dist(From.Owner.TransformPosition(From.LocalTip), To.Owner.TransformPosition(To.LocalTip));
+	const int32 NumSweeps = FMath::Clamp(FMath::CeilToInt(TipTravel / TipDistancePerSweep), 1, MaxSweepsPerFrame);
+
+	FVector FromBase, FromTip;
+	GetPose(From, To, 0.f, FromBase, FromTip);
+	for(int32 Step = 1; Step <= NumSweeps; Step++)
+	{
+		FVector ToBase, ToTip;
+		GetPose(From, To, (float)Step / NumSweeps, ToBase, ToTip);
+		SweepPose(FromBase, FromTip, ToBase, ToTip);
+		FromBase = ToBase;
+		FromTip = ToTip;
+	}
+	SUN_INC_COUNTER(STAT_SUN_MeleeSweeps, Traces, NumSweeps);
+}
+
+//The blade direction is slerped in the owner's space so intermediate poses follow the swing arc
+void UMeleeTraceComponent::GetPose(const FBladeSample& From, const FBladeSample& To, float Alpha, FVector& OutBase, FVector& OutTip) const
+{
+	FTransform Owner;
+	Owner.Blend(From.Owner, To.Owner, Alpha);
+
+	const FVector FromBlade = From.LocalTip - From.LocalBase;
+	const FVector ToBlade = To.LocalTip - To.LocalBase;
+	const FQuat Swing = FQuat::Slerp(FQuat::Identity, FQuat::FindBetweenVectors(FromBlade, ToBlade), Alpha);
+	const FVector LocalBase = FMath::Lerp(From.LocalBase, To.LocalBase, Alpha);
+	const float Length = FMath::Lerp(FromBlade.Size(), ToBlade.Size(), Alpha);
+
+	OutBase = Owner.TransformPosition(LocalBase);
+	OutTip = Owner.TransformPosition(LocalBase + Swing.RotateVector(FromBlade.GetSafeNormal()) * Length);
+}
+
+//Capsule along the blade at its mid pose, moved from the centre of one pose to the next
+void UMeleeTraceComponent::SweepPose(const FVector& FromBase, const FVector& FromTip, const FVector& ToBase, const FVector& ToTip)
+{
+	const FVector MidBase = (FromBase + ToBase) * 0.5f;
+	const FVector MidTip = (FromTip + ToTip) * 0.5f;
+	const FVector Axis = MidTip - MidBase;
+	const float HalfHeight = Axis.Size() * 0.5f + BladeRadius;
+	const FQuat Rotation = FRotationMatrix::MakeFromZ(Axis).ToQuat();
+	const FVector Start = (FromBase + FromTip) * 0.5f;
+	const FVector End = (ToBase + ToTip) * 0.5f;
+	const FCollisionShape Capsule = FCollisionShape::MakeCapsule(BladeRadius, HalfHeight);
+
+	//Every overlapped pawn or body along the way, not just the first blocking one
+	TArray<FHitResult> Hits;
+	const FCollisionObjectQueryParams ObjectParams(ECC_TO_BITFIELD(ECC_Pawn) | ECC_TO_BITFIELD(ECC_PhysicsBody) | ECC_TO_BITFIELD(ECC_WorldDynamic));
+	GetWorld()->SweepMultiByObjectType(Hits, Start, End, Rotation, ObjectParams, Capsule, QueryParams);
+
+	SUN_DRAW_CAPSULE(GetWorld(), Melee, End, HalfHeight, BladeRadius, Rotation, Hits.Num() > 0 ? FColor::Red : FColor::Green, 1.0f);
+
+	const FVector Direction = (End - Start).GetSafeNormal();
+	for(const FHitResult& Hit : Hits)
+	{
+		ApplyHit(Hit, Direction);
+	}
+}
+
+void UMeleeTraceComponent::ApplyHit(const FHitResult& Hit, const FVector& Direction)
+{
+	AActor* HitActor = Hit.GetActor();
+	if(!HitActor || HitActor->IsPendingKillPending())
+	{
+		return;
+	}
+
+	//Only the server's swing deals damage, a client's copy just shows it
+	bool bAlreadyHit = false;
+	HitActors.Add(HitActor, &bAlreadyHit);
+	if(!bAlreadyHit && GetOwner()->HasAuthority())
+	{
+		UGameplayStatics::ApplyPointDamage(HitActor, Damage, Direction, Hit, nullptr, GetOwner(), DamageType);
+	}
+}
@@ -0,0 +1,98 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "CollisionQueryParams.h"
+#include "MeleeTraceComponent.generated.h"
+
+class UDamageType;
+class USkinnedMeshComponent;
+enum class EVisibilityBasedAnimTickOption : uint8;
+
+//Hit detection for a blade swing. Every tick of the swing samples the blade base and tip sockets, and the motion since
+//the previous sample is split into up to MaxSweepsPerFrame interpolated poses (rotating around the owner, not cutting
+//across the arc) with a capsule swept from each pose to the next. Each actor is hit at most once per swing, so fast
+//swings are covered at low tick rates while the number of sweeps per frame stays bounded
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class SUN_API UMeleeTraceComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this component's properties
+	UMeleeTraceComponent();
+
+protected:
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+public:
+	// Called every frame while swinging
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	//Component carrying the blade sockets
+	void SetBlade(USceneComponent* InBlade);
+
+	//Start detecting hits for Duration seconds
+	void BeginSwing(float Duration);
+	void EndSwing();
+
+	bool IsSwinging() const { return bSwinging; }
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Melee)
+	FName BladeBaseSocket = TEXT("BladeBase");
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Melee)
+	FName BladeTipSocket = TEXT("BladeTip");
+
+	//Used from the blade origin along its X axis when the mesh has no tip socket
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Melee)
+	float BladeLength = 100.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Melee)
+	float BladeRadius = 8.f;
+
+	//Upper bound on sweeps per tick, however far the blade moved
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Melee, meta = (ClampMin = 1))
+	int32 MaxSweepsPerFrame = 8;
+
+	//Blade tip travel covered by one sweep before another one is added
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Melee, meta = (ClampMin = 1))
+	float TipDistancePerSweep = 30.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Melee)
+	float Damage = 40.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Melee)
+	TSubclassOf<UDamageType> DamageType;
+
+private:
+	//Blade pose relative to the owner plus the owner's transform at the time it was sampled
+	struct FBladeSample
+	{
+		FTransform Owner;
+		FVector LocalBase;
+		FVector LocalTip;
+	};
+
+	FBladeSample SampleBlade() const;
+	void SweepBetween(const FBladeSample& From, const FBladeSample& To);
+	void GetPose(const FBladeSample& From, const FBladeSample& To, float Alpha, FVector& OutBase, FVector& OutTip) const;
+	void SweepPose(const FVector& FromBase, const FVector& FromTip, const FVector& ToBase, const FVector& ToTip);
+	void ApplyHit(const FHitResult& Hit, const FVector& Direction);
+
+	UPROPERTY(Transient)
+	USceneComponent* Blade;
+
+	FBladeSample PreviousSample;
+	bool bSwinging = false;
+	float SwingTimeLeft = 0.f;
+	TSet<TWeakObjectPtr<AActor>> HitActors;
+	FCollisionQueryParams QueryParams;
+
+	//Animation on the blade's parent mesh has to keep updating on servers that never render it
+	UPROPERTY(Transient)
+	USkinnedMeshComponent* AnimatedParent;
+	EVisibilityBasedAnimTickOption SavedAnimTickOption;
+};
@@ -2,15 +2,28 @@
 
 
 #include "ParkourComponent.h"
+#include "SUN.h"
+#include "LedgeGraphSubsystem.h"
+#include "SUNCharacterMovementComponent.h"
+#include "WallRunTraceSubsystem.h"
+#include "SUNDebugDraw.h"
+#include "SUNPerf.h"
+#include "Components/CapsuleComponent.h"
+#include "GameFramework/Character.h"
+#include "Kismet/KismetMathLibrary.h"
+
+DECLARE_CYCLE_STAT(TEXT("Wall-run detection"), STAT_SUN_WallRunDetect, STATGROUP_SUN);
 
 // Sets default values for this component's properties
 UParkourComponent::UParkourComponent()
 {
-	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
-	// off to improve performance if you don't need them.
+	// Ticks to look for walls while falling, the wall run itself is simulated by the movement component
 	PrimaryComponentTick.bCanEverTick = true;
 
-	// ...
+	NearWall = false;
+	IsWallRunning = false;
+	WallRunDirection = FVector::ZeroVector;
+	WallRunSide = Left;
 }
 
 
@@ -19,16 +32,376 @@ void UParkourComponent::BeginPlay()
 {
 	Super::BeginPlay();
 
-	// ...
-	
+	CharacterOwner = Cast<ACharacter>(GetOwner());
+	Movement = CharacterOwner ? Cast<USUNCharacterMovementComponent>(CharacterOwner->GetCharacterMovement()) : nullptr;
+	if(Movement)
+	{
+		Movement->SetParkourComponent(this);
+	}
+	else
+	{
+		SetComponentTickEnabled(false);
+	}
+
+	//Simple collision, the same the surface cache is built from, so a wall is found the same way with and without it
+	WallDetectParams = FCollisionQueryParams(SCENE_QUERY_STAT(WallRunDetect), false, GetOwner());
+	WallStickParams = FCollisionQueryParams(SCENE_QUERY_STAT(WallTrace), false, GetOwner());
+}
+
+void UParkourComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if(UWallRunTraceSubsystem* WallTraces = GetWorld()->GetSubsystem<UWallRunTraceSubsystem>())
+	{
+		WallTraces->CancelWallTraces(GetOwner());
+	}
+	Super::EndPlay(EndPlayReason);
 }
 
 
 // Called every frame
 void UParkourComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
+	SUN_SCOPE_CYCLE_COUNTER(STAT_SUN_WallRunDetect, WallRunDetect);
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
-	// ...
+	//Wall running is its own movement mode, so this only runs while looking for a wall. Characters controlled
+	//from a client get their wall-run requests with the client's moves
+	if (!Movement->IsFalling() || IsWallRunning || !CharacterOwner->IsLocallyControlled())
+	{
+		NearWall = false;
+		return;
+	}
+
+	//Static walls come from the surface cache, physics is only asked about dynamic objects then
+	const bool bAsync = UWallRunTraceSubsystem::IsAsyncEnabled();
+	if(DetectWallCached(bAsync) != EWallCacheResult::Unknown)
+	{
+		return;
+	}
+
+	if(bAsync)
+	{
+		DetectWallAsync();
+	}
+	else
+	{
+		DetectWallSync();
+	}
+}
+
+//Same left then right order as the traces. The cache only knows static walls, so dynamic objects are probed too and
+//one in front of the cached wall wins. With bDeferDynamic those probes go through UWallRunTraceSubsystem: last frame's
+//are read and the next ones queued, so no trace blocks the tick. Unknown if either side needs a full trace
+EWallCacheResult UParkourComponent::DetectWallCached(bool bDeferDynamic)
+{
+	UWallSurfaceCache* Cache = GetWorld()->GetSubsystem<UWallSurfaceCache>();
+	UWallRunTraceSubsystem* WallTraces = bDeferDynamic ? GetWorld()->GetSubsystem<UWallRunTraceSubsystem>() : nullptr;
+	if(!Cache || !UWallSurfaceCache::IsEnabled() || (bDeferDynamic && !WallTraces))
+	{
+		return EWallCacheResult::Unknown;
+	}
+
+	const FVector Start = GetOwner()->GetActorLocation();
+	const FVector End = GetOwner()->GetActorRightVector() * PlayerToWallDistance;
+	FWallSurfaceHit Surfaces[2];
+	const EWallCacheResult Results[2] = {
+		Cache->Raycast(Start, Start + -End, ECC_WorldStatic, Surfaces[0]),
+		Cache->Raycast(Start, Start + End, ECC_WorldStatic, Surfaces[1])
+	};
+	if(Results[0] == EWallCacheResult::Unknown || Results[1] == EWallCacheResult::Unknown)
+	{
+		return EWallCacheResult::Unknown;
+	}
+
+	WallDetectParams.MobilityType = EQueryMobilityType::Dynamic;
+	FHitResult DynamicHit;
+	bool bDynamicLeft = false;
+	const bool bDynamicHit = bDeferDynamic && WallTraces->ConsumeWallTraces(GetOwner(), DynamicHit, bDynamicLeft);
+	if(bDeferDynamic)
+	{
+		WallTraces->RequestWallTraces(GetOwner(), Start, End, ECC_WorldStatic, WallDetectParams);
+	}
+
+	for(int32 SideIndex = 0; SideIndex < 2; SideIndex++)
+	{
+		const EWallRunSide Side = SideIndex == 0 ? Left : Right;
+		const bool bCachedHit = Results[SideIndex] == EWallCacheResult::Hit;
+		if(bDeferDynamic)
+		{
+			//Probed the full distance last frame, only counts if nearer than the cached wall
+			if(bDynamicHit && bDynamicLeft == (SideIndex == 0)
+				&& (!bCachedHit || FVector::DistSquared(Start, DynamicHit.ImpactPoint) < FVector::DistSquared(Start, Surfaces[SideIndex].Point)))
+			{
+				TryBeginWallRun(DynamicHit, Side);
+				return EWallCacheResult::Hit;
+			}
+		}
+		else
+		{
+			const FVector SideEnd = bCachedHit ? Surfaces[SideIndex].Point : Start + (SideIndex == 0 ? -End : End);
+			SUN_INC_COUNTER(STAT_SUN_WallRunTraces, Traces, 1);
+			if(GetWorld()->LineTraceSingleByChannel(DynamicHit, Start, SideEnd, ECC_WorldStatic, WallDetectParams))
+			{
+				TryBeginWallRun(DynamicHit, Side);
+				return EWallCacheResult::Hit;
+			}
+		}
+		if(bCachedHit)
+		{
+			TryBeginWallRun(*Cache, Surfaces[SideIndex], Side);
+			return EWallCacheResult::Hit;
+		}
+	}
+	NearWall = false;
+	return EWallCacheResult::Miss;
+}
+
+//Blocking probes, left first then right
+void UParkourComponent::DetectWallSync()
+{
+	const FVector Start = GetOwner()->GetActorLocation();
+	const FVector End = GetOwner()->GetActorRightVector() * PlayerToWallDistance;
+	FHitResult Hit;
+	WallDetectParams.MobilityType = EQueryMobilityType::Any;
+
+	SUN_INC_COUNTER(STAT_SUN_WallRunTraces, Traces, 1);
+	if (GetWorld()->LineTraceSingleByChannel(Hit, Start, Start + -End, ECC_WorldStatic, WallDetectParams))
+	{
+		TryBeginWallRun(Hit, Left);
+		return;
+	}
+	SUN_INC_COUNTER(STAT_SUN_WallRunTraces, Traces, 1);
+	if (GetWorld()->LineTraceSingleByChannel(Hit, Start, Start + End, ECC_WorldStatic, WallDetectParams))
+	{
+		TryBeginWallRun(Hit, Right);
+		return;
+	}
+	NearWall = false;
+}
+
+//Uses the probes queued last frame, then queues the next ones. Detection runs one frame behind
+void UParkourComponent::DetectWallAsync()
+{
+	UWallRunTraceSubsystem* WallTraces = GetWorld()->GetSubsystem<UWallRunTraceSubsystem>();
+	if(!WallTraces)
+	{
+		DetectWallSync();
+		return;
+	}
+
+	FHitResult Hit;
+	bool bLeftSide;
+	if(WallTraces->ConsumeWallTraces(GetOwner(), Hit, bLeftSide))
+	{
+		TryBeginWallRun(Hit, bLeftSide ? Left : Right);
+		if(IsWallRunning)
+		{
+			return;
+		}
+	}
+	else
+	{
+		NearWall = false;
+	}
+	WallDetectParams.MobilityType = EQueryMobilityType::Any;
+	WallTraces->RequestWallTraces(GetOwner(), GetOwner()->GetActorLocation(), GetOwner()->GetActorRightVector() * PlayerToWallDistance, ECC_WorldStatic, WallDetectParams);
 }
 
+void UParkourComponent::TryBeginWallRun(const FHitResult& Hit, EWallRunSide Side)
+{
+	NearWall = true;
+	if(!IsWallRunning && CanSurfaceBeRan(Hit.ImpactNormal))
+	{
+		if(!bBeginOnRunnableWall)
+		{
+			Movement->RequestWallRun();
+			return;
+		}
+		FindDirectionAndSide(Hit.ImpactNormal);
+		WallRunSide = Side;
+		BeginWallRun();
+	}
+}
+
+void UParkourComponent::TryBeginWallRun(const UWallSurfaceCache& Cache, const FWallSurfaceHit& Surface, EWallRunSide Side)
+{
+	NearWall = true;
+	//The cached flag was classified with the default walkable angle
+	const bool bRunnable = FMath::IsNearlyEqual(Cache.GetWalkableFloorZ(), Movement->GetWalkableFloorZ()) ? Surface.bRunnable : CanSurfaceBeRan(Surface.Normal);
+	if(!IsWallRunning && bRunnable)
+	{
+		if(!bBeginOnRunnableWall)
+		{
+			Movement->RequestWallRun();
+			return;
+		}
+		FindDirectionAndSide(Surface);
+		WallRunSide = Side;
+		BeginWallRun();
+	}
+}
+
+//Checks the wall is still there, so long as it is hitting a wall on the same side the player keeps wall running
+bool UParkourComponent::UpdateWallRun()
+{
+	FVector WallSide;
+	FHitResult Hit;
+	switch(WallRunSide)
+	{
+		case Left:
+			WallSide = FVector(0,0,-1);
+			break;
+		case Right:
+			WallSide = FVector(0,0,1);
+			break;
+	}
+
+	const FVector Start = GetOwner()->GetActorLocation();
+	const FVector ToWall = FVector::CrossProduct(WallRunDirection, WallSide) * WallStickDistance;
+	const EWallRunSide PrevSide = WallRunSide;
+
+	//Cached static walls first, physics for anything the cache can't answer and for dynamic objects in front of them
+	UWallSurfaceCache* Cache = GetWorld()->GetSubsystem<UWallSurfaceCache>();
+	FWallSurfaceHit Surface;
+	const EWallCacheResult CacheResult = (Cache && UWallSurfaceCache::IsEnabled()) ? Cache->Raycast(Start, Start + ToWall, ECC_Visibility, Surface) : EWallCacheResult::Unknown;
+	WallStickParams.MobilityType = CacheResult == EWallCacheResult::Unknown ? EQueryMobilityType::Any : EQueryMobilityType::Dynamic;
+	const FVector End = CacheResult == EWallCacheResult::Hit ? Surface.Point : Start + ToWall;
+	SUN_INC_COUNTER(STAT_SUN_WallRunTraces, Traces, 1);
+	if(GetWorld()->LineTraceSingleByChannel(Hit, Start, End, ECC_Visibility, WallStickParams))
+	{
+		FindDirectionAndSide(Hit.ImpactNormal);
+	}
+	else if(CacheResult == EWallCacheResult::Hit)
+	{
+		FindDirectionAndSide(Surface);
+	}
+	else
+	{
+		EndWallRun(FallOffWall);
+		return false;
+	}
+
+	SUN_DRAW_LINE(GetWorld(), WallRun, Start, Start + ToWall, FColor::Green, 0.1f);
+	if(PrevSide != WallRunSide)
+	{
+		EndWallRun(FallOffWall);
+		return false;
+	}
+	return true;
+}
+
+//Hand the character over to the wall-run movement mode, it ignores gravity and air control on its own
+void UParkourComponent::BeginWallRun()
+{
+	IsWallRunning = true;
+	Movement->SetMovementMode(MOVE_Custom, CMOVE_WallRun);
+}
+
+void UParkourComponent::BeginRequestedWallRun()
+{
+	if(IsWallRunning)
+	{
+		return;
+	}
+
+	//Blocking, the server and replays have to decide from this move's position
+	bBeginOnRunnableWall = true;
+	if(DetectWallCached(false) == EWallCacheResult::Unknown)
+	{
+		DetectWallSync();
+	}
+	bBeginOnRunnableWall = false;
+}
+
+void UParkourComponent::EndWallRun(EWallRunEndReason Reason)
+{
+	IsWallRunning = false;
+	if(Movement->IsWallRunning())
+	{
+		Movement->SetMovementMode(MOVE_Falling);
+	}
+}
+
+void UParkourComponent::OnWallRunModeExited()
+{
+	IsWallRunning = false;
+}
+
+//Finds the side of the player the wall is on and the direction the player will travel
+void UParkourComponent::FindDirectionAndSide(FVector WallNormal)
+{
+	const FVector ActorRightVector = GetOwner()->GetActorRightVector();
+	FVector2D WallNorm = FVector2D(WallNormal.X, WallNormal.Y);
+	FVector2D ActorRight = FVector2D(ActorRightVector.X, ActorRightVector.Y);
+	float DotProduct = FVector2D::DotProduct(WallNorm, ActorRight);
+	FVector Direction;
+	if(DotProduct > 0)
+	{
+		WallRunSide = Right;
+		Direction = FVector(0,0,1);
+		WallRunDirection = FVector::CrossProduct(WallNormal,Direction);
+	}
+	else
+	{
+		WallRunSide = Left;
+		Direction = FVector(0,0,-1);
+		WallRunDirection = FVector::CrossProduct(WallNormal,Direction);
+	}
+}
+
+//FindDirectionAndSide for a cached surface, the run direction is already worked out
+void UParkourComponent::FindDirectionAndSide(const FWallSurfaceHit& Surface)
+{
+	float DotProduct = FVector2D::DotProduct(FVector2D(Surface.Normal), FVector2D(GetOwner()->GetActorRightVector()));
+	if(DotProduct > 0)
+	{
+		WallRunSide = Right;
+		WallRunDirection = Surface.RunDirection;
+	}
+	else
+	{
+		WallRunSide = Left;
+		WallRunDirection = -Surface.RunDirection;
+	}
+}
+
+//Checks if the surface is wall runable (Not too flat or to steep)
+bool UParkourComponent::CanSurfaceBeRan(FVector SurfaceNormal) const
+{
+	if(SurfaceNormal.Z < -0.05)
+	{
+		return false;
+	}
+	else
+	{
+		FVector Surface = FVector (SurfaceNormal.X, SurfaceNormal.Y, 0);
+		if(UKismetMathLibrary::DegAcos(FVector::DotProduct(Surface.GetSafeNormal(), SurfaceNormal)) < Movement->GetWalkableFloorAngle())
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool UParkourComponent::FindLedge(float MaxDistance, FLedgeHit& OutLedge) const
+{
+	const ULedgeGraphSubsystem* LedgeGraphs = GetWorld()->GetSubsystem<ULedgeGraphSubsystem>();
+	if(!LedgeGraphs || !CharacterOwner)
+	{
+		return false;
+	}
+
+	const FVector Location = CharacterOwner->GetActorLocation();
+	const FVector Forward = CharacterOwner->GetActorForwardVector().GetSafeNormal2D();
+	const float HalfHeight = CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleHalfHeight();
+	const float MinZ = Location.Z - HalfHeight;
+	const float MaxZ = Location.Z + HalfHeight + LedgeReachHeight;
+
+	//In reach vertically, ahead of the character and facing it
+	return LedgeGraphs->FindLedge(Location, MaxDistance, [&](const FVector& Position, const FVector& Normal)
+	{
+		return Position.Z >= MinZ && Position.Z <= MaxZ
+			&& FVector::DotProduct(Position - Location, Forward) > 0.f
+			&& FVector::DotProduct(Normal, Forward) < -0.5f;
+	}, OutLedge);
+}
@@ -4,27 +4,109 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
+#include "CollisionQueryParams.h"
+#include "WallSurfaceCache.h"
 #include "ParkourComponent.generated.h"
 
+class ACharacter;
+class USUNCharacterMovementComponent;
+struct FLedgeHit;
 
+UENUM()
+enum EWallRunSide
+{
+	Left,
+	Right
+};
+
+UENUM()
+enum EWallRunEndReason
+{
+	FallOffWall,
+	JumpedOffWall
+};
+
+//Owns the wall-run rules: finding a runnable wall while falling, deciding which way to run and when the
+//wall is lost. The movement itself is the CMOVE_WallRun mode of USUNCharacterMovementComponent. Only the
+//controlling side looks for walls every frame, finding one requests the wall run from the next move
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class SUN_API UParkourComponent : public UActorComponent
 {
 	GENERATED_BODY()
 
-public:	
+public:
 	// Sets default values for this component's properties
 	UParkourComponent();
 
 protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
-public:	
+public:
 	// Called every frame
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
+	//How far to each side a wall is looked for while falling
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = WallRun)
+	float PlayerToWallDistance = 75;
+
+	//How far toward the wall it is checked for while running along it
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = WallRun)
+	float WallStickDistance = 100;
+
+	//How far above the top of the capsule a ledge can still be grabbed
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Ledge)
+	float LedgeReachHeight = 50;
+
+	//How far ahead a ledge is looked for when jumping in the air or off a wall, one in reach is mantled instead
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Ledge)
+	float MantleDistance = 100;
+
+	//Horizontal speed toward the ledge while mantling, enough to carry the capsule over the edge at the top of the arc
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Ledge)
+	float MantleSpeed = 300;
+
 	bool NearWall;
 	bool IsWallRunning;
-		
+	FVector WallRunDirection;
+	EWallRunSide WallRunSide;
+
+	void BeginWallRun();
+	//Called by the movement component inside the move that carries the wall-run request. Looks for the wall again
+	//with blocking probes, so the server and client replays decide from the position the move starts at
+	void BeginRequestedWallRun();
+	void EndWallRun(EWallRunEndReason Reason);
+
+	//Called by the movement component once per wall-run substep. Returns false once the wall is lost
+	bool UpdateWallRun();
+
+	//The movement component left wall running on its own (launch, landing, mode change)
+	void OnWallRunModeExited();
+
+	void FindDirectionAndSide(FVector WallNormal);
+	void FindDirectionAndSide(const FWallSurfaceHit& Surface);
+	bool CanSurfaceBeRan(FVector SurfaceNormal) const;
+
+	//Closest baked ledge in front of the owner within MaxDistance, between its feet and its reach. No traces involved
+	bool FindLedge(float MaxDistance, FLedgeHit& OutLedge) const;
+
+private:
+	EWallCacheResult DetectWallCached(bool bDeferDynamic);
+	void DetectWallSync();
+	void DetectWallAsync();
+	void TryBeginWallRun(const FHitResult& Hit, EWallRunSide Side);
+	void TryBeginWallRun(const UWallSurfaceCache& Cache, const FWallSurfaceHit& Surface, EWallRunSide Side);
+
+	UPROPERTY(Transient)
+	ACharacter* CharacterOwner;
+
+	UPROPERTY(Transient)
+	USUNCharacterMovementComponent* Movement;
+
+	FCollisionQueryParams WallDetectParams;
+	FCollisionQueryParams WallStickParams;
+
+	//Set while BeginRequestedWallRun probes, a runnable wall then starts the wall run instead of requesting it
+	bool bBeginOnRunnableWall = false;
 };
@@ -0,0 +1,169 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ProjectilePool.h"
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "SUNProjectile.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Projectiles acquired"), STAT_SUN_ProjectilesAcquired, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Projectiles spawned"), STAT_SUN_ProjectilesSpawned, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Projectiles released"), STAT_SUN_ProjectilesReleased, STATGROUP_SUN);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Projectiles parked"), STAT_SUN_ProjectilesParked, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Projectile acquire"), STAT_SUN_ProjectileAcquire, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Projectile release"), STAT_SUN_ProjectileRelease, STATGROUP_SUN);
+
+static TAutoConsoleVariable<int32> CVarProjectilePool(
+	TEXT("sun.Projectile.Pool"),
+	1,
+	TEXT("0: projectiles are spawned per shot and destroyed on hit or after their lifespan\n")
+	TEXT("1: projectiles are taken from and returned to UProjectilePool"),
+	ECVF_Default);
+
+UProjectilePool::UProjectilePool()
+{
+	TickGroup = TG_PostUpdateWork;
+}
+
+bool UProjectilePool::IsPoolingEnabled()
+{
+	return CVarProjectilePool.GetValueOnGameThread() != 0;
+}
+
+void UProjectilePool::Prewarm(TSubclassOf<ASUNProjectile> Class, int32 Count)
+{
+	if(!Class || !IsPoolingEnabled())
+	{
+		return;
+	}
+
+	TArray<ASUNProjectile*>& Free = Buckets.FindOrAdd(Class).Free;
+	while(Free.Num() < Count)
+	{
+		ASUNProjectile* Projectile = SpawnParked(Class);
+		if(!Projectile)
+		{
+			return;
+		}
+		Free.Add(Projectile);
+	}
+}
+
+ASUNProjectile* UProjectilePool::Acquire(TSubclassOf<ASUNProjectile> Class, const FVector& Location, const FRotator& Rotation, AActor* Owner, APawn* Instigator)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SUN_ProjectileAcquire);
+
+	if(!Class)
+	{
+		return nullptr;
+	}
+
+	UWorld* World = GetWorld();
+	if(!IsPoolingEnabled())
+	{
+		SUN_INC_COUNTER(STAT_SUN_ProjectilesSpawned, Spawns, 1);
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding;
+		SpawnParams.Owner = Owner;
+		SpawnParams.Instigator = Instigator;
+		return World->SpawnActor<ASUNProjectile>(Class, Location, Rotation, SpawnParams);
+	}
+
+	//Parked projectiles can be destroyed from outside (level teardown), those come back as null
+	ASUNProjectile* Projectile = nullptr;
+	TArray<ASUNProjectile*>& Free = Buckets.FindOrAdd(Class).Free;
+	while(!Projectile && Free.Num() > 0)
+	{
+		Projectile = Free.Pop(false);
+		DEC_DWORD_STAT(STAT_SUN_ProjectilesParked);
+	}
+	if(!Projectile)
+	{
+		Projectile = SpawnParked(Class);
+		if(!Projectile)
+		{
+			return nullptr;
+		}
+		DEC_DWORD_STAT(STAT_SUN_ProjectilesParked);
+	}
+
+	INC_DWORD_STAT(STAT_SUN_ProjectilesAcquired);
+	Projectile->SetOwner(Owner);
+	Projectile->SetInstigator(Instigator);
+	//A lifespan of 0 means none, like the actor's own InitialLifeSpan and UProjectileSimulator::Spawn
+	const float LifeSpan = Projectile->GetClass()->GetDefaultObject<ASUNProjectile>()->InitialLifeSpan;
+	Projectile->PoolExpireTime = LifeSpan > 0.f ? World->GetTimeSeconds() + LifeSpan : MAX_flt;
+	Projectile->Launch(Location, Rotation);
+	Active.Add(Projectile);
+	return Projectile;
+}
+
+void UProjectilePool::Release(ASUNProjectile* Projectile)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SUN_ProjectileRelease);
+
+	if(!Projectile || Projectile->IsPendingKillPending())
+	{
+		return;
+	}
+	if(!Projectile->bPooled)
+	{
+		SUN_INC_COUNTER(STAT_SUN_ActorDestroys, Destroys, 1);
+		Projectile->Destroy();
+		return;
+	}
+
+	//Released twice in one frame (hit and expiry) only parks once
+	if(Active.RemoveSingleSwap(Projectile, false) == 0)
+	{
+		return;
+	}
+
+	INC_DWORD_STAT(STAT_SUN_ProjectilesReleased);
+	Park(Projectile);
+	Buckets.FindOrAdd(Projectile->GetClass()).Free.Add(Projectile);
+}
+
+void UProjectilePool::Tick(float DeltaTime)
+{
+	const float Now = GetWorld()->GetTimeSeconds();
+	for(int32 Index = Active.Num() - 1; Index >= 0; Index--)
+	{
+		ASUNProjectile* Projectile = Active[Index];
+		if(!Projectile)
+		{
+			Active.RemoveAtSwap(Index, 1, false);
+		}
+		else if(Projectile->PoolExpireTime <= Now)
+		{
+			Release(Projectile);
+		}
+	}
+}
+
+ASUNProjectile* UProjectilePool::SpawnParked(UClass* Class)
+{
+	SUN_INC_COUNTER(STAT_SUN_ProjectilesSpawned, Spawns, 1);
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	ASUNProjectile* Projectile = GetWorld()->SpawnActor<ASUNProjectile>(Class, FVector::ZeroVector, FRotator::ZeroRotator, SpawnParams);
+	if(!Projectile)
+	{
+		return nullptr;
+	}
+
+	//The pool owns the lifetime from here on
+	Projectile->bPooled = true;
+	Projectile->SetLifeSpan(0.f);
+	Park(Projectile);
+	return Projectile;
+}
+
+void UProjectilePool::Park(ASUNProjectile* Projectile)
+{
+	INC_DWORD_STAT(STAT_SUN_ProjectilesParked);
+	Projectile->Park();
+}
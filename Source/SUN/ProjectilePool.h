@@ -0,0 +1,54 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SUNWorldSubsystem.h"
+#include "ProjectilePool.generated.h"
+
+class ASUNProjectile;
+
+USTRUCT()
+struct FProjectilePoolBucket
+{
+	GENERATED_BODY()
+
+	UPROPERTY(Transient)
+	TArray<ASUNProjectile*> Free;
+};
+
+//Keeps spawned projectiles around instead of destroying them. Acquire hands out a parked projectile of the
+//requested class (spawning one only when the class has run dry), Release parks it again: hidden, no collision
+//and movement deactivated. Lifetimes of handed out projectiles are expired here in one pass per frame
+UCLASS()
+class SUN_API UProjectilePool : public USUNWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	UProjectilePool();
+
+	//False when sun.Projectile.Pool is 0, projectiles are then spawned and destroyed per shot as before
+	static bool IsPoolingEnabled();
+
+	//Make sure at least Count projectiles of Class are parked and ready
+	void Prewarm(TSubclassOf<ASUNProjectile> Class, int32 Count);
+
+	//Launch a projectile of Class from Location along Rotation. Lives for the class default InitialLifeSpan
+	ASUNProjectile* Acquire(TSubclassOf<ASUNProjectile> Class, const FVector& Location, const FRotator& Rotation, AActor* Owner, APawn* Instigator);
+
+	//Park a projectile handed out by Acquire. Projectiles the pool does not own are destroyed
+	void Release(ASUNProjectile* Projectile);
+
+	virtual void Tick(float DeltaTime) override;
+
+private:
+	ASUNProjectile* SpawnParked(UClass* Class);
+	void Park(ASUNProjectile* Projectile);
+
+	UPROPERTY(Transient)
+	TMap<UClass*, FProjectilePoolBucket> Buckets;
+
+	UPROPERTY(Transient)
+	TArray<ASUNProjectile*> Active;
+};
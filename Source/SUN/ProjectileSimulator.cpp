@@ -0,0 +1,481 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ProjectileSimulator.h"
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "SUNCharacter.h"
+#include "SUNProjectile.h"
+#include "Async/ParallelFor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/SphereComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/ProjectileMovementComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "Kismet/GameplayStatics.h"
+#include "Math/VectorRegister.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogProjectileSimulator, Log, All);
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Simulated projectiles"), STAT_SUN_SimulatedProjectiles, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Simulated projectile sweeps"), STAT_SUN_SimulatedProjectileSweeps, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Simulated projectile hits"), STAT_SUN_SimulatedProjectileHits, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Projectile simulation"), STAT_SUN_ProjectileSimulation, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Projectile integrate"), STAT_SUN_ProjectileIntegrate, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Projectile resolve hits"), STAT_SUN_ProjectileResolveHits, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Projectile instances"), STAT_SUN_ProjectileInstances, STATGROUP_SUN);
+
+static TAutoConsoleVariable<int32> CVarProjectileSimulate(
+	TEXT("sun.Projectile.Simulate"),
+	0,
+	TEXT("0: fired projectiles are ASUNProjectile actors\n")
+	TEXT("1: fired projectiles are simulated without actors by UProjectileSimulator"),
+	ECVF_Default);
+
+static FAutoConsoleCommandWithWorldAndArgs ProjectileBenchmarkCommand(
+	TEXT("sun.Projectile.Benchmark"),
+	TEXT("sun.Projectile.Benchmark [Count] [ProjectileClassPath]: fires Count (10000) simulated projectiles from the first player and logs the cost"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&UProjectileSimulator::StartBenchmark));
+
+//Projectiles per ParallelFor task
+static const int32 ProjectileChunkSize = 256;
+
+FProjectileSimParams FProjectileSimParams::FromClass(TSubclassOf<ASUNProjectile> Class)
+{
+	const ASUNProjectile* Defaults = Class->GetDefaultObject<ASUNProjectile>();
+	const USphereComponent* Collision = Defaults->GetCollisionComp();
+	const UProjectileMovementComponent* Movement = Defaults->GetProjectileMovement();
+
+	FProjectileSimParams Params;
+	Params.Radius = Collision->GetScaledSphereRadius();
+	Params.InitialSpeed = Movement->InitialSpeed;
+	Params.MaxSpeed = Movement->MaxSpeed;
+	Params.GravityScale = Movement->ProjectileGravityScale;
+	Params.Bounciness = Movement->Bounciness;
+	Params.Friction = Movement->Friction;
+	Params.BounceStopSpeed = Movement->BounceVelocityStopSimulatingThreshold;
+	Params.LifeSpan = Defaults->InitialLifeSpan;
+	Params.Damage = Defaults->Damage;
+	Params.MaxBounces = Defaults->MaxSimulatedBounces;
+	Params.MaxIterations = FMath::Max(Movement->MaxSimulationIterations, 1);
+	Params.bShouldBounce = Movement->bShouldBounce;
+	Params.bBounceAngleAffectsFriction = Movement->bBounceAngleAffectsFriction;
+	Params.Channel = Collision->GetCollisionObjectType();
+	Params.ResponseParams = FCollisionResponseParams(Collision->GetCollisionResponseToChannels());
+	return Params;
+}
+
+void FProjectileBatch::RemoveAtSwap(int32 Index)
+{
+	Positions.RemoveAtSwap(Index, 1, false);
+	Velocities.RemoveAtSwap(Index, 1, false);
+	LifeRemaining.RemoveAtSwap(Index, 1, false);
+	Bounces.RemoveAtSwap(Index, 1, false);
+	Owners.RemoveAtSwap(Index, 1, false);
+}
+
+UProjectileSimulator::UProjectileSimulator()
+{
+	//Before physics so impulses from this frame's hits are part of this frame's simulation, same as the actors
+	TickGroup = TG_PrePhysics;
+	QueryParams = FCollisionQueryParams(SCENE_QUERY_STAT(ProjectileSimulator), false);
+}
+
+bool UProjectileSimulator::IsSimulationEnabled()
+{
+	return CVarProjectileSimulate.GetValueOnGameThread() != 0;
+}
+
+void UProjectileSimulator::Spawn(TSubclassOf<ASUNProjectile> Class, const FVector& Location, const FRotator& Rotation, AActor* Owner)
+{
+	if(!Class)
+	{
+		return;
+	}
+
+	FProjectileBatch& Batch = FindOrAddBatch(Class);
+	Batch.Positions.Add(Location);
+	Batch.Velocities.Add(Rotation.Vector() * Batch.Params.InitialSpeed);
+	Batch.LifeRemaining.Add(Batch.Params.LifeSpan > 0.f ? Batch.Params.LifeSpan : MAX_flt);
+	Batch.Bounces.Add(0);
+	Batch.Owners.Add(Owner);
+	INC_DWORD_STAT(STAT_SUN_SimulatedProjectiles);
+}
+
+int32 UProjectileSimulator::GetNumProjectiles() const
+{
+	int32 Num = 0;
+	for(const FProjectileBatch& Batch : Batches)
+	{
+		Num += Batch.Num();
+	}
+	return Num;
+}
+
+void UProjectileSimulator::Deinitialize()
+{
+	for(const FProjectileBatch& Batch : Batches)
+	{
+		DEC_DWORD_STAT_BY(STAT_SUN_SimulatedProjectiles, Batch.Num());
+	}
+	Batches.Empty();
+	BatchIndices.Empty();
+	Renderers.Empty();
+
+	Super::Deinitialize();
+}
+
+void UProjectileSimulator::Tick(float DeltaTime)
+{
+	SUN_SCOPE_CYCLE_COUNTER(STAT_SUN_ProjectileSimulation, ProjectileSim);
+	const double StartTime = FPlatformTime::Seconds();
+
+	for(FProjectileBatch& Batch : Batches)
+	{
+		if(Batch.Num() > 0)
+		{
+			const int32 NumHits = Integrate(Batch, DeltaTime);
+			ResolveHits(Batch, NumHits, DeltaTime);
+			RemoveExpired(Batch);
+		}
+		UpdateInstances(Batch);
+	}
+
+	if(bBenchmarkRunning)
+	{
+		const double Seconds = FPlatformTime::Seconds() - StartTime;
+		BenchmarkFrames++;
+		BenchmarkSeconds += Seconds;
+		BenchmarkPeakSeconds = FMath::Max(BenchmarkPeakSeconds, Seconds);
+		if(GetNumProjectiles() == 0)
+		{
+			bBenchmarkRunning = false;
+			UE_LOG(LogProjectileSimulator, Display, TEXT("Benchmark: %d projectiles over %d frames, simulation %.3f ms avg, %.3f ms peak"),
+				BenchmarkCount, BenchmarkFrames, BenchmarkSeconds * 1000.0 / FMath::Max(BenchmarkFrames, 1), BenchmarkPeakSeconds * 1000.0);
+		}
+	}
+}
+
+FProjectileBatch& UProjectileSimulator::FindOrAddBatch(TSubclassOf<ASUNProjectile> Class)
+{
+	if(const int32* Index = BatchIndices.Find(Class))
+	{
+		return Batches[*Index];
+	}
+
+	BatchIndices.Add(Class, Batches.Num());
+	FProjectileBatch& Batch = Batches.AddDefaulted_GetRef();
+	Batch.Params = FProjectileSimParams::FromClass(Class);
+	Batch.Shape = FCollisionShape::MakeSphere(Batch.Params.Radius);
+
+	//One instanced mesh per class, owned by a transient actor so it registers with the persistent level
+	const ASUNProjectile* Defaults = Class->GetDefaultObject<ASUNProjectile>();
+	UStaticMesh* Mesh = Defaults->SimulatedMesh;
+	FVector Scale = Defaults->SimulatedMeshScale;
+	if(!Mesh)
+	{
+		Mesh = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Sphere.Sphere"));
+		Scale = FVector(Batch.Params.Radius / 50.f);
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.ObjectFlags |= RF_Transient;
+	AActor* Renderer = GetWorld()->SpawnActor<AActor>(AActor::StaticClass(), FTransform::Identity, SpawnParams);
+	if(Renderer)
+	{
+		UInstancedStaticMeshComponent* Instances = NewObject<UInstancedStaticMeshComponent>(Renderer);
+		Instances->SetMobility(EComponentMobility::Movable);
+		Instances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		Instances->SetCastShadow(false);
+		Instances->SetStaticMesh(Mesh);
+		Instances->SetRelativeScale3D(Scale);
+		Renderer->SetRootComponent(Instances);
+		Instances->RegisterComponent();
+		Batch.Instances = Instances;
+		Renderers.Add(Renderer);
+	}
+	return Batch;
+}
+
+//Same step as UProjectileMovementComponent: move by V*t + g*t^2/2, then V += g*t clamped to MaxSpeed.
+//Every projectile is swept from its old to its new position, hits are only recorded here and handled afterwards
+int32 UProjectileSimulator::Integrate(FProjectileBatch& Batch, float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SUN_ProjectileIntegrate);
+
+	UWorld* World = GetWorld();
+	const FProjectileSimParams& Params = Batch.Params;
+	const int32 Num = Batch.Num();
+	if(Hits.Num() < Num)
+	{
+		Hits.SetNum(Num);
+	}
+
+	const VectorRegister Gravity = MakeVectorRegister(0.f, 0.f, World->GetGravityZ() * Params.GravityScale, 0.f);
+	const VectorRegister Step = VectorSetFloat1(DeltaTime);
+	const VectorRegister HalfStepSq = VectorSetFloat1(0.5f * DeltaTime * DeltaTime);
+	const VectorRegister MaxSpeed = VectorSetFloat1(Params.MaxSpeed);
+	const VectorRegister MaxSpeedSq = VectorSetFloat1(Params.MaxSpeed > 0.f ? FMath::Square(Params.MaxSpeed) : MAX_flt);
+
+	FThreadSafeCounter NumHits;
+	FThreadSafeCounter NumSweeps;
+	const int32 NumChunks = FMath::DivideAndRoundUp(Num, ProjectileChunkSize);
+	ParallelFor(NumChunks, [&](int32 Chunk)
+	{
+		const int32 First = Chunk * ProjectileChunkSize;
+		const int32 Last = FMath::Min(First + ProjectileChunkSize, Num);
+		FHitResult Hit;
+		int32 ChunkSweeps = 0;
+		//Per chunk, the shooter each projectile ignores changes from one sweep to the next
+		FCollisionQueryParams ChunkParams = QueryParams;
+		for(int32 Index = First; Index < Last; Index++)
+		{
+			Batch.LifeRemaining[Index] -= DeltaTime;
+
+			//Stopped after a bounce below BounceStopSpeed, sits there until its lifespan runs out
+			if(Batch.Velocities[Index].IsZero())
+			{
+				continue;
+			}
+
+			const VectorRegister Position = VectorLoadFloat3_W0(&Batch.Positions[Index]);
+			VectorRegister Velocity = VectorLoadFloat3_W0(&Batch.Velocities[Index]);
+			const VectorRegister Target = VectorAdd(Position, VectorMultiplyAdd(Velocity, Step, VectorMultiply(Gravity, HalfStepSq)));
+
+			Velocity = VectorMultiplyAdd(Gravity, Step, Velocity);
+			const VectorRegister SpeedSq = VectorDot3(Velocity, Velocity);
+			const VectorRegister Clamped = VectorMultiply(Velocity, VectorMultiply(MaxSpeed, VectorReciprocalSqrtAccurate(SpeedSq)));
+			Velocity = VectorSelect(VectorCompareGT(SpeedSq, MaxSpeedSq), Clamped, Velocity);
+			VectorStoreFloat3(Velocity, &Batch.Velocities[Index]);
+
+			FVector End;
+			VectorStoreFloat3(Target, &End);
+			ChunkSweeps++;
+			ChunkParams.ClearIgnoredActors();
+			ChunkParams.AddIgnoredActor(Batch.Owners[Index].Get());
+			if(World->SweepSingleByChannel(Hit, Batch.Positions[Index], End, FQuat::Identity, Params.Channel, Batch.Shape, ChunkParams, Params.ResponseParams))
+			{
+				FSimHit& SimHit = Hits[NumHits.Increment() - 1];
+				SimHit.Index = Index;
+				SimHit.Hit = Hit;
+			}
+			else
+			{
+				Batch.Positions[Index] = End;
+			}
+		}
+		NumSweeps.Add(ChunkSweeps);
+	});
+
+	SUN_INC_COUNTER(STAT_SUN_SimulatedProjectileSweeps, Traces, NumSweeps.GetValue());
+	INC_DWORD_STAT_BY(STAT_SUN_SimulatedProjectileHits, NumHits.GetValue());
+	return NumHits.GetValue();
+}
+
+//Hits were recorded in whatever order the workers finished, sort them so impulses are applied deterministically
+void UProjectileSimulator::ResolveHits(FProjectileBatch& Batch, int32 NumHits, float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SUN_ProjectileResolveHits);
+
+	Sort(Hits.GetData(), NumHits, [](const FSimHit& A, const FSimHit& B) { return A.Index < B.Index; });
+	for(int32 HitIndex = 0; HitIndex < NumHits; HitIndex++)
+	{
+		const FSimHit& SimHit = Hits[HitIndex];
+		ResolveHit(Batch, SimHit.Index, SimHit.Hit, DeltaTime * (1.f - SimHit.Hit.Time));
+	}
+}
+
+//ASUNProjectile::OnHit plus UProjectileMovementComponent's bounce: physics bodies get pushed and end the projectile,
+//anything else takes the projectile's damage on the server, credited to the shooter, and is bounced off, then the
+//rest of the frame is swept again, up to MaxSimulationIterations times
+void UProjectileSimulator::ResolveHit(FProjectileBatch& Batch, int32 Index, FHitResult Hit, float RemainingTime)
+{
+	const FProjectileSimParams& Params = Batch.Params;
+	FVector& Position = Batch.Positions[Index];
+	FVector& Velocity = Batch.Velocities[Index];
+	AActor* Owner = Batch.Owners[Index].Get();
+	const bool bDealsDamage = Params.Damage > 0.f && GetWorld()->GetNetMode() != NM_Client;
+
+	FCollisionQueryParams OwnerParams = QueryParams;
+	OwnerParams.AddIgnoredActor(Owner);
+
+	for(int32 Iteration = 0; Iteration < Params.MaxIterations; Iteration++)
+	{
+		Position = Hit.Location;
+
+		UPrimitiveComponent* HitComponent = Hit.GetComponent();
+		if(Hit.GetActor() && HitComponent && HitComponent->IsSimulatingPhysics())
+		{
+			HitComponent->AddImpulseAtLocation(Velocity * 100.0f, Position);
+			Batch.LifeRemaining[Index] = 0.f;
+			return;
+		}
+
+		if(bDealsDamage && Hit.GetActor())
+		{
+			const APawn* Shooter = Cast<APawn>(Owner);
+			UGameplayStatics::ApplyPointDamage(Hit.GetActor(), Params.Damage, Velocity.GetSafeNormal(), Hit, Shooter ? Shooter->GetController() : nullptr, Owner, nullptr);
+		}
+
+		if(!Params.bShouldBounce)
+		{
+			Velocity = FVector::ZeroVector;
+			return;
+		}
+
+		const float VDotNormal = Velocity | Hit.Normal;
+		if(VDotNormal <= 0.f)
+		{
+			const FVector ProjectedNormal = Hit.Normal * -VDotNormal;
+			Velocity += ProjectedNormal;
+			const float ScaledFriction = Params.bBounceAngleAffectsFriction ? FMath::Clamp(-VDotNormal / Velocity.Size(), 0.f, 1.f) * Params.Friction : Params.Friction;
+			Velocity *= FMath::Clamp(1.f - ScaledFriction, 0.f, 1.f);
+			Velocity += ProjectedNormal * FMath::Max(Params.Bounciness, 0.f);
+			if(Params.MaxSpeed > 0.f)
+			{
+				Velocity = Velocity.GetClampedToMaxSize(Params.MaxSpeed);
+			}
+		}
+
+		Batch.Bounces[Index]++;
+		if(Params.MaxBounces > 0 && Batch.Bounces[Index] >= Params.MaxBounces)
+		{
+			Batch.LifeRemaining[Index] = 0.f;
+			return;
+		}
+		if(Velocity.SizeSquared() < FMath::Square(Params.BounceStopSpeed))
+		{
+			Velocity = FVector::ZeroVector;
+			return;
+		}
+		if(RemainingTime <= KINDA_SMALL_NUMBER)
+		{
+			return;
+		}
+
+		const FVector End = Position + Velocity * RemainingTime;
+		SUN_INC_COUNTER(STAT_SUN_SimulatedProjectileSweeps, Traces, 1);
+		if(!GetWorld()->SweepSingleByChannel(Hit, Position, End, FQuat::Identity, Params.Channel, Batch.Shape, OwnerParams, Params.ResponseParams))
+		{
+			Position = End;
+			return;
+		}
+		RemainingTime *= 1.f - Hit.Time;
+	}
+}
+
+void UProjectileSimulator::RemoveExpired(FProjectileBatch& Batch)
+{
+	for(int32 Index = Batch.Num() - 1; Index >= 0; Index--)
+	{
+		if(Batch.LifeRemaining[Index] <= 0.f)
+		{
+			Batch.RemoveAtSwap(Index);
+			DEC_DWORD_STAT(STAT_SUN_SimulatedProjectiles);
+		}
+	}
+}
+
+//Instances are only ever added, spare ones are collapsed to zero scale until the batch empties out completely
+void UProjectileSimulator::UpdateInstances(FProjectileBatch& Batch)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SUN_ProjectileInstances);
+
+	UInstancedStaticMeshComponent* Instances = Batch.Instances.Get();
+	if(!Instances)
+	{
+		return;
+	}
+
+	const int32 Num = Batch.Num();
+	if(Num == 0)
+	{
+		if(Instances->GetInstanceCount() > 0)
+		{
+			Instances->ClearInstances();
+		}
+		return;
+	}
+
+	while(Instances->GetInstanceCount() < Num)
+	{
+		Instances->AddInstance(FTransform::Identity);
+	}
+
+	const int32 NumInstances = Instances->GetInstanceCount();
+	const FVector Scale = Instances->GetRelativeScale3D();
+	InstanceTransforms.SetNum(NumInstances, false);
+	ParallelFor(FMath::DivideAndRoundUp(NumInstances, ProjectileChunkSize), [&](int32 Chunk)
+	{
+		const int32 First = Chunk * ProjectileChunkSize;
+		const int32 Last = FMath::Min(First + ProjectileChunkSize, NumInstances);
+		for(int32 Index = First; Index < Last; Index++)
+		{
+			if(Index < Num)
+			{
+				//bRotationFollowsVelocity
+				const FVector& Velocity = Batch.Velocities[Index];
+				const FQuat Rotation = Velocity.IsZero() ? FQuat::Identity : Velocity.ToOrientationQuat();
+				InstanceTransforms[Index] = FTransform(Rotation, Batch.Positions[Index], Scale);
+			}
+			else
+			{
+				InstanceTransforms[Index] = FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector);
+			}
+		}
+	});
+
+	Instances->BatchUpdateInstancesTransforms(0, InstanceTransforms, true, true, true);
+}
+
+void UProjectileSimulator::StartBenchmark(const TArray<FString>& Args, UWorld* World)
+{
+	UProjectileSimulator* Simulator = World ? World->GetSubsystem<UProjectileSimulator>() : nullptr;
+	if(!Simulator || !World->IsGameWorld())
+	{
+		UE_LOG(LogProjectileSimulator, Warning, TEXT("sun.Projectile.Benchmark needs a running game world"));
+		return;
+	}
+
+	const int32 Count = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 10000;
+
+	//Fire from the first player like they had held the trigger down, with their projectile class if they have one
+	FVector Origin = FVector::ZeroVector;
+	FVector Forward = FVector::ForwardVector;
+	TSubclassOf<ASUNProjectile> Class = ASUNProjectile::StaticClass();
+	if(APlayerController* Player = World->GetFirstPlayerController())
+	{
+		FRotator ViewRotation;
+		Player->GetPlayerViewPoint(Origin, ViewRotation);
+		Forward = ViewRotation.Vector();
+		const ASUNCharacter* Character = Cast<ASUNCharacter>(Player->GetPawn());
+		if(Character && Character->ProjectileClass)
+		{
+			Class = Character->ProjectileClass;
+		}
+	}
+	if(Args.Num() > 1)
+	{
+		if(UClass* Override = LoadClass<ASUNProjectile>(nullptr, *Args[1]))
+		{
+			Class = Override;
+		}
+	}
+
+	//Fixed seed so runs are comparable
+	FRandomStream Random(1234);
+	for(int32 Index = 0; Index < Count; Index++)
+	{
+		const FVector Direction = Random.VRandCone(Forward, FMath::DegreesToRadians(30.f));
+		Simulator->Spawn(Class, Origin + Direction * 100.f, Direction.Rotation(), nullptr);
+	}
+
+	Simulator->bBenchmarkRunning = true;
+	Simulator->BenchmarkCount = Count;
+	Simulator->BenchmarkFrames = 0;
+	Simulator->BenchmarkSeconds = 0.0;
+	Simulator->BenchmarkPeakSeconds = 0.0;
+	UE_LOG(LogProjectileSimulator, Display, TEXT("Benchmark: fired %d %s"), Count, *Class->GetName());
+}
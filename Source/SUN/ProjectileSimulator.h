@@ -0,0 +1,109 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CollisionQueryParams.h"
+#include "CollisionShape.h"
+#include "Engine/EngineTypes.h"
+#include "SUNWorldSubsystem.h"
+#include "ProjectileSimulator.generated.h"
+
+class ASUNProjectile;
+class UInstancedStaticMeshComponent;
+
+//Movement and collision settings of one projectile class, read from its CollisionComp and ProjectileMovement defaults
+struct FProjectileSimParams
+{
+	float Radius;
+	float InitialSpeed;
+	float MaxSpeed;
+	float GravityScale;
+	float Bounciness;
+	float Friction;
+	float BounceStopSpeed;
+	float LifeSpan;
+	float Damage;
+	int32 MaxBounces;
+	int32 MaxIterations;
+	bool bShouldBounce;
+	bool bBounceAngleAffectsFriction;
+	ECollisionChannel Channel;
+	FCollisionResponseParams ResponseParams;
+
+	static FProjectileSimParams FromClass(TSubclassOf<ASUNProjectile> Class);
+};
+
+//Projectiles of one class, stored as parallel arrays so the integration pass walks them linearly
+struct FProjectileBatch
+{
+	FProjectileSimParams Params;
+	FCollisionShape Shape;
+	TWeakObjectPtr<UInstancedStaticMeshComponent> Instances;
+
+	TArray<FVector> Positions;
+	TArray<FVector> Velocities;
+	TArray<float> LifeRemaining;
+	TArray<uint16> Bounces;
+	TArray<TWeakObjectPtr<AActor>> Owners;
+
+	int32 Num() const { return Positions.Num(); }
+	void RemoveAtSwap(int32 Index);
+};
+
+//Actor-less projectiles. Same flight, bounce, impulse-on-physics-hit and lifespan rules as ASUNProjectile with its
+//UProjectileMovementComponent, but with no actor or components per projectile: state lives in FProjectileBatch,
+//integration and sweeps run in parallel chunks on worker threads, hits are resolved on the game thread afterwards
+//and each class is drawn with one instanced static mesh
+UCLASS()
+class SUN_API UProjectileSimulator : public USUNWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	UProjectileSimulator();
+
+	//True when sun.Projectile.Simulate is set, characters then fire through Spawn instead of UProjectilePool
+	static bool IsSimulationEnabled();
+
+	void Spawn(TSubclassOf<ASUNProjectile> Class, const FVector& Location, const FRotator& Rotation, AActor* Owner);
+
+	int32 GetNumProjectiles() const;
+
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+
+	//sun.Projectile.Benchmark [Count] fires Count projectiles at once and logs the simulation cost until the last one is gone
+	static void StartBenchmark(const TArray<FString>& Args, UWorld* World);
+
+private:
+	struct FSimHit
+	{
+		int32 Index;
+		FHitResult Hit;
+	};
+
+	FProjectileBatch& FindOrAddBatch(TSubclassOf<ASUNProjectile> Class);
+	int32 Integrate(FProjectileBatch& Batch, float DeltaTime);
+	void ResolveHits(FProjectileBatch& Batch, int32 NumHits, float DeltaTime);
+	void ResolveHit(FProjectileBatch& Batch, int32 Index, FHitResult Hit, float RemainingTime);
+	void RemoveExpired(FProjectileBatch& Batch);
+	void UpdateInstances(FProjectileBatch& Batch);
+
+	TArray<FProjectileBatch> Batches;
+	TMap<UClass*, int32> BatchIndices;
+
+	//Scratch reused every frame
+	TArray<FSimHit> Hits;
+	TArray<FTransform> InstanceTransforms;
+	FCollisionQueryParams QueryParams;
+
+	UPROPERTY(Transient)
+	TArray<AActor*> Renderers;
+
+	bool bBenchmarkRunning = false;
+	int32 BenchmarkCount = 0;
+	int32 BenchmarkFrames = 0;
+	double BenchmarkSeconds = 0.0;
+	double BenchmarkPeakSeconds = 0.0;
+};
@@ -3,5 +3,8 @@
 #include "SUN.h"
 #include "Modules/ModuleManager.h"
 
+DEFINE_STAT(STAT_SUN_WallRunTraces);
+DEFINE_STAT(STAT_SUN_ActorSpawns);
+DEFINE_STAT(STAT_SUN_ActorDestroys);
+
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, SUN, "SUN" );
- 
\ No newline at end of file
@@ -3,3 +3,10 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+DECLARE_STATS_GROUP(TEXT("SUN"), STATGROUP_SUN, STATCAT_Advanced);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Wall-run traces"), STAT_SUN_WallRunTraces, STATGROUP_SUN, SUN_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Gameplay actors spawned"), STAT_SUN_ActorSpawns, STATGROUP_SUN, SUN_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Gameplay actors destroyed"), STAT_SUN_ActorDestroys, STATGROUP_SUN, SUN_API);
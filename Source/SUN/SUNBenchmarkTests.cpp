@@ -0,0 +1,635 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "SUNCharacter.h"
+#include "SUNProjectile.h"
+#include "Enemy.h"
+#include "EnemyPool.h"
+#include "FireScheduler.h"
+#include "HordeSubsystem.h"
+#include "ProjectileSimulator.h"
+#include "Tests/AutomationCommon.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/GameModeBase.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+#include "Kismet/GameplayStatics.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogSUNBenchmark, Log, All);
+
+static TAutoConsoleVariable<FString> CVarBenchmarkMap(
+	TEXT("sun.Benchmark.Map"),
+	TEXT("/Game/FirstPersonCPP/Maps/FirstPersonExampleMap"),
+	TEXT("Map the SUN.Benchmark automation tests load before spawning their load"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarBenchmarkFrames(
+	TEXT("sun.Benchmark.Frames"),
+	600,
+	TEXT("Frames measured by each SUN.Benchmark test"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarBenchmarkWarmupFrames(
+	TEXT("sun.Benchmark.WarmupFrames"),
+	60,
+	TEXT("Frames run before measuring starts, so spawning and first use costs are not counted"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarBenchmarkTolerance(
+	TEXT("sun.Benchmark.Tolerance"),
+	0.15f,
+	TEXT("How much worse than the baseline a number may be before the test fails, 0.15 is 15%"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarBenchmarkUpdateBaseline(
+	TEXT("sun.Benchmark.UpdateBaseline"),
+	0,
+	TEXT("1 writes the results over the baseline instead of comparing against it"),
+	ECVF_Default);
+
+namespace SUNBenchmark
+{
+	enum class ELoad : uint8
+	{
+		WallRun,
+		Shooters,
+		Projectiles,
+		Damage,
+		Horde
+	};
+
+	struct FScenario
+	{
+		const TCHAR* Name;
+		ELoad Load;
+		int32 Count;
+	};
+
+	//Counts are part of the baseline, changing one needs a new baseline for that scenario
+	static const FScenario Scenarios[] =
+	{
+		{ TEXT("WallRun"), ELoad::WallRun, 64 },
+		{ TEXT("Shooters"), ELoad::Shooters, 32 },
+		{ TEXT("Projectiles"), ELoad::Projectiles, 5000 },
+		{ TEXT("Damage"), ELoad::Damage, 2000 },
+		{ TEXT("Horde"), ELoad::Horde, 20000 },
+	};
+
+	//High above the test map so the scripted load only collides with the arena built for it
+	static const FVector ArenaOrigin(0.f, 0.f, 50000.f);
+	static const float ArenaSize = 10000.f;
+	static const int32 NumWalls = 8;
+	static const float WallSpacing = 800.f;
+	static const FVector WallSize(3000.f, 40.f, 1000.f);
+	static const float RunnerHeight = 300.f;
+	static const float HordeRadius = 8000.f;
+	//Every enemy in the damage scenario dies in this many frames and comes back
+	static const float FramesToKill = 30.f;
+
+	//Numbers below these are noise, whatever the tolerance says
+	static const double MinRegressionMs = 0.05;
+	static const double MinRegressionMB = 16.0;
+
+	static const FScenario* FindScenario(const FString& Name)
+	{
+		for(const FScenario& Scenario : Scenarios)
+		{
+			if(Name == Scenario.Name)
+			{
+				return &Scenario;
+			}
+		}
+		return nullptr;
+	}
+
+	static UWorld* FindGameWorld()
+	{
+		for(const FWorldContext& Context : GEngine->GetWorldContexts())
+		{
+			if((Context.WorldType == EWorldType::Game || Context.WorldType == EWorldType::PIE) && Context.World())
+			{
+				return Context.World();
+			}
+		}
+		return nullptr;
+	}
+
+	static void SpawnBox(UWorld* World, const FVector& Center, const FVector& Size)
+	{
+		AStaticMeshActor* Box = World->SpawnActor<AStaticMeshActor>(Center, FRotator::ZeroRotator);
+		UStaticMeshComponent* Mesh = Box->GetStaticMeshComponent();
+		Mesh->SetMobility(EComponentMobility::Movable);
+		Mesh->SetStaticMesh(LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube")));
+		Box->SetActorScale3D(Size / 100.f);
+	}
+
+	static FVector GetFloorTop()
+	{
+		return ArenaOrigin + FVector(0.f, 0.f, 50.f);
+	}
+
+	static FVector GetWallCenter(int32 Wall)
+	{
+		return GetFloorTop() + FVector(0.f, (Wall - (NumWalls - 1) * 0.5f) * WallSpacing, WallSize.Z * 0.5f);
+	}
+
+	//Sorted ascending
+	static float Percentile(const TArray<float>& Sorted, float Fraction)
+	{
+		if(Sorted.Num() == 0)
+		{
+			return 0.f;
+		}
+		return Sorted[FMath::Clamp(FMath::CeilToInt(Fraction * Sorted.Num()) - 1, 0, Sorted.Num() - 1)];
+	}
+
+	static float Average(const TArray<float>& Values)
+	{
+		float Sum = 0.f;
+		for(const float Value : Values)
+		{
+			Sum += Value;
+		}
+		return Values.Num() > 0 ? Sum / Values.Num() : 0.f;
+	}
+
+	static void Flatten(const TSharedPtr<FJsonObject>& Object, const FString& Prefix, TMap<FString, double>& OutValues)
+	{
+		for(const TPair<FString, TSharedPtr<FJsonValue>>& Field : Object->Values)
+		{
+			const FString Name = Prefix.IsEmpty() ? Field.Key : Prefix + TEXT(".") + Field.Key;
+			if(Field.Value->Type == EJson::Number)
+			{
+				OutValues.Add(Name, Field.Value->AsNumber());
+			}
+			else if(Field.Value->Type == EJson::Object)
+			{
+				Flatten(Field.Value->AsObject(), Name, OutValues);
+			}
+		}
+	}
+}
+
+//Builds the scenario's load in the loaded map, drives it every frame and records timings. When done the results are
+//written to Saved/Benchmarks and compared against Benchmarks/Baseline in the project folder
+class FSUNBenchmarkCommand : public IAutomationLatentCommand
+{
+public:
+	FSUNBenchmarkCommand(FAutomationTestBase* InTest, const SUNBenchmark::FScenario& InScenario)
+		: Test(InTest)
+		, Scenario(InScenario)
+		, Random(1234)
+	{
+	}
+
+	virtual bool Update() override
+	{
+		UWorld* World = SUNBenchmark::FindGameWorld();
+		if(!World)
+		{
+			Test->AddError(TEXT("No game world, SUN.Benchmark runs in a game (-game -nullrhi), not in the editor"));
+			return true;
+		}
+
+		if(!bSetUp)
+		{
+			SetUp(World);
+			bSetUp = true;
+			return false;
+		}
+
+		Drive(World);
+		Record();
+		if(Frame < NumWarmupFrames + NumFrames)
+		{
+			return false;
+		}
+		Finish();
+		return true;
+	}
+
+private:
+	void SetUp(UWorld* World)
+	{
+		NumFrames = FMath::Max(CVarBenchmarkFrames.GetValueOnGameThread(), 1);
+		NumWarmupFrames = FMath::Max(CVarBenchmarkWarmupFrames.GetValueOnGameThread(), 0);
+
+		//Frame times are measured on the wall clock, smoothing would only measure the cap
+		bSavedSmoothFrameRate = GEngine->bSmoothFrameRate;
+		GEngine->bSmoothFrameRate = false;
+
+		//Every scenario measures its load at full rate, the characters are far from any player view and would
+		//otherwise be scored by USignificanceSubsystem's heuristics, which would then end up in the baseline
+		SignificanceCVar = IConsoleManager::Get().FindConsoleVariable(TEXT("sun.Significance.Enable"));
+		if(SignificanceCVar)
+		{
+			SavedSignificance = SignificanceCVar->GetInt();
+			SignificanceCVar->Set(0, ECVF_SetByCode);
+		}
+
+		const AGameModeBase* GameMode = World->GetAuthGameMode();
+		CharacterClass = ASUNCharacter::StaticClass();
+		if(GameMode && GameMode->DefaultPawnClass && GameMode->DefaultPawnClass->IsChildOf(ASUNCharacter::StaticClass()))
+		{
+			CharacterClass = GameMode->DefaultPawnClass.Get();
+		}
+		EnemyClass = LoadClass<AEnemy>(nullptr, TEXT("/Game/MyEnemy.MyEnemy_C"));
+		if(!EnemyClass)
+		{
+			EnemyClass = AEnemy::StaticClass();
+		}
+
+		SUNBenchmark::SpawnBox(World, SUNBenchmark::ArenaOrigin, FVector(SUNBenchmark::ArenaSize, SUNBenchmark::ArenaSize, 100.f));
+		for(int32 Wall = 0; Wall < SUNBenchmark::NumWalls; Wall++)
+		{
+			SUNBenchmark::SpawnBox(World, SUNBenchmark::GetWallCenter(Wall), SUNBenchmark::WallSize);
+		}
+
+		switch(Scenario.Load)
+		{
+		case SUNBenchmark::ELoad::WallRun: SetUpWallRun(World); break;
+		case SUNBenchmark::ELoad::Shooters: SetUpShooters(World); break;
+		case SUNBenchmark::ELoad::Projectiles: TopUpProjectiles(World); break;
+		case SUNBenchmark::ELoad::Damage: SetUpDamage(World); break;
+		case SUNBenchmark::ELoad::Horde: SetUpHorde(World); break;
+		}
+
+		UE_LOG(LogSUNBenchmark, Display, TEXT("%s: %d, %d warmup and %d measured frames"), Scenario.Name, Scenario.Count, NumWarmupFrames, NumFrames);
+	}
+
+	ASUNCharacter* SpawnCharacter(UWorld* World, const FVector& Location, const FRotator& Rotation)
+	{
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+		ASUNCharacter* Character = World->SpawnActor<ASUNCharacter>(CharacterClass, Location, Rotation, SpawnParams);
+		if(Character)
+		{
+			//Movement only runs with a controller
+			Character->SpawnDefaultController();
+			Characters.Add(Character);
+		}
+		return Character;
+	}
+
+	//Runners drop in next to a wall facing along it, alternating sides, and are put back once they reach the floor
+	void SetUpWallRun(UWorld* World)
+	{
+		const int32 PerSide = FMath::DivideAndRoundUp(Scenario.Count, SUNBenchmark::NumWalls * 2);
+		for(int32 Index = 0; Index < Scenario.Count; Index++)
+		{
+			const int32 Wall = Index % SUNBenchmark::NumWalls;
+			const float Side = (Index / SUNBenchmark::NumWalls) % 2 ? 1.f : -1.f;
+			const int32 Row = Index / (SUNBenchmark::NumWalls * 2);
+			const float Along = (Row + 0.5f) / PerSide - 0.5f;
+
+			FVector Start = SUNBenchmark::GetWallCenter(Wall);
+			Start.X += Along * SUNBenchmark::WallSize.X * 0.5f;
+			Start.Y += Side * (SUNBenchmark::WallSize.Y * 0.5f + 80.f);
+			Start.Z += SUNBenchmark::RunnerHeight;
+			if(SpawnCharacter(World, Start, FRotator::ZeroRotator))
+			{
+				RunnerStarts.Add(Start);
+				RunnerSides.Add(Side);
+			}
+		}
+	}
+
+	//In a ring around the walls holding the trigger down, aiming at the walls and each other
+	void SetUpShooters(UWorld* World)
+	{
+		for(int32 Index = 0; Index < Scenario.Count; Index++)
+		{
+			const float Angle = 2.f * PI * Index / Scenario.Count;
+			const FVector Offset(FMath::Cos(Angle) * 3000.f, FMath::Sin(Angle) * 3000.f, 100.f);
+			if(ASUNCharacter* Character = SpawnCharacter(World, SUNBenchmark::GetFloorTop() + Offset, (-Offset).Rotation()))
+			{
+				//What StartFire does for a held trigger
+				World->GetSubsystem<UFireScheduler>()->StartFiring(Character);
+			}
+		}
+	}
+
+	void SetUpDamage(UWorld* World)
+	{
+		UEnemyPool* Pool = World->GetSubsystem<UEnemyPool>();
+		const int32 Side = FMath::CeilToInt(FMath::Sqrt((float)Scenario.Count));
+		for(int32 Index = 0; Index < Scenario.Count; Index++)
+		{
+			const FVector Offset(((Index % Side) - Side * 0.5f) * 150.f, ((Index / Side) - Side * 0.5f) * 150.f, 100.f);
+			EnemyTransforms.Add(FTransform(SUNBenchmark::GetFloorTop() + Offset));
+			Enemies.Add(Pool->Spawn(EnemyClass, EnemyTransforms.Last()));
+		}
+	}
+
+	//Around the player, like sun.Horde.Spawn, so enemies get promoted and demoted while it runs
+	void SetUpHorde(UWorld* World)
+	{
+		FVector Center = SUNBenchmark::GetFloorTop();
+		APlayerController* Player = World->GetFirstPlayerController();
+		if(Player && Player->GetPawn())
+		{
+			Center = Player->GetPawn()->GetActorLocation();
+		}
+		World->GetSubsystem<UHordeSubsystem>()->Spawn(EnemyClass, Scenario.Count, Center, SUNBenchmark::HordeRadius);
+	}
+
+	//Keeps Count projectiles in flight, raining down on the arena from random points
+	void TopUpProjectiles(UWorld* World)
+	{
+		UProjectileSimulator* Simulator = World->GetSubsystem<UProjectileSimulator>();
+		const ASUNCharacter* Defaults = CharacterClass->GetDefaultObject<ASUNCharacter>();
+		const TSubclassOf<ASUNProjectile> Class = Defaults->ProjectileClass ? Defaults->ProjectileClass : TSubclassOf<ASUNProjectile>(ASUNProjectile::StaticClass());
+		const float HalfSize = SUNBenchmark::ArenaSize * 0.4f;
+
+		for(int32 Missing = Scenario.Count - Simulator->GetNumProjectiles(); Missing > 0; Missing--)
+		{
+			const FVector Location = SUNBenchmark::GetFloorTop() + FVector(Random.FRandRange(-HalfSize, HalfSize), Random.FRandRange(-HalfSize, HalfSize), Random.FRandRange(200.f, 1500.f));
+			const FRotator Rotation(Random.FRandRange(-60.f, 10.f), Random.FRandRange(0.f, 360.f), 0.f);
+			Simulator->Spawn(Class, Location, Rotation, nullptr);
+		}
+	}
+
+	void Drive(UWorld* World)
+	{
+		switch(Scenario.Load)
+		{
+		case SUNBenchmark::ELoad::WallRun:
+			for(int32 Index = 0; Index < Characters.Num(); Index++)
+			{
+				ASUNCharacter* Character = Characters[Index].Get();
+				if(!Character)
+				{
+					continue;
+				}
+				if(Character->GetCharacterMovement()->IsMovingOnGround() || Character->GetActorLocation().X > SUNBenchmark::WallSize.X * 0.5f)
+				{
+					Character->TeleportTo(RunnerStarts[Index], FRotator::ZeroRotator);
+					Character->GetCharacterMovement()->Velocity = FVector::ZeroVector;
+				}
+				//The same input MoveForward and MoveRight add for a player
+				Character->AddMovementInput(Character->GetActorForwardVector(), 1.f);
+				Character->AddMovementInput(Character->GetActorRightVector(), -RunnerSides[Index]);
+			}
+			break;
+
+		case SUNBenchmark::ELoad::Projectiles:
+			TopUpProjectiles(World);
+			break;
+
+		case SUNBenchmark::ELoad::Damage:
+		{
+			UEnemyPool* Pool = World->GetSubsystem<UEnemyPool>();
+			for(int32 Index = 0; Index < Enemies.Num(); Index++)
+			{
+				AEnemy* Enemy = Enemies[Index].Get();
+				if(!Enemy || Enemy->IsParked())
+				{
+					Enemies[Index] = Pool->Spawn(EnemyClass, EnemyTransforms[Index]);
+					continue;
+				}
+				UGameplayStatics::ApplyDamage(Enemy, Enemy->Health->GetMaxHealth() / SUNBenchmark::FramesToKill, nullptr, nullptr, nullptr);
+			}
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+
+	void Record()
+	{
+		const double Now = FPlatformTime::Seconds();
+		const bool bMeasuring = Frame >= NumWarmupFrames && LastFrameTime > 0.0;
+		if(bMeasuring)
+		{
+			FrameMs.Add((float)((Now - LastFrameTime) * 1000.0));
+			for(int32 Scope = 0; Scope < (int32)ESUNPerfScope::Num; Scope++)
+			{
+				ScopeMs[Scope].Add(FSUNPerf::GetMs((ESUNPerfScope)Scope));
+			}
+			for(int32 Counter = 0; Counter < (int32)ESUNPerfCounter::Num; Counter++)
+			{
+				CounterTotals[Counter] += FSUNPerf::GetCount((ESUNPerfCounter)Counter);
+			}
+
+			const FPlatformMemoryStats Memory = FPlatformMemory::GetStats();
+			if(StartUsedPhysical == 0)
+			{
+				StartUsedPhysical = Memory.UsedPhysical;
+			}
+			PeakUsedPhysical = FMath::Max<uint64>(PeakUsedPhysical, Memory.UsedPhysical);
+			PeakUsedVirtual = FMath::Max<uint64>(PeakUsedVirtual, Memory.UsedVirtual);
+		}
+		LastFrameTime = Now;
+		Frame++;
+	}
+
+	TSharedRef<FJsonObject> MakeResults() const
+	{
+		const double MB = 1024.0 * 1024.0;
+
+		TArray<float> Sorted = FrameMs;
+		Sorted.Sort();
+		TSharedRef<FJsonObject> Frames = MakeShared<FJsonObject>();
+		Frames->SetNumberField(TEXT("Avg"), SUNBenchmark::Average(Sorted));
+		Frames->SetNumberField(TEXT("P50"), SUNBenchmark::Percentile(Sorted, 0.5f));
+		Frames->SetNumberField(TEXT("P90"), SUNBenchmark::Percentile(Sorted, 0.9f));
+		Frames->SetNumberField(TEXT("P99"), SUNBenchmark::Percentile(Sorted, 0.99f));
+		Frames->SetNumberField(TEXT("Max"), SUNBenchmark::Percentile(Sorted, 1.f));
+
+		TSharedRef<FJsonObject> GameThread = MakeShared<FJsonObject>();
+		for(int32 Scope = 0; Scope < (int32)ESUNPerfScope::Num; Scope++)
+		{
+			Sorted = ScopeMs[Scope];
+			Sorted.Sort();
+			TSharedRef<FJsonObject> Times = MakeShared<FJsonObject>();
+			Times->SetNumberField(TEXT("Avg"), SUNBenchmark::Average(Sorted));
+			Times->SetNumberField(TEXT("P95"), SUNBenchmark::Percentile(Sorted, 0.95f));
+			Times->SetNumberField(TEXT("Max"), SUNBenchmark::Percentile(Sorted, 1.f));
+			GameThread->SetObjectField(FSUNPerf::GetName((ESUNPerfScope)Scope), Times);
+		}
+
+		TSharedRef<FJsonObject> Counters = MakeShared<FJsonObject>();
+		for(int32 Counter = 0; Counter < (int32)ESUNPerfCounter::Num; Counter++)
+		{
+			Counters->SetNumberField(FSUNPerf::GetName((ESUNPerfCounter)Counter), (double)CounterTotals[Counter] / FMath::Max(FrameMs.Num(), 1));
+		}
+
+		TSharedRef<FJsonObject> Memory = MakeShared<FJsonObject>();
+		Memory->SetNumberField(TEXT("PeakUsedPhysical"), PeakUsedPhysical / MB);
+		Memory->SetNumberField(TEXT("PeakUsedVirtual"), PeakUsedVirtual / MB);
+		Memory->SetNumberField(TEXT("Growth"), (PeakUsedPhysical - FMath::Min(StartUsedPhysical, PeakUsedPhysical)) / MB);
+
+		TSharedRef<FJsonObject> Results = MakeShared<FJsonObject>();
+		Results->SetStringField(TEXT("Scenario"), Scenario.Name);
+		Results->SetNumberField(TEXT("Count"), Scenario.Count);
+		Results->SetNumberField(TEXT("Frames"), FrameMs.Num());
+		Results->SetObjectField(TEXT("FrameMs"), Frames);
+		Results->SetObjectField(TEXT("GameThreadMs"), GameThread);
+		//Per frame, to check the load did what it was meant to, not compared
+		Results->SetObjectField(TEXT("Counters"), Counters);
+		Results->SetObjectField(TEXT("MemoryMB"), Memory);
+		return Results;
+	}
+
+	//Lower is better for everything compared, so only going up by more than the tolerance fails
+	void CompareToBaseline(const TSharedRef<FJsonObject>& Results, const FString& BaselinePath)
+	{
+		FString Text;
+		TSharedPtr<FJsonObject> Baseline;
+		if(!FFileHelper::LoadFileToString(Text, *BaselinePath) || !FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(Text), Baseline) || !Baseline.IsValid())
+		{
+			Test->AddWarning(FString::Printf(TEXT("No baseline at %s, run with sun.Benchmark.UpdateBaseline 1 to make one"), *BaselinePath));
+			return;
+		}
+		if(Baseline->GetIntegerField(TEXT("Count")) != Scenario.Count)
+		{
+			Test->AddWarning(FString::Printf(TEXT("Baseline is for %d, not %d, not compared"), Baseline->GetIntegerField(TEXT("Count")), Scenario.Count));
+			return;
+		}
+
+		TMap<FString, double> Current, Previous;
+		SUNBenchmark::Flatten(Results, FString(), Current);
+		SUNBenchmark::Flatten(Baseline, FString(), Previous);
+
+		const double Tolerance = FMath::Max(CVarBenchmarkTolerance.GetValueOnGameThread(), 0.f);
+		int32 NumRegressions = 0;
+		for(const TPair<FString, double>& Value : Current)
+		{
+			const bool bMemory = Value.Key.StartsWith(TEXT("MemoryMB."));
+			if(!bMemory && !Value.Key.StartsWith(TEXT("FrameMs.")) && !Value.Key.StartsWith(TEXT("GameThreadMs.")))
+			{
+				continue;
+			}
+			const double* Old = Previous.Find(Value.Key);
+			if(!Old)
+			{
+				continue;
+			}
+			const double MinRegression = bMemory ? SUNBenchmark::MinRegressionMB : SUNBenchmark::MinRegressionMs;
+			if(Value.Value > *Old * (1.0 + Tolerance) && Value.Value - *Old > MinRegression)
+			{
+				Test->AddError(FString::Printf(TEXT("%s %s went from %.3f to %.3f"), Scenario.Name, *Value.Key, *Old, Value.Value));
+				NumRegressions++;
+			}
+		}
+		UE_LOG(LogSUNBenchmark, Display, TEXT("%s: %d regressions against %s"), Scenario.Name, NumRegressions, *BaselinePath);
+	}
+
+	void Finish()
+	{
+		GEngine->bSmoothFrameRate = bSavedSmoothFrameRate;
+		if(SignificanceCVar)
+		{
+			SignificanceCVar->Set(SavedSignificance, ECVF_SetByCode);
+		}
+		if(UWorld* World = SUNBenchmark::FindGameWorld())
+		{
+			for(const TWeakObjectPtr<ASUNCharacter>& Character : Characters)
+			{
+				if(Character.IsValid())
+				{
+					World->GetSubsystem<UFireScheduler>()->StopFiring(Character.Get());
+				}
+			}
+		}
+
+		const TSharedRef<FJsonObject> Results = MakeResults();
+		FString Text;
+		FJsonSerializer::Serialize(Results, TJsonWriterFactory<>::Create(&Text));
+
+		const FString FileName = FString(Scenario.Name) + TEXT(".json");
+		const FString ResultsPath = FPaths::ProjectSavedDir() / TEXT("Benchmarks") / FileName;
+		const FString BaselinePath = FPaths::ProjectDir() / TEXT("Benchmarks") / TEXT("Baseline") / FileName;
+		FFileHelper::SaveStringToFile(Text, *ResultsPath);
+		Test->AddInfo(FString::Printf(TEXT("%s: frame p50 %.2f ms, p99 %.2f ms, results in %s"), Scenario.Name,
+			Results->GetObjectField(TEXT("FrameMs"))->GetNumberField(TEXT("P50")), Results->GetObjectField(TEXT("FrameMs"))->GetNumberField(TEXT("P99")), *ResultsPath));
+
+		if(CVarBenchmarkUpdateBaseline.GetValueOnGameThread() != 0)
+		{
+			FFileHelper::SaveStringToFile(Text, *BaselinePath);
+			Test->AddInfo(FString::Printf(TEXT("Baseline updated at %s"), *BaselinePath));
+		}
+		else
+		{
+			CompareToBaseline(Results, BaselinePath);
+		}
+	}
+
+	FAutomationTestBase* Test;
+	SUNBenchmark::FScenario Scenario;
+	FRandomStream Random;
+
+	bool bSetUp = false;
+	bool bSavedSmoothFrameRate = false;
+	IConsoleVariable* SignificanceCVar = nullptr;
+	int32 SavedSignificance = 1;
+	int32 NumFrames = 0;
+	int32 NumWarmupFrames = 0;
+	int32 Frame = 0;
+	double LastFrameTime = 0.0;
+
+	UClass* CharacterClass = nullptr;
+	UClass* EnemyClass = nullptr;
+	TArray<TWeakObjectPtr<ASUNCharacter>> Characters;
+	TArray<FVector> RunnerStarts;
+	TArray<float> RunnerSides;
+	TArray<TWeakObjectPtr<AEnemy>> Enemies;
+	TArray<FTransform> EnemyTransforms;
+
+	TArray<float> FrameMs;
+	TArray<float> ScopeMs[(int32)ESUNPerfScope::Num];
+	int64 CounterTotals[(int32)ESUNPerfCounter::Num] = {};
+	uint64 StartUsedPhysical = 0;
+	uint64 PeakUsedPhysical = 0;
+	uint64 PeakUsedVirtual = 0;
+};
+
+//Headless: UE4Editor SUN -game -nullrhi -unattended -ExecCmds="Automation RunTests SUN.Benchmark; Quit"
+IMPLEMENT_COMPLEX_AUTOMATION_TEST(FSUNBenchmarkTest, "SUN.Benchmark", EAutomationTestFlags::ClientContext | EAutomationTestFlags::PerfFilter)
+
+void FSUNBenchmarkTest::GetTests(TArray<FString>& OutBeautifiedNames, TArray<FString>& OutTestCommands) const
+{
+	for(const SUNBenchmark::FScenario& Scenario : SUNBenchmark::Scenarios)
+	{
+		OutBeautifiedNames.Add(Scenario.Name);
+		OutTestCommands.Add(Scenario.Name);
+	}
+}
+
+bool FSUNBenchmarkTest::RunTest(const FString& Parameters)
+{
+	const SUNBenchmark::FScenario* Scenario = SUNBenchmark::FindScenario(Parameters);
+	if(!Scenario)
+	{
+		AddError(FString::Printf(TEXT("Unknown benchmark %s"), *Parameters));
+		return false;
+	}
+
+	//A fresh map per scenario so nothing left over from the last one is measured
+	AutomationOpenMap(CVarBenchmarkMap.GetValueOnGameThread());
+	ADD_LATENT_AUTOMATION_COMMAND(FWaitForMapToLoadCommand());
+	ADD_LATENT_AUTOMATION_COMMAND(FSUNBenchmarkCommand(this, *Scenario));
+	return true;
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,160 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SUNBotController.h"
+#include "SUNCharacter.h"
+#include "SUNCharacterMovementComponent.h"
+#include "Engine/World.h"
+
+//Below this ground speed for a moment the bot has run into something and turns away
+static const float StuckSpeed = 50.f;
+static const float StuckSeconds = .5f;
+//Second jump of a double jump, after the first one has lifted off
+static const float AirJumpDelay = .35f;
+
+ASUNBotController::ASUNBotController()
+{
+	PrimaryActorTick.bCanEverTick = true;
+	//Input handlers run before the character's movement, like a player's
+	PrimaryActorTick.TickGroup = TG_PrePhysics;
+}
+
+void ASUNBotController::SetSeed(int32 Seed)
+{
+	Random.Initialize(Seed);
+	HeadingYaw = Random.FRandRange(0.f, 360.f);
+}
+
+void ASUNBotController::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	ASUNCharacter* Character = Cast<ASUNCharacter>(GetPawn());
+	if(!Character)
+	{
+		return;
+	}
+
+	const FVector Location = Character->GetActorLocation();
+	if(bHasLastLocation)
+	{
+		DistanceMoved += FVector::Dist(Location, LastLocation);
+	}
+	LastLocation = Location;
+	bHasLastLocation = true;
+
+	const float Now = GetWorld()->GetTimeSeconds();
+	UpdateHeading(Character, DeltaSeconds, Now);
+	SetControlRotation(FRotator(0.f, HeadingYaw, 0.f));
+
+	Character->MoveForward(1.f);
+	Character->MoveRight(Strafe);
+
+	UpdateAbilities(Character, Now);
+	UpdateFire(Character, Now);
+}
+
+void ASUNBotController::UpdateHeading(const ASUNCharacter* Character, float DeltaSeconds, float Now)
+{
+	const bool bStuck = Character->GetCharacterMovement()->IsMovingOnGround() && Character->GetVelocity().SizeSquared2D() < FMath::Square(StuckSpeed);
+	StuckTime = bStuck ? StuckTime + DeltaSeconds : 0.f;
+	if(StuckTime > StuckSeconds)
+	{
+		HeadingYaw += Random.FRandRange(90.f, 270.f);
+		StuckTime = 0.f;
+	}
+	else if(Now >= NextTurnTime)
+	{
+		HeadingYaw += Random.FRandRange(-60.f, 60.f);
+		NextTurnTime = Now + Random.FRandRange(2.f, 5.f);
+	}
+	HeadingYaw = FRotator::ClampAxis(HeadingYaw);
+}
+
+void ASUNBotController::UpdateAbilities(ASUNCharacter* Character, float Now)
+{
+	const USUNCharacterMovementComponent* Movement = Character->GetSUNMovement();
+
+	const bool bWallRunning = Movement->IsWallRunning();
+	if(bWallRunning && !bWasWallRunning)
+	{
+		NumWallRuns++;
+		WallJumpTime = Now + Random.FRandRange(.5f, 1.5f);
+	}
+	bWasWallRunning = bWallRunning;
+
+	if(bWallRunning)
+	{
+		Strafe = 0.f;
+		if(Now >= WallJumpTime)
+		{
+			Character->DoubleJump();
+			NumDoubleJumps++;
+			WallJumpTime = MAX_flt;
+		}
+		return;
+	}
+
+	if(Movement->IsMovingOnGround())
+	{
+		Strafe = 0.f;
+		if(Now >= NextJumpTime)
+		{
+			Character->DoubleJump();
+			//Drift to one side while in the air, into any wall running alongside
+			Strafe = Random.FRandBool() ? 1.f : -1.f;
+			AirJumpTime = Random.FRand() < .7f ? Now + AirJumpDelay : 0.f;
+			NextJumpTime = Now + Random.FRandRange(1.5f, 4.f);
+		}
+	}
+	else if(AirJumpTime > 0.f && Now >= AirJumpTime)
+	{
+		Character->DoubleJump();
+		NumDoubleJumps++;
+		AirJumpTime = 0.f;
+	}
+
+	if(Now >= NextDashTime)
+	{
+		Character->Dash();
+		NumDashes++;
+		NextDashTime = Now + Random.FRandRange(3.f, 8.f);
+	}
+}
+
+void ASUNBotController::UpdateFire(ASUNCharacter* Character, float Now)
+{
+	if(Now < NextFireTime)
+	{
+		return;
+	}
+
+	if(bFiring)
+	{
+		Character->EndAttack();
+		if(Random.FRand() < .1f)
+		{
+			Character->SwitchWeaponMode();
+		}
+		NextFireTime = Now + Random.FRandRange(1.f, 4.f);
+	}
+	else
+	{
+		Character->StartAttack();
+		NumBursts++;
+		NextFireTime = Now + Random.FRandRange(1.f, 3.f);
+	}
+	bFiring = !bFiring;
+}
+
+void ASUNBotController::OnUnPossess()
+{
+	ASUNCharacter* Character = Cast<ASUNCharacter>(GetPawn());
+	if(Character && bFiring)
+	{
+		Character->EndAttack();
+	}
+	bFiring = false;
+	bHasLastLocation = false;
+	Super::OnUnPossess();
+}
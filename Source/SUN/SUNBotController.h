@@ -0,0 +1,56 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Controller.h"
+#include "SUNBotController.generated.h"
+
+//Plays an ASUNCharacter through the same input handlers the key bindings call: runs and turns, double jumps, dashes,
+//drifts sideways while in the air so it catches walls to run along and jumps off them, and fires in bursts, now and
+//then switching to the katana. Timings come from a stream seeded per bot
+UCLASS()
+class SUN_API ASUNBotController : public AController
+{
+	GENERATED_BODY()
+
+public:
+	ASUNBotController();
+
+	void SetSeed(int32 Seed);
+
+	virtual void Tick(float DeltaSeconds) override;
+
+	//Abilities used since spawn. Jumps off the ground are not counted, only the ones in the air or off a wall
+	int32 NumDoubleJumps = 0;
+	int32 NumDashes = 0;
+	int32 NumWallRuns = 0;
+	int32 NumBursts = 0;
+	//Distance its character has covered, a soak checks this to know the bots really played
+	float DistanceMoved = 0.f;
+
+protected:
+	virtual void OnUnPossess() override;
+
+private:
+	void UpdateHeading(const class ASUNCharacter* Character, float DeltaSeconds, float Now);
+	void UpdateAbilities(class ASUNCharacter* Character, float Now);
+	void UpdateFire(class ASUNCharacter* Character, float Now);
+
+	FRandomStream Random;
+
+	float HeadingYaw = 0.f;
+	float Strafe = 0.f;
+	float StuckTime = 0.f;
+	float NextTurnTime = 0.f;
+	float NextJumpTime = 0.f;
+	//0 when no second jump is coming
+	float AirJumpTime = 0.f;
+	float WallJumpTime = 0.f;
+	float NextDashTime = 0.f;
+	float NextFireTime = 0.f;
+	bool bFiring = false;
+	bool bWasWallRunning = false;
+	bool bHasLastLocation = false;
+	FVector LastLocation;
+};
@@ -1,20 +1,34 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "SUNCharacter.h"
+#include "SUN.h"
+#include "SUNPerf.h"
 #include "SUNProjectile.h"
+#include "SUNCharacterMovementComponent.h"
+#include "HitscanSubsystem.h"
+#include "ProjectilePool.h"
+#include "ProjectileSimulator.h"
+#include "MeleeTraceComponent.h"
+#include "InputRecorderComponent.h"
+#include "LagCompensationSubsystem.h"
+#include "FireScheduler.h"
 #include "Animation/AnimInstance.h"
 #include "Camera/CameraComponent.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/InputComponent.h"
 #include "GameFramework/InputSettings.h"
 #include "Kismet/GameplayStatics.h"
-#include "DrawDebugHelpers.h"
+#include "SUNDebugDraw.h"
 #include "GameFramework/CharacterMovementComponent.h"
 #include "TimerManager.h"
 #include "Components/ActorComponent.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "Math/Vector.h"
 
+DECLARE_CYCLE_STAT(TEXT("Character tick"), STAT_SUN_CharacterTick, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("FireShot"), STAT_SUN_FireShot, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Shots fired"), STAT_SUN_ShotsFired, STATGROUP_SUN);
+
 #define LEFT -90
 #define RIGHT 90
 DEFINE_LOG_CATEGORY_STATIC(LogFPChar, Warning, All);
@@ -22,7 +36,8 @@ DEFINE_LOG_CATEGORY_STATIC(LogFPChar, Warning, All);
 //////////////////////////////////////////////////////////////////////////
 // ASUNCharacter
 
-ASUNCharacter::ASUNCharacter()
+ASUNCharacter::ASUNCharacter(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer.SetDefaultSubobjectClass<USUNCharacterMovementComponent>(ACharacter::CharacterMovementComponentName))
 {
 	// Set size for collision capsule
 	GetCapsuleComponent()->InitCapsuleSize(55.f, 96.0f);
@@ -58,7 +73,7 @@ ASUNCharacter::ASUNCharacter()
 	FP_Sword->SetOnlyOwnerSee(true);			
 	FP_Sword->bCastDynamicShadow = false;
 	FP_Sword->CastShadow = false;
-	FP_Sword->SetupAttachment(RootComponent);
+	FP_Sword->SetupAttachment(Mesh1P);
 	FP_Sword->SetRelativeScale3D(FVector(10, 10, 10));
 
 	FP_MuzzleLocation = CreateDefaultSubobject<USceneComponent>(TEXT("MuzzleLocation"));
@@ -76,6 +91,14 @@ ASUNCharacter::ASUNCharacter()
 	TriggerCapsule->SetupAttachment(RootComponent);
 
 	Health = CreateDefaultSubobject<UHealthComponent>(TEXT("HealthComponent"));
+
+	Parkour = CreateDefaultSubobject<UParkourComponent>(TEXT("ParkourComponent"));
+
+	MeleeTrace = CreateDefaultSubobject<UMeleeTraceComponent>(TEXT("MeleeTraceComponent"));
+
+	InputRecorder = CreateDefaultSubobject<UInputRecorderComponent>(TEXT("InputRecorderComponent"));
+
+	SUNMovement = CastChecked<USUNCharacterMovementComponent>(GetCharacterMovement());
 }
 
 void ASUNCharacter::BeginPlay()
@@ -85,6 +108,8 @@ void ASUNCharacter::BeginPlay()
 
 	//Attach gun mesh component to Skeleton, doing it here because the skeleton is not yet created in the constructor
 	FP_Gun->AttachToComponent(Mesh1P, FAttachmentTransformRules(EAttachmentRule::SnapToTarget, true), TEXT("GripPoint"));
+	//Same for the katana, keeping its scale
+	FP_Sword->AttachToComponent(Mesh1P, FAttachmentTransformRules(EAttachmentRule::SnapToTarget, EAttachmentRule::SnapToTarget, EAttachmentRule::KeepRelative, true), SwordSocket);
 	if(CanJumpInAir)
 	{
 		MaxJumps = 2;
@@ -94,6 +119,21 @@ void ASUNCharacter::BeginPlay()
 		MaxJumps = 1;
 	}
 	WeaponMode = GUN;
+	MeleeTrace->SetBlade(FP_Sword);
+	//Nobody may see the arms on the server, but swings are traced there so the blade has to follow the animation
+	if(HasAuthority())
+	{
+		Mesh1P->VisibilityBasedAnimTickOption = EVisibilityBasedAnimTickOption::AlwaysTickPoseAndRefreshBones;
+	}
+	if(!MeleeTrace->DamageType)
+	{
+		MeleeTrace->DamageType = DamageType;
+	}
+	if(bUseProjectiles)
+	{
+		GetWorld()->GetSubsystem<UProjectilePool>()->Prewarm(ProjectileClass, ProjectilePoolSize);
+	}
+	GetWorld()->GetSubsystem<UFireScheduler>()->Register(this, FirstPersonCameraComponent, WeaponFireRate, FOnScheduledShot::CreateUObject(this, &ASUNCharacter::FireShot));
 	//TriggerCapsule ->OnComponentHit.AddDynamic(this, &ASUNCharacter::OnCompHit);
 }
 
@@ -124,6 +164,7 @@ void ASUNCharacter::SetupPlayerInputComponent(class UInputComponent* PlayerInput
 
 void ASUNCharacter::MoveForward(float Value)
 {
+	InputRecorder->RecordForward(Value);
 	if (Value != 0.0f)
 	{
 		// add movement in that direction
@@ -134,6 +175,7 @@ void ASUNCharacter::MoveForward(float Value)
 
 void ASUNCharacter::MoveRight(float Value)
 {
+	InputRecorder->RecordRight(Value);
 	if (Value != 0.0f)
 	{
 		// add movement in that direction
@@ -157,11 +199,25 @@ void ASUNCharacter::LookUpAtRate(float Rate)
 
 void ASUNCharacter::SwitchWeaponMode()
 {
+	InputRecorder->RecordAction(ESUNInputAction::SwitchWeaponMode);
 	GEngine->AddOnScreenDebugMessage(-1, 1.f, FColor::Red, FString::Printf(TEXT("MODE CHANGE")));
+	StopAttacking();
+	WeaponMode = WeaponMode == GUN ? MELEE : GUN;
+	if(!HasAuthority())
+	{
+		ServerSwitchWeaponMode();
+	}
+}
+
+void ASUNCharacter::ServerSwitchWeaponMode_Implementation()
+{
+	StopAttacking();
+	WeaponMode = WeaponMode == GUN ? MELEE : GUN;
 }
 
 void ASUNCharacter::StartAttack()
 {
+	InputRecorder->RecordAction(ESUNInputAction::StartAttack);
 	if(WeaponMode == GUN)
 	{
 		StartFire();
@@ -175,6 +231,13 @@ void ASUNCharacter::StartAttack()
 }
 
 void ASUNCharacter::EndAttack()
+{
+	InputRecorder->RecordAction(ESUNInputAction::EndAttack);
+	StopAttacking();
+}
+
+//Not recorded, so callers that record their own action don't replay an extra EndAttack
+void ASUNCharacter::StopAttacking()
 {
 	if(WeaponMode == GUN)
 	{
@@ -192,27 +255,65 @@ void ASUNCharacter::EndAttack()
 
 void ASUNCharacter::StartFire()
 {
-	FireShot();
-	GetWorldTimerManager().SetTimer(ShotTimer,this,&ASUNCharacter::FireShot,WeaponFireRate,true);
+	GetWorld()->GetSubsystem<UFireScheduler>()->StartFiring(this);
 }
 
-//Loops for automatic rifle
-void ASUNCharacter::FireShot()
+//Called by UFireScheduler for every shot of the automatic rifle, possibly several per frame. On a client only the
+//shooter's own projectile copy, sound and animation happen here, everything else once the server has the shot
+void ASUNCharacter::FireShot(const FVector& Origin, const FVector& Direction, float ShotTime)
 {
-	FHitResult Hit;
+	SUN_SCOPE_CYCLE_COUNTER(STAT_SUN_FireShot, FireShot);
+	SUN_INC_COUNTER(STAT_SUN_ShotsFired, ShotsFired, 1);
 
-	const float WeaponRange = 20000.f;
-	const FVector StartTrace = FirstPersonCameraComponent->GetComponentLocation();
-	const FVector EndTrace = (FirstPersonCameraComponent->GetForwardVector() * WeaponRange) + StartTrace;
+	const bool bAuthority = HasAuthority();
+	if(!bAuthority)
+	{
+		ServerFireShot(Origin, Direction);
+	}
 
-	FCollisionQueryParams QueryParams = FCollisionQueryParams(SCENE_QUERY_STAT(WeaponTrace),false,this);
-	if(GetWorld()->LineTraceSingleByChannel(Hit, StartTrace,EndTrace, ECC_Visibility,QueryParams))
+	if(bUseProjectiles && ProjectileClass != NULL)
 	{
-		AActor* HitActor = Hit.GetActor();
-		UGameplayStatics::ApplyPointDamage(HitActor, 20.f, GetActorLocation(), Hit, nullptr, this, DamageType);
+		const FRotator SpawnRotation = Direction.Rotation();
+		const FVector SpawnLocation = FP_MuzzleLocation->GetComponentLocation() + SpawnRotation.RotateVector(GunOffset);
+		if(UProjectileSimulator::IsSimulationEnabled())
+		{
+			GetWorld()->GetSubsystem<UProjectileSimulator>()->Spawn(ProjectileClass, SpawnLocation, SpawnRotation, this);
+			if(bAuthority)
+			{
+				MulticastSimulatedProjectile(SpawnLocation, SpawnRotation.Vector());
+			}
+		}
+		else if(bAuthority)
+		{
+			//Pooled projectiles replicate, the client sees the server's
+			GetWorld()->GetSubsystem<UProjectilePool>()->Acquire(ProjectileClass, SpawnLocation, SpawnRotation, this, this);
+		}
 	}
+	else
+	{
+		const float WeaponRange = 20000.f;
+		const FVector StartTrace = Origin;
+		const FVector EndTrace = (Direction * WeaponRange) + StartTrace;
+
+		//On the server the trace and the damage happen later this frame, batched with everyone else's shots
+		if(bAuthority)
+		{
+			FHitscanShot Shot;
+			Shot.Shooter = this;
+			Shot.Start = StartTrace;
+			Shot.End = EndTrace;
+			Shot.Damage = 20.f;
+			Shot.DamageType = DamageType;
+			Shot.Channel = ECC_Visibility;
+			Shot.Params = FCollisionQueryParams(SCENE_QUERY_STAT(WeaponTrace),false,this);
+			//Rewound by the shooter's latency and by how far into the frame the shot was due
+			const float RewindTime = GetWorld()->GetSubsystem<ULagCompensationSubsystem>()->GetShotTime(this);
+			Shot.ShotTime = RewindTime >= 0.f ? RewindTime - (GetWorld()->GetTimeSeconds() - ShotTime) : -1.f;
+			GetWorld()->GetSubsystem<UHitscanSubsystem>()->SubmitShot(Shot);
+		}
 
-	DrawDebugLine(GetWorld(),StartTrace, EndTrace, FColor::White, false, 1.0f, 0, 1.0f);
+		SUN_DRAW_LINE(GetWorld(), Hitscan, StartTrace, EndTrace, FColor::White, 1.0f);
+	}
 
 	// try and play the sound if specified
 	if (FireSound != NULL)
@@ -232,225 +333,121 @@ void ASUNCharacter::FireShot()
 	}
 }
 
-void ASUNCharacter::EndFire()
+bool ASUNCharacter::ServerFireShot_Validate(FVector_NetQuantize Origin, FVector_NetQuantizeNormal Direction)
 {
-	GetWorldTimerManager().ClearTimer(ShotTimer);
+	return !Origin.ContainsNaN() && !Direction.ContainsNaN();
 }
 
-void ASUNCharacter::StartMelee()
-{}
-void ASUNCharacter::Melee()
-{}
-void ASUNCharacter::EndMelee()
-{}
-//Double Jump
-void ASUNCharacter::DoubleJump()
+//Rewound by the client's latency in FireShot, ULagCompensationSubsystem knows it from the player state. Shots are
+//dropped outside gun mode and past WeaponFireRate, with ServerShotBurst shots of slack, and fired from near the camera
+void ASUNCharacter::ServerFireShot_Implementation(FVector_NetQuantize Origin, FVector_NetQuantizeNormal Direction)
 {
-	bool isFalling = GetCharacterMovement()->MovementMode==EMovementMode::MOVE_Falling;
-	if(NumJumps < MaxJumps)
+	if(WeaponMode != GUN)
 	{
-		if(!IsWallRunning)
-		{
-			ACharacter::LaunchCharacter(FVector(0,0,JumpHeight), false, true);
-			NumJumps++;
-			if(isFalling) NumJumps++;
-		}
-		else
-		{
-			EndWallRun(JumpedOffWall);
-			if(WallRunSide == Left) //Slightly offset when jumping off a wall to jump away from it
-			{
-				ACharacter::LaunchCharacter(FVector(0,20,JumpHeight), false, true);
-			}
-			else
-			{
-				ACharacter::LaunchCharacter(FVector(0,-20,JumpHeight), false, true);
-			}
-			SetJumps(0);
-			NumJumps++;
-		}
+		return;
 	}
-}
 
-void ASUNCharacter::SetJumps(int Jumps)
-{
-	NumJumps = Jumps;
+	const float Now = GetWorld()->GetTimeSeconds();
+	ServerShotCredit = FMath::Min(ServerShotCredit + (Now - LastServerShotTime) / FMath::Max(WeaponFireRate, KINDA_SMALL_NUMBER), ServerShotBurst);
+	LastServerShotTime = Now;
+	if(ServerShotCredit < 1.f)
+	{
+		return;
+	}
+	ServerShotCredit -= 1.f;
+
+	const FVector Camera = FirstPersonCameraComponent->GetComponentLocation();
+	const FVector ShotOrigin = Camera + (Origin - Camera).GetClampedToMaxSize(ServerShotOriginTolerance);
+	FireShot(ShotOrigin, Direction.GetSafeNormal(), Now);
 }
 
-void ASUNCharacter::Landed(const FHitResult & Hit)
+void ASUNCharacter::EndFire()
 {
-	SetJumps(0);
+	GetWorld()->GetSubsystem<UFireScheduler>()->StopFiring(this);
 }
 
-//Dash in Direction of player's movement
-void ASUNCharacter::Dash()
+void ASUNCharacter::StartMelee()
 {
-	if(CanDash)
+	if(!HasAuthority())
 	{
-		FVector DashDirection = GetVelocity();
-		DashDirection.Z = 0;
-		GetCharacterMovement()->GroundFriction = 0.f;
-		ACharacter::LaunchCharacter((DashDirection) * DashAmount, true, true);
-		GetWorldTimerManager().SetTimer(DashTimer, this, &ASUNCharacter::StopDash, .25f, false);
-		if(IsWallRunning)EndWallRun(JumpedOffWall);
-		// try and play the sound if specified
-		if (FireSound != NULL)
-		{
-			UGameplayStatics::PlaySoundAtLocation(this, FireSound, GetActorLocation());
-		}
+		ServerStartMelee();
 	}
+	Melee();
+	GetWorldTimerManager().SetTimer(MeleeTimer,this,&ASUNCharacter::Melee,MeleeSwingTime,true);
 }
 
-void ASUNCharacter::StopDash()
-{
-	GetCharacterMovement()->GroundFriction = 8;
-	GetCharacterMovement()->StopMovementImmediately();
-}
-
-void ASUNCharacter::Tick(float DeltaTime)
+//One katana swing, hits are swept by MeleeTrace for as long as it lasts
+void ASUNCharacter::Melee()
 {
-	Super::Tick(DeltaTime);
+	MeleeTrace->BeginSwing(MeleeSwingTime);
 
-	if (GetCharacterMovement()->IsFalling())
+	if (MeleeAnimation != NULL)
 	{
-		FHitResult HitResultForward;
-		FHitResult HitResultLeft;
-		FHitResult HitResulRight;
-		FHitResult Hit;
-		FCollisionQueryParams TraceParams = FCollisionQueryParams(FName(TEXT("Trace")), true, this);
-
-		ECollisionChannel Channel = ECC_WorldStatic;
-
-		FVector Start = GetActorLocation();
-		FVector End = GetActorRightVector() * PlayerToWallDistance;
-		FVector ForwardEnd = GetActorForwardVector() * PlayerToWallDistance;
-		
-		if (GetWorld()->LineTraceSingleByChannel(Hit, Start, Start + -End, Channel, TraceParams))
-		{
-			if(!IsWallRunning)
-			{
-			
-			if(CanSurfaceBeRan(Hit.ImpactNormal))
-			{
-
-				FindDirectionAndSide(Hit.ImpactNormal);
-				WallRunSide = Left;
-				BeginWallRun();
-			}
-			}
-		}
-		else if (GetWorld()->LineTraceSingleByChannel(Hit, Start, Start + End, Channel, TraceParams))
+		UAnimInstance* AnimInstance = Mesh1P->GetAnimInstance();
+		if (AnimInstance != NULL)
 		{
-			if(!IsWallRunning)
-			{
-
-			if(CanSurfaceBeRan(Hit.ImpactNormal))
-			{
-				FindDirectionAndSide(Hit.ImpactNormal);
-				WallRunSide = Right;
-				BeginWallRun();
-			}
-			}
+			AnimInstance->Montage_Play(MeleeAnimation, 1.f);
 		}
 	}
 }
 
-//Fires a raycast, so long as the raycast is hitting a wall it keeps the player wall running
-void ASUNCharacter::WallRun()
+//Lets the current swing finish, just stops the next one
+void ASUNCharacter::EndMelee()
 {
-	FVector WallSide;
-	FHitResult Hit;
-	switch(WallRunSide)
+	if(!HasAuthority())
 	{
-		case Left:
-			WallSide = FVector(0,0,-1);
-			break;
-		case Right:
-			WallSide = FVector(0,0,1);
-			break;
+		ServerEndMelee();
 	}
+	GetWorldTimerManager().ClearTimer(MeleeTimer);
+}
 
-	FVector ToWall = (FVector::CrossProduct(WallRunDirection, WallSide ) * 100) ;
-	FCollisionQueryParams QueryParams = FCollisionQueryParams(SCENE_QUERY_STAT(WallTrace),false,this);
-	EWallRunSide PrevSide;
-	if(GetWorld()->LineTraceSingleByChannel(Hit, GetActorLocation(),(GetActorLocation() + ToWall), ECC_Visibility,QueryParams))
-	{
-		PrevSide = WallRunSide;
-		FindDirectionAndSide(Hit.ImpactNormal);
-		DrawDebugLine(GetWorld(), GetActorLocation(), (GetActorLocation() + ToWall), FColor::Green, true);
-		if(PrevSide != WallRunSide)
-		{
-			EndWallRun(FallOffWall);
-			return;
-		}
-		else
-		{
-			FVector WallRunVelocity = WallRunDirection * GetCharacterMovement()->GetMaxSpeed();
-			GetCharacterMovement()->Velocity = FVector(WallRunVelocity.X ,WallRunVelocity.Y, 0);
-		}
-	}
-	else
+void ASUNCharacter::ServerStartMelee_Implementation()
+{
+	if(WeaponMode == MELEE)
 	{
-		EndWallRun(FallOffWall);
-		return;
+		StartMelee();
 	}
-
 }
 
-//Turn off gravity and contrain player to singular air movment for wall run
-void ASUNCharacter::BeginWallRun()
+void ASUNCharacter::ServerEndMelee_Implementation()
 {
-	GetCharacterMovement()->AirControl = 1.0f;
-	GetCharacterMovement()->GravityScale = 0;
-	GetCharacterMovement()->SetPlaneConstraintNormal(FVector(0,0,1));
-	IsWallRunning = true;
-	GetWorldTimerManager().SetTimer(WallRunTimer, this, &ASUNCharacter::WallRun, .1f, true);
+	EndMelee();
 }
-
-void ASUNCharacter::EndWallRun(EWallRunEndReason Reason)
+//Double Jump
+void ASUNCharacter::MulticastSimulatedProjectile_Implementation(FVector_NetQuantize Location, FVector_NetQuantizeNormal Direction)
 {
-	GetCharacterMovement()->AirControl = 0.5f;
-	GetCharacterMovement()->GravityScale = 0.9f;
-	GetCharacterMovement()->SetPlaneConstraintNormal(FVector(0,0,0));
-	IsWallRunning = false;
-	GetWorldTimerManager().ClearTimer(WallRunTimer);
+	//The server and the shooter have already spawned theirs
+	if(HasAuthority() || IsLocallyControlled() || ProjectileClass == NULL)
+	{
+		return;
+	}
+	GetWorld()->GetSubsystem<UProjectileSimulator>()->Spawn(ProjectileClass, Location, Direction.Rotation(), this);
 }
 
-//Finds the side of the player the wall is on and the direction the player will travel
-void ASUNCharacter::FindDirectionAndSide(FVector WallNormal) 
+//Happens at the start of the next move so the server can repeat it, see USUNCharacterMovementComponent
+void ASUNCharacter::DoubleJump()
 {
-	FVector2D WallNorm = FVector2D(WallNormal.X, WallNormal.Y);
-	FVector2D ActorRight = FVector2D(GetActorRightVector().X, GetActorRightVector().Y);
-	float DotProduct = FVector2D::DotProduct(WallNorm, ActorRight);
-	FVector Direction;
-	if(DotProduct > 0)
-	{
-		WallRunSide = Right;
-		Direction = FVector(0,0,1);
-		WallRunDirection = FVector::CrossProduct(WallNormal,Direction);
-	}
-	else
-	{
-		WallRunSide = Left;
-		Direction = FVector(0,0,-1);
-		WallRunDirection = FVector::CrossProduct(WallNormal,Direction);
-	}
+	InputRecorder->RecordAction(ESUNInputAction::DoubleJump);
+	SUNMovement->RequestDoubleJump();
 }
 
-//Checks if the surface is wall runable (Not too flat or to steep)
-bool ASUNCharacter::CanSurfaceBeRan(FVector SurfaceNormal) const
+//Dash in Direction of player's movement
+void ASUNCharacter::Dash()
 {
-    if(SurfaceNormal.Z < -0.05)
-	{
-		return false;
-	}
-	else
+	InputRecorder->RecordAction(ESUNInputAction::Dash);
+	if(CanDash)
 	{
-		FVector Surface = FVector (SurfaceNormal.X, SurfaceNormal.Y, 0);
-		if(UKismetMathLibrary::DegAcos(FVector::DotProduct(Surface.GetSafeNormal(), SurfaceNormal)) < GetCharacterMovement()->GetWalkableFloorAngle())
+		SUNMovement->RequestDash();
+		// try and play the sound if specified
+		if (FireSound != NULL)
 		{
-			return true;
+			UGameplayStatics::PlaySoundAtLocation(this, FireSound, GetActorLocation());
 		}
 	}
-	return false;
-}
\ No newline at end of file
+}
+
+void ASUNCharacter::Tick(float DeltaTime)
+{
+	SUN_SCOPE_CYCLE_COUNTER(STAT_SUN_CharacterTick, CharacterTick);
+	Super::Tick(DeltaTime);
+}
@@ -6,25 +6,12 @@
 #include "GameFramework/Character.h"
 #include "TimerManager.h"
 #include "HealthComponent.h"
+#include "ParkourComponent.h"
 #include "Components/ActorComponent.h"
 #include "SUNCharacter.generated.h"
 
 class UInputComponent;
 class UDamageType;
-UENUM()
-enum EWallRunSide
-{
-	Left,
-	Right
-};
-
-UENUM()
-enum EWallRunEndReason
-{
-	FallOffWall,
-	JumpedOffWall
-};
-
 UENUM()
 enum EWeaponMode
 {
@@ -62,9 +49,24 @@ class ASUNCharacter : public ACharacter
 	UPROPERTY(EditAnywhere, Category = Health)
 	class UHealthComponent* Health;
 
+	UPROPERTY(VisibleAnywhere, Category = Movement)
+	class UParkourComponent* Parkour;
+
+	UPROPERTY(VisibleAnywhere, Category = Melee)
+	class UMeleeTraceComponent* MeleeTrace;
+
+	UPROPERTY(VisibleAnywhere, Category = Input)
+	class UInputRecorderComponent* InputRecorder;
+
+	UPROPERTY(Transient)
+	class USUNCharacterMovementComponent* SUNMovement;
+
+	//Replays and bots feed input through the same handlers the bindings call
+	friend class UInputRecorderComponent;
+	friend class ASUNBotController;
 
 public:
-	ASUNCharacter();
+	ASUNCharacter(const FObjectInitializer& ObjectInitializer);
 
 protected:
 	virtual void BeginPlay();
@@ -87,6 +89,14 @@ public:
 	UPROPERTY(EditDefaultsOnly, Category=Projectile)
 	TSubclassOf<class ASUNProjectile> ProjectileClass;
 
+	//Fire ProjectileClass instead of hitscan shots
+	UPROPERTY(EditDefaultsOnly, Category=Projectile)
+	bool bUseProjectiles = false;
+
+	//How many projectiles of ProjectileClass are spawned up front so firing never has to
+	UPROPERTY(EditDefaultsOnly, Category=Projectile)
+	int32 ProjectilePoolSize = 32;
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Gameplay)
 	class USoundBase* FireSound;
 
@@ -97,28 +107,67 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = WallRun)
 	float WallRunSpeed = 5;
 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = WallRun)
-	float PlayerToWallDistance = 75;
-
 protected:
 	
 	
 	void StartAttack();
 	void EndAttack();
+	void StopAttacking();
 
 	//Gun Mode attack
 	void StartFire();
 	void EndFire();
-	void FireShot();
+	void FireShot(const FVector& Origin, const FVector& Direction, float ShotTime);
+
+	//A client's shots, fired again on the server where the damage, the pooled projectile actors and the copies of
+	//simulated projectiles for other clients come from
+	UFUNCTION(Server, Reliable, WithValidation)
+	void ServerFireShot(FVector_NetQuantize Origin, FVector_NetQuantizeNormal Direction);
+
+	//The server checks a client's shots against its own weapon mode, so it has to follow the switches
+	UFUNCTION(Server, Reliable)
+	void ServerSwitchWeaponMode();
+
+	//How far a client's shot origin may be from the server's camera before it is pulled back to it
+	UPROPERTY(EditDefaultsOnly, Category = Projectile)
+	float ServerShotOriginTolerance = 200.f;
+
+	//Shots a client can fire back to back on the server before WeaponFireRate applies, for shots bunched up by the network
+	UPROPERTY(EditDefaultsOnly, Category = Projectile)
+	float ServerShotBurst = 3.f;
+
+	float ServerShotCredit = 0.f;
+	float LastServerShotTime = 0.f;
+
+	//Projectiles from UProjectileSimulator are not actors, so other clients simulate their own copy from this
+	UFUNCTION(NetMulticast, Unreliable)
+	void MulticastSimulatedProjectile(FVector_NetQuantize Location, FVector_NetQuantizeNormal Direction);
 
 	//Melee mode attack
 	void StartMelee();
 	void EndMelee();
 	void Melee();
 
-	FTimerHandle ShotTimer;
+	//A client's swings run on the server too, where their hits are applied
+	UFUNCTION(Server, Reliable)
+	void ServerStartMelee();
+	UFUNCTION(Server, Reliable)
+	void ServerEndMelee();
+
+	FTimerHandle MeleeTimer;
 
+	//Length of one katana swing, holding attack swings again once it is over
+	UPROPERTY(EditAnywhere, Category = Melee)
+	float MeleeSwingTime = .4f;
 
+	//Hand socket on Mesh1P the katana is held in, so the swing animation moves the blade
+	UPROPERTY(EditDefaultsOnly, Category = Melee)
+	FName SwordSocket = TEXT("GripPoint");
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Melee)
+	class UAnimMontage* MeleeAnimation;
+
+	//Seconds between automatic shots, UFireScheduler fires several in one frame if this is shorter than the frame
 	UPROPERTY(EditAnywhere)
 	float WeaponFireRate = .25f;
 
@@ -143,40 +192,30 @@ public:
 	float ForwardAxis;
 	float RightAxis;
 
-	//Double Jump
+	//Double Jump, performed by USUNCharacterMovementComponent
 	UPROPERTY(EditDefaultsOnly, Category = "Movement")
 	bool CanJumpInAir;
-	int  NumJumps;
 	UPROPERTY(EditDefaultsOnly, Category = "Movement")
 	int  MaxJumps;
 	void DoubleJump();
-	virtual void Landed(const FHitResult& Hit) override;
 	UPROPERTY(EditDefaultsOnly, Category = "Movement")
 	float JumpHeight = 500.f;
-	void SetJumps(int Jumps);
 
-	//Wall run
+	//Wall run, detection and movement live in UParkourComponent
 	UPROPERTY(EditDefaultsOnly, Category = "Movement")
 	bool CanWallRun;
-	bool IsWallRunning;
-	FVector WallRunDirection;
-	FTimerHandle WallRunTimer;
-	EWallRunSide WallRunSide;
 	FTimerHandle CameraTiltTimer;
-	void WallRun();
-	void BeginWallRun();
-	void EndWallRun(EWallRunEndReason Reason);
-	void FindDirectionAndSide(FVector WallNormal);
-	bool CanSurfaceBeRan(FVector SurfaceNormal) const;
+	FORCEINLINE class UParkourComponent* GetParkour() const { return Parkour; }
+	FORCEINLINE class UInputRecorderComponent* GetInputRecorder() const { return InputRecorder; }
+
+	FORCEINLINE class USUNCharacterMovementComponent* GetSUNMovement() const { return SUNMovement; }
 
-	//Dash
+	//Dash, performed by USUNCharacterMovementComponent
 	void Dash();
 	UPROPERTY(EditDefaultsOnly, Category = "Movement")
 	bool CanDash;
 	UPROPERTY(EditDefaultsOnly, Category = "Movement")
 	float DashAmount = 10;
-	FTimerHandle DashTimer;
-	void StopDash();
 
 	//Weapon Modes: Gun and Melee
 	EWeaponMode WeaponMode;
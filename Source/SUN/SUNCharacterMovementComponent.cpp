@@ -0,0 +1,369 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SUNCharacterMovementComponent.h"
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "SUNCharacter.h"
+#include "ParkourComponent.h"
+#include "LedgeGraphSubsystem.h"
+#include "Engine/NetConnection.h"
+#include "Engine/World.h"
+#include "Components/CapsuleComponent.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogSUNMovement, Log, All);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Movement corrections"), STAT_SUN_MovementCorrections, STATGROUP_SUN);
+
+//Corrections and bandwidth of every player this world is the server for
+static void ReportNetMovement(const TArray<FString>& Args, UWorld* World)
+{
+	if(!World || World->GetNetMode() == NM_Client)
+	{
+		UE_LOG(LogSUNMovement, Warning, TEXT("sun.Net.Movement only has the numbers on the server"));
+		return;
+	}
+
+	const float Seconds = FMath::Max(World->GetTimeSeconds(), KINDA_SMALL_NUMBER);
+	for(FConstPlayerControllerIterator Iterator = World->GetPlayerControllerIterator(); Iterator; ++Iterator)
+	{
+		const APlayerController* Player = Iterator->Get();
+		const ACharacter* Character = Player ? Cast<ACharacter>(Player->GetPawn()) : nullptr;
+		const USUNCharacterMovementComponent* Movement = Character ? Cast<USUNCharacterMovementComponent>(Character->GetCharacterMovement()) : nullptr;
+		if(!Movement)
+		{
+			continue;
+		}
+		const UNetConnection* Connection = Player->NetConnection;
+		UE_LOG(LogSUNMovement, Log, TEXT("%s: %d corrections (%.2f/s), in %d B/s, out %d B/s"),
+			*Player->GetName(), Movement->GetNumCorrections(), Movement->GetNumCorrections() / Seconds,
+			Connection ? Connection->InBytesPerSecond : 0, Connection ? Connection->OutBytesPerSecond : 0);
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs NetMovementCommand(
+	TEXT("sun.Net.Movement"),
+	TEXT("Logs movement corrections sent and bytes per second received and sent for every player"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&ReportNetMovement));
+
+float USUNCharacterMovementComponent::GetMaxSpeed() const
+{
+	//Wall running keeps the speed the player had on the ground
+	if(IsWallRunning())
+	{
+		return IsCrouching() ? MaxWalkSpeedCrouched : MaxWalkSpeed;
+	}
+	return Super::GetMaxSpeed();
+}
+
+void USUNCharacterMovementComponent::ResetAbilities()
+{
+	bWantsToDoubleJump = false;
+	bWantsToDash = false;
+	bWantsToWallRun = false;
+	JumpCount = 0;
+	DashTimeRemaining = 0.f;
+}
+
+void USUNCharacterMovementComponent::UpdateFromCompressedFlags(uint8 Flags)
+{
+	Super::UpdateFromCompressedFlags(Flags);
+
+	bWantsToDoubleJump = (Flags & FSavedMove_SUN::FLAG_DoubleJump) != 0;
+	bWantsToDash = (Flags & FSavedMove_SUN::FLAG_Dash) != 0;
+	bWantsToWallRun = (Flags & FSavedMove_SUN::FLAG_WallRun) != 0;
+}
+
+FNetworkPredictionData_Client* USUNCharacterMovementComponent::GetPredictionData_Client() const
+{
+	if(!ClientPredictionData)
+	{
+		USUNCharacterMovementComponent* MutableThis = const_cast<USUNCharacterMovementComponent*>(this);
+		MutableThis->ClientPredictionData = new FNetworkPredictionData_Client_SUN(*this);
+	}
+	return ClientPredictionData;
+}
+
+//Runs at the start of every move, on the owning client, on the server when it gets the move and again on the client
+//when it replays moves after a correction. The launches are applied by the move right after this
+void USUNCharacterMovementComponent::UpdateCharacterStateBeforeMovement(float DeltaSeconds)
+{
+	Super::UpdateCharacterStateBeforeMovement(DeltaSeconds);
+
+	if(bWantsToWallRun)
+	{
+		bWantsToWallRun = false;
+		if(IsFalling() && Parkour)
+		{
+			Parkour->BeginRequestedWallRun();
+		}
+	}
+	if(bWantsToDoubleJump)
+	{
+		bWantsToDoubleJump = false;
+		DoubleJump();
+	}
+	if(bWantsToDash)
+	{
+		bWantsToDash = false;
+		Dash();
+	}
+}
+
+void USUNCharacterMovementComponent::DoubleJump()
+{
+	const ASUNCharacter* Character = Cast<ASUNCharacter>(CharacterOwner);
+	if(!Character)
+	{
+		return;
+	}
+
+	//A ledge in reach is mantled even with no jumps left
+	FLedgeHit Ledge;
+	if((IsFalling() || IsWallRunning()) && Parkour && Parkour->FindLedge(Parkour->MantleDistance, Ledge))
+	{
+		Mantle(Ledge);
+		return;
+	}
+
+	if(JumpCount >= Character->MaxJumps)
+	{
+		return;
+	}
+
+	if(IsWallRunning() && Parkour)
+	{
+		//Slightly offset when jumping off a wall to jump away from it
+		const float AwayFromWall = Parkour->WallRunSide == Left ? 20.f : -20.f;
+		Parkour->EndWallRun(JumpedOffWall);
+		Launch(FVector(Velocity.X, Velocity.Y + AwayFromWall, Character->JumpHeight));
+		JumpCount = 1;
+	}
+	else
+	{
+		//Walking off a ledge uses up the first jump
+		JumpCount += IsFalling() ? 2 : 1;
+		Launch(FVector(Velocity.X, Velocity.Y, Character->JumpHeight));
+	}
+}
+
+//Launches just high enough for the bottom of the capsule to clear the ledge, moving toward it so the arc ends on top
+void USUNCharacterMovementComponent::Mantle(const FLedgeHit& Ledge)
+{
+	const ASUNCharacter* Character = Cast<ASUNCharacter>(CharacterOwner);
+	if(IsWallRunning())
+	{
+		Parkour->EndWallRun(JumpedOffWall);
+	}
+
+	const float HalfHeight = CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleHalfHeight();
+	const float Rise = FMath::Max(Ledge.Position.Z + HalfHeight + MantleClearance - UpdatedComponent->GetComponentLocation().Z, 0.f);
+	const FVector Toward = -Ledge.Normal.GetSafeNormal2D() * Parkour->MantleSpeed;
+	Launch(FVector(Toward.X, Toward.Y, FMath::Sqrt(2.f * FMath::Abs(GetGravityZ()) * Rise)));
+
+	//No air jumps until landing
+	JumpCount = Character->MaxJumps;
+}
+
+//Launches along the horizontal velocity, then slides without ground friction for DashDuration
+void USUNCharacterMovementComponent::Dash()
+{
+	const ASUNCharacter* Character = Cast<ASUNCharacter>(CharacterOwner);
+	if(!Character || !Character->CanDash)
+	{
+		return;
+	}
+
+	if(IsWallRunning() && Parkour)
+	{
+		Parkour->EndWallRun(JumpedOffWall);
+	}
+	Launch(FVector(Velocity.X, Velocity.Y, 0.f) * Character->DashAmount);
+	DashTimeRemaining = DashDuration;
+}
+
+void USUNCharacterMovementComponent::OnMovementUpdated(float DeltaSeconds, const FVector& OldLocation, const FVector& OldVelocity)
+{
+	Super::OnMovementUpdated(DeltaSeconds, OldLocation, OldVelocity);
+
+	//Counted in move time rather than with a timer, so the server ends the dash on the same move as the client
+	if(DashTimeRemaining > 0.f)
+	{
+		DashTimeRemaining -= DeltaSeconds;
+		if(DashTimeRemaining <= 0.f)
+		{
+			DashTimeRemaining = 0.f;
+			StopMovementImmediately();
+		}
+	}
+}
+
+void USUNCharacterMovementComponent::CalcVelocity(float DeltaTime, float Friction, bool bFluid, float BrakingDeceleration)
+{
+	if(IsDashing() && IsMovingOnGround())
+	{
+		Friction = 0.f;
+	}
+	Super::CalcVelocity(DeltaTime, Friction, bFluid, BrakingDeceleration);
+}
+
+void USUNCharacterMovementComponent::PhysCustom(float deltaTime, int32 Iterations)
+{
+	switch(CustomMovementMode)
+	{
+		case CMOVE_WallRun:
+			PhysWallRun(deltaTime, Iterations);
+			break;
+		default:
+			Super::PhysCustom(deltaTime, Iterations);
+			break;
+	}
+}
+
+void USUNCharacterMovementComponent::OnMovementModeChanged(EMovementMode PreviousMovementMode, uint8 PreviousCustomMode)
+{
+	Super::OnMovementModeChanged(PreviousMovementMode, PreviousCustomMode);
+
+	//Launches, landing or anything else that changes the mode also ends the wall run
+	const bool bWasWallRunning = PreviousMovementMode == MOVE_Custom && PreviousCustomMode == CMOVE_WallRun;
+	if(bWasWallRunning && !IsWallRunning() && Parkour)
+	{
+		Parkour->OnWallRunModeExited();
+	}
+
+	if(IsMovingOnGround())
+	{
+		JumpCount = 0;
+	}
+}
+
+bool USUNCharacterMovementComponent::ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel, const FVector& ClientWorldLocation, const FVector& RelativeClientLocation, UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode)
+{
+	const bool bError = Super::ServerCheckClientError(ClientTimeStamp, DeltaTime, Accel, ClientWorldLocation, RelativeClientLocation, ClientMovementBase, ClientBaseBoneName, ClientMovementMode);
+	if(bError)
+	{
+		NumCorrections++;
+		SUN_INC_COUNTER(STAT_SUN_MovementCorrections, Corrections, 1);
+	}
+	return bError;
+}
+
+//Moves along the wall with no gravity. The wall is checked once per substep, so the cost follows the
+//simulation rate instead of a separate timer
+void USUNCharacterMovementComponent::PhysWallRun(float deltaTime, int32 Iterations)
+{
+	if(deltaTime < MIN_TICK_TIME)
+	{
+		return;
+	}
+
+	if(!Parkour)
+	{
+		SetMovementMode(MOVE_Falling);
+		StartNewPhysics(deltaTime, Iterations);
+		return;
+	}
+
+	float RemainingTime = deltaTime;
+	while((RemainingTime >= MIN_TICK_TIME) && (Iterations < MaxSimulationIterations) && CharacterOwner && (CharacterOwner->Controller || bRunPhysicsWithNoController || CharacterOwner->GetLocalRole() == ROLE_SimulatedProxy))
+	{
+		Iterations++;
+		const float TimeTick = GetSimulationTimeStep(RemainingTime, Iterations);
+		RemainingTime -= TimeTick;
+
+		//Lost the wall or switched sides, the parkour component has already put us back in falling
+		if(!Parkour->UpdateWallRun())
+		{
+			StartNewPhysics(RemainingTime + TimeTick, Iterations - 1);
+			return;
+		}
+
+		const FVector WallRunVelocity = Parkour->WallRunDirection * GetMaxSpeed();
+		Velocity = FVector(WallRunVelocity.X, WallRunVelocity.Y, 0.f);
+
+		const FVector Delta = Velocity * TimeTick;
+		FHitResult Hit(1.f);
+		SafeMoveUpdatedComponent(Delta, UpdatedComponent->GetComponentQuat(), true, Hit);
+		if(Hit.Time < 1.f)
+		{
+			HandleImpact(Hit, TimeTick, Delta);
+			SlideAlongSurface(Delta, 1.f - Hit.Time, Hit.Normal, Hit, true);
+		}
+	}
+}
+
+void FSavedMove_SUN::Clear()
+{
+	Super::Clear();
+
+	bWantsToDoubleJump = false;
+	bWantsToDash = false;
+	bWantsToWallRun = false;
+	SavedJumpCount = 0;
+	SavedDashTimeRemaining = 0.f;
+}
+
+uint8 FSavedMove_SUN::GetCompressedFlags() const
+{
+	uint8 Flags = Super::GetCompressedFlags();
+	if(bWantsToDoubleJump)
+	{
+		Flags |= FLAG_DoubleJump;
+	}
+	if(bWantsToDash)
+	{
+		Flags |= FLAG_Dash;
+	}
+	if(bWantsToWallRun)
+	{
+		Flags |= FLAG_WallRun;
+	}
+	return Flags;
+}
+
+//Moves with different flags are never combined by the base class, a dash ending mid-move must not be either
+bool FSavedMove_SUN::CanCombineWith(const FSavedMovePtr& NewMove, ACharacter* InCharacter, float MaxDelta) const
+{
+	const FSavedMove_SUN* NewSUNMove = static_cast<const FSavedMove_SUN*>(NewMove.Get());
+	if((SavedDashTimeRemaining > 0.f) != (NewSUNMove->SavedDashTimeRemaining > 0.f))
+	{
+		return false;
+	}
+	return Super::CanCombineWith(NewMove, InCharacter, MaxDelta);
+}
+
+void FSavedMove_SUN::SetMoveFor(ACharacter* C, float InDeltaTime, FVector const& NewAccel, FNetworkPredictionData_Client_Character& ClientData)
+{
+	Super::SetMoveFor(C, InDeltaTime, NewAccel, ClientData);
+
+	if(const USUNCharacterMovementComponent* Movement = Cast<USUNCharacterMovementComponent>(C->GetCharacterMovement()))
+	{
+		bWantsToDoubleJump = Movement->bWantsToDoubleJump;
+		bWantsToDash = Movement->bWantsToDash;
+		bWantsToWallRun = Movement->bWantsToWallRun;
+		SavedJumpCount = Movement->JumpCount;
+		SavedDashTimeRemaining = Movement->DashTimeRemaining;
+	}
+}
+
+void FSavedMove_SUN::PrepMoveFor(ACharacter* C)
+{
+	Super::PrepMoveFor(C);
+
+	if(USUNCharacterMovementComponent* Movement = Cast<USUNCharacterMovementComponent>(C->GetCharacterMovement()))
+	{
+		Movement->bWantsToDoubleJump = bWantsToDoubleJump;
+		Movement->bWantsToDash = bWantsToDash;
+		Movement->bWantsToWallRun = bWantsToWallRun;
+		Movement->JumpCount = SavedJumpCount;
+		Movement->DashTimeRemaining = SavedDashTimeRemaining;
+	}
+}
+
+FSavedMovePtr FNetworkPredictionData_Client_SUN::AllocateNewMove()
+{
+	return FSavedMovePtr(new FSavedMove_SUN());
+}
@@ -0,0 +1,122 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "SUNCharacterMovementComponent.generated.h"
+
+class UParkourComponent;
+struct FLedgeHit;
+
+UENUM()
+enum ESUNCustomMovementMode
+{
+	CMOVE_WallRun = 0
+};
+
+//Character movement with the parkour modes. Wall running is MOVE_Custom/CMOVE_WallRun and is simulated in
+//substeps like the built in modes, the wall checks themselves are done by the owner's UParkourComponent.
+//Double jump, dash and starting a wall run are requested by the owner and happen inside the move, so they are
+//sent to the server in the saved move's compressed flags and replayed there and after corrections the same way
+UCLASS()
+class SUN_API USUNCharacterMovementComponent : public UCharacterMovementComponent
+{
+	GENERATED_BODY()
+
+	friend class FSavedMove_SUN;
+
+public:
+	//How long a dash slides without ground friction before the character is stopped
+	UPROPERTY(EditDefaultsOnly, Category = "Character Movement: Dash")
+	float DashDuration = .25f;
+
+	//How far the bottom of the capsule is launched above a ledge when mantling it
+	UPROPERTY(EditDefaultsOnly, Category = "Character Movement: Mantle")
+	float MantleClearance = 10.f;
+
+	bool IsWallRunning() const { return MovementMode == MOVE_Custom && CustomMovementMode == CMOVE_WallRun; }
+	bool IsDashing() const { return DashTimeRemaining > 0.f; }
+
+	void SetParkourComponent(UParkourComponent* InParkour) { Parkour = InParkour; }
+
+	//Performed at the start of the next move
+	void RequestDoubleJump() { bWantsToDoubleJump = true; }
+	void RequestDash() { bWantsToDash = true; }
+	//The parkour component found a runnable wall. The move checks it again before starting the wall run
+	void RequestWallRun() { bWantsToWallRun = true; }
+
+	//Drops pending requests, the dash and the jump count, for teleports like input replays
+	void ResetAbilities();
+
+	//Corrections the server has sent this character's client
+	int32 GetNumCorrections() const { return NumCorrections; }
+
+	virtual float GetMaxSpeed() const override;
+	virtual void UpdateFromCompressedFlags(uint8 Flags) override;
+	virtual class FNetworkPredictionData_Client* GetPredictionData_Client() const override;
+
+protected:
+	virtual void UpdateCharacterStateBeforeMovement(float DeltaSeconds) override;
+	virtual void OnMovementUpdated(float DeltaSeconds, const FVector& OldLocation, const FVector& OldVelocity) override;
+	virtual void CalcVelocity(float DeltaTime, float Friction, bool bFluid, float BrakingDeceleration) override;
+	virtual void PhysCustom(float deltaTime, int32 Iterations) override;
+	virtual void OnMovementModeChanged(EMovementMode PreviousMovementMode, uint8 PreviousCustomMode) override;
+	virtual bool ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel, const FVector& ClientWorldLocation, const FVector& RelativeClientLocation, UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode) override;
+
+	void PhysWallRun(float deltaTime, int32 Iterations);
+	void DoubleJump();
+	void Mantle(const FLedgeHit& Ledge);
+	void Dash();
+
+private:
+	UPROPERTY(Transient)
+	UParkourComponent* Parkour;
+
+	//Requests for the next move, FLAG_Custom_0 to 2 of the saved move
+	bool bWantsToDoubleJump = false;
+	bool bWantsToDash = false;
+	bool bWantsToWallRun = false;
+
+	//Ability state the moves change. Saved with each move so replays after a correction start from the same state
+	int32 JumpCount = 0;
+	float DashTimeRemaining = 0.f;
+
+	int32 NumCorrections = 0;
+};
+
+class FSavedMove_SUN : public FSavedMove_Character
+{
+public:
+	typedef FSavedMove_Character Super;
+
+	enum ESUNCompressedFlags
+	{
+		FLAG_DoubleJump = FLAG_Custom_0,
+		FLAG_Dash = FLAG_Custom_1,
+		FLAG_WallRun = FLAG_Custom_2
+	};
+
+	virtual void Clear() override;
+	virtual uint8 GetCompressedFlags() const override;
+	virtual bool CanCombineWith(const FSavedMovePtr& NewMove, ACharacter* InCharacter, float MaxDelta) const override;
+	virtual void SetMoveFor(ACharacter* C, float InDeltaTime, FVector const& NewAccel, class FNetworkPredictionData_Client_Character& ClientData) override;
+	virtual void PrepMoveFor(ACharacter* C) override;
+
+	uint8 bWantsToDoubleJump : 1;
+	uint8 bWantsToDash : 1;
+	uint8 bWantsToWallRun : 1;
+
+	int32 SavedJumpCount = 0;
+	float SavedDashTimeRemaining = 0.f;
+};
+
+class FNetworkPredictionData_Client_SUN : public FNetworkPredictionData_Client_Character
+{
+public:
+	typedef FNetworkPredictionData_Client_Character Super;
+
+	FNetworkPredictionData_Client_SUN(const UCharacterMovementComponent& ClientMovement) : Super(ClientMovement) {}
+
+	virtual FSavedMovePtr AllocateNewMove() override;
+};
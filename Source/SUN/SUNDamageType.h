@@ -0,0 +1,18 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/DamageType.h"
+#include "SUNDamageType.generated.h"
+
+//Damage type with a multiplier applied by UDamageSubsystem when the damage is resolved
+UCLASS()
+class SUN_API USUNDamageType : public UDamageType
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Damage)
+	float DamageScale = 1.f;
+};
@@ -0,0 +1,207 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SUNDebugDraw.h"
+
+#if SUN_DEBUG_DRAW
+
+#include "SUN.h"
+#include "DrawDebugHelpers.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Debug draw wall-run shapes"), STAT_SUN_DebugDrawWallRun, STATGROUP_SUN);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Debug draw hitscan shapes"), STAT_SUN_DebugDrawHitscan, STATGROUP_SUN);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Debug draw melee shapes"), STAT_SUN_DebugDrawMelee, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Debug draw shapes overwritten"), STAT_SUN_DebugDrawOverwritten, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Debug draw"), STAT_SUN_DebugDraw, STATGROUP_SUN);
+
+static TAutoConsoleVariable<int32> CVarDebugDrawCapacity(
+	TEXT("sun.DebugDraw.Capacity"),
+	256,
+	TEXT("Shapes kept per debug draw category and world, the oldest is overwritten once full. Read when a world first draws"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarDebugDrawWallRun(
+	TEXT("sun.DebugDraw.WallRun"),
+	1,
+	TEXT("Draw the wall-run stick probes"),
+	ECVF_Cheat);
+
+static TAutoConsoleVariable<int32> CVarDebugDrawHitscan(
+	TEXT("sun.DebugDraw.Hitscan"),
+	1,
+	TEXT("Draw every hitscan shot"),
+	ECVF_Cheat);
+
+static TAutoConsoleVariable<int32> CVarDebugDrawMelee(
+	TEXT("sun.DebugDraw.Melee"),
+	0,
+	TEXT("Draw every capsule swept for melee hits"),
+	ECVF_Cheat);
+
+namespace SUNDebugDraw
+{
+	enum class EShape : uint8
+	{
+		Line,
+		Capsule
+	};
+
+	struct FShape
+	{
+		EShape Type;
+		FColor Color;
+		FVector A;
+		FVector B;
+		FQuat Rotation;
+		float ExpireTime;
+	};
+
+	struct FRing
+	{
+		TArray<FShape> Shapes;
+		int32 Capacity = 0;
+		int32 Next = 0;
+		int32 NumLive = 0;
+	};
+
+	struct FWorldShapes
+	{
+		FRing Rings[(int32)ESUNDebugCategory::Num];
+	};
+
+	static TMap<const UWorld*, FWorldShapes> Worlds;
+	static FDelegateHandle PostActorTickHandle;
+	static FDelegateHandle WorldCleanupHandle;
+
+	static void SetLiveStat(ESUNDebugCategory Category, int32 NumLive)
+	{
+		switch(Category)
+		{
+		case ESUNDebugCategory::WallRun: SET_DWORD_STAT(STAT_SUN_DebugDrawWallRun, NumLive); break;
+		case ESUNDebugCategory::Hitscan: SET_DWORD_STAT(STAT_SUN_DebugDrawHitscan, NumLive); break;
+		case ESUNDebugCategory::Melee: SET_DWORD_STAT(STAT_SUN_DebugDrawMelee, NumLive); break;
+		default: break;
+		}
+	}
+
+	//Everything still alive is drawn for exactly one frame, so the line batcher is emptied again next frame
+	static void DrawWorld(UWorld* World, ELevelTick TickType, float DeltaTime)
+	{
+		FWorldShapes* WorldShapes = Worlds.Find(World);
+		if(!WorldShapes)
+		{
+			return;
+		}
+
+		SCOPE_CYCLE_COUNTER(STAT_SUN_DebugDraw);
+
+		const float Now = World->GetTimeSeconds();
+		for(int32 Category = 0; Category < (int32)ESUNDebugCategory::Num; Category++)
+		{
+			FRing& Ring = WorldShapes->Rings[Category];
+			const bool bEnabled = FSUNDebugDraw::IsEnabled((ESUNDebugCategory)Category);
+			int32 NumLive = 0;
+			for(const FShape& Shape : Ring.Shapes)
+			{
+				if(Shape.ExpireTime < Now)
+				{
+					continue;
+				}
+
+				NumLive++;
+				if(!bEnabled)
+				{
+					continue;
+				}
+				if(Shape.Type == EShape::Line)
+				{
+					DrawDebugLine(World, Shape.A, Shape.B, Shape.Color, false, -1.f);
+				}
+				else
+				{
+					DrawDebugCapsule(World, Shape.A, Shape.B.X, Shape.B.Y, Shape.Rotation, Shape.Color, false, -1.f);
+				}
+			}
+			Ring.NumLive = NumLive;
+			SetLiveStat((ESUNDebugCategory)Category, NumLive);
+		}
+	}
+
+	static void OnWorldCleanup(UWorld* World, bool bSessionEnded, bool bCleanupResources)
+	{
+		Worlds.Remove(World);
+	}
+
+	static void Add(const UWorld* World, ESUNDebugCategory Category, const FShape& Shape)
+	{
+		if(!PostActorTickHandle.IsValid())
+		{
+			PostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddStatic(&DrawWorld);
+			WorldCleanupHandle = FWorldDelegates::OnWorldCleanup.AddStatic(&OnWorldCleanup);
+		}
+
+		FRing& Ring = Worlds.FindOrAdd(World).Rings[(int32)Category];
+		if(Ring.Capacity == 0)
+		{
+			Ring.Capacity = FMath::Max(CVarDebugDrawCapacity.GetValueOnGameThread(), 1);
+			Ring.Shapes.Reserve(Ring.Capacity);
+		}
+
+		if(Ring.Shapes.Num() < Ring.Capacity)
+		{
+			Ring.Shapes.Add(Shape);
+			return;
+		}
+
+		if(Ring.Shapes[Ring.Next].ExpireTime >= World->GetTimeSeconds())
+		{
+			INC_DWORD_STAT(STAT_SUN_DebugDrawOverwritten);
+		}
+		Ring.Shapes[Ring.Next] = Shape;
+		Ring.Next = (Ring.Next + 1) % Ring.Capacity;
+	}
+}
+
+bool FSUNDebugDraw::IsEnabled(ESUNDebugCategory Category)
+{
+	switch(Category)
+	{
+	case ESUNDebugCategory::WallRun: return CVarDebugDrawWallRun.GetValueOnGameThread() != 0;
+	case ESUNDebugCategory::Hitscan: return CVarDebugDrawHitscan.GetValueOnGameThread() != 0;
+	case ESUNDebugCategory::Melee: return CVarDebugDrawMelee.GetValueOnGameThread() != 0;
+	default: return false;
+	}
+}
+
+int32 FSUNDebugDraw::GetNumShapes(const UWorld* World)
+{
+	const SUNDebugDraw::FWorldShapes* WorldShapes = SUNDebugDraw::Worlds.Find(World);
+	int32 NumShapes = 0;
+	for(int32 Category = 0; WorldShapes && Category < (int32)ESUNDebugCategory::Num; Category++)
+	{
+		NumShapes += WorldShapes->Rings[Category].Shapes.Num();
+	}
+	return NumShapes;
+}
+
+//Nobody looks at a dedicated server, the shapes would only be kept and walked for nothing
+void FSUNDebugDraw::Line(const UWorld* World, ESUNDebugCategory Category, const FVector& Start, const FVector& End, const FColor& Color, float Duration)
+{
+	if(World && IsEnabled(Category) && World->GetNetMode() != NM_DedicatedServer)
+	{
+		SUNDebugDraw::Add(World, Category, { SUNDebugDraw::EShape::Line, Color, Start, End, FQuat::Identity, World->GetTimeSeconds() + Duration });
+	}
+}
+
+//B carries the half height and radius
+void FSUNDebugDraw::Capsule(const UWorld* World, ESUNDebugCategory Category, const FVector& Center, float HalfHeight, float Radius, const FQuat& Rotation, const FColor& Color, float Duration)
+{
+	if(World && IsEnabled(Category) && World->GetNetMode() != NM_DedicatedServer)
+	{
+		SUNDebugDraw::Add(World, Category, { SUNDebugDraw::EShape::Capsule, Color, Center, FVector(HalfHeight, Radius, 0.f), Rotation, World->GetTimeSeconds() + Duration });
+	}
+}
+
+#endif
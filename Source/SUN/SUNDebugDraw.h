@@ -0,0 +1,47 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Gameplay debug drawing, gone entirely from Shipping and Test builds, call sites included
+#ifndef SUN_DEBUG_DRAW
+#define SUN_DEBUG_DRAW !(UE_BUILD_SHIPPING || UE_BUILD_TEST)
+#endif
+
+enum class ESUNDebugCategory : uint8
+{
+	WallRun,
+	Hitscan,
+	Melee,
+	Num
+};
+
+#if SUN_DEBUG_DRAW
+
+class UWorld;
+
+//Shapes are kept per world in one fixed-size ring per category (sun.DebugDraw.Capacity) and redrawn as one-frame lines
+//after every world tick until their duration runs out. When a ring is full the oldest shape is overwritten, so nothing
+//ever accumulates in the line batcher however long the session runs. Each category is toggled by sun.DebugDraw.<Category>
+class SUN_API FSUNDebugDraw
+{
+public:
+	static bool IsEnabled(ESUNDebugCategory Category);
+
+	//Shapes kept for World over all categories, live or expired
+	static int32 GetNumShapes(const UWorld* World);
+
+	static void Line(const UWorld* World, ESUNDebugCategory Category, const FVector& Start, const FVector& End, const FColor& Color, float Duration);
+	static void Capsule(const UWorld* World, ESUNDebugCategory Category, const FVector& Center, float HalfHeight, float Radius, const FQuat& Rotation, const FColor& Color, float Duration);
+};
+
+#define SUN_DRAW_LINE(World, Category, Start, End, Color, Duration) FSUNDebugDraw::Line(World, ESUNDebugCategory::Category, Start, End, Color, Duration)
+#define SUN_DRAW_CAPSULE(World, Category, Center, HalfHeight, Radius, Rotation, Color, Duration) FSUNDebugDraw::Capsule(World, ESUNDebugCategory::Category, Center, HalfHeight, Radius, Rotation, Color, Duration)
+
+#else
+
+#define SUN_DRAW_LINE(World, Category, Start, End, Color, Duration)
+#define SUN_DRAW_CAPSULE(World, Category, Center, HalfHeight, Radius, Rotation, Color, Duration)
+
+#endif
@@ -1,12 +1,49 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "SUNHUD.h"
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "DamageSubsystem.h"
+#include "HealthComponent.h"
 #include "Engine/Canvas.h"
+#include "Engine/Engine.h"
+#include "Engine/Font.h"
 #include "Engine/Texture2D.h"
 #include "TextureResource.h"
 #include "CanvasItem.h"
+#include "CanvasTypes.h"
+#include "RenderUtils.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
 #include "UObject/ConstructorHelpers.h"
 
+DECLARE_DWORD_COUNTER_STAT(TEXT("HUD draw calls"), STAT_SUN_HUDDrawCalls, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("HUD static rebuilds"), STAT_SUN_HUDRebuilds, STATGROUP_SUN);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("HUD damage numbers"), STAT_SUN_HUDDamageNumbers, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("HUD draw"), STAT_SUN_HUDDraw, STATGROUP_SUN);
+
+static TAutoConsoleVariable<int32> CVarHUDMaxDamageNumbers(
+	TEXT("sun.HUD.MaxDamageNumbers"),
+	256,
+	TEXT("Damage numbers on screen at once, the oldest is reused after that. Read when the HUD is created"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarHUDDamageNumberTime(
+	TEXT("sun.HUD.DamageNumberTime"),
+	1.f,
+	TEXT("Seconds a damage number floats up before it is gone"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarPerfOverlay(
+	TEXT("sun.PerfOverlay"),
+	0,
+	TEXT("1 draws the game thread time of the gameplay systems and their counts in the top left corner"),
+	ECVF_Default);
+
+static const float HealthBarTime = 3.f;
+static const float HitMarkerDuration = 0.15f;
+static const float DamageNumberRise = 60.f;
+
 ASUNHUD::ASUNHUD()
 {
 	// Set the crosshair texture
@@ -14,22 +51,335 @@ ASUNHUD::ASUNHUD()
 	CrosshairTex = CrosshairTexObj.Object;
 }
 
+void ASUNHUD::BeginPlay()
+{
+	Super::BeginPlay();
+
+	DamageNumbers.SetNumZeroed(FMath::Max(CVarHUDMaxDamageNumbers.GetValueOnGameThread(), 1));
+	CacheDigitGlyphs();
+	HitsHandle = GetWorld()->GetSubsystem<UDamageSubsystem>()->OnHits.AddUObject(this, &ASUNHUD::OnHits);
+}
+
+void ASUNHUD::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if(UDamageSubsystem* Damage = GetWorld()->GetSubsystem<UDamageSubsystem>())
+	{
+		Damage->OnHits.Remove(HitsHandle);
+	}
+	DEC_DWORD_STAT_BY(STAT_SUN_HUDDamageNumbers, DamageNumbers.FilterByPredicate([](const FDamageNumber& Number) { return Number.bActive; }).Num());
+	Super::EndPlay(EndPlayReason);
+}
 
 void ASUNHUD::DrawHUD()
 {
 	Super::DrawHUD();
+	SUN_SCOPE_CYCLE_COUNTER(STAT_SUN_HUDDraw, HUD);
+
+	const FVector2D CanvasSize(Canvas->ClipX, Canvas->ClipY);
+	const UHealthComponent* PlayerHealth = GetOwningPawn() ? GetOwningPawn()->FindComponentByClass<UHealthComponent>() : nullptr;
+	const float Health = PlayerHealth ? PlayerHealth->CurrentHealth : -1.f;
+	if(CanvasSize != BuiltCanvasSize || Health != BuiltHealth)
+	{
+		BuiltCanvasSize = CanvasSize;
+		BuiltHealth = Health;
+		RebuildStatic();
+	}
+	RebuildDynamic();
+
+	//One draw per texture: the crosshair, every white shape, and one per font page used by the damage numbers
+	Submit(CrosshairTex ? CrosshairTex->Resource : nullptr, { &CrosshairQuads });
+	Submit(GWhiteTexture, { &StaticQuads, &DynamicQuads });
+	if(bBatchedDigits)
+	{
+		for(int32 Page = 0; Page < DigitQuads.Num(); Page++)
+		{
+			UTexture2D* PageTexture = DamageNumberFont->Textures[Page];
+			Submit(PageTexture ? PageTexture->Resource : nullptr, { &DigitQuads[Page] });
+		}
+	}
+
+	if(CVarPerfOverlay.GetValueOnGameThread() != 0)
+	{
+		DrawPerfOverlay();
+	}
+}
+
+//Text is fine here, this is a debug view and it is off by default
+void ASUNHUD::DrawPerfOverlay()
+{
+	UFont* Font = GEngine->GetSmallFont();
+	const float LineHeight = Font->GetMaxCharHeight() + 2.f;
+	FVector2D Position(20.f, 40.f);
+
+	FCanvasTextItem TextItem(Position, FText::GetEmpty(), Font, FLinearColor::White);
+	TextItem.EnableShadow(FLinearColor::Black);
+	auto DrawLine = [&](const FString& Line, const FLinearColor& Color)
+	{
+		TextItem.Position = Position;
+		TextItem.Text = FText::FromString(Line);
+		TextItem.SetColor(Color);
+		Canvas->DrawItem(TextItem);
+		INC_DWORD_STAT(STAT_SUN_HUDDrawCalls);
+		Position.Y += LineHeight;
+	};
+
+	const float FrameMs = FApp::GetDeltaTime() * 1000.f;
+	DrawLine(FString::Printf(TEXT("Frame %.2f ms"), FrameMs), FLinearColor::White);
+	DrawLine(TEXT("Game thread ms            last    avg   peak"), FLinearColor::Gray);
+	for(int32 Index = 0; Index < (int32)ESUNPerfScope::Num; Index++)
+	{
+		const ESUNPerfScope Scope = (ESUNPerfScope)Index;
+		const float Peak = FSUNPerf::GetPeakMs(Scope);
+		//Anything that took a tenth of the frame at some point in the window stands out
+		const FLinearColor Color = Peak > FrameMs * 0.1f ? FLinearColor::Yellow : FLinearColor::White;
+		DrawLine(FString::Printf(TEXT("%-22s %6.2f %6.2f %6.2f"), FSUNPerf::GetName(Scope), FSUNPerf::GetMs(Scope), FSUNPerf::GetAverageMs(Scope), Peak), Color);
+	}
+	for(int32 Index = 0; Index < (int32)ESUNPerfCounter::Num; Index++)
+	{
+		const ESUNPerfCounter Counter = (ESUNPerfCounter)Index;
+		DrawLine(FString::Printf(TEXT("%-22s %6d"), FSUNPerf::GetName(Counter), FSUNPerf::GetCount(Counter)), FLinearColor::White);
+	}
+}
+
+void ASUNHUD::OnHits(const TArray<FHitEvent>& Hits)
+{
+	const APawn* Pawn = GetOwningPawn();
+	const float Now = GetWorld()->GetTimeSeconds();
+	for(const FHitEvent& Hit : Hits)
+	{
+		//Actor-less horde enemies have no location to show anything at
+		if(!Hit.Health || !Hit.Health->GetOwner() || Hit.Health->GetOwner() == Pawn)
+		{
+			continue;
+		}
+
+		FDamageNumber& Number = DamageNumbers[NextDamageNumber];
+		if(!Number.bActive)
+		{
+			INC_DWORD_STAT(STAT_SUN_HUDDamageNumbers);
+		}
+		Number.WorldLocation = Hit.Health->GetOwner()->GetActorLocation() + FVector(FMath::FRandRange(-20.f, 20.f), FMath::FRandRange(-20.f, 20.f), 50.f);
+		Number.SpawnTime = Now;
+		Number.Value = FMath::Max(FMath::RoundToInt(Hit.Amount), 1);
+		Number.bActive = true;
+		NextDamageNumber = (NextDamageNumber + 1) % DamageNumbers.Num();
+
+		RecentlyHit.Add(Hit.Health, Now);
+		const AActor* Causer = Hit.Causer.Get();
+		if(Pawn && Causer && (Causer == Pawn || Causer->GetInstigator() == Pawn))
+		{
+			HitMarkerTime = Now;
+		}
+	}
+}
+
+//Digit glyphs are read from the font once, damage numbers are then laid out without touching the font again
+void ASUNHUD::CacheDigitGlyphs()
+{
+	if(!DamageNumberFont)
+	{
+		DamageNumberFont = GEngine->GetMediumFont();
+	}
 
-	// Draw very simple crosshair
+	bBatchedDigits = DamageNumberFont && DamageNumberFont->FontCacheType == EFontCacheType::Offline && DamageNumberFont->Textures.Num() > 0;
+	if(!bBatchedDigits)
+	{
+		return;
+	}
+
+	for(int32 Digit = 0; Digit < 10; Digit++)
+	{
+		const int32 CharIndex = DamageNumberFont->RemapChar(TEXT('0') + Digit);
+		if(!DamageNumberFont->Characters.IsValidIndex(CharIndex))
+		{
+			bBatchedDigits = false;
+			return;
+		}
+
+		const FFontCharacter& Char = DamageNumberFont->Characters[CharIndex];
+		const UTexture2D* Texture = DamageNumberFont->Textures.IsValidIndex(Char.TextureIndex) ? DamageNumberFont->Textures[Char.TextureIndex] : nullptr;
+		if(!Texture)
+		{
+			bBatchedDigits = false;
+			return;
+		}
+
+		const FVector2D TextureSize(Texture->GetSurfaceWidth(), Texture->GetSurfaceHeight());
+		FDigitGlyph& Glyph = DigitGlyphs[Digit];
+		Glyph.Size = FVector2D(Char.USize, Char.VSize);
+		Glyph.UVMin = FVector2D(Char.StartU, Char.StartV) / TextureSize;
+		Glyph.UVMax = FVector2D(Char.StartU + Char.USize, Char.StartV + Char.VSize) / TextureSize;
+		Glyph.VerticalOffset = Char.VerticalOffset;
+		Glyph.TextureIndex = Char.TextureIndex;
+	}
+	DigitQuads.SetNum(DamageNumberFont->Textures.Num());
+}
+
+void ASUNHUD::RebuildStatic()
+{
+	INC_DWORD_STAT(STAT_SUN_HUDRebuilds);
 
 	// find center of the Canvas
 	const FVector2D Center(Canvas->ClipX * 0.5f, Canvas->ClipY * 0.5f);
 
-	// offset by half the texture's dimensions so that the center of the texture aligns with the center of the Canvas
-	const FVector2D CrosshairDrawPosition( (Center.X),
-										   (Center.Y - 5.0f));
+	CrosshairQuads.Reset();
+	if(CrosshairTex)
+	{
+		// offset by half the texture's dimensions so that the center of the texture aligns with the center of the Canvas
+		const FVector2D CrosshairDrawPosition(Center.X, Center.Y - 5.0f);
+		const FVector2D Size(CrosshairTex->GetSurfaceWidth(), CrosshairTex->GetSurfaceHeight());
+		CrosshairQuads.Add({ CrosshairDrawPosition, CrosshairDrawPosition + Size, FVector2D(0.f, 0.f), FVector2D(1.f, 1.f), FLinearColor::White });
+	}
+
+	//Player health, bottom left
+	StaticQuads.Reset();
+	const UHealthComponent* PlayerHealth = GetOwningPawn() ? GetOwningPawn()->FindComponentByClass<UHealthComponent>() : nullptr;
+	if(PlayerHealth && PlayerHealth->GetMaxHealth() > 0.f)
+	{
+		const FVector2D Min(40.f, Canvas->ClipY - 60.f);
+		const FVector2D Size(300.f, 20.f);
+		const float Fraction = FMath::Clamp(PlayerHealth->CurrentHealth / PlayerHealth->GetMaxHealth(), 0.f, 1.f);
+		StaticQuads.Add({ Min, Min + Size, FVector2D::ZeroVector, FVector2D::UnitVector, FLinearColor(0.f, 0.f, 0.f, 0.5f) });
+		StaticQuads.Add({ Min, Min + FVector2D(Size.X * Fraction, Size.Y), FVector2D::ZeroVector, FVector2D::UnitVector, FLinearColor(0.8f, 0.1f, 0.1f, 0.9f) });
+	}
+}
+
+//Follows the camera, so written every frame, but into arrays that keep their memory
+void ASUNHUD::RebuildDynamic()
+{
+	DynamicQuads.Reset();
+	for(TArray<FHUDQuad>& Page : DigitQuads)
+	{
+		Page.Reset();
+	}
+
+	const float Now = GetWorld()->GetTimeSeconds();
+	const FVector2D Center(Canvas->ClipX * 0.5f, Canvas->ClipY * 0.5f);
+
+	if(Now - HitMarkerTime < HitMarkerDuration)
+	{
+		//Four short ticks around the crosshair
+		const FLinearColor Color(1.f, 1.f, 1.f, 1.f - (Now - HitMarkerTime) / HitMarkerDuration);
+		const float Inner = 8.f;
+		const float Outer = 16.f;
+		const float Half = 1.f;
+		DynamicQuads.Add({ Center + FVector2D(-Outer, -Half), Center + FVector2D(-Inner, Half), FVector2D::ZeroVector, FVector2D::UnitVector, Color });
+		DynamicQuads.Add({ Center + FVector2D(Inner, -Half), Center + FVector2D(Outer, Half), FVector2D::ZeroVector, FVector2D::UnitVector, Color });
+		DynamicQuads.Add({ Center + FVector2D(-Half, -Outer), Center + FVector2D(Half, -Inner), FVector2D::ZeroVector, FVector2D::UnitVector, Color });
+		DynamicQuads.Add({ Center + FVector2D(-Half, Inner), Center + FVector2D(Half, Outer), FVector2D::ZeroVector, FVector2D::UnitVector, Color });
+	}
+
+	for(auto It = RecentlyHit.CreateIterator(); It; ++It)
+	{
+		const UHealthComponent* Health = It.Key().Get();
+		if(!Health || !Health->GetOwner() || Now - It.Value() > HealthBarTime || Health->CurrentHealth <= 0.f)
+		{
+			It.RemoveCurrent();
+			continue;
+		}
+
+		const FVector Screen = Project(Health->GetOwner()->GetActorLocation() + FVector(0.f, 0.f, 100.f));
+		if(Screen.Z <= 0.f)
+		{
+			continue;
+		}
+		const FVector2D Size(60.f, 6.f);
+		const FVector2D Min = FVector2D(Screen.X, Screen.Y) - Size * 0.5f;
+		const float Fraction = FMath::Clamp(Health->CurrentHealth / FMath::Max(Health->GetMaxHealth(), 1.f), 0.f, 1.f);
+		DynamicQuads.Add({ Min, Min + Size, FVector2D::ZeroVector, FVector2D::UnitVector, FLinearColor(0.f, 0.f, 0.f, 0.5f) });
+		DynamicQuads.Add({ Min, Min + FVector2D(Size.X * Fraction, Size.Y), FVector2D::ZeroVector, FVector2D::UnitVector, FLinearColor(0.9f, 0.2f, 0.1f, 0.9f) });
+	}
+
+	const float Lifetime = FMath::Max(CVarHUDDamageNumberTime.GetValueOnGameThread(), 0.01f);
+	for(FDamageNumber& Number : DamageNumbers)
+	{
+		if(!Number.bActive)
+		{
+			continue;
+		}
+
+		const float Age = (Now - Number.SpawnTime) / Lifetime;
+		if(Age >= 1.f)
+		{
+			Number.bActive = false;
+			DEC_DWORD_STAT(STAT_SUN_HUDDamageNumbers);
+			continue;
+		}
+
+		const FVector Screen = Project(Number.WorldLocation);
+		if(Screen.Z > 0.f)
+		{
+			AddDamageNumber(Number, FVector2D(Screen.X, Screen.Y - Age * DamageNumberRise), 1.f - Age * Age);
+		}
+	}
+}
+
+void ASUNHUD::AddDamageNumber(const FDamageNumber& Number, const FVector2D& ScreenPosition, float Alpha)
+{
+	const FLinearColor Color(1.f, 0.85f, 0.2f, Alpha);
+	if(!bBatchedDigits)
+	{
+		//Slow path, one text item per number
+		FCanvasTextItem TextItem(ScreenPosition, FText::AsNumber(Number.Value), DamageNumberFont ? DamageNumberFont : GEngine->GetMediumFont(), Color);
+		TextItem.Scale = FVector2D(DamageNumberScale, DamageNumberScale);
+		TextItem.bCentreX = true;
+		Canvas->DrawItem(TextItem);
+		INC_DWORD_STAT(STAT_SUN_HUDDrawCalls);
+		return;
+	}
+
+	//Digits right to left, then centred on the position
+	int32 Digits[10];
+	int32 NumDigits = 0;
+	float Width = 0.f;
+	for(int32 Value = Number.Value; NumDigits == 0 || (Value > 0 && NumDigits < 10); Value /= 10)
+	{
+		Digits[NumDigits] = Value % 10;
+		Width += DigitGlyphs[Digits[NumDigits]].Size.X * DamageNumberScale;
+		NumDigits++;
+	}
+
+	float X = ScreenPosition.X - Width * 0.5f;
+	for(int32 Index = NumDigits - 1; Index >= 0; Index--)
+	{
+		const FDigitGlyph& Glyph = DigitGlyphs[Digits[Index]];
+		const FVector2D Min(X, ScreenPosition.Y + Glyph.VerticalOffset * DamageNumberScale);
+		DigitQuads[Glyph.TextureIndex].Add({ Min, Min + Glyph.Size * DamageNumberScale, Glyph.UVMin, Glyph.UVMax, Color });
+		X += Glyph.Size.X * DamageNumberScale;
+	}
+}
+
+//Goes straight to the canvas' batched elements, FCanvasTriangleItem would copy the triangle list every frame
+void ASUNHUD::Submit(const FTexture* Texture, std::initializer_list<const TArray<FHUDQuad>*> Lists)
+{
+	int32 NumQuads = 0;
+	for(const TArray<FHUDQuad>* List : Lists)
+	{
+		NumQuads += List->Num();
+	}
+	if(NumQuads == 0 || !Texture)
+	{
+		return;
+	}
+
+	FCanvas* Target = Canvas->Canvas;
+	FBatchedElements* Batched = Target->GetBatchedElements(FCanvas::ET_Triangle, nullptr, Texture, SE_BLEND_Translucent);
+	const FMatrix& Transform = Target->GetTransformStack().Top().GetMatrix();
+	const FHitProxyId HitProxyId = Target->GetHitProxyId();
+	Batched->ReserveVertices(NumQuads * 4);
+	Batched->ReserveTriangles(NumQuads * 2, Texture, SE_BLEND_Translucent);
 
-	// draw the crosshair
-	FCanvasTileItem TileItem( CrosshairDrawPosition, CrosshairTex->Resource, FLinearColor::White);
-	TileItem.BlendMode = SE_BLEND_Translucent;
-	Canvas->DrawItem( TileItem );
+	for(const TArray<FHUDQuad>* List : Lists)
+	{
+		for(const FHUDQuad& Quad : *List)
+		{
+			const int32 V0 = Batched->AddVertex(Transform.TransformFVector4(FVector4(Quad.Min.X, Quad.Min.Y, 0.f, 1.f)), Quad.UVMin, Quad.Color, HitProxyId);
+			const int32 V1 = Batched->AddVertex(Transform.TransformFVector4(FVector4(Quad.Max.X, Quad.Min.Y, 0.f, 1.f)), FVector2D(Quad.UVMax.X, Quad.UVMin.Y), Quad.Color, HitProxyId);
+			const int32 V2 = Batched->AddVertex(Transform.TransformFVector4(FVector4(Quad.Max.X, Quad.Max.Y, 0.f, 1.f)), Quad.UVMax, Quad.Color, HitProxyId);
+			const int32 V3 = Batched->AddVertex(Transform.TransformFVector4(FVector4(Quad.Min.X, Quad.Max.Y, 0.f, 1.f)), FVector2D(Quad.UVMin.X, Quad.UVMax.Y), Quad.Color, HitProxyId);
+			Batched->AddTriangle(V0, V1, V2, Texture, SE_BLEND_Translucent);
+			Batched->AddTriangle(V0, V2, V3, Texture, SE_BLEND_Translucent);
+		}
+	}
+	INC_DWORD_STAT(STAT_SUN_HUDDrawCalls);
 }
@@ -6,6 +6,10 @@
 #include "GameFramework/HUD.h"
 #include "SUNHUD.generated.h"
 
+class UFont;
+class FTexture;
+struct FHitEvent;
+
 UCLASS()
 class ASUNHUD : public AHUD
 {
@@ -17,9 +21,79 @@ public:
 	/** Primary draw call for the HUD */
 	virtual void DrawHUD() override;
 
+	//Needs an offline cached font to be batched, runtime fonts fall back to one text item per number
+	UPROPERTY(EditDefaultsOnly, Category = HUD)
+	UFont* DamageNumberFont;
+
+	UPROPERTY(EditDefaultsOnly, Category = HUD)
+	float DamageNumberScale = 1.f;
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 private:
+	//Screen space rectangle, two triangles once submitted
+	struct FHUDQuad
+	{
+		FVector2D Min;
+		FVector2D Max;
+		FVector2D UVMin;
+		FVector2D UVMax;
+		FLinearColor Color;
+	};
+
+	//Pooled, the oldest is reused once they are all taken
+	struct FDamageNumber
+	{
+		FVector WorldLocation;
+		float SpawnTime;
+		int32 Value;
+		bool bActive;
+	};
+
+	//Where a digit sits in the font, cached once per font
+	struct FDigitGlyph
+	{
+		FVector2D Size;
+		FVector2D UVMin;
+		FVector2D UVMax;
+		float VerticalOffset;
+		int32 TextureIndex;
+	};
+
+	void OnHits(const TArray<FHitEvent>& Hits);
+	void CacheDigitGlyphs();
+	void RebuildStatic();
+	void RebuildDynamic();
+	void DrawPerfOverlay();
+	void AddDamageNumber(const FDamageNumber& Number, const FVector2D& ScreenPosition, float Alpha);
+
+	//Everything in Lists is one batch, so one draw call
+	void Submit(const FTexture* Texture, std::initializer_list<const TArray<FHUDQuad>*> Lists);
+
 	/** Crosshair asset pointer */
 	class UTexture2D* CrosshairTex;
 
-};
+	//Only rebuilt when the canvas size or the player's health changes
+	TArray<FHUDQuad> CrosshairQuads;
+	TArray<FHUDQuad> StaticQuads;
+	FVector2D BuiltCanvasSize = FVector2D::ZeroVector;
+	float BuiltHealth = -1.f;
+
+	//Rebuilt every frame in place, they follow the camera
+	TArray<FHUDQuad> DynamicQuads;
+	TArray<TArray<FHUDQuad>> DigitQuads;
+
+	TArray<FDamageNumber> DamageNumbers;
+	int32 NextDamageNumber = 0;
 
+	FDigitGlyph DigitGlyphs[10];
+	bool bBatchedDigits = false;
+
+	//Enemies hit recently get a health bar
+	TMap<TWeakObjectPtr<class UHealthComponent>, float> RecentlyHit;
+	float HitMarkerTime = -MAX_flt;
+
+	FDelegateHandle HitsHandle;
+};
@@ -0,0 +1,145 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SUNPerf.h"
+#include "Engine/World.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/DelayedAutoRegister.h"
+
+namespace SUNPerf
+{
+	static uint32 FrameCycles[(int32)ESUNPerfScope::Num] = {};
+	static int32 FrameCounts[(int32)ESUNPerfCounter::Num] = {};
+
+	static float LastMs[(int32)ESUNPerfScope::Num] = {};
+	static float AverageMs[(int32)ESUNPerfScope::Num] = {};
+	static float History[(int32)ESUNPerfScope::Num][FSUNPerf::PeakFrames] = {};
+	static int32 LastCounts[(int32)ESUNPerfCounter::Num] = {};
+	static int32 HistoryIndex = 0;
+	static uint32 FrameStartCycles = 0;
+	static float FrameMs = 0.f;
+
+	//The frame's first world tick, after the engine has waited out the max tick rate. OnBeginFrame comes before that
+	//wait, a capped frame would always measure the whole frame budget
+	static void BeginWorldTick(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+	{
+		if(!FrameStartCycles)
+		{
+			FrameStartCycles = FPlatformTime::Cycles();
+		}
+	}
+
+	//Everything added this frame becomes the last frame's numbers
+	static void EndFrame()
+	{
+		FrameMs = FrameStartCycles ? FPlatformTime::ToMilliseconds(FPlatformTime::Cycles() - FrameStartCycles) : 0.f;
+		FrameStartCycles = 0;
+		for(int32 Scope = 0; Scope < (int32)ESUNPerfScope::Num; Scope++)
+		{
+			const float Ms = FPlatformTime::ToMilliseconds(FrameCycles[Scope]);
+			LastMs[Scope] = Ms;
+			AverageMs[Scope] = FMath::Lerp(AverageMs[Scope], Ms, 0.05f);
+			History[Scope][HistoryIndex] = Ms;
+			FrameCycles[Scope] = 0;
+		}
+		for(int32 Counter = 0; Counter < (int32)ESUNPerfCounter::Num; Counter++)
+		{
+			LastCounts[Counter] = FrameCounts[Counter];
+			FrameCounts[Counter] = 0;
+		}
+		HistoryIndex = (HistoryIndex + 1) % FSUNPerf::PeakFrames;
+
+		FSUNPerf::OnFrameEnd.Broadcast();
+	}
+
+	static FDelayedAutoRegisterHelper RegisterEndFrame(EDelayedRegisterRunPhase::EndOfEngineInit, []()
+	{
+		FWorldDelegates::OnWorldTickStart.AddStatic(&BeginWorldTick);
+		FCoreDelegates::OnEndFrame.AddStatic(&EndFrame);
+	});
+}
+
+FSimpleMulticastDelegate FSUNPerf::OnFrameEnd;
+
+//Worker threads are left out, only game thread work is summed
+void FSUNPerf::AddCycles(ESUNPerfScope Scope, uint32 Cycles)
+{
+	if(IsInGameThread())
+	{
+		SUNPerf::FrameCycles[(int32)Scope] += Cycles;
+	}
+}
+
+void FSUNPerf::AddCount(ESUNPerfCounter Counter, int32 Amount)
+{
+	if(IsInGameThread())
+	{
+		SUNPerf::FrameCounts[(int32)Counter] += Amount;
+	}
+}
+
+float FSUNPerf::GetFrameMs()
+{
+	return SUNPerf::FrameMs;
+}
+
+float FSUNPerf::GetMs(ESUNPerfScope Scope)
+{
+	return SUNPerf::LastMs[(int32)Scope];
+}
+
+float FSUNPerf::GetAverageMs(ESUNPerfScope Scope)
+{
+	return SUNPerf::AverageMs[(int32)Scope];
+}
+
+float FSUNPerf::GetPeakMs(ESUNPerfScope Scope)
+{
+	float Peak = 0.f;
+	for(const float Ms : SUNPerf::History[(int32)Scope])
+	{
+		Peak = FMath::Max(Peak, Ms);
+	}
+	return Peak;
+}
+
+int32 FSUNPerf::GetCount(ESUNPerfCounter Counter)
+{
+	return SUNPerf::LastCounts[(int32)Counter];
+}
+
+const TCHAR* FSUNPerf::GetName(ESUNPerfScope Scope)
+{
+	switch(Scope)
+	{
+	case ESUNPerfScope::CharacterTick: return TEXT("Character tick");
+	case ESUNPerfScope::WallRunDetect: return TEXT("Wall-run detection");
+	case ESUNPerfScope::FireShot: return TEXT("FireShot");
+	case ESUNPerfScope::Hitscan: return TEXT("Hitscan");
+	case ESUNPerfScope::DamageHandling: return TEXT("Damage handling");
+	case ESUNPerfScope::DamageResolve: return TEXT("Damage resolve");
+	case ESUNPerfScope::ProjectileHit: return TEXT("Projectile hit");
+	case ESUNPerfScope::ProjectileSim: return TEXT("Projectile simulation");
+	case ESUNPerfScope::Horde: return TEXT("Horde");
+	case ESUNPerfScope::StatusEffects: return TEXT("Status effects");
+	case ESUNPerfScope::HUD: return TEXT("HUD");
+	case ESUNPerfScope::Replication: return TEXT("Replication");
+	default: return TEXT("");
+	}
+}
+
+const TCHAR* FSUNPerf::GetName(ESUNPerfCounter Counter)
+{
+	switch(Counter)
+	{
+	case ESUNPerfCounter::ShotsFired: return TEXT("Shots fired");
+	case ESUNPerfCounter::ProjectileHits: return TEXT("Projectile hits");
+	case ESUNPerfCounter::DamageEvents: return TEXT("Damage events");
+	case ESUNPerfCounter::Deaths: return TEXT("Deaths");
+	case ESUNPerfCounter::Traces: return TEXT("Traces");
+	case ESUNPerfCounter::Spawns: return TEXT("Actor spawns");
+	case ESUNPerfCounter::Destroys: return TEXT("Actor destroys");
+	case ESUNPerfCounter::Corrections: return TEXT("Movement corrections");
+	default: return TEXT("");
+	}
+}
@@ -0,0 +1,93 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+//Gameplay systems timed for the in-game overlay and the frame watchdog
+enum class ESUNPerfScope : uint8
+{
+	CharacterTick,
+	WallRunDetect,
+	FireShot,
+	Hitscan,
+	DamageHandling,
+	DamageResolve,
+	ProjectileHit,
+	ProjectileSim,
+	Horde,
+	StatusEffects,
+	HUD,
+	Replication,
+	Num
+};
+
+enum class ESUNPerfCounter : uint8
+{
+	ShotsFired,
+	ProjectileHits,
+	DamageEvents,
+	Deaths,
+	Traces,
+	Spawns,
+	Destroys,
+	Corrections,
+	Num
+};
+
+//Per-frame game thread time and counts of the gameplay systems, readable at runtime unlike stats. Every scope also
+//feeds its cycle stat and an Unreal Insights CPU event, see SUN_SCOPE_CYCLE_COUNTER
+struct SUN_API FSUNPerf
+{
+	static void AddCycles(ESUNPerfScope Scope, uint32 Cycles);
+	static void AddCount(ESUNPerfCounter Counter, int32 Amount);
+
+	//Of the last finished frame
+	static float GetMs(ESUNPerfScope Scope);
+	static float GetAverageMs(ESUNPerfScope Scope);
+	//Highest of the last PeakFrames frames
+	static float GetPeakMs(ESUNPerfScope Scope);
+	static int32 GetCount(ESUNPerfCounter Counter);
+	//Game thread time of the last finished frame, from the start of its first world tick to the end of the frame. Leaves
+	//out the wait for the max tick rate, 0 for a frame without a world tick
+	static float GetFrameMs();
+
+	//Once a frame has finished, the getters above already return its numbers
+	static FSimpleMulticastDelegate OnFrameEnd;
+
+	static const TCHAR* GetName(ESUNPerfScope Scope);
+	static const TCHAR* GetName(ESUNPerfCounter Counter);
+
+	static const int32 PeakFrames = 120;
+};
+
+struct SUN_API FSUNPerfScopeTimer
+{
+	explicit FSUNPerfScopeTimer(ESUNPerfScope InScope)
+		: Scope(InScope)
+		, StartCycles(FPlatformTime::Cycles())
+	{
+	}
+
+	~FSUNPerfScopeTimer()
+	{
+		FSUNPerf::AddCycles(Scope, FPlatformTime::Cycles() - StartCycles);
+	}
+
+private:
+	ESUNPerfScope Scope;
+	uint32 StartCycles;
+};
+
+//Cycle stat, Insights event and overlay time for one scope
+#define SUN_SCOPE_CYCLE_COUNTER(Stat, Scope) \
+	SCOPE_CYCLE_COUNTER(Stat); \
+	TRACE_CPUPROFILER_EVENT_SCOPE(Stat); \
+	FSUNPerfScopeTimer PREPROCESSOR_JOIN(SUNPerfScope_, __LINE__)(ESUNPerfScope::Scope)
+
+//Counter stat and overlay count
+#define SUN_INC_COUNTER(Stat, Counter, Amount) \
+	INC_DWORD_STAT_BY(Stat, Amount); \
+	FSUNPerf::AddCount(ESUNPerfCounter::Counter, Amount)
@@ -1,8 +1,17 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "SUNProjectile.h"
+#include "SUN.h"
+#include "SUNPerf.h"
 #include "GameFramework/ProjectileMovementComponent.h"
 #include "Components/SphereComponent.h"
+#include "ProjectilePool.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "Kismet/GameplayStatics.h"
+
+DECLARE_CYCLE_STAT(TEXT("Projectile hit"), STAT_SUN_ProjectileHit, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Projectile hits"), STAT_SUN_ProjectileHits, STATGROUP_SUN);
 
 ASUNProjectile::ASUNProjectile() 
 {
@@ -29,15 +38,65 @@ ASUNProjectile::ASUNProjectile()
 
 	// Die after 3 seconds by default
 	InitialLifeSpan = 3.0f;
+
+	// Replicated to clients near enough to see it, they fly their copy with its own movement component between updates
+	bReplicates = true;
+	SetReplicatingMovement(true);
+	NetCullDistanceSquared = FMath::Square(5000.f);
 }
 
 void ASUNProjectile::OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit)
 {
+	SUN_SCOPE_CYCLE_COUNTER(STAT_SUN_ProjectileHit, ProjectileHit);
+	SUN_INC_COUNTER(STAT_SUN_ProjectileHits, ProjectileHits, 1);
+
+	if(Damage > 0.f && HasAuthority() && OtherActor && OtherActor != GetOwner() && OtherComp && !OtherComp->IsSimulatingPhysics())
+	{
+		UGameplayStatics::ApplyPointDamage(OtherActor, Damage, GetVelocity().GetSafeNormal(), Hit, GetInstigatorController(), GetOwner(), nullptr);
+	}
+
 	// Only add impulse and destroy projectile if we hit a physics
 	if ((OtherActor != NULL) && (OtherActor != this) && (OtherComp != NULL) && OtherComp->IsSimulatingPhysics())
 	{
 		OtherComp->AddImpulseAtLocation(GetVelocity() * 100.0f, GetActorLocation());
 
-		Destroy();
+		// Clients wait for the server to park or destroy their copy
+		if(!HasAuthority())
+		{
+			return;
+		}
+		if(bPooled)
+		{
+			GetWorld()->GetSubsystem<UProjectilePool>()->Release(this);
+		}
+		else
+		{
+			SUN_INC_COUNTER(STAT_SUN_ActorDestroys, Destroys, 1);
+			Destroy();
+		}
 	}
+}
+
+void ASUNProjectile::Launch(const FVector& Location, const FRotator& Rotation)
+{
+	SetActorLocationAndRotation(Location, Rotation, false, nullptr, ETeleportType::ResetPhysics);
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+	SetNetDormancy(DORM_Awake);
+
+	ProjectileMovement->SetUpdatedComponent(CollisionComp);
+	ProjectileMovement->Velocity = Rotation.Vector() * ProjectileMovement->InitialSpeed;
+	ProjectileMovement->Activate(true);
+	ProjectileMovement->UpdateComponentVelocity();
+}
+
+//Deactivating is safe from inside OnHit, the movement component stops its substep loop once it is inactive
+void ASUNProjectile::Park()
+{
+	ProjectileMovement->StopMovementImmediately();
+	ProjectileMovement->Deactivate();
+	SetActorEnableCollision(false);
+	SetActorHiddenInGame(true);
+	// Replicates being hidden, then nothing until it is launched again
+	SetNetDormancy(DORM_DormantAll);
 }
\ No newline at end of file
@@ -26,6 +26,33 @@ public:
 	UFUNCTION()
 	void OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit);
 
+	/** Place the projectile and send it off at InitialSpeed, used when it is taken out of UProjectilePool */
+	void Launch(const FVector& Location, const FRotator& Rotation);
+
+	/** Hide the projectile and stop its movement and collision, used when it goes back into UProjectilePool */
+	void Park();
+
+	/** Set for projectiles spawned by UProjectilePool, those are released to it instead of being destroyed */
+	bool bPooled = false;
+
+	/** Point damage dealt on the server to anything hit that is not simulating physics, credited to the owner */
+	UPROPERTY(EditDefaultsOnly, Category=Projectile)
+	float Damage = 0.f;
+
+	/** World time at which the pool takes this projectile back */
+	float PoolExpireTime = 0.f;
+
+	/** Mesh drawn for this class by UProjectileSimulator, an engine sphere the size of the collision when unset */
+	UPROPERTY(EditDefaultsOnly, Category=Simulation)
+	class UStaticMesh* SimulatedMesh = nullptr;
+
+	UPROPERTY(EditDefaultsOnly, Category=Simulation)
+	FVector SimulatedMeshScale = FVector(1.f);
+
+	/** Bounces before a simulated projectile is removed, 0 keeps it bouncing until its lifespan runs out like the actor */
+	UPROPERTY(EditDefaultsOnly, Category=Simulation)
+	int32 MaxSimulatedBounces = 0;
+
 	/** Returns CollisionComp subobject **/
 	FORCEINLINE class USphereComponent* GetCollisionComp() const { return CollisionComp; }
 	/** Returns ProjectileMovement subobject **/
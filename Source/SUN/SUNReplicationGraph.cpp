@@ -0,0 +1,247 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SUNReplicationGraph.h"
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "SUNProjectile.h"
+#include "Enemy.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/UObjectIterator.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogSUNReplication, Log, All);
+
+DECLARE_CYCLE_STAT(TEXT("Replication"), STAT_SUN_Replication, STATGROUP_SUN);
+
+static TAutoConsoleVariable<float> CVarNetCellSize(
+	TEXT("sun.Net.CellSize"),
+	10000.f,
+	TEXT("Size of a replication grid cell, read when a server starts"),
+	ECVF_Default);
+
+static FAutoConsoleCommandWithWorldAndArgs NetReportCommand(
+	TEXT("sun.Net.Report"),
+	TEXT("Logs server replication time, enemy dormancy and the bytes per second of every client connection"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&USUNReplicationGraph::ReportCommand));
+
+//Where the grid starts. Actors further out than this from the origin share the outer cells
+static const float GridExtent = 200000.f;
+
+void USUNReplicationGraph::InitGlobalActorClassSettings()
+{
+	Super::InitGlobalActorClassSettings();
+
+	//Game classes whose routing is not what their class defaults would give, their subclasses inherit it
+	SetClassInfo(AActor::StaticClass(), ESUNRepNodeMapping::Spatialize_Dynamic);
+	ClassMappings.Add(AEnemy::StaticClass(), ESUNRepNodeMapping::Spatialize_Dormancy);
+	ClassMappings.Add(ASUNProjectile::StaticClass(), ESUNRepNodeMapping::Spatialize_Dynamic);
+
+	//Like the stock ShooterGame graph, every replicated class loaded now gets the rate and cull distance of its own
+	//defaults. Classes loaded later, Blueprints mostly, get theirs when their first actor is added
+	for(TObjectIterator<UClass> It; It; ++It)
+	{
+		UClass* Class = *It;
+		const AActor* CDO = Cast<AActor>(Class->GetDefaultObject());
+		if(!CDO || !CDO->GetIsReplicated() || Class->GetName().StartsWith(TEXT("SKEL_")) || Class->GetName().StartsWith(TEXT("REINST_")))
+		{
+			continue;
+		}
+		SetClassInfo(Class, GetMapping(Class));
+	}
+}
+
+//Replication period from the class's NetUpdateFrequency and, in the grid, culling at its NetCullDistanceSquared
+void USUNReplicationGraph::SetClassInfo(UClass* Class, ESUNRepNodeMapping Mapping)
+{
+	ClassesWithoutInfo.Remove(Class);
+
+	const AActor* CDO = Class->GetDefaultObject<AActor>();
+	FClassReplicationInfo Info;
+	Info.ReplicationPeriodFrame = FMath::Max<uint32>(1, FMath::RoundToInt(NetDriver->NetServerMaxTickRate / FMath::Max(CDO->NetUpdateFrequency, 1.f)));
+	if(Mapping != ESUNRepNodeMapping::NotRouted && Mapping != ESUNRepNodeMapping::AlwaysRelevant)
+	{
+		Info.SetCullDistanceSquared(CDO->NetCullDistanceSquared);
+	}
+	GlobalActorReplicationInfoMap.SetClassInfo(Class, Info);
+}
+
+ESUNRepNodeMapping USUNReplicationGraph::GetMapping(UClass* Class)
+{
+	if(const ESUNRepNodeMapping* Mapping = ClassMappings.Find(Class))
+	{
+		return *Mapping;
+	}
+	ClassesWithoutInfo.Add(Class);
+
+	//Game classes carry their mapping down to Blueprint subclasses
+	ESUNRepNodeMapping Mapping = ESUNRepNodeMapping::Spatialize_Dynamic;
+	bool bFound = false;
+	for(UClass* Parent = Class->GetSuperClass(); Parent && Parent != AActor::StaticClass(); Parent = Parent->GetSuperClass())
+	{
+		if(const ESUNRepNodeMapping* ParentMapping = ClassMappings.Find(Parent))
+		{
+			Mapping = *ParentMapping;
+			bFound = true;
+			break;
+		}
+	}
+
+	if(!bFound)
+	{
+		const AActor* CDO = Class->GetDefaultObject<AActor>();
+		if(CDO->bAlwaysRelevant)
+		{
+			Mapping = ESUNRepNodeMapping::AlwaysRelevant;
+		}
+		else if(CDO->bOnlyRelevantToOwner)
+		{
+			Mapping = ESUNRepNodeMapping::NotRouted;
+		}
+		else if(!CDO->IsReplicatingMovement())
+		{
+			Mapping = ESUNRepNodeMapping::Spatialize_Static;
+		}
+	}
+
+	ClassMappings.Add(Class, Mapping);
+	return Mapping;
+}
+
+void USUNReplicationGraph::InitGlobalGraphNodes()
+{
+	Super::InitGlobalGraphNodes();
+
+	GridNode = CreateNewNode<UReplicationGraphNode_GridSpatialization2D>();
+	GridNode->CellSize = CVarNetCellSize.GetValueOnGameThread();
+	GridNode->SpatialBias = FVector2D(-GridExtent, -GridExtent);
+	AddGlobalGraphNode(GridNode);
+
+	AlwaysRelevantNode = CreateNewNode<UReplicationGraphNode_ActorList>();
+	AddGlobalGraphNode(AlwaysRelevantNode);
+}
+
+//Each connection's player controller, pawn and view target
+void USUNReplicationGraph::InitConnectionGraphNodes(UNetReplicationGraphConnection* RepGraphConnection)
+{
+	Super::InitConnectionGraphNodes(RepGraphConnection);
+
+	UReplicationGraphNode_AlwaysRelevant_ForConnection* ConnectionNode = CreateNewNode<UReplicationGraphNode_AlwaysRelevant_ForConnection>();
+	AddConnectionGraphNode(ConnectionNode, RepGraphConnection);
+}
+
+void USUNReplicationGraph::RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo)
+{
+	const ESUNRepNodeMapping Mapping = GetMapping(ActorInfo.Class);
+	//The actor's info was made from its parent class's settings, it gets its own class's before the grid reads them
+	if(ClassesWithoutInfo.Contains(ActorInfo.Class))
+	{
+		SetClassInfo(ActorInfo.Class, Mapping);
+		GlobalInfo.Settings = GlobalActorReplicationInfoMap.GetClassInfo(ActorInfo.Class);
+	}
+
+	switch(Mapping)
+	{
+	case ESUNRepNodeMapping::AlwaysRelevant:
+		AlwaysRelevantNode->NotifyAddNetworkActor(ActorInfo);
+		break;
+	case ESUNRepNodeMapping::Spatialize_Static:
+		GridNode->AddActor_Static(ActorInfo, GlobalInfo);
+		break;
+	case ESUNRepNodeMapping::Spatialize_Dynamic:
+		GridNode->AddActor_Dynamic(ActorInfo, GlobalInfo);
+		break;
+	case ESUNRepNodeMapping::Spatialize_Dormancy:
+		GridNode->AddActor_Dormancy(ActorInfo, GlobalInfo);
+		break;
+	default:
+		break;
+	}
+}
+
+void USUNReplicationGraph::RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo)
+{
+	switch(GetMapping(ActorInfo.Class))
+	{
+	case ESUNRepNodeMapping::AlwaysRelevant:
+		AlwaysRelevantNode->NotifyRemoveNetworkActor(ActorInfo);
+		break;
+	case ESUNRepNodeMapping::Spatialize_Static:
+		GridNode->RemoveActor_Static(ActorInfo);
+		break;
+	case ESUNRepNodeMapping::Spatialize_Dynamic:
+		GridNode->RemoveActor_Dynamic(ActorInfo);
+		break;
+	case ESUNRepNodeMapping::Spatialize_Dormancy:
+		GridNode->RemoveActor_Dormancy(ActorInfo);
+		break;
+	default:
+		break;
+	}
+}
+
+int32 USUNReplicationGraph::ServerReplicateActors(float DeltaSeconds)
+{
+	SUN_SCOPE_CYCLE_COUNTER(STAT_SUN_Replication, Replication);
+	return Super::ServerReplicateActors(DeltaSeconds);
+}
+
+void USUNReplicationGraph::ReportCommand(const TArray<FString>& Args, UWorld* World)
+{
+	UNetDriver* Driver = World ? World->GetNetDriver() : nullptr;
+	if(!Driver || !Driver->IsServer())
+	{
+		UE_LOG(LogSUNReplication, Warning, TEXT("sun.Net.Report only has numbers on a server"));
+		return;
+	}
+
+	int32 TotalOutBytes = 0;
+	int32 MaxOutBytes = 0;
+	for(UNetConnection* Connection : Driver->ClientConnections)
+	{
+		if(!Connection)
+		{
+			continue;
+		}
+		TotalOutBytes += Connection->OutBytesPerSecond;
+		MaxOutBytes = FMath::Max(MaxOutBytes, Connection->OutBytesPerSecond);
+		UE_LOG(LogSUNReplication, Log, TEXT("  %s: out %d B/s, in %d B/s, %d open channels"),
+			Connection->PlayerController ? *Connection->PlayerController->GetName() : *Connection->LowLevelGetRemoteAddress(),
+			Connection->OutBytesPerSecond, Connection->InBytesPerSecond, Connection->OpenChannels.Num());
+	}
+
+	int32 NumAwake = 0;
+	int32 NumDormant = 0;
+	for(TActorIterator<AEnemy> It(World); It; ++It)
+	{
+		if(It->IsParked())
+		{
+			continue;
+		}
+		if(It->NetDormancy > DORM_Awake)
+		{
+			NumDormant++;
+		}
+		else
+		{
+			NumAwake++;
+		}
+	}
+
+	const int32 NumConnections = Driver->ClientConnections.Num();
+	if(Cast<USUNReplicationGraph>(Driver->GetReplicationDriver()))
+	{
+		UE_LOG(LogSUNReplication, Log, TEXT("Replication %.2f ms average, %.2f ms peak"),
+			FSUNPerf::GetAverageMs(ESUNPerfScope::Replication), FSUNPerf::GetPeakMs(ESUNPerfScope::Replication));
+	}
+	else
+	{
+		UE_LOG(LogSUNReplication, Log, TEXT("Replication graph not in use, replication is not timed"));
+	}
+	UE_LOG(LogSUNReplication, Log, TEXT("%d connections, out %d B/s average, %d B/s max, enemies %d awake, %d dormant"),
+		NumConnections, NumConnections > 0 ? TotalOutBytes / NumConnections : 0, MaxOutBytes, NumAwake, NumDormant);
+}
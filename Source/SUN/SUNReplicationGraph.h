@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ReplicationGraph.h"
+#include "SUNReplicationGraph.generated.h"
+
+class UReplicationGraphNode_ActorList;
+class UReplicationGraphNode_GridSpatialization2D;
+
+enum class ESUNRepNodeMapping : uint8
+{
+	//Only to the owning connection, through its UReplicationGraphNode_AlwaysRelevant_ForConnection
+	NotRouted,
+	AlwaysRelevant,
+	//In the grid cells it overlaps, never moves
+	Spatialize_Static,
+	//Moved between grid cells every frame
+	Spatialize_Dynamic,
+	//Static while dormant, dynamic while awake
+	Spatialize_Dormancy
+};
+
+//Replaces the net driver's per-actor, per-connection relevancy checks. Spatialized actors sit in a 2D grid and each
+//connection only gathers the cells around its viewer, with every class culled at its NetCullDistanceSquared.
+//Enemies stay dormant in the grid until something they replicate changes, projectile actors are culled by distance
+//and actors that are always relevant or only relevant to their owner skip the grid
+UCLASS(Transient)
+class SUN_API USUNReplicationGraph : public UReplicationGraph
+{
+	GENERATED_BODY()
+
+public:
+	virtual void InitGlobalActorClassSettings() override;
+	virtual void InitGlobalGraphNodes() override;
+	virtual void InitConnectionGraphNodes(UNetReplicationGraphConnection* RepGraphConnection) override;
+	virtual void RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo) override;
+	virtual void RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo) override;
+	virtual int32 ServerReplicateActors(float DeltaSeconds) override;
+
+	//sun.Net.Report logs replication time and the bandwidth of every connection
+	static void ReportCommand(const TArray<FString>& Args, UWorld* World);
+
+private:
+	ESUNRepNodeMapping GetMapping(UClass* Class);
+	void SetClassInfo(UClass* Class, ESUNRepNodeMapping Mapping);
+
+	UPROPERTY()
+	UReplicationGraphNode_GridSpatialization2D* GridNode;
+
+	UPROPERTY()
+	UReplicationGraphNode_ActorList* AlwaysRelevantNode;
+
+	//Filled with the game classes up front, everything else is added from its class defaults the first time it is seen
+	TMap<UClass*, ESUNRepNodeMapping> ClassMappings;
+
+	//Mapped after InitGlobalActorClassSettings, their replication info is set when their first actor is added
+	TSet<UClass*> ClassesWithoutInfo;
+};
@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SUNWorldSubsystem.h"
+#include "Engine/Level.h"
+
+void FSUNWorldSubsystemTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	if(Target && TickType != LEVELTICK_ViewportsOnly)
+	{
+		Target->Tick(DeltaTime);
+	}
+}
+
+FString FSUNWorldSubsystemTickFunction::DiagnosticMessage()
+{
+	return Target ? Target->GetFullName() + TEXT("[Tick]") : FString(TEXT("USUNWorldSubsystem[Tick]"));
+}
+
+void USUNWorldSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	UWorld* World = GetWorld();
+	if(!World || !World->IsGameWorld())
+	{
+		return;
+	}
+
+	//The persistent level may not exist yet if the world is still being set up
+	if(World->PersistentLevel)
+	{
+		RegisterTick(World);
+	}
+	else
+	{
+		PostWorldInitHandle = FWorldDelegates::OnPostWorldInitialization.AddUObject(this, &USUNWorldSubsystem::OnPostWorldInitialization);
+	}
+}
+
+void USUNWorldSubsystem::Deinitialize()
+{
+	FWorldDelegates::OnPostWorldInitialization.Remove(PostWorldInitHandle);
+	if(TickFunction.IsTickFunctionRegistered())
+	{
+		TickFunction.UnRegisterTickFunction();
+	}
+	TickFunction.Target = nullptr;
+
+	Super::Deinitialize();
+}
+
+void USUNWorldSubsystem::RegisterTick(UWorld* World)
+{
+	TickFunction.Target = this;
+	TickFunction.TickGroup = TickGroup;
+	TickFunction.bCanEverTick = true;
+	TickFunction.bStartWithTickEnabled = true;
+	TickFunction.RegisterTickFunction(World->PersistentLevel);
+}
+
+void USUNWorldSubsystem::OnPostWorldInitialization(UWorld* World, const UWorld::InitializationValues IVS)
+{
+	if(World == GetWorld() && World->PersistentLevel)
+	{
+		FWorldDelegates::OnPostWorldInitialization.Remove(PostWorldInitHandle);
+		PostWorldInitHandle.Reset();
+		RegisterTick(World);
+	}
+}
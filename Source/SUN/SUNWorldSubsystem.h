@@ -0,0 +1,57 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineBaseTypes.h"
+#include "Engine/World.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SUNWorldSubsystem.generated.h"
+
+class USUNWorldSubsystem;
+
+//Tick function that forwards to a USUNWorldSubsystem once per frame
+USTRUCT()
+struct FSUNWorldSubsystemTickFunction : public FTickFunction
+{
+	GENERATED_BODY()
+
+	USUNWorldSubsystem* Target = nullptr;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FSUNWorldSubsystemTickFunction> : public TStructOpsTypeTraitsBase2<FSUNWorldSubsystemTickFunction>
+{
+	enum
+	{
+		WithCopy = false
+	};
+};
+
+//Base for the gameplay systems that batch work from many actors. Gets one game thread tick per frame
+//in TickGroup, so batches are flushed at a known point relative to actor ticks and to each other
+UCLASS(Abstract)
+class SUN_API USUNWorldSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	// Called every frame in game worlds
+	virtual void Tick(float DeltaTime) {}
+
+protected:
+	ETickingGroup TickGroup = TG_PostUpdateWork;
+
+private:
+	void RegisterTick(UWorld* World);
+	void OnPostWorldInitialization(UWorld* World, const UWorld::InitializationValues IVS);
+
+	FSUNWorldSubsystemTickFunction TickFunction;
+	FDelegateHandle PostWorldInitHandle;
+};
@@ -0,0 +1,278 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SignificanceSubsystem.h"
+#include "SUN.h"
+#include "Components/ActorComponent.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/MovementComponent.h"
+#include "GameFramework/Pawn.h"
+#include "Components/SkinnedMeshComponent.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Significance every frame"), STAT_SUN_SignificanceEveryFrame, STATGROUP_SUN);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Significance every 2nd frame"), STAT_SUN_SignificanceEvery2nd, STATGROUP_SUN);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Significance every 4th frame"), STAT_SUN_SignificanceEvery4th, STATGROUP_SUN);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Significance dormant"), STAT_SUN_SignificanceDormant, STATGROUP_SUN);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Significance ticks skipped"), STAT_SUN_SignificanceTicksSkipped, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Significance update"), STAT_SUN_SignificanceUpdate, STATGROUP_SUN);
+
+static TAutoConsoleVariable<int32> CVarSignificanceEnable(
+	TEXT("sun.Significance.Enable"),
+	1,
+	TEXT("0: every registered actor ticks at its own rate\n")
+	TEXT("1: registered actors tick every frame, every 2nd, every 4th or rarely depending on their significance"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSignificanceFarDistance(
+	TEXT("sun.Significance.FarDistance"),
+	8000.f,
+	TEXT("Distance to the nearest controlled pawn at which distance stops adding significance"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSignificanceActivityTime(
+	TEXT("sun.Significance.ActivityTime"),
+	2.f,
+	TEXT("Seconds an actor ticks every frame after NotifyActivity"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSignificanceDormantInterval(
+	TEXT("sun.Significance.DormantInterval"),
+	1.f,
+	TEXT("Tick interval in seconds of dormant actors"),
+	ECVF_Default);
+
+USignificanceSubsystem::USignificanceSubsystem()
+{
+	//After movement, scores use where everything ended up this frame
+	TickGroup = TG_PostUpdateWork;
+}
+
+void USignificanceSubsystem::Register(AActor* Actor)
+{
+	if(!Actor || Indices.Contains(Actor))
+	{
+		return;
+	}
+
+	FManagedActor Entry;
+	Entry.Actor = Actor;
+	Entry.OriginalInterval = Actor->PrimaryActorTick.TickInterval;
+	//Movement only integrates correctly at full rate, a throttled character would teleport between its ticks. Of a
+	//character only the animation is slowed down, its gameplay components have to react to its own input
+	const bool bCharacter = Actor->IsA<ACharacter>();
+	Entry.bManageActorTick = !bCharacter && Actor->PrimaryActorTick.bCanEverTick;
+	for(UActorComponent* Component : Actor->GetComponents())
+	{
+		if(Component && Component->PrimaryComponentTick.bCanEverTick && !Component->IsA<UMovementComponent>()
+			&& (!bCharacter || Component->IsA<USkinnedMeshComponent>()))
+		{
+			Entry.Components.Add({ Component, Component->PrimaryComponentTick.TickInterval });
+		}
+	}
+	//Enemies don't tick at all, there is nothing to slow down
+	if(!Entry.bManageActorTick && Entry.Components.Num() == 0)
+	{
+		return;
+	}
+	Entry.Bucket = ETickBucket::EveryFrame;
+	Entry.StaggerOffset = NextStaggerOffset++;
+	Entry.LastActivityTime = GetWorld()->GetTimeSeconds();
+
+	Indices.Add(Actor, Managed.Num());
+	Managed.Add(MoveTemp(Entry));
+}
+
+void USignificanceSubsystem::Unregister(AActor* Actor)
+{
+	int32 Index;
+	if(!Indices.RemoveAndCopyValue(Actor, Index))
+	{
+		return;
+	}
+
+	Restore(Managed[Index]);
+	Managed.RemoveAtSwap(Index, 1, false);
+	if(Managed.IsValidIndex(Index))
+	{
+		Indices.Add(Managed[Index].Actor, Index);
+	}
+}
+
+void USignificanceSubsystem::NotifyActivity(AActor* Actor)
+{
+	if(const int32* Index = Indices.Find(Actor))
+	{
+		FManagedActor& Entry = Managed[*Index];
+		Entry.LastActivityTime = GetWorld()->GetTimeSeconds();
+		SetBucket(Entry, ETickBucket::EveryFrame);
+	}
+}
+
+void USignificanceSubsystem::Deinitialize()
+{
+	for(FManagedActor& Entry : Managed)
+	{
+		Restore(Entry);
+	}
+	Managed.Empty();
+	Indices.Empty();
+
+	Super::Deinitialize();
+}
+
+void USignificanceSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SUN_SignificanceUpdate);
+
+	FrameCounter++;
+	AverageFrameTime = FMath::Lerp(AverageFrameTime, DeltaTime, 0.1f);
+
+	const bool bEnabled = CVarSignificanceEnable.GetValueOnGameThread() != 0;
+	//Players and bots alike, a dedicated server running only bots has no player views
+	PawnLocations.Reset();
+	for(TActorIterator<APawn> It(GetWorld()); It; ++It)
+	{
+		if(It->GetController())
+		{
+			PawnLocations.Add(It->GetActorLocation());
+		}
+	}
+
+	const float Now = GetWorld()->GetTimeSeconds();
+	int32 Counts[(int32)ETickBucket::Num] = {};
+	float TicksSkipped = 0.f;
+	for(int32 Index = Managed.Num() - 1; Index >= 0; Index--)
+	{
+		FManagedActor& Entry = Managed[Index];
+		if(!Entry.Actor.IsValid())
+		{
+			Indices.Remove(Entry.Actor);
+			Managed.RemoveAtSwap(Index, 1, false);
+			if(Managed.IsValidIndex(Index))
+			{
+				Indices.Add(Managed[Index].Actor, Index);
+			}
+			continue;
+		}
+
+		ETickBucket Bucket = ETickBucket::EveryFrame;
+		if(bEnabled)
+		{
+			const float Significance = Score(Entry, Now);
+			Bucket = Significance >= 1.f ? ETickBucket::EveryFrame
+				: Significance >= 0.5f ? ETickBucket::Every2nd
+				: Significance >= 0.1f ? ETickBucket::Every4th
+				: ETickBucket::Dormant;
+		}
+
+		//Speeding up happens straight away, slowing down waits for the actor's turn in the new period
+		const int32 Period = Bucket == ETickBucket::Every2nd ? 2 : 4;
+		if(Bucket < Entry.Bucket || (Bucket > Entry.Bucket && (FrameCounter + Entry.StaggerOffset) % Period == 0))
+		{
+			SetBucket(Entry, Bucket);
+		}
+
+		Counts[(int32)Entry.Bucket]++;
+		const int32 NumTicks = (Entry.bManageActorTick ? 1 : 0) + Entry.Components.Num();
+		switch(Entry.Bucket)
+		{
+		case ETickBucket::Every2nd: TicksSkipped += NumTicks * 0.5f; break;
+		case ETickBucket::Every4th: TicksSkipped += NumTicks * 0.75f; break;
+		case ETickBucket::Dormant: TicksSkipped += NumTicks * (1.f - FMath::Min(AverageFrameTime / CVarSignificanceDormantInterval.GetValueOnGameThread(), 1.f)); break;
+		default: break;
+		}
+	}
+
+	SET_DWORD_STAT(STAT_SUN_SignificanceEveryFrame, Counts[(int32)ETickBucket::EveryFrame]);
+	SET_DWORD_STAT(STAT_SUN_SignificanceEvery2nd, Counts[(int32)ETickBucket::Every2nd]);
+	SET_DWORD_STAT(STAT_SUN_SignificanceEvery4th, Counts[(int32)ETickBucket::Every4th]);
+	SET_DWORD_STAT(STAT_SUN_SignificanceDormant, Counts[(int32)ETickBucket::Dormant]);
+	SET_FLOAT_STAT(STAT_SUN_SignificanceTicksSkipped, TicksSkipped);
+}
+
+//Up to 1 for being next to a controlled pawn, 0.5 for having been rendered recently and 1 for recent activity
+float USignificanceSubsystem::Score(const FManagedActor& Entry, float Now) const
+{
+	const AActor* Actor = Entry.Actor.Get();
+	//The pawns this machine drives, remote players' characters and their simulated proxies are scored like the rest
+	const APawn* Pawn = Cast<APawn>(Actor);
+	if(Pawn && Pawn->IsLocallyControlled())
+	{
+		return MAX_flt;
+	}
+	if(Now - Entry.LastActivityTime < CVarSignificanceActivityTime.GetValueOnGameThread())
+	{
+		return MAX_flt;
+	}
+
+	const FVector Location = Actor->GetActorLocation();
+	float NearestSq = MAX_flt;
+	for(const FVector& PawnLocation : PawnLocations)
+	{
+		NearestSq = FMath::Min(NearestSq, FVector::DistSquared(Location, PawnLocation));
+	}
+
+	const float FarDistance = FMath::Max(CVarSignificanceFarDistance.GetValueOnGameThread(), 1.f);
+	float Significance = FMath::Max(1.f - FMath::Sqrt(NearestSq) / FarDistance, 0.f);
+	//Nothing is rendered on a dedicated server, distance alone decides there
+	if(Actor->WasRecentlyRendered(0.25f))
+	{
+		Significance += 0.5f;
+	}
+	return Significance;
+}
+
+void USignificanceSubsystem::SetBucket(FManagedActor& Entry, ETickBucket Bucket)
+{
+	if(Entry.Bucket == Bucket)
+	{
+		return;
+	}
+
+	Entry.Bucket = Bucket;
+	const float Interval = GetBucketInterval(Bucket);
+	AActor* Actor = Entry.Actor.Get();
+	if(Actor && Entry.bManageActorTick)
+	{
+		Actor->PrimaryActorTick.UpdateTickIntervalAndCoolDown(FMath::Max(Entry.OriginalInterval, Interval));
+	}
+	for(const FManagedTick& ManagedTick : Entry.Components)
+	{
+		if(UActorComponent* Component = ManagedTick.Component.Get())
+		{
+			Component->SetComponentTickIntervalAndCooldown(FMath::Max(ManagedTick.OriginalInterval, Interval));
+		}
+	}
+}
+
+void USignificanceSubsystem::Restore(FManagedActor& Entry)
+{
+	AActor* Actor = Entry.Actor.Get();
+	if(Actor && Entry.bManageActorTick)
+	{
+		Actor->PrimaryActorTick.UpdateTickIntervalAndCoolDown(Entry.OriginalInterval);
+	}
+	for(const FManagedTick& ManagedTick : Entry.Components)
+	{
+		if(UActorComponent* Component = ManagedTick.Component.Get())
+		{
+			Component->SetComponentTickIntervalAndCooldown(ManagedTick.OriginalInterval);
+		}
+	}
+	Entry.Bucket = ETickBucket::EveryFrame;
+}
+
+//Half a frame short of the period, so frame time jitter does not push a tick a whole frame late
+float USignificanceSubsystem::GetBucketInterval(ETickBucket Bucket) const
+{
+	switch(Bucket)
+	{
+	case ETickBucket::Every2nd: return 1.5f * AverageFrameTime;
+	case ETickBucket::Every4th: return 3.5f * AverageFrameTime;
+	case ETickBucket::Dormant: return CVarSignificanceDormantInterval.GetValueOnGameThread();
+	default: return 0.f;
+	}
+}
@@ -0,0 +1,76 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SUNWorldSubsystem.h"
+#include "SignificanceSubsystem.generated.h"
+
+class UActorComponent;
+
+enum class ETickBucket : uint8
+{
+	EveryFrame,
+	Every2nd,
+	Every4th,
+	Dormant,
+	Num
+};
+
+//Scores every registered gameplay actor by distance to the nearest controlled pawn, whether it was rendered recently and
+//whether it did something recently, and puts its actor and component ticks in a bucket: every frame, every 2nd,
+//every 4th or dormant. Buckets become tick intervals, so ticks still get the real time since their last tick.
+//Moves to slower buckets only happen on a frame picked by the actor's stagger offset, which spreads the actors of
+//one bucket over the frames of its period. Locally controlled pawns, player or AI, always tick every frame. Of other
+//characters, such as remote players on the server or their proxies on clients, only the mesh animation is slowed down
+UCLASS()
+class SUN_API USignificanceSubsystem : public USUNWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	USignificanceSubsystem();
+
+	void Register(AActor* Actor);
+	void Unregister(AActor* Actor);
+
+	//Something happened to or was done by Actor, it ticks every frame for a while
+	void NotifyActivity(AActor* Actor);
+
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+
+private:
+	struct FManagedTick
+	{
+		TWeakObjectPtr<UActorComponent> Component;
+		float OriginalInterval;
+	};
+
+	struct FManagedActor
+	{
+		TWeakObjectPtr<AActor> Actor;
+		float OriginalInterval;
+		//False for characters and actors that never tick
+		bool bManageActorTick;
+		TArray<FManagedTick> Components;
+		ETickBucket Bucket;
+		uint8 StaggerOffset;
+		float LastActivityTime;
+	};
+
+	float Score(const FManagedActor& Managed, float Now) const;
+	void SetBucket(FManagedActor& Managed, ETickBucket Bucket);
+	void Restore(FManagedActor& Managed);
+	float GetBucketInterval(ETickBucket Bucket) const;
+
+	TArray<FManagedActor> Managed;
+	TMap<TWeakObjectPtr<AActor>, int32> Indices;
+
+	//Scratch reused every frame
+	TArray<FVector> PawnLocations;
+
+	float AverageFrameTime = 1.f / 60.f;
+	uint32 FrameCounter = 0;
+	uint8 NextStaggerOffset = 0;
+};
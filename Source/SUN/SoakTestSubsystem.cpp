@@ -0,0 +1,471 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SoakTestSubsystem.h"
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "SUNBotController.h"
+#include "SUNCharacter.h"
+#include "SUNCharacterMovementComponent.h"
+#include "SUNDebugDraw.h"
+#include "Enemy.h"
+#include "EnemyPool.h"
+#include "Components/LineBatchComponent.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/PlayerStart.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+#include "Misc/App.h"
+#include "Misc/Paths.h"
+#include "UObject/UObjectArray.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogSoakTest, Log, All);
+
+static TAutoConsoleVariable<float> CVarSoakSampleSeconds(
+	TEXT("sun.Soak.SampleSeconds"),
+	10.f,
+	TEXT("Seconds between two lines of the soak file"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSoakSpawnRadius(
+	TEXT("sun.Soak.SpawnRadius"),
+	3000.f,
+	TEXT("Bots and enemies are scattered this far around the player starts"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSoakLeakMBPerHour(
+	TEXT("sun.Soak.LeakMBPerHour"),
+	64.f,
+	TEXT("Physical memory growth per hour past which a soak reports a possible leak"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSoakLeakLinesPerHour(
+	TEXT("sun.Soak.LeakLinesPerHour"),
+	1000.f,
+	TEXT("Growth per hour of the line batchers' lines past which a soak reports a possible leak"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSoakMinBotSpeed(
+	TEXT("sun.Soak.MinBotSpeed"),
+	100.f,
+	TEXT("Average speed in cm/s the bots must keep up for a soak to pass"),
+	ECVF_Default);
+
+static FAutoConsoleCommandWithWorldAndArgs SoakStartCommand(
+	TEXT("sun.Soak.Start"),
+	TEXT("sun.Soak.Start [Bots] [Enemies] [Minutes] [exit]: spawns Bots (64) bot players and Enemies (2000) enemies and records a soak for Minutes (0, until sun.Soak.Stop), then exits if asked"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&USoakTestSubsystem::StartCommand));
+
+static FAutoConsoleCommandWithWorldAndArgs SoakStopCommand(
+	TEXT("sun.Soak.Stop"),
+	TEXT("Ends the running soak, logs its growth per hour and removes its bots and enemies"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&USoakTestSubsystem::StopCommand));
+
+namespace SoakTest
+{
+	//Everything DrawDebug* has queued, a debug line that is never cleared shows up here
+	static int32 CountBatchedLines(const UWorld* World)
+	{
+		int32 NumLines = 0;
+		for(const ULineBatchComponent* LineBatcher : { World->LineBatcher, World->PersistentLineBatcher, World->ForegroundLineBatcher })
+		{
+			if(LineBatcher)
+			{
+				NumLines += LineBatcher->BatchedLines.Num();
+			}
+		}
+		return NumLines;
+	}
+}
+
+void USoakTestSubsystem::StartCommand(const TArray<FString>& Args, UWorld* World)
+{
+	USoakTestSubsystem* Soak = World ? World->GetSubsystem<USoakTestSubsystem>() : nullptr;
+	if(!Soak || !World->IsGameWorld() || World->GetNetMode() == NM_Client)
+	{
+		UE_LOG(LogSoakTest, Warning, TEXT("sun.Soak.Start needs a running game world with authority"));
+		return;
+	}
+
+	const int32 NumBots = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 64;
+	const int32 NumEnemies = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 2000;
+	const float Minutes = Args.Num() > 2 ? FCString::Atof(*Args[2]) : 0.f;
+	const bool bExit = Args.Contains(TEXT("exit"));
+	Soak->Start(NumBots, NumEnemies, Minutes, bExit);
+	if(!Soak->IsRunning() && bExit)
+	{
+		FPlatformMisc::RequestExitWithStatus(false, 1);
+	}
+}
+
+void USoakTestSubsystem::StopCommand(const TArray<FString>& Args, UWorld* World)
+{
+	if(USoakTestSubsystem* Soak = World ? World->GetSubsystem<USoakTestSubsystem>() : nullptr)
+	{
+		Soak->Stop();
+	}
+}
+
+void USoakTestSubsystem::Start(int32 NumBots, int32 NumEnemies, float Minutes, bool bInExitWhenDone)
+{
+	if(IsRunning())
+	{
+		UE_LOG(LogSoakTest, Warning, TEXT("A soak is already running"));
+		return;
+	}
+
+	const FString Path = FPaths::ProjectSavedDir() / TEXT("Soak") / FString::Printf(TEXT("Soak-%s.csv"), *FDateTime::Now().ToString());
+	File = IFileManager::Get().CreateFileWriter(*Path, FILEWRITE_AllowRead);
+	if(!File)
+	{
+		UE_LOG(LogSoakTest, Error, TEXT("Could not write %s"), *Path);
+		return;
+	}
+
+	TArray<FVector> Starts;
+	for(TActorIterator<APlayerStart> It(GetWorld()); It; ++It)
+	{
+		Starts.Add(It->GetActorLocation());
+	}
+	if(Starts.Num() == 0)
+	{
+		Starts.Add(FVector::ZeroVector);
+	}
+	SpawnBots(NumBots, Starts);
+	SpawnEnemies(NumEnemies, Starts);
+
+	bExitWhenDone = bInExitWhenDone;
+	StartTime = FPlatformTime::Seconds();
+	LastSampleTime = StartTime;
+	EndTime = Minutes > 0.f ? StartTime + Minutes * 60.0 : 0.0;
+	TickStartTime = 0.0;
+	IntervalFrames = 0;
+	IntervalTickMs = 0.0;
+	IntervalMaxTickMs = 0.f;
+	IntervalFrameMs = 0.0;
+	IntervalScopeMs.Init(0.0, (int32)ESUNPerfScope::Num);
+	IntervalCounts.Init(0, (int32)ESUNPerfCounter::Num);
+	bHasFirstSample = false;
+	LastSample = FSample();
+
+	WriteHeader();
+	FrameEndHandle = FSUNPerf::OnFrameEnd.AddUObject(this, &USoakTestSubsystem::OnFrameEnd);
+	WorldTickStartHandle = FWorldDelegates::OnWorldTickStart.AddUObject(this, &USoakTestSubsystem::OnWorldTickStart);
+
+	UE_LOG(LogSoakTest, Display, TEXT("Soak started with %d bots and %d enemies, writing %s"), Bots.Num(), Enemies.Num(), *Path);
+}
+
+void USoakTestSubsystem::Stop()
+{
+	if(!IsRunning())
+	{
+		return;
+	}
+
+	const bool bFailed = Finish();
+	Despawn();
+	if(bExitWhenDone)
+	{
+		FPlatformMisc::RequestExitWithStatus(false, bFailed ? 1 : 0);
+	}
+}
+
+bool USoakTestSubsystem::Finish()
+{
+	FSUNPerf::OnFrameEnd.Remove(FrameEndHandle);
+	FWorldDelegates::OnWorldTickStart.Remove(WorldTickStartHandle);
+	if(IntervalFrames > 0)
+	{
+		WriteSample(FPlatformTime::Seconds());
+	}
+	delete File;
+	File = nullptr;
+	const bool bLeak = LogGrowth();
+	const bool bBotsMoved = CheckBotsMoved();
+	return bLeak || !bBotsMoved;
+}
+
+//Bots and their characters are destroyed, enemies still standing go back to the pool
+void USoakTestSubsystem::Despawn()
+{
+	for(ASUNBotController* Bot : Bots)
+	{
+		if(!Bot)
+		{
+			continue;
+		}
+		if(APawn* Pawn = Bot->GetPawn())
+		{
+			Pawn->Destroy();
+		}
+		Bot->Destroy();
+	}
+	Bots.Reset();
+
+	UEnemyPool* Pool = GetWorld()->GetSubsystem<UEnemyPool>();
+	for(AEnemy* Enemy : Enemies)
+	{
+		if(Enemy && !Enemy->IsParked())
+		{
+			Pool->Release(Enemy);
+		}
+	}
+	Enemies.Reset();
+}
+
+void USoakTestSubsystem::Deinitialize()
+{
+	//The world is going away with everything in it, only the file needs closing
+	if(IsRunning())
+	{
+		Finish();
+	}
+	Super::Deinitialize();
+}
+
+void USoakTestSubsystem::SpawnBots(int32 Count, const TArray<FVector>& Starts)
+{
+	UWorld* World = GetWorld();
+	const AGameModeBase* GameMode = World->GetAuthGameMode();
+	UClass* CharacterClass = ASUNCharacter::StaticClass();
+	if(GameMode && GameMode->DefaultPawnClass && GameMode->DefaultPawnClass->IsChildOf(ASUNCharacter::StaticClass()))
+	{
+		CharacterClass = GameMode->DefaultPawnClass.Get();
+	}
+
+	const float Radius = CVarSoakSpawnRadius.GetValueOnGameThread();
+	FRandomStream Random(Count);
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+	for(int32 Index = 0; Index < Count; Index++)
+	{
+		const FVector Location = Starts[Index % Starts.Num()] + FVector(Random.FRandRange(-Radius, Radius), Random.FRandRange(-Radius, Radius), 100.f);
+		ASUNCharacter* Character = World->SpawnActor<ASUNCharacter>(CharacterClass, Location, FRotator::ZeroRotator, SpawnParams);
+		ASUNBotController* Bot = Character ? World->SpawnActor<ASUNBotController>() : nullptr;
+		if(!Bot)
+		{
+			continue;
+		}
+		Bot->SetSeed(Index + 1);
+		Bot->Possess(Character);
+		Bots.Add(Bot);
+	}
+}
+
+void USoakTestSubsystem::SpawnEnemies(int32 Count, const TArray<FVector>& Starts)
+{
+	UClass* EnemyClass = LoadClass<AEnemy>(nullptr, TEXT("/Game/MyEnemy.MyEnemy_C"));
+	if(!EnemyClass)
+	{
+		EnemyClass = AEnemy::StaticClass();
+	}
+
+	UEnemyPool* Pool = GetWorld()->GetSubsystem<UEnemyPool>();
+	const float Radius = CVarSoakSpawnRadius.GetValueOnGameThread();
+	FRandomStream Random(Count);
+	for(int32 Index = 0; Index < Count; Index++)
+	{
+		const FVector Location = Starts[Index % Starts.Num()] + FVector(Random.FRandRange(-Radius, Radius), Random.FRandRange(-Radius, Radius), 0.f);
+		if(AEnemy* Enemy = Pool->Spawn(EnemyClass, FTransform(FRotator(0.f, Random.FRandRange(0.f, 360.f), 0.f), Location)))
+		{
+			Enemies.Add(Enemy);
+		}
+	}
+}
+
+void USoakTestSubsystem::OnWorldTickStart(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+{
+	if(World == GetWorld())
+	{
+		TickStartTime = FPlatformTime::Seconds();
+	}
+}
+
+//Tick time runs from the start of this world's tick to the end of the frame, so it leaves out the wait for the
+//server tick rate that the frame time includes
+void USoakTestSubsystem::OnFrameEnd()
+{
+	const double Now = FPlatformTime::Seconds();
+	if(TickStartTime > 0.0)
+	{
+		const float TickMs = (float)((Now - TickStartTime) * 1000.0);
+		IntervalTickMs += TickMs;
+		IntervalMaxTickMs = FMath::Max(IntervalMaxTickMs, TickMs);
+	}
+	IntervalFrameMs += FApp::GetDeltaTime() * 1000.0;
+	IntervalFrames++;
+	for(int32 Scope = 0; Scope < (int32)ESUNPerfScope::Num; Scope++)
+	{
+		IntervalScopeMs[Scope] += FSUNPerf::GetMs((ESUNPerfScope)Scope);
+	}
+	for(int32 Counter = 0; Counter < (int32)ESUNPerfCounter::Num; Counter++)
+	{
+		IntervalCounts[Counter] += FSUNPerf::GetCount((ESUNPerfCounter)Counter);
+	}
+
+	if(EndTime > 0.0 && Now >= EndTime)
+	{
+		Stop();
+	}
+	else if(Now - LastSampleTime >= CVarSoakSampleSeconds.GetValueOnGameThread())
+	{
+		WriteSample(Now);
+	}
+}
+
+void USoakTestSubsystem::WriteHeader()
+{
+	FString Line = TEXT("Seconds,Frames,Tick ms,Max tick ms,Frame ms,Physical MB,Virtual MB,UObjects,Actors,Debug shapes,Debug lines,Connections,Out B/s per connection,Bot speed,Bots wall running,Air jumps,Dashes,Wall runs,Bursts");
+	for(int32 Scope = 0; Scope < (int32)ESUNPerfScope::Num; Scope++)
+	{
+		Line += FString::Printf(TEXT(",%s ms"), FSUNPerf::GetName((ESUNPerfScope)Scope));
+	}
+	for(int32 Counter = 0; Counter < (int32)ESUNPerfCounter::Num; Counter++)
+	{
+		Line += FString::Printf(TEXT(",%s/s"), FSUNPerf::GetName((ESUNPerfCounter)Counter));
+	}
+	WriteLine(Line);
+}
+
+void USoakTestSubsystem::WriteSample(double Now)
+{
+	UWorld* World = GetWorld();
+	const FPlatformMemoryStats Memory = FPlatformMemory::GetStats();
+
+	FSample Sample;
+	Sample.Time = Now - StartTime;
+	Sample.PhysicalMB = Memory.UsedPhysical / (1024.0 * 1024.0);
+	Sample.Objects = GUObjectArray.GetObjectArrayNumMinusAvailable();
+	Sample.Actors = World->GetActorCount();
+	Sample.DebugLines = SoakTest::CountBatchedLines(World);
+
+	int32 NumDebugShapes = 0;
+#if SUN_DEBUG_DRAW
+	NumDebugShapes = FSUNDebugDraw::GetNumShapes(World);
+#endif
+
+	int32 NumConnections = 0;
+	int32 OutBytes = 0;
+	if(const UNetDriver* Driver = World->GetNetDriver())
+	{
+		for(const UNetConnection* Connection : Driver->ClientConnections)
+		{
+			if(Connection)
+			{
+				NumConnections++;
+				OutBytes += Connection->OutBytesPerSecond;
+			}
+		}
+	}
+
+	int32 NumWallRunning = 0;
+	int32 NumAirJumps = 0;
+	int32 NumDashes = 0;
+	int32 NumWallRuns = 0;
+	int32 NumBursts = 0;
+	for(const ASUNBotController* Bot : Bots)
+	{
+		if(!Bot)
+		{
+			continue;
+		}
+		const ASUNCharacter* Character = Cast<ASUNCharacter>(Bot->GetPawn());
+		if(Character && Character->GetSUNMovement()->IsWallRunning())
+		{
+			NumWallRunning++;
+		}
+		Sample.BotDistance += Bot->DistanceMoved;
+		NumAirJumps += Bot->NumDoubleJumps;
+		NumDashes += Bot->NumDashes;
+		NumWallRuns += Bot->NumWallRuns;
+		NumBursts += Bot->NumBursts;
+	}
+
+	const int32 Frames = FMath::Max(IntervalFrames, 1);
+	const double Seconds = FMath::Max(Now - LastSampleTime, 0.001);
+	const double BotSpeed = Bots.Num() > 0 ? (Sample.BotDistance - LastSample.BotDistance) / Seconds / Bots.Num() : 0.0;
+	FString Line = FString::Printf(TEXT("%.0f,%d,%.2f,%.2f,%.2f,%.1f,%.1f,%d,%d,%d,%d,%d,%d,%.0f,%d,%d,%d,%d,%d"),
+		Sample.Time, IntervalFrames, IntervalTickMs / Frames, IntervalMaxTickMs, IntervalFrameMs / Frames,
+		Sample.PhysicalMB, Memory.UsedVirtual / (1024.0 * 1024.0), Sample.Objects, Sample.Actors, NumDebugShapes, Sample.DebugLines,
+		NumConnections, NumConnections > 0 ? OutBytes / NumConnections : 0, BotSpeed,
+		NumWallRunning, NumAirJumps, NumDashes, NumWallRuns, NumBursts);
+	for(int32 Scope = 0; Scope < (int32)ESUNPerfScope::Num; Scope++)
+	{
+		Line += FString::Printf(TEXT(",%.3f"), IntervalScopeMs[Scope] / Frames);
+		IntervalScopeMs[Scope] = 0.0;
+	}
+	for(int32 Counter = 0; Counter < (int32)ESUNPerfCounter::Num; Counter++)
+	{
+		Line += FString::Printf(TEXT(",%.1f"), IntervalCounts[Counter] / Seconds);
+		IntervalCounts[Counter] = 0;
+	}
+	WriteLine(Line);
+
+	IntervalFrames = 0;
+	IntervalTickMs = 0.0;
+	IntervalMaxTickMs = 0.f;
+	IntervalFrameMs = 0.0;
+	LastSampleTime = Now;
+
+	if(!bHasFirstSample)
+	{
+		FirstSample = Sample;
+		bHasFirstSample = true;
+	}
+	LastSample = Sample;
+}
+
+void USoakTestSubsystem::WriteLine(const FString& Line)
+{
+	const FTCHARToUTF8 Utf8(*(Line + LINE_TERMINATOR));
+	File->Serialize((void*)Utf8.Get(), Utf8.Length());
+	//Flushed every time, a soak that ends in a crash still has its numbers up to the crash
+	File->Flush();
+}
+
+//The first sample is taken once everything has spawned and settled for an interval, growth is measured from there
+bool USoakTestSubsystem::LogGrowth() const
+{
+	const double Hours = (LastSample.Time - FirstSample.Time) / 3600.0;
+	if(!bHasFirstSample || Hours <= 0.0)
+	{
+		UE_LOG(LogSoakTest, Display, TEXT("Soak too short to measure growth"));
+		return false;
+	}
+
+	const double MBPerHour = (LastSample.PhysicalMB - FirstSample.PhysicalMB) / Hours;
+	const double LinesPerHour = (LastSample.DebugLines - FirstSample.DebugLines) / Hours;
+	UE_LOG(LogSoakTest, Display, TEXT("Soak ran %.2f h: memory %+.1f MB/h, UObjects %+.0f/h, actors %+.0f/h, debug lines %+.0f/h"),
+		LastSample.Time / 3600.0, MBPerHour, (LastSample.Objects - FirstSample.Objects) / Hours,
+		(LastSample.Actors - FirstSample.Actors) / Hours, LinesPerHour);
+
+	const bool bLeak = MBPerHour > CVarSoakLeakMBPerHour.GetValueOnGameThread() || LinesPerHour > CVarSoakLeakLinesPerHour.GetValueOnGameThread();
+	if(bLeak)
+	{
+		UE_LOG(LogSoakTest, Warning, TEXT("Possible leak: memory or debug lines grew faster than sun.Soak.LeakMBPerHour or sun.Soak.LeakLinesPerHour"));
+	}
+	return bLeak;
+}
+
+//Over the whole run, a bot stuck against a wall for a while does not fail it but bots that never ticked do
+bool USoakTestSubsystem::CheckBotsMoved() const
+{
+	if(Bots.Num() == 0 || LastSample.Time <= 0.0)
+	{
+		return true;
+	}
+
+	const double Speed = LastSample.BotDistance / LastSample.Time / Bots.Num();
+	UE_LOG(LogSoakTest, Display, TEXT("Bots moved %.0f cm/s on average"), Speed);
+	if(Speed < CVarSoakMinBotSpeed.GetValueOnGameThread())
+	{
+		UE_LOG(LogSoakTest, Warning, TEXT("Bots moved slower than sun.Soak.MinBotSpeed, the soak does not reflect a match"));
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,90 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineBaseTypes.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SoakTestSubsystem.generated.h"
+
+class AEnemy;
+class ASUNBotController;
+
+//A long unattended run for sizing servers and finding leaks. sun.Soak.Start spawns bot players and enemies, then every
+//sun.Soak.SampleSeconds one line goes to Saved/Soak/Soak-<start time>.csv: tick and frame times, memory, UObject and
+//actor counts, debug shapes and line batcher lines, connections and their traffic, what the bots did and the SUN scope
+//times and counts of the interval. When it stops, the growth per hour since the first sample is logged, and memory or
+//debug lines growing faster than sun.Soak.LeakMBPerHour or sun.Soak.LeakLinesPerHour are reported as a possible leak.
+//Bots averaging less than sun.Soak.MinBotSpeed fail the soak too, its numbers would not be those of a match
+UCLASS()
+class SUN_API USoakTestSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	//Minutes 0 runs until Stop. Exits the game once done if bExitWhenDone, with a non-zero code if the soak failed
+	void Start(int32 NumBots, int32 NumEnemies, float Minutes, bool bExitWhenDone);
+	void Stop();
+	bool IsRunning() const { return File != nullptr; }
+
+	virtual void Deinitialize() override;
+
+	//sun.Soak.Start [Bots] [Enemies] [Minutes] [exit]
+	static void StartCommand(const TArray<FString>& Args, UWorld* World);
+	static void StopCommand(const TArray<FString>& Args, UWorld* World);
+
+private:
+	struct FSample
+	{
+		double Time = 0.0;
+		double PhysicalMB = 0.0;
+		int32 Objects = 0;
+		int32 Actors = 0;
+		int32 DebugLines = 0;
+		double BotDistance = 0.0;
+	};
+
+	void SpawnBots(int32 Count, const TArray<FVector>& Starts);
+	void SpawnEnemies(int32 Count, const TArray<FVector>& Starts);
+	void Despawn();
+	//Writes the last sample and closes the file, true if the soak failed
+	bool Finish();
+
+	void OnWorldTickStart(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+	void OnFrameEnd();
+	void WriteHeader();
+	void WriteSample(double Now);
+	void WriteLine(const FString& Line);
+	//True if something grew enough to look like a leak
+	bool LogGrowth() const;
+	//False if the bots stood still, stuck or not ticking
+	bool CheckBotsMoved() const;
+
+	UPROPERTY(Transient)
+	TArray<ASUNBotController*> Bots;
+
+	UPROPERTY(Transient)
+	TArray<AEnemy*> Enemies;
+
+	FArchive* File = nullptr;
+	FDelegateHandle FrameEndHandle;
+	FDelegateHandle WorldTickStartHandle;
+	bool bExitWhenDone = false;
+
+	double StartTime = 0.0;
+	double EndTime = 0.0;
+	double LastSampleTime = 0.0;
+	double TickStartTime = 0.0;
+
+	//Summed over the frames since the last sample
+	int32 IntervalFrames = 0;
+	double IntervalTickMs = 0.0;
+	float IntervalMaxTickMs = 0.f;
+	double IntervalFrameMs = 0.0;
+	TArray<double> IntervalScopeMs;
+	TArray<int64> IntervalCounts;
+
+	bool bHasFirstSample = false;
+	FSample FirstSample;
+	FSample LastSample;
+};
@@ -0,0 +1,292 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "StatusEffectSubsystem.h"
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "DamageSubsystem.h"
+#include "Async/ParallelFor.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogStatusEffects, Log, All);
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Status effects"), STAT_SUN_StatusEffects, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Status effect steps"), STAT_SUN_StatusEffectSteps, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Status effect tick"), STAT_SUN_StatusEffectTick, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Status effect advance"), STAT_SUN_StatusEffectAdvance, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Status effect apply"), STAT_SUN_StatusEffectApply, STATGROUP_SUN);
+
+static TAutoConsoleVariable<float> CVarEffectsRate(
+	TEXT("sun.Effects.Rate"),
+	10.f,
+	TEXT("Steps per second for damage and heal over time effects"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarEffectsParallel(
+	TEXT("sun.Effects.Parallel"),
+	1,
+	TEXT("0: status effects are advanced on the game thread\n")
+	TEXT("1: status effects are advanced with ParallelFor once there are enough of them"),
+	ECVF_Default);
+
+static FAutoConsoleCommandWithWorldAndArgs EffectsBenchmarkCommand(
+	TEXT("sun.Effects.Benchmark"),
+	TEXT("sun.Effects.Benchmark [Count]: runs Count (5000) concurrent damage and heal over time effects and logs the cost"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&UStatusEffectSubsystem::StartBenchmark));
+
+//Effects per ParallelFor task
+static const int32 EffectChunkSize = 1024;
+
+//Steps a long frame may catch up on, the rest of the time is dropped
+static const int32 MaxStepsPerFrame = 4;
+
+UStatusEffectSubsystem::UStatusEffectSubsystem()
+{
+	//Before UDamageSubsystem (TG_LastDemotable) so the queued damage is resolved this frame
+	TickGroup = TG_PostUpdateWork;
+}
+
+void UStatusEffectSubsystem::ApplyEffect(int32 HealthSlot, const FStatusEffectSpec& Spec, AActor* Causer)
+{
+	if(HealthSlot == INDEX_NONE || Spec.Duration <= 0.f)
+	{
+		return;
+	}
+
+	const float Rate = Spec.bHeal ? -Spec.AmountPerSecond : Spec.AmountPerSecond;
+	const FEffectKey Key{ HealthSlot, Spec.Id };
+	if(Spec.Stacking != EStatusEffectStacking::Independent)
+	{
+		if(const int32* Found = Keyed.Find(Key))
+		{
+			const int32 Index = *Found;
+			TimeLeft[Index] = FMath::Max(TimeLeft[Index], Spec.Duration);
+			Causers[Index] = Causer;
+			if(Spec.Stacking == EStatusEffectStacking::Stack)
+			{
+				MaxStacks[Index] = FMath::Max(Spec.MaxStacks, 1);
+				Stacks[Index] = FMath::Min(Stacks[Index] + 1, MaxStacks[Index]);
+			}
+			else
+			{
+				Rates[Index] = Rate;
+			}
+			return;
+		}
+		Keyed.Add(Key, Slots.Num());
+	}
+
+	Rates.Add(Rate);
+	TimeLeft.Add(Spec.Duration);
+	Stacks.Add(1);
+	MaxStacks.Add(FMath::Max(Spec.MaxStacks, 1));
+	Slots.Add(HealthSlot);
+	Ids.Add(Spec.Id);
+	DamageTypes.Add(Spec.DamageType);
+	Causers.Add(Causer);
+	INC_DWORD_STAT(STAT_SUN_StatusEffects);
+}
+
+void UStatusEffectSubsystem::RemoveEffects(int32 HealthSlot)
+{
+	for(int32 Index = Slots.Num() - 1; Index >= 0; Index--)
+	{
+		if(Slots[Index] == HealthSlot)
+		{
+			RemoveAtSwap(Index);
+		}
+	}
+}
+
+void UStatusEffectSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_SUN_StatusEffects, Slots.Num());
+	Rates.Empty();
+	TimeLeft.Empty();
+	Stacks.Empty();
+	MaxStacks.Empty();
+	Slots.Empty();
+	Ids.Empty();
+	DamageTypes.Empty();
+	Causers.Empty();
+	Amounts.Empty();
+	Keyed.Empty();
+
+	Super::Deinitialize();
+}
+
+void UStatusEffectSubsystem::Tick(float DeltaTime)
+{
+	SUN_SCOPE_CYCLE_COUNTER(STAT_SUN_StatusEffectTick, StatusEffects);
+	const float Step = 1.f / FMath::Max(CVarEffectsRate.GetValueOnGameThread(), 1.f);
+	Accumulator = FMath::Min(Accumulator + DeltaTime, Step * MaxStepsPerFrame);
+	while(Accumulator >= Step)
+	{
+		Accumulator -= Step;
+		if(Slots.Num() == 0)
+		{
+			continue;
+		}
+
+		const double StartTime = FPlatformTime::Seconds();
+		Advance(Step);
+
+		if(bBenchmarkRunning)
+		{
+			const double Seconds = FPlatformTime::Seconds() - StartTime;
+			BenchmarkSteps++;
+			BenchmarkSeconds += Seconds;
+			BenchmarkPeakSeconds = FMath::Max(BenchmarkPeakSeconds, Seconds);
+		}
+	}
+
+	if(bBenchmarkRunning && Slots.Num() == 0)
+	{
+		bBenchmarkRunning = false;
+		UE_LOG(LogStatusEffects, Display, TEXT("Benchmark: %d effects over %d steps, %.3f ms avg, %.3f ms peak"),
+			BenchmarkCount, BenchmarkSteps, BenchmarkSeconds * 1000.0 / FMath::Max(BenchmarkSteps, 1), BenchmarkPeakSeconds * 1000.0);
+
+		UDamageSubsystem* Damage = GetWorld()->GetSubsystem<UDamageSubsystem>();
+		for(const int32 Slot : BenchmarkSlots)
+		{
+			Damage->RemoveHealth(Slot);
+		}
+		BenchmarkSlots.Empty();
+	}
+}
+
+//The arithmetic runs over plain float arrays, in parallel when there are enough effects. Queueing the results
+//and dropping finished effects happens afterwards on the game thread
+void UStatusEffectSubsystem::Advance(float DeltaTime)
+{
+	INC_DWORD_STAT(STAT_SUN_StatusEffectSteps);
+
+	const int32 Num = Slots.Num();
+	Amounts.SetNumUninitialized(Num, false);
+	{
+		SCOPE_CYCLE_COUNTER(STAT_SUN_StatusEffectAdvance);
+
+		const int32 NumChunks = FMath::DivideAndRoundUp(Num, EffectChunkSize);
+		const bool bParallel = CVarEffectsParallel.GetValueOnGameThread() != 0;
+		ParallelFor(NumChunks, [this, Num, DeltaTime](int32 Chunk)
+		{
+			const int32 End = FMath::Min((Chunk + 1) * EffectChunkSize, Num);
+			for(int32 Index = Chunk * EffectChunkSize; Index < End; Index++)
+			{
+				Amounts[Index] = Rates[Index] * Stacks[Index] * FMath::Min(DeltaTime, TimeLeft[Index]);
+				TimeLeft[Index] -= DeltaTime;
+			}
+		}, !bParallel || NumChunks < 2);
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_SUN_StatusEffectApply);
+	UDamageSubsystem* Damage = GetWorld()->GetSubsystem<UDamageSubsystem>();
+	for(int32 Index = Num - 1; Index >= 0; Index--)
+	{
+		const int32 Slot = Slots[Index];
+		if(!Damage->IsAlive(Slot))
+		{
+			RemoveAtSwap(Index);
+			continue;
+		}
+
+		const float Amount = Amounts[Index];
+		if(Amount > 0.f)
+		{
+			Damage->QueueDamage(Slot, Amount, DamageTypes[Index], Causers[Index].Get());
+		}
+		else if(Amount < 0.f)
+		{
+			Damage->QueueHeal(Slot, -Amount);
+		}
+
+		if(TimeLeft[Index] <= 0.f)
+		{
+			RemoveAtSwap(Index);
+		}
+	}
+}
+
+void UStatusEffectSubsystem::RemoveAtSwap(int32 Index)
+{
+	const int32 Last = Slots.Num() - 1;
+	//Independent effects share the key of a Refresh or Stack effect with the same id on the slot without owning it
+	const FEffectKey Key{ Slots[Index], Ids[Index] };
+	const int32* Owner = Keyed.Find(Key);
+	if(Owner && *Owner == Index)
+	{
+		Keyed.Remove(Key);
+	}
+	if(Index != Last)
+	{
+		//The last effect moves into Index, keep its key pointing at it
+		int32* Moved = Keyed.Find({ Slots[Last], Ids[Last] });
+		if(Moved && *Moved == Last)
+		{
+			*Moved = Index;
+		}
+	}
+
+	Rates.RemoveAtSwap(Index, 1, false);
+	TimeLeft.RemoveAtSwap(Index, 1, false);
+	Stacks.RemoveAtSwap(Index, 1, false);
+	MaxStacks.RemoveAtSwap(Index, 1, false);
+	Slots.RemoveAtSwap(Index, 1, false);
+	Ids.RemoveAtSwap(Index, 1, false);
+	DamageTypes.RemoveAtSwap(Index, 1, false);
+	Causers.RemoveAtSwap(Index, 1, false);
+	DEC_DWORD_STAT(STAT_SUN_StatusEffects);
+}
+
+void UStatusEffectSubsystem::StartBenchmark(const TArray<FString>& Args, UWorld* World)
+{
+	UStatusEffectSubsystem* Effects = World ? World->GetSubsystem<UStatusEffectSubsystem>() : nullptr;
+	if(!Effects || !World->IsGameWorld())
+	{
+		UE_LOG(LogStatusEffects, Warning, TEXT("sun.Effects.Benchmark needs a running game world"));
+		return;
+	}
+	if(Effects->bBenchmarkRunning)
+	{
+		UE_LOG(LogStatusEffects, Warning, TEXT("sun.Effects.Benchmark is already running"));
+		return;
+	}
+
+	const int32 Count = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 5000;
+
+	//A mix of refreshing burns, stacking bleeds and independent regen, one per slot without an actor. Every
+	//other effect is applied twice so refresh and stacking are part of the cost. Fixed seed so runs are comparable
+	FRandomStream Random(1234);
+	UDamageSubsystem* Damage = World->GetSubsystem<UDamageSubsystem>();
+	static const FName Burn(TEXT("Burn"));
+	static const FName Bleed(TEXT("Bleed"));
+	static const FName Regen(TEXT("Regen"));
+	for(int32 Index = 0; Index < Count; Index++)
+	{
+		const int32 Slot = Damage->AddHealth(1000000.f);
+		Effects->BenchmarkSlots.Add(Slot);
+
+		FStatusEffectSpec Spec;
+		Spec.Duration = Random.FRandRange(2.f, 6.f);
+		Spec.AmountPerSecond = Random.FRandRange(1.f, 20.f);
+		switch(Index % 3)
+		{
+		case 0: Spec.Id = Burn; break;
+		case 1: Spec.Id = Bleed; Spec.Stacking = EStatusEffectStacking::Stack; Spec.MaxStacks = 5; break;
+		default: Spec.Id = Regen; Spec.bHeal = true; break;
+		}
+		Effects->ApplyEffect(Slot, Spec, nullptr);
+		if(Index % 2 == 0)
+		{
+			Effects->ApplyEffect(Slot, Spec, nullptr);
+		}
+	}
+
+	Effects->bBenchmarkRunning = true;
+	Effects->BenchmarkCount = Effects->GetNumEffects();
+	Effects->BenchmarkSteps = 0;
+	Effects->BenchmarkSeconds = 0.0;
+	Effects->BenchmarkPeakSeconds = 0.0;
+	UE_LOG(LogStatusEffects, Display, TEXT("Benchmark: %d effects applied"), Effects->BenchmarkCount);
+}
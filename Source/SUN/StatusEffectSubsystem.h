@@ -0,0 +1,109 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SUNWorldSubsystem.h"
+#include "GameFramework/DamageType.h"
+#include "StatusEffectSubsystem.generated.h"
+
+UENUM(BlueprintType)
+enum class EStatusEffectStacking : uint8
+{
+	//Applying it again restarts the duration and takes the new rate
+	Refresh,
+	//Applying it again adds a stack, up to MaxStacks, and restarts the duration
+	Stack,
+	//Every application runs on its own
+	Independent
+};
+
+//Burning, bleeding, regen... Applied to a health slot, ticks AmountPerSecond for Duration
+USTRUCT(BlueprintType)
+struct FStatusEffectSpec
+{
+	GENERATED_BODY()
+
+	//Effects with the same Id on the same slot stack or refresh
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Effect)
+	FName Id;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Effect)
+	float AmountPerSecond = 10.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Effect)
+	float Duration = 5.f;
+
+	//Heals instead of damaging
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Effect)
+	bool bHeal = false;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Effect)
+	EStatusEffectStacking Stacking = EStatusEffectStacking::Refresh;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Effect)
+	int32 MaxStacks = 1;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Effect)
+	TSubclassOf<UDamageType> DamageType;
+};
+
+//Every running damage and heal over time effect in the world, kept in parallel arrays. They are advanced together at
+//a fixed rate (sun.Effects.Rate), optionally in parallel, and what they did is queued on UDamageSubsystem. Effects on
+//slots that died or were removed are dropped on the next step
+UCLASS()
+class SUN_API UStatusEffectSubsystem : public USUNWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	UStatusEffectSubsystem();
+
+	void ApplyEffect(int32 HealthSlot, const FStatusEffectSpec& Spec, AActor* Causer);
+	void RemoveEffects(int32 HealthSlot);
+
+	int32 GetNumEffects() const { return Slots.Num(); }
+
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+
+	//sun.Effects.Benchmark [Count] applies Count (5000) effects to actor-less slots and logs the cost until they run out
+	static void StartBenchmark(const TArray<FString>& Args, UWorld* World);
+
+private:
+	struct FEffectKey
+	{
+		int32 Slot;
+		FName Id;
+
+		bool operator==(const FEffectKey& Other) const { return Slot == Other.Slot && Id == Other.Id; }
+		friend uint32 GetTypeHash(const FEffectKey& Key) { return HashCombine(::GetTypeHash(Key.Slot), GetTypeHash(Key.Id)); }
+	};
+
+	void Advance(float DeltaTime);
+	void RemoveAtSwap(int32 Index);
+
+	//Damage per second for one stack, negative for healing
+	TArray<float> Rates;
+	TArray<float> TimeLeft;
+	TArray<int32> Stacks;
+	TArray<int32> MaxStacks;
+	TArray<int32> Slots;
+	TArray<FName> Ids;
+	TArray<TSubclassOf<UDamageType>> DamageTypes;
+	TArray<TWeakObjectPtr<AActor>> Causers;
+	//Filled by the parallel pass, what each effect does this step
+	TArray<float> Amounts;
+
+	//Only effects that stack or refresh are in here
+	TMap<FEffectKey, int32> Keyed;
+
+	float Accumulator = 0.f;
+
+	bool bBenchmarkRunning = false;
+	int32 BenchmarkCount = 0;
+	int32 BenchmarkSteps = 0;
+	double BenchmarkSeconds = 0.0;
+	double BenchmarkPeakSeconds = 0.0;
+	TArray<int32> BenchmarkSlots;
+};
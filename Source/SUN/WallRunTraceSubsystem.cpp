@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WallRunTraceSubsystem.h"
+#include "SUN.h"
+#include "SUNPerf.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<int32> CVarWallRunAsyncTrace(
+	TEXT("sun.WallRun.AsyncTrace"),
+	1,
+	TEXT("0: wall-run detection uses blocking line traces in the character tick\n")
+	TEXT("1: wall-run probes are batched into async traces and read back the next frame"),
+	ECVF_Default);
+
+bool UWallRunTraceSubsystem::IsAsyncEnabled()
+{
+	return CVarWallRunAsyncTrace.GetValueOnGameThread() != 0;
+}
+
+void UWallRunTraceSubsystem::RequestWallTraces(const AActor* Requester, const FVector& Start, const FVector& RightOffset, ECollisionChannel Channel, const FCollisionQueryParams& Params)
+{
+	PendingTraces.Add({ Requester, Start, RightOffset, Channel, Params });
+}
+
+bool UWallRunTraceSubsystem::ConsumeWallTraces(const AActor* Requester, FHitResult& OutHit, bool& bOutLeftSide)
+{
+	FIssuedWallTrace Issued;
+	if(!IssuedTraces.RemoveAndCopyValue(Requester, Issued))
+	{
+		return false;
+	}
+
+	if(ReadBlockingHit(Issued.Left, OutHit))
+	{
+		bOutLeftSide = true;
+		return true;
+	}
+	if(ReadBlockingHit(Issued.Right, OutHit))
+	{
+		bOutLeftSide = false;
+		return true;
+	}
+	return false;
+}
+
+void UWallRunTraceSubsystem::CancelWallTraces(const AActor* Requester)
+{
+	IssuedTraces.Remove(Requester);
+	PendingTraces.RemoveAllSwap([Requester](const FPendingWallTrace& Pending) { return Pending.Requester == Requester; });
+}
+
+//Issues every probe gathered this frame. Anything from last frame that was not consumed belongs to a
+//character that stopped asking (landed or started wall running) so it is dropped
+void UWallRunTraceSubsystem::Tick(float DeltaTime)
+{
+	IssuedTraces.Reset();
+	if(PendingTraces.Num() == 0)
+	{
+		return;
+	}
+
+	UWorld* World = GetWorld();
+	for(const FPendingWallTrace& Pending : PendingTraces)
+	{
+		FIssuedWallTrace& Issued = IssuedTraces.Add(Pending.Requester);
+		Issued.Left = World->AsyncLineTraceByChannel(EAsyncTraceType::Single, Pending.Start, Pending.Start - Pending.RightOffset, Pending.Channel, Pending.Params);
+		Issued.Right = World->AsyncLineTraceByChannel(EAsyncTraceType::Single, Pending.Start, Pending.Start + Pending.RightOffset, Pending.Channel, Pending.Params);
+	}
+
+	SUN_INC_COUNTER(STAT_SUN_WallRunTraces, Traces, PendingTraces.Num() * 2);
+	PendingTraces.Reset();
+}
+
+bool UWallRunTraceSubsystem::ReadBlockingHit(const FTraceHandle& Handle, FHitResult& OutHit)
+{
+	FTraceDatum Datum;
+	if(GetWorld()->QueryTraceData(Handle, Datum) && Datum.OutHits.Num() > 0 && Datum.OutHits[0].bBlockingHit)
+	{
+		OutHit = Datum.OutHits[0];
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,53 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CollisionQueryParams.h"
+#include "WorldCollision.h"
+#include "SUNWorldSubsystem.h"
+#include "WallRunTraceSubsystem.generated.h"
+
+//Batches the left/right wall-run probes of every falling character into one set of async traces per frame.
+//Probes requested in frame N are issued after all actors have ticked and their results are read in frame N+1
+UCLASS()
+class SUN_API UWallRunTraceSubsystem : public USUNWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	//True when sun.WallRun.AsyncTrace is set, false means characters trace synchronously in their tick
+	static bool IsAsyncEnabled();
+
+	//Queue a probe from Start to Start - RightOffset (left) and Start + RightOffset (right)
+	void RequestWallTraces(const AActor* Requester, const FVector& Start, const FVector& RightOffset, ECollisionChannel Channel, const FCollisionQueryParams& Params);
+
+	//Reads the probes issued last frame for Requester. Left is checked before right, same as the blocking path
+	bool ConsumeWallTraces(const AActor* Requester, FHitResult& OutHit, bool& bOutLeftSide);
+
+	//Drops anything queued or in flight for Requester
+	void CancelWallTraces(const AActor* Requester);
+
+	virtual void Tick(float DeltaTime) override;
+
+private:
+	struct FPendingWallTrace
+	{
+		const AActor* Requester;
+		FVector Start;
+		FVector RightOffset;
+		ECollisionChannel Channel;
+		FCollisionQueryParams Params;
+	};
+
+	struct FIssuedWallTrace
+	{
+		FTraceHandle Left;
+		FTraceHandle Right;
+	};
+
+	bool ReadBlockingHit(const FTraceHandle& Handle, FHitResult& OutHit);
+
+	TArray<FPendingWallTrace> PendingTraces;
+	TMap<const AActor*, FIssuedWallTrace> IssuedTraces;
+};
@@ -0,0 +1,506 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WallSurfaceCache.h"
+#include "SUN.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/ModelComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Level.h"
+#include "Engine/StaticMesh.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/VectorRegister.h"
+#include "PhysicsEngine/AggregateGeom.h"
+#include "PhysicsEngine/BodySetup.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Wall cache surfaces"), STAT_SUN_WallCacheSurfaces, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Wall cache hits"), STAT_SUN_WallCacheHits, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Wall cache unknowns"), STAT_SUN_WallCacheUnknowns, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Wall cache level build"), STAT_SUN_WallCacheBuild, STATGROUP_SUN);
+
+static TAutoConsoleVariable<int32> CVarWallSurfaceCache(
+	TEXT("sun.WallRun.SurfaceCache"),
+	1,
+	TEXT("1: wall-run probes check the static surface cache before tracing, 0: always trace"),
+	ECVF_Default);
+
+enum EWallSurfaceFlags : uint8
+{
+	WSF_Runnable = 1 << 0,
+	WSF_BlocksWorldStatic = 1 << 1,
+	WSF_BlocksVisibility = 1 << 2,
+};
+
+//Cells only need to be a little bigger than the probe length
+static const float WallCellSize = 256.f;
+
+void UWallSurfaceCache::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	WalkableFloorZ = GetDefault<UCharacterMovementComponent>()->GetWalkableFloorZ();
+
+	ActorsInitializedHandle = FWorldDelegates::OnWorldInitializedActors.AddUObject(this, &UWallSurfaceCache::OnWorldInitializedActors);
+	LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UWallSurfaceCache::OnLevelAdded);
+	LevelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &UWallSurfaceCache::OnLevelRemoved);
+}
+
+void UWallSurfaceCache::Deinitialize()
+{
+	FWorldDelegates::OnWorldInitializedActors.Remove(ActorsInitializedHandle);
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedHandle);
+
+	DEC_DWORD_STAT_BY(STAT_SUN_WallCacheSurfaces, Flags.Num() - FreeSurfaces.Num());
+	Cells.Empty();
+	Levels.Empty();
+
+	Super::Deinitialize();
+}
+
+bool UWallSurfaceCache::IsEnabled()
+{
+	return CVarWallSurfaceCache.GetValueOnGameThread() != 0;
+}
+
+EWallCacheResult UWallSurfaceCache::Raycast(const FVector& Start, const FVector& End, ECollisionChannel Channel, FWallSurfaceHit& OutHit) const
+{
+	const FVector Dir = End - Start;
+	uint8 ChannelFlag = 0;
+	if(Channel == ECC_WorldStatic)
+	{
+		ChannelFlag = WSF_BlocksWorldStatic;
+	}
+	else if(Channel == ECC_Visibility)
+	{
+		ChannelFlag = WSF_BlocksVisibility;
+	}
+
+	//Horizontal faces are never stored, so anything with a real vertical component has to trace
+	if(!ChannelFlag || FMath::Abs(Dir.Z) > KINDA_SMALL_NUMBER)
+	{
+		INC_DWORD_STAT(STAT_SUN_WallCacheUnknowns);
+		return EWallCacheResult::Unknown;
+	}
+
+	FIntPoint CellMin, CellMax;
+	GetCellRange(FBox(Start.ComponentMin(End), Start.ComponentMax(End)), CellMin, CellMax);
+
+	float BestTime = 2.f;
+	int32 BestSurface = INDEX_NONE;
+	for(int32 CellX = CellMin.X; CellX <= CellMax.X; CellX++)
+	{
+		for(int32 CellY = CellMin.Y; CellY <= CellMax.Y; CellY++)
+		{
+			const FWallCell* Cell = Cells.Find(FIntPoint(CellX, CellY));
+			if(!Cell)
+			{
+				continue;
+			}
+			if(Cell->UncoveredCount > 0)
+			{
+				INC_DWORD_STAT(STAT_SUN_WallCacheUnknowns);
+				return EWallCacheResult::Unknown;
+			}
+
+			for(const int32 Index : Cell->Surfaces)
+			{
+				//Single sided like the physics shapes
+				if(!(Flags[Index] & ChannelFlag) || FVector::DotProduct(Dir, Normals[Index]) >= 0.f)
+				{
+					continue;
+				}
+
+				const FVector Edge1 = VertB[Index] - VertA[Index];
+				const FVector Edge2 = VertC[Index] - VertA[Index];
+				const FVector P = FVector::CrossProduct(Dir, Edge2);
+				const float Det = FVector::DotProduct(Edge1, P);
+				if(FMath::Abs(Det) < SMALL_NUMBER)
+				{
+					continue;
+				}
+				const float InvDet = 1.f / Det;
+				const FVector ToStart = Start - VertA[Index];
+				const float U = FVector::DotProduct(ToStart, P) * InvDet;
+				if(U < 0.f || U > 1.f)
+				{
+					continue;
+				}
+				const FVector Q = FVector::CrossProduct(ToStart, Edge1);
+				const float V = FVector::DotProduct(Dir, Q) * InvDet;
+				if(V < 0.f || U + V > 1.f)
+				{
+					continue;
+				}
+				const float Time = FVector::DotProduct(Edge2, Q) * InvDet;
+				if(Time >= 0.f && Time <= 1.f && Time < BestTime)
+				{
+					BestTime = Time;
+					BestSurface = Index;
+				}
+			}
+		}
+	}
+
+	if(BestSurface == INDEX_NONE)
+	{
+		return EWallCacheResult::Miss;
+	}
+
+	INC_DWORD_STAT(STAT_SUN_WallCacheHits);
+	OutHit.Point = Start + Dir * BestTime;
+	OutHit.Normal = Normals[BestSurface];
+	OutHit.RunDirection = RunDirections[BestSurface];
+	OutHit.bRunnable = (Flags[BestSurface] & WSF_Runnable) != 0;
+	return EWallCacheResult::Hit;
+}
+
+bool UWallSurfaceCache::GatherBoxTriangles(const FKAggregateGeom& AggGeom, const FTransform& ComponentTransform, TArray<FVector>& OutVerts, TArray<FVector>& OutNormals)
+{
+	if(AggGeom.BoxElems.Num() == 0 || AggGeom.SphereElems.Num() > 0 || AggGeom.SphylElems.Num() > 0 || AggGeom.ConvexElems.Num() > 0 || AggGeom.TaperedCapsuleElems.Num() > 0)
+	{
+		return false;
+	}
+
+	//Corner index bits: 1 = +X, 2 = +Y, 4 = +Z. Each face lists its corners going around the quad
+	static const int32 FaceCorners[6][4] =
+	{
+		{ 0, 2, 6, 4 }, { 1, 3, 7, 5 },
+		{ 0, 1, 5, 4 }, { 2, 3, 7, 6 },
+		{ 0, 1, 3, 2 }, { 4, 5, 7, 6 },
+	};
+
+	for(const FKBoxElem& Box : AggGeom.BoxElems)
+	{
+		const FTransform BoxTransform = Box.GetTransform() * ComponentTransform;
+		const FVector HalfExtent(Box.X * 0.5f, Box.Y * 0.5f, Box.Z * 0.5f);
+		const FVector BoxCenter = BoxTransform.GetLocation();
+
+		FVector Corners[8];
+		for(int32 Corner = 0; Corner < 8; Corner++)
+		{
+			const FVector Local((Corner & 1) ? HalfExtent.X : -HalfExtent.X, (Corner & 2) ? HalfExtent.Y : -HalfExtent.Y, (Corner & 4) ? HalfExtent.Z : -HalfExtent.Z);
+			Corners[Corner] = BoxTransform.TransformPosition(Local);
+		}
+
+		for(const int32* Face : FaceCorners)
+		{
+			const FVector FaceCenter = (Corners[Face[0]] + Corners[Face[1]] + Corners[Face[2]] + Corners[Face[3]]) * 0.25f;
+			//Works for any scale, including mirrored components
+			const FVector Normal = (FaceCenter - BoxCenter).GetSafeNormal();
+
+			//Horizontal rays can't hit floors and ceilings, keep them out of the grid
+			if(Normal.IsNearlyZero() || FMath::Abs(Normal.Z) > 0.999f)
+			{
+				continue;
+			}
+
+			OutVerts.Add(Corners[Face[0]]);
+			OutVerts.Add(Corners[Face[1]]);
+			OutVerts.Add(Corners[Face[2]]);
+			OutNormals.Add(Normal);
+			OutVerts.Add(Corners[Face[0]]);
+			OutVerts.Add(Corners[Face[2]]);
+			OutVerts.Add(Corners[Face[3]]);
+			OutNormals.Add(Normal);
+		}
+	}
+	return true;
+}
+
+//Runnable when Z >= -0.05 and the angle between the normal and its horizontal part is under the walkable floor angle.
+//For a unit normal that angle is acos(|N.XY|), so the test becomes |N.XY|^2 > WalkableFloorZ^2
+void UWallSurfaceCache::ClassifyNormals(const FVector* InNormals, int32 Num, float InWalkableFloorZ, uint8* OutFlags, uint8 RunnableFlag)
+{
+	const VectorRegister MinZ = VectorSetFloat1(-0.05f);
+	const VectorRegister MinHorizontalSq = VectorSetFloat1(InWalkableFloorZ * InWalkableFloorZ);
+
+	for(int32 Base = 0; Base < Num; Base += 4)
+	{
+		const int32 Lanes = FMath::Min(4, Num - Base);
+		//Unused lanes are left at zero, which is never runnable
+		MS_ALIGN(16) float X[4] GCC_ALIGN(16) = { 0.f, 0.f, 0.f, 0.f };
+		MS_ALIGN(16) float Y[4] GCC_ALIGN(16) = { 0.f, 0.f, 0.f, 0.f };
+		MS_ALIGN(16) float Z[4] GCC_ALIGN(16) = { 0.f, 0.f, 0.f, 0.f };
+		for(int32 Lane = 0; Lane < Lanes; Lane++)
+		{
+			X[Lane] = InNormals[Base + Lane].X;
+			Y[Lane] = InNormals[Base + Lane].Y;
+			Z[Lane] = InNormals[Base + Lane].Z;
+		}
+
+		const VectorRegister VX = VectorLoadAligned(X);
+		const VectorRegister VY = VectorLoadAligned(Y);
+		const VectorRegister VZ = VectorLoadAligned(Z);
+		const VectorRegister HorizontalSq = VectorMultiplyAdd(VX, VX, VectorMultiply(VY, VY));
+		const VectorRegister Runnable = VectorBitwiseAnd(VectorCompareGT(HorizontalSq, MinHorizontalSq), VectorCompareGE(VZ, MinZ));
+		const int32 Mask = VectorMaskBits(Runnable);
+
+		for(int32 Lane = 0; Lane < Lanes; Lane++)
+		{
+			if(Mask & (1 << Lane))
+			{
+				OutFlags[Base + Lane] |= RunnableFlag;
+			}
+		}
+	}
+}
+
+void UWallSurfaceCache::AddLevel(ULevel* Level)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SUN_WallCacheBuild);
+
+	if(!Level || Levels.Contains(Level))
+	{
+		return;
+	}
+	FLevelSurfaces& LevelSurfaces = Levels.Add(Level);
+
+	TArray<FVector> Verts;
+	TArray<FVector> FaceNormals;
+	TArray<uint8> FaceFlags;
+
+	//Not representable, any probe near it goes to physics
+	auto AddUncovered = [this, &LevelSurfaces](const FBox& Box)
+	{
+		FIntPoint CellMin, CellMax;
+		GetCellRange(Box, CellMin, CellMax);
+		for(int32 CellX = CellMin.X; CellX <= CellMax.X; CellX++)
+		{
+			for(int32 CellY = CellMin.Y; CellY <= CellMax.Y; CellY++)
+			{
+				const FIntPoint CellKey(CellX, CellY);
+				Cells.FindOrAdd(CellKey).UncoveredCount++;
+				LevelSurfaces.UncoveredCells.Add(CellKey);
+			}
+		}
+	};
+
+	//Boxes of the simple collision placed at Transform, false if they can't stand in for it
+	auto AddBoxes = [&Verts, &FaceNormals, &FaceFlags](const UBodySetup* BodySetup, const FTransform& Transform, uint8 ChannelFlags)
+	{
+		const int32 FirstFace = FaceNormals.Num();
+		if(!BodySetup || BodySetup->CollisionTraceFlag == CTF_UseComplexAsSimple
+			|| !GatherBoxTriangles(BodySetup->AggGeom, Transform, Verts, FaceNormals))
+		{
+			return false;
+		}
+		FaceFlags.AddUninitialized(FaceNormals.Num() - FirstFace);
+		for(int32 Face = FirstFace; Face < FaceNormals.Num(); Face++)
+		{
+			FaceFlags[Face] = ChannelFlags;
+		}
+		return true;
+	};
+
+	//Every static primitive that blocks a probe channel is either cached or makes its cells unknown, a Miss has to
+	//mean nothing static is there
+	auto GetChannelFlags = [](const UPrimitiveComponent* Primitive)
+	{
+		uint8 ChannelFlags = 0;
+		if(!Primitive->IsRegistered() || Primitive->Mobility != EComponentMobility::Static || !Primitive->IsCollisionEnabled())
+		{
+			return ChannelFlags;
+		}
+		if(Primitive->GetCollisionResponseToChannel(ECC_WorldStatic) == ECR_Block)
+		{
+			ChannelFlags |= WSF_BlocksWorldStatic;
+		}
+		if(Primitive->GetCollisionResponseToChannel(ECC_Visibility) == ECR_Block)
+		{
+			ChannelFlags |= WSF_BlocksVisibility;
+		}
+		return ChannelFlags;
+	};
+
+	//BSP belongs to the level, not to an actor
+	for(UModelComponent* Model : Level->ModelComponents)
+	{
+		if(Model && GetChannelFlags(Model))
+		{
+			AddUncovered(Model->Bounds.GetBox());
+		}
+	}
+
+	for(AActor* Actor : Level->Actors)
+	{
+		if(!Actor)
+		{
+			continue;
+		}
+
+		TInlineComponentArray<UPrimitiveComponent*> Primitives(Actor);
+		for(UPrimitiveComponent* Primitive : Primitives)
+		{
+			const uint8 ChannelFlags = GetChannelFlags(Primitive);
+			if(!ChannelFlags)
+			{
+				continue;
+			}
+
+			//Each instance is its own set of boxes
+			if(UInstancedStaticMeshComponent* Instanced = Cast<UInstancedStaticMeshComponent>(Primitive))
+			{
+				const UBodySetup* BodySetup = Instanced->GetBodySetup();
+				const FBox MeshBox = Instanced->GetStaticMesh() ? Instanced->GetStaticMesh()->GetBoundingBox() : FBox(ForceInit);
+				for(int32 Instance = 0; Instance < Instanced->GetInstanceCount(); Instance++)
+				{
+					FTransform InstanceTransform;
+					if(Instanced->GetInstanceTransform(Instance, InstanceTransform, true) && !AddBoxes(BodySetup, InstanceTransform, ChannelFlags))
+					{
+						AddUncovered(MeshBox.IsValid ? MeshBox.TransformBy(InstanceTransform) : Instanced->Bounds.GetBox());
+					}
+				}
+				continue;
+			}
+
+			UStaticMeshComponent* Mesh = Cast<UStaticMeshComponent>(Primitive);
+			if(!Mesh || !AddBoxes(Mesh->GetBodySetup(), Mesh->GetComponentTransform(), ChannelFlags))
+			{
+				AddUncovered(Primitive->Bounds.GetBox());
+			}
+		}
+	}
+
+	ClassifyNormals(FaceNormals.GetData(), FaceNormals.Num(), WalkableFloorZ, FaceFlags.GetData(), WSF_Runnable);
+
+	LevelSurfaces.Surfaces.Reserve(FaceNormals.Num());
+	for(int32 Face = 0; Face < FaceNormals.Num(); Face++)
+	{
+		const int32 Index = AllocateSurface();
+		VertA[Index] = Verts[Face * 3];
+		VertB[Index] = Verts[Face * 3 + 1];
+		VertC[Index] = Verts[Face * 3 + 2];
+		Normals[Index] = FaceNormals[Face];
+		RunDirections[Index] = FVector::CrossProduct(FaceNormals[Face], FVector(0, 0, 1));
+		Flags[Index] = FaceFlags[Face];
+		LevelSurfaces.Surfaces.Add(Index);
+
+		FBox Bounds(ForceInit);
+		Bounds += VertA[Index];
+		Bounds += VertB[Index];
+		Bounds += VertC[Index];
+		FIntPoint CellMin, CellMax;
+		GetCellRange(Bounds, CellMin, CellMax);
+		for(int32 CellX = CellMin.X; CellX <= CellMax.X; CellX++)
+		{
+			for(int32 CellY = CellMin.Y; CellY <= CellMax.Y; CellY++)
+			{
+				Cells.FindOrAdd(FIntPoint(CellX, CellY)).Surfaces.Add(Index);
+			}
+		}
+	}
+	INC_DWORD_STAT_BY(STAT_SUN_WallCacheSurfaces, FaceNormals.Num());
+}
+
+void UWallSurfaceCache::RemoveLevel(ULevel* Level)
+{
+	FLevelSurfaces LevelSurfaces;
+	if(!Levels.RemoveAndCopyValue(Level, LevelSurfaces))
+	{
+		return;
+	}
+
+	for(const int32 Index : LevelSurfaces.Surfaces)
+	{
+		FBox Bounds(ForceInit);
+		Bounds += VertA[Index];
+		Bounds += VertB[Index];
+		Bounds += VertC[Index];
+		FIntPoint CellMin, CellMax;
+		GetCellRange(Bounds, CellMin, CellMax);
+		for(int32 CellX = CellMin.X; CellX <= CellMax.X; CellX++)
+		{
+			for(int32 CellY = CellMin.Y; CellY <= CellMax.Y; CellY++)
+			{
+				const FIntPoint CellKey(CellX, CellY);
+				FWallCell& Cell = Cells.FindChecked(CellKey);
+				Cell.Surfaces.RemoveSingleSwap(Index, false);
+				if(Cell.Surfaces.Num() == 0 && Cell.UncoveredCount == 0)
+				{
+					Cells.Remove(CellKey);
+				}
+			}
+		}
+		Flags[Index] = 0;
+		FreeSurfaces.Add(Index);
+	}
+
+	for(const FIntPoint& CellKey : LevelSurfaces.UncoveredCells)
+	{
+		FWallCell& Cell = Cells.FindChecked(CellKey);
+		if(--Cell.UncoveredCount == 0 && Cell.Surfaces.Num() == 0)
+		{
+			Cells.Remove(CellKey);
+		}
+	}
+	DEC_DWORD_STAT_BY(STAT_SUN_WallCacheSurfaces, LevelSurfaces.Surfaces.Num());
+}
+
+int32 UWallSurfaceCache::AllocateSurface()
+{
+	if(FreeSurfaces.Num() > 0)
+	{
+		return FreeSurfaces.Pop(false);
+	}
+	VertA.AddUninitialized();
+	VertB.AddUninitialized();
+	VertC.AddUninitialized();
+	Normals.AddUninitialized();
+	RunDirections.AddUninitialized();
+	return Flags.AddZeroed();
+}
+
+void UWallSurfaceCache::GetCellRange(const FBox& Box, FIntPoint& OutMin, FIntPoint& OutMax) const
+{
+	OutMin = FIntPoint(FMath::FloorToInt(Box.Min.X / WallCellSize), FMath::FloorToInt(Box.Min.Y / WallCellSize));
+	OutMax = FIntPoint(FMath::FloorToInt(Box.Max.X / WallCellSize), FMath::FloorToInt(Box.Max.Y / WallCellSize));
+}
+
+void UWallSurfaceCache::OnWorldInitializedActors(const UWorld::FActorsInitializedParams& Params)
+{
+	if(Params.World != GetWorld() || !Params.World->IsGameWorld())
+	{
+		return;
+	}
+	for(ULevel* Level : Params.World->GetLevels())
+	{
+		if(Level == Params.World->PersistentLevel || Level->bIsVisible)
+		{
+			AddLevel(Level);
+		}
+	}
+}
+
+void UWallSurfaceCache::OnLevelAdded(ULevel* Level, UWorld* World)
+{
+	if(World == GetWorld() && World->IsGameWorld())
+	{
+		AddLevel(Level);
+	}
+}
+
+void UWallSurfaceCache::OnLevelRemoved(ULevel* Level, UWorld* World)
+{
+	if(World != GetWorld())
+	{
+		return;
+	}
+	//A null level means the whole world is going away
+	if(!Level)
+	{
+		DEC_DWORD_STAT_BY(STAT_SUN_WallCacheSurfaces, Flags.Num() - FreeSurfaces.Num());
+		Cells.Empty();
+		Levels.Empty();
+		VertA.Empty();
+		VertB.Empty();
+		VertC.Empty();
+		Normals.Empty();
+		RunDirections.Empty();
+		Flags.Empty();
+		FreeSurfaces.Empty();
+		return;
+	}
+	RemoveLevel(Level);
+}
@@ -0,0 +1,98 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineTypes.h"
+#include "Engine/World.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "WallSurfaceCache.generated.h"
+
+class ULevel;
+struct FKAggregateGeom;
+
+enum class EWallCacheResult : uint8
+{
+	//A cached static surface was hit
+	Hit,
+	//Every static primitive along the ray is cached and none was hit
+	Miss,
+	//The ray passes through geometry the cache can't represent, a physics trace is needed
+	Unknown
+};
+
+struct FWallSurfaceHit
+{
+	FVector Point;
+	FVector Normal;
+	//Direction of travel when the wall is on the right, negate it for the left
+	FVector RunDirection;
+	bool bRunnable;
+};
+
+//World level cache of the static surfaces characters can run along. Built from the simple box collision of
+//static meshes and mesh instances when a level is added to the world and dropped when it is removed, so static walls
+//become a lookup into a flat XY grid and physics only has to trace dynamic objects. Cells touched by any other static
+//collision (BSP, landscape, volumes, non-box meshes) answer Unknown. Only answers horizontal rays
+UCLASS()
+class SUN_API UWallSurfaceCache : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//True when sun.WallRun.SurfaceCache is set
+	static bool IsEnabled();
+
+	EWallCacheResult Raycast(const FVector& Start, const FVector& End, ECollisionChannel Channel, FWallSurfaceHit& OutHit) const;
+
+	//Cos of the walkable floor angle the runnable flags were classified with
+	float GetWalkableFloorZ() const { return WalkableFloorZ; }
+
+	//Appends two triangles per box face for every box element, returns false if the geometry has any other element type
+	static bool GatherBoxTriangles(const FKAggregateGeom& AggGeom, const FTransform& ComponentTransform, TArray<FVector>& OutVerts, TArray<FVector>& OutNormals);
+
+	//Same test as ASUNCharacter::CanSurfaceBeRan, four normals at a time
+	static void ClassifyNormals(const FVector* Normals, int32 Num, float WalkableFloorZ, uint8* OutFlags, uint8 RunnableFlag);
+
+private:
+	struct FWallCell
+	{
+		TArray<int32, TInlineAllocator<8>> Surfaces;
+		int32 UncoveredCount = 0;
+	};
+
+	struct FLevelSurfaces
+	{
+		TArray<int32> Surfaces;
+		TArray<FIntPoint> UncoveredCells;
+	};
+
+	void AddLevel(ULevel* Level);
+	void RemoveLevel(ULevel* Level);
+	int32 AllocateSurface();
+	void GetCellRange(const FBox& Box, FIntPoint& OutMin, FIntPoint& OutMax) const;
+	void OnWorldInitializedActors(const UWorld::FActorsInitializedParams& Params);
+	void OnLevelAdded(ULevel* Level, UWorld* World);
+	void OnLevelRemoved(ULevel* Level, UWorld* World);
+
+	//Surface storage, one triangle per index. Freed slots are reused when levels stream in
+	TArray<FVector> VertA;
+	TArray<FVector> VertB;
+	TArray<FVector> VertC;
+	TArray<FVector> Normals;
+	TArray<FVector> RunDirections;
+	TArray<uint8> Flags;
+	TArray<int32> FreeSurfaces;
+
+	TMap<FIntPoint, FWallCell> Cells;
+	TMap<ULevel*, FLevelSurfaces> Levels;
+
+	float WalkableFloorZ;
+
+	FDelegateHandle ActorsInitializedHandle;
+	FDelegateHandle LevelAddedHandle;
+	FDelegateHandle LevelRemovedHandle;
+};
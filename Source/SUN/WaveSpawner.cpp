@@ -0,0 +1,315 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WaveSpawner.h"
+#include "SUN.h"
+#include "Enemy.h"
+#include "EnemyPool.h"
+#include "HordeSubsystem.h"
+#include "Engine/AssetManager.h"
+#include "Engine/StreamableManager.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogWaveSpawner, Log, All);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Wave spawns"), STAT_SUN_WaveSpawns, STATGROUP_SUN);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Wave pre-warms"), STAT_SUN_WavePrewarms, STATGROUP_SUN);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Wave frames over budget"), STAT_SUN_WaveFramesOverBudget, STATGROUP_SUN);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Wave load latency ms"), STAT_SUN_WaveLoadLatency, STATGROUP_SUN);
+DECLARE_CYCLE_STAT(TEXT("Wave spawning"), STAT_SUN_WaveSpawning, STATGROUP_SUN);
+
+static TAutoConsoleVariable<float> CVarWaveSpawnBudgetMs(
+	TEXT("sun.Wave.SpawnBudgetMs"),
+	2.f,
+	TEXT("Milliseconds per frame the wave spawner may spend spawning and pre-warming. At least one spawn always happens"),
+	ECVF_Default);
+
+//Horde enemies are cheap, they are spawned in chunks of this many per job
+static const int32 HordeJobSize = 256;
+
+AWaveSpawner::AWaveSpawner()
+{
+	PrimaryActorTick.bCanEverTick = true;
+}
+
+void AWaveSpawner::BeginPlay()
+{
+	Super::BeginPlay();
+
+	LoadHandles.SetNum(Waves.Num());
+	LoadStartTimes.SetNumZeroed(Waves.Num());
+	bWaveLoaded.Init(false, Waves.Num());
+	if(bStartOnBeginPlay)
+	{
+		StartWaves();
+	}
+}
+
+void AWaveSpawner::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	for(TSharedPtr<FStreamableHandle>& Handle : LoadHandles)
+	{
+		if(Handle.IsValid())
+		{
+			Handle->CancelHandle();
+		}
+	}
+	LoadHandles.Empty();
+	Super::EndPlay(EndPlayReason);
+}
+
+void AWaveSpawner::StartWaves()
+{
+	if(State != EWaveState::Idle || Waves.Num() == 0)
+	{
+		return;
+	}
+
+	CurrentWave = 0;
+	State = EWaveState::Loading;
+	WaitTimeLeft = Waves[0].Delay;
+	RequestLoad(0);
+}
+
+void AWaveSpawner::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	switch(State)
+	{
+	case EWaveState::Loading:
+		//Waiting for OnWaveLoaded, pre-warming may already be running
+		break;
+	case EWaveState::Waiting:
+		WaitTimeLeft -= DeltaTime;
+		//Only start once the pool is warm, the delay covers it unless loading ran late
+		if(WaitTimeLeft <= 0.f && NextJob == Jobs.Num())
+		{
+			QueueSpawns(CurrentWave);
+			State = EWaveState::Spawning;
+		}
+		break;
+	case EWaveState::Spawning:
+		if(NextJob == Jobs.Num())
+		{
+			State = EWaveState::Fighting;
+			//The next wave loads and warms up while this one is fought
+			RequestLoad(CurrentWave + 1);
+		}
+		break;
+	case EWaveState::Fighting:
+		if(IsWaveCleared())
+		{
+			CurrentWave++;
+			if(!Waves.IsValidIndex(CurrentWave))
+			{
+				State = EWaveState::Done;
+				UE_LOG(LogWaveSpawner, Display, TEXT("%s: all %d waves cleared"), *GetName(), Waves.Num());
+				break;
+			}
+			WaitTimeLeft = Waves[CurrentWave].Delay;
+			State = bWaveLoaded[CurrentWave] ? EWaveState::Waiting : EWaveState::Loading;
+		}
+		break;
+	default:
+		break;
+	}
+
+	RunJobs();
+}
+
+void AWaveSpawner::RequestLoad(int32 Wave)
+{
+	if(!Waves.IsValidIndex(Wave) || bWaveLoaded[Wave] || LoadHandles[Wave].IsValid())
+	{
+		return;
+	}
+
+	TArray<FSoftObjectPath> Paths;
+	for(const FEnemyWaveEntry& Entry : Waves[Wave].Entries)
+	{
+		if(!Entry.EnemyClass.IsNull())
+		{
+			Paths.AddUnique(Entry.EnemyClass.ToSoftObjectPath());
+		}
+	}
+
+	LoadStartTimes[Wave] = FPlatformTime::Seconds();
+	LoadHandles[Wave] = UAssetManager::GetStreamableManager().RequestAsyncLoad(Paths, FStreamableDelegate::CreateUObject(this, &AWaveSpawner::OnWaveLoaded, Wave));
+	if(!LoadHandles[Wave].IsValid())
+	{
+		//Nothing to load, the delegate was not called
+		OnWaveLoaded(Wave);
+	}
+}
+
+void AWaveSpawner::OnWaveLoaded(int32 Wave)
+{
+	if(!Waves.IsValidIndex(Wave) || bWaveLoaded[Wave])
+	{
+		return;
+	}
+
+	const double LatencyMs = (FPlatformTime::Seconds() - LoadStartTimes[Wave]) * 1000.0;
+	SET_FLOAT_STAT(STAT_SUN_WaveLoadLatency, LatencyMs);
+	bWaveLoaded[Wave] = true;
+
+	//Late if the wave was already due to start, it should have loaded while the previous one was fought
+	const bool bLate = Wave == CurrentWave && State == EWaveState::Loading && Wave > 0;
+	UE_LOG(LogWaveSpawner, Display, TEXT("%s: wave %d loaded in %.1f ms%s"), *GetName(), Wave, LatencyMs, bLate ? TEXT(", after it was due") : TEXT(""));
+
+	QueuePrewarm(Wave);
+	if(Wave == CurrentWave && State == EWaveState::Loading)
+	{
+		State = EWaveState::Waiting;
+	}
+}
+
+//Fill the pool with as many actors as the wave will spawn, pooling caps what is actually kept
+void AWaveSpawner::QueuePrewarm(int32 Wave)
+{
+	if(!UEnemyPool::IsPoolingEnabled())
+	{
+		return;
+	}
+
+	for(const FEnemyWaveEntry& Entry : Waves[Wave].Entries)
+	{
+		UClass* Class = Entry.EnemyClass.Get();
+		if(Class && !Entry.bHorde)
+		{
+			Jobs.Add({ Class, Entry.Count, false, true });
+		}
+	}
+}
+
+void AWaveSpawner::QueueSpawns(int32 Wave)
+{
+	Spawned.Reset();
+	bWaveHasHorde = false;
+	for(const FEnemyWaveEntry& Entry : Waves[Wave].Entries)
+	{
+		UClass* Class = Entry.EnemyClass.Get();
+		if(!Class)
+		{
+			UE_LOG(LogWaveSpawner, Warning, TEXT("%s: wave %d has an enemy class that did not load (%s)"), *GetName(), Wave, *Entry.EnemyClass.ToString());
+			continue;
+		}
+
+		if(Entry.bHorde)
+		{
+			bWaveHasHorde = true;
+			for(int32 Queued = 0; Queued < Entry.Count; Queued += HordeJobSize)
+			{
+				Jobs.Add({ Class, FMath::Min(HordeJobSize, Entry.Count - Queued), true, false });
+			}
+		}
+		else
+		{
+			for(int32 Queued = 0; Queued < Entry.Count; Queued++)
+			{
+				Jobs.Add({ Class, 1, false, false });
+			}
+		}
+	}
+	UE_LOG(LogWaveSpawner, Display, TEXT("%s: wave %d starting"), *GetName(), Wave);
+}
+
+void AWaveSpawner::RunJobs()
+{
+	if(NextJob == Jobs.Num())
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_SUN_WaveSpawning);
+
+	const double BudgetSeconds = CVarWaveSpawnBudgetMs.GetValueOnGameThread() / 1000.0;
+	const double StartTime = FPlatformTime::Seconds();
+	int32 NumRun = 0;
+	while(NextJob < Jobs.Num())
+	{
+		if(NumRun > 0 && FPlatformTime::Seconds() - StartTime >= BudgetSeconds)
+		{
+			break;
+		}
+		//Copied, pre-warm jobs can queue themselves again
+		const FSpawnJob Job = Jobs[NextJob++];
+		RunJob(Job);
+		NumRun++;
+	}
+
+	if(NextJob == Jobs.Num())
+	{
+		Jobs.Reset();
+		NextJob = 0;
+	}
+
+	const double Seconds = FPlatformTime::Seconds() - StartTime;
+	if(Seconds > BudgetSeconds)
+	{
+		INC_DWORD_STAT(STAT_SUN_WaveFramesOverBudget);
+		UE_LOG(LogWaveSpawner, Warning, TEXT("%s: spawning took %.2f ms for %d jobs, over the %.2f ms budget"), *GetName(), Seconds * 1000.0, NumRun, BudgetSeconds * 1000.0);
+	}
+}
+
+//Pre-warming adds one enemy per job, so a big wave is warmed over several frames too
+void AWaveSpawner::RunJob(const FSpawnJob& Job)
+{
+	UWorld* World = GetWorld();
+	if(Job.bPrewarm)
+	{
+		UEnemyPool* Pool = World->GetSubsystem<UEnemyPool>();
+		const int32 Parked = Pool->GetNumParked(Job.Class);
+		if(Parked < Job.Count)
+		{
+			Pool->Prewarm(Job.Class, Parked + 1);
+			INC_DWORD_STAT(STAT_SUN_WavePrewarms);
+			if(Parked + 1 < Job.Count && Pool->GetNumParked(Job.Class) > Parked)
+			{
+				Jobs.Add(Job);
+			}
+		}
+		return;
+	}
+
+	INC_DWORD_STAT_BY(STAT_SUN_WaveSpawns, Job.Count);
+	if(Job.bHorde)
+	{
+		World->GetSubsystem<UHordeSubsystem>()->Spawn(Job.Class, Job.Count, GetSpawnLocation(), SpawnRadius);
+		return;
+	}
+
+	const FVector Offset = FMath::VRand().GetSafeNormal2D() * FMath::FRandRange(0.f, SpawnRadius);
+	if(AEnemy* Enemy = World->GetSubsystem<UEnemyPool>()->Spawn(Job.Class, FTransform(GetSpawnLocation() + Offset)))
+	{
+		Spawned.Add(Enemy);
+	}
+}
+
+//Dead enemies are parked by the pool, or destroyed when it is full
+bool AWaveSpawner::IsWaveCleared() const
+{
+	for(const TWeakObjectPtr<AEnemy>& Enemy : Spawned)
+	{
+		if(Enemy.IsValid() && !Enemy->IsParked() && !Enemy->IsPendingKillPending())
+		{
+			return false;
+		}
+	}
+	return !bWaveHasHorde || GetWorld()->GetSubsystem<UHordeSubsystem>()->GetNumEnemies() == 0;
+}
+
+FVector AWaveSpawner::GetSpawnLocation()
+{
+	for(int32 Tries = 0; Tries < SpawnPoints.Num(); Tries++)
+	{
+		AActor* SpawnPoint = SpawnPoints[NextSpawnPoint++ % SpawnPoints.Num()];
+		if(SpawnPoint)
+		{
+			return SpawnPoint->GetActorLocation();
+		}
+	}
+	return GetActorLocation();
+}
@@ -0,0 +1,124 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "WaveSpawner.generated.h"
+
+class AEnemy;
+struct FStreamableHandle;
+
+USTRUCT(BlueprintType)
+struct FEnemyWaveEntry
+{
+	GENERATED_BODY()
+
+	//Soft so nothing is loaded before the wave asks for it
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Wave)
+	TSoftClassPtr<AEnemy> EnemyClass;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Wave)
+	int32 Count = 10;
+
+	//Spawned into UHordeSubsystem instead of as actors
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Wave)
+	bool bHorde = false;
+};
+
+USTRUCT(BlueprintType)
+struct FEnemyWave
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Wave)
+	TArray<FEnemyWaveEntry> Entries;
+
+	//Seconds between the previous wave being cleared and this one starting
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Wave)
+	float Delay = 3.f;
+};
+
+//Runs Waves one after the other. The enemy classes of a wave, and the meshes they reference, are loaded
+//asynchronously one wave ahead and their pool is filled before the wave starts. Spawning and pre-warming are spread
+//over frames, each frame doing as many as fit in sun.Wave.SpawnBudgetMs. A wave is over once all of its enemies are dead
+UCLASS()
+class SUN_API AWaveSpawner : public AActor
+{
+	GENERATED_BODY()
+	
+public:	
+	AWaveSpawner();
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Waves)
+	TArray<FEnemyWave> Waves;
+
+	//Enemies spawn around these in turn, or around the spawner if there are none
+	UPROPERTY(EditInstanceOnly, BlueprintReadWrite, Category = Waves)
+	TArray<AActor*> SpawnPoints;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Waves)
+	float SpawnRadius = 500.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Waves)
+	bool bStartOnBeginPlay = true;
+
+	//Load and pre-warm the first wave, then run them all
+	UFUNCTION(BlueprintCallable, Category = Waves)
+	void StartWaves();
+
+	UFUNCTION(BlueprintPure, Category = Waves)
+	int32 GetCurrentWave() const { return CurrentWave; }
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+public:	
+	virtual void Tick(float DeltaTime) override;
+
+private:
+	enum class EWaveState : uint8
+	{
+		Idle,
+		Loading,
+		Waiting,
+		Spawning,
+		Fighting,
+		Done
+	};
+
+	//One actor, or one chunk of horde enemies
+	struct FSpawnJob
+	{
+		TSubclassOf<AEnemy> Class;
+		int32 Count;
+		bool bHorde;
+		bool bPrewarm;
+	};
+
+	void RequestLoad(int32 Wave);
+	void OnWaveLoaded(int32 Wave);
+	void QueuePrewarm(int32 Wave);
+	void QueueSpawns(int32 Wave);
+	void RunJobs();
+	void RunJob(const FSpawnJob& Job);
+	bool IsWaveCleared() const;
+	FVector GetSpawnLocation();
+
+	EWaveState State = EWaveState::Idle;
+	int32 CurrentWave = INDEX_NONE;
+	float WaitTimeLeft = 0.f;
+	int32 NextSpawnPoint = 0;
+
+	//Per wave, kept so the loaded classes stay referenced
+	TArray<TSharedPtr<FStreamableHandle>> LoadHandles;
+	TArray<double> LoadStartTimes;
+	TBitArray<> bWaveLoaded;
+
+	TArray<FSpawnJob> Jobs;
+	int32 NextJob = 0;
+
+	TArray<TWeakObjectPtr<AEnemy>> Spawned;
+	bool bWaveHasHorde = false;
+};